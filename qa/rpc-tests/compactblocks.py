@@ -0,0 +1,80 @@
+#!/usr/bin/env python2
+# Copyright (c) 2018 The Slingcoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test compact block relay: a node whose mempool already has a block's
+# transactions receives far fewer bytes for it than one that fetches full
+# blocks, and still gets the block when some transactions are missing.
+#
+
+from test_framework import BitcoinTestFramework
+from util import *
+import time
+
+class CompactBlocksTest(BitcoinTestFramework):
+
+    def setup_network(self):
+        # node1 takes compact blocks from node0, node2 full blocks
+        self.nodes = []
+        self.nodes.append(start_node(0, self.options.tmpdir, ["-debug=cmpctblock"]))
+        self.nodes.append(start_node(1, self.options.tmpdir, ["-debug=cmpctblock"]))
+        self.nodes.append(start_node(2, self.options.tmpdir, ["-compactblocks=0"]))
+        connect_nodes(self.nodes[1], 0)
+        connect_nodes(self.nodes[2], 0)
+        self.is_network_split = False
+        self.sync_all()
+
+    def send_transactions(self, count):
+        address = self.nodes[2].getnewaddress()
+        for i in range(count):
+            self.nodes[0].sendtoaddress(address, 1)
+
+    def mine_and_measure(self):
+        """Mine a block on node0, return its size and the bytes node1 and node2 received meanwhile"""
+        recv1 = self.nodes[1].getnettotals()['totalbytesrecv']
+        recv2 = self.nodes[2].getnettotals()['totalbytesrecv']
+        blockhash = self.nodes[0].setgenerate(True, 1)[0]
+        sync_blocks(self.nodes)
+        size = self.nodes[0].getblock(blockhash)['size']
+        recv1 = self.nodes[1].getnettotals()['totalbytesrecv'] - recv1
+        recv2 = self.nodes[2].getnettotals()['totalbytesrecv'] - recv2
+        print("block of %d bytes: node1 received %d bytes, node2 %d bytes" % (size, recv1, recv2))
+        return size, recv1, recv2
+
+    def run_test(self):
+        # First block: node1 asks for a compact block after node0's inv
+        self.send_transactions(40)
+        self.sync_all()
+        size, recv1, recv2 = self.mine_and_measure()
+        assert_greater_than(recv2, size)
+        assert_greater_than(size / 2, recv1)
+
+        # node0 delivered the tip first, so node1 asked it to send the next
+        # compact block straight away, without an inv
+        self.send_transactions(40)
+        self.sync_all()
+        size, recv1, recv2 = self.mine_and_measure()
+        assert_greater_than(recv2, size)
+        assert_greater_than(size / 2, recv1)
+        assert_equal(self.nodes[0].getrawmempool(), [])
+
+        # Transactions node1 never saw are fetched with getblocktxn
+        stop_node(self.nodes[1], 1)
+        self.send_transactions(10)
+        self.nodes[1] = start_node(1, self.options.tmpdir, ["-debug=cmpctblock"])
+        connect_nodes(self.nodes[1], 0)
+        self.send_transactions(10)
+        sync_mempools([self.nodes[0], self.nodes[2]])
+        for i in range(300):
+            if len(self.nodes[1].getrawmempool()) >= 10:
+                break
+            time.sleep(0.1)
+        assert_equal(len(self.nodes[1].getrawmempool()), 10)
+        size, recv1, recv2 = self.mine_and_measure()
+        assert_equal(self.nodes[1].getbestblockhash(), self.nodes[0].getbestblockhash())
+        assert_greater_than(size, recv1)
+
+if __name__ == '__main__':
+    CompactBlocksTest().main()
@@ -17,6 +17,7 @@ public:
     bool Load(uint256 nCheckpoint);
     bool Accumulate(libzerocoin::PublicCoin pubCoin, bool fSkipValidation = false);
     CBigNum GetValue(libzerocoin::CoinDenomination denom);
+    void SetValue(libzerocoin::CoinDenomination denom, const CBigNum& bnValue);
     uint256 GetCheckpoint();
     void Reset();
 };
@@ -15,6 +15,187 @@ using namespace libzerocoin;
 std::map<uint32_t, CBigNum> mapAccumulatorValues;
 std::list<uint256> listAccCheckpointsNoDB;
 
+namespace {
+
+//! Pubcoins of a connected block, see RecordBlockPubcoins()
+struct CBlockPubcoins {
+    int nHeight;
+    //! number of mints in the block, including any that do not validate
+    int nMints;
+    //! whether the coins that do not validate were dropped from listPubcoins yet
+    bool fValidated;
+    std::list<PublicCoin> listPubcoins;
+};
+
+//! Accumulator values after the checkpoint calculated on top of a block
+struct CAccumulatorState {
+    uint256 nCheckpoint;
+    std::map<CoinDenomination, CBigNum> mapValues;
+};
+
+/**
+ * Both caches are guarded by cs_main. mapBlockPubcoins is keyed by block
+ * hash and listAccumulatorStates by the hash of the block the checkpoint
+ * was calculated on top of, most recent first, so both stay correct
+ * across reorgs.
+ */
+std::map<uint256, CBlockPubcoins> mapBlockPubcoins;
+std::list<std::pair<uint256, CAccumulatorState> > listAccumulatorStates;
+
+const CAccumulatorState* FindAccumulatorState(const uint256& hashBlock)
+{
+    for (std::list<std::pair<uint256, CAccumulatorState> >::iterator it = listAccumulatorStates.begin(); it != listAccumulatorStates.end(); ++it) {
+        if (it->first == hashBlock) {
+            listAccumulatorStates.splice(listAccumulatorStates.begin(), listAccumulatorStates, it);
+            return &listAccumulatorStates.front().second;
+        }
+    }
+    return NULL;
+}
+
+void CacheAccumulatorState(const uint256& hashBlock, const uint256& nCheckpoint, AccumulatorMap& mapAccumulators)
+{
+    CAccumulatorState accState;
+    accState.nCheckpoint = nCheckpoint;
+    for (auto& denom : zerocoinDenomList)
+        accState.mapValues[denom] = mapAccumulators.GetValue(denom);
+
+    listAccumulatorStates.push_front(make_pair(hashBlock, accState));
+    if (listAccumulatorStates.size() > ACCUMULATOR_STATE_CACHE_SIZE)
+        listAccumulatorStates.pop_back();
+}
+
+void ApplyAccumulatorState(const CAccumulatorState& accState, AccumulatorMap& mapAccumulators)
+{
+    for (auto& denom : zerocoinDenomList)
+        mapAccumulators.SetValue(denom, accState.mapValues.at(denom));
+}
+
+//! Valid pubcoins of a block, from the cache if it was connected recently and from disk otherwise
+bool GetBlockPubcoins(const CBlockIndex* pindex, std::list<PublicCoin>& listPubcoins, int& nMints)
+{
+    std::map<uint256, CBlockPubcoins>::iterator it = mapBlockPubcoins.find(pindex->GetBlockHash());
+    if (it == mapBlockPubcoins.end()) {
+        CBlock block;
+        if(!ReadBlockFromDisk(block, pindex)) {
+            LogPrint("zero","%s: failed to read block from disk\n", __func__);
+            return false;
+        }
+
+        CBlockPubcoins blockPubcoins;
+        blockPubcoins.nHeight = pindex->nHeight;
+        blockPubcoins.fValidated = false;
+        if (!BlockToPubcoinList(block, blockPubcoins.listPubcoins)) {
+            LogPrint("zero","%s: failed to get zerocoin mintlist from block %d\n", __func__, pindex->nHeight);
+            return false;
+        }
+        blockPubcoins.nMints = blockPubcoins.listPubcoins.size();
+        it = mapBlockPubcoins.insert(make_pair(pindex->GetBlockHash(), blockPubcoins)).first;
+    }
+
+    CBlockPubcoins& blockPubcoins = it->second;
+    if (!blockPubcoins.fValidated) {
+        std::list<PublicCoin>::iterator itCoin = blockPubcoins.listPubcoins.begin();
+        while (itCoin != blockPubcoins.listPubcoins.end()) {
+            if (itCoin->validate())
+                ++itCoin;
+            else
+                itCoin = blockPubcoins.listPubcoins.erase(itCoin);
+        }
+        blockPubcoins.fValidated = true;
+    }
+
+    listPubcoins = blockPubcoins.listPubcoins;
+    nMints = blockPubcoins.nMints;
+    return true;
+}
+
+bool ReadMintCounts(const CBlockIndex* pindex, std::vector<int>& vMintCounts)
+{
+    uint256 hashBlock;
+    std::vector<int> vMintCountsDB;
+    if (!zerocoinDB->ReadMintCounts(pindex->nHeight, hashBlock, vMintCountsDB))
+        return false;
+
+    //an entry left behind by a block that was reorganized away or that the index missed
+    if (hashBlock != pindex->GetBlockHash() || vMintCountsDB.size() != zerocoinDenomList.size())
+        return false;
+
+    vMintCounts.swap(vMintCountsDB);
+    return true;
+}
+
+void AddMintCounts(const CBlockIndex* pindex, std::vector<int>& vMintCounts)
+{
+    for (unsigned int i = 0; i < zerocoinDenomList.size(); i++)
+        vMintCounts[i] += std::count(pindex->vMintDenominationsInBlock.begin(), pindex->vMintDenominationsInBlock.end(), zerocoinDenomList[i]);
+}
+
+/**
+ * Number of mints of each denomination, in zerocoinDenomList order, from the zerocoin
+ * start height up to and including pindex. Blocks connected before the index existed
+ * are counted once from their block index and written to the index on the way.
+ */
+std::vector<int> GetMintCounts(const CBlockIndex* pindex)
+{
+    std::vector<int> vMintCounts(zerocoinDenomList.size(), 0);
+
+    std::vector<const CBlockIndex*> vMissing;
+    while (pindex && pindex->nHeight >= GetZerocoinStartHeight() && !ReadMintCounts(pindex, vMintCounts)) {
+        vMissing.push_back(pindex);
+        pindex = pindex->pprev;
+    }
+
+    for (std::vector<const CBlockIndex*>::reverse_iterator it = vMissing.rbegin(); it != vMissing.rend(); ++it) {
+        AddMintCounts(*it, vMintCounts);
+        zerocoinDB->WriteMintCounts((*it)->nHeight, (*it)->GetBlockHash(), vMintCounts);
+    }
+
+    return vMintCounts;
+}
+
+void WriteBlockPubcoins(const CBlockIndex* pindex, const std::list<PublicCoin>& listPubcoins)
+{
+    std::map<CoinDenomination, std::vector<CBigNum> > mapPubcoins;
+    for (const PublicCoin& pubcoin : listPubcoins)
+        mapPubcoins[pubcoin.getDenomination()].push_back(pubcoin.getValue());
+
+    for (auto& denom : zerocoinDenomList) {
+        if (mapPubcoins.count(denom))
+            zerocoinDB->WritePubcoins(denom, pindex->nHeight, pindex->GetBlockHash(), mapPubcoins.at(denom));
+    }
+}
+
+//! Pubcoins of one denomination minted in a block, in block order, from the index and from disk if it misses the block
+bool GetBlockPubcoinValues(const CBlockIndex* pindex, CoinDenomination denom, std::vector<CBigNum>& vPubcoins)
+{
+    uint256 hashBlock;
+    if (zerocoinDB->ReadPubcoins(denom, pindex->nHeight, hashBlock, vPubcoins) && hashBlock == pindex->GetBlockHash())
+        return true;
+
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex)) {
+        LogPrintf("%s: failed to read block from disk\n", __func__);
+        return false;
+    }
+
+    std::list<PublicCoin> listPubcoins;
+    if (!BlockToPubcoinList(block, listPubcoins)) {
+        LogPrintf("%s: failed to get zerocoin mintlist from block %d\n", __func__, pindex->nHeight);
+        return false;
+    }
+    WriteBlockPubcoins(pindex, listPubcoins);
+
+    vPubcoins.clear();
+    for (const PublicCoin& pubcoin : listPubcoins) {
+        if (pubcoin.getDenomination() == denom)
+            vPubcoins.push_back(pubcoin.getValue());
+    }
+    return true;
+}
+
+} // anonymous namespace
+
 uint32_t ParseChecksum(uint256 nChecksum, CoinDenomination denomination)
 {
     //shift to the beginning bit of this denomination and trim any remaining bits by returning 32 bits only
@@ -151,6 +332,61 @@ bool EraseCheckpoints(int nStartHeight, int nEndHeight)
     return true;
 }
 
+bool RecordBlockPubcoins(const CBlockIndex* pindex, const CBlock& block)
+{
+    AssertLockHeld(cs_main);
+
+    CBlockPubcoins blockPubcoins;
+    blockPubcoins.nHeight = pindex->nHeight;
+    blockPubcoins.fValidated = false;
+    if (!BlockToPubcoinList(block, blockPubcoins.listPubcoins))
+        return false;
+    blockPubcoins.nMints = blockPubcoins.listPubcoins.size();
+    mapBlockPubcoins[pindex->GetBlockHash()] = blockPubcoins;
+
+    //checkpoints only ever need the blocks 11 to 20 below the next block
+    std::map<uint256, CBlockPubcoins>::iterator it = mapBlockPubcoins.begin();
+    while (it != mapBlockPubcoins.end()) {
+        if (it->second.nHeight <= pindex->nHeight - PUBCOIN_CACHE_DEPTH)
+            mapBlockPubcoins.erase(it++);
+        else
+            ++it;
+    }
+    return true;
+}
+
+/**
+ * Index the pubcoins of a connected block by denomination and height, together with
+ * the running mint counts, so that witnesses never have to read blocks from disk.
+ */
+bool IndexBlockMints(const CBlockIndex* pindex, const CBlock& block)
+{
+    if (pindex->nHeight >= GetZerocoinStartHeight()) {
+        std::vector<int> vMintCounts = pindex->pprev ? GetMintCounts(pindex->pprev) : std::vector<int>(zerocoinDenomList.size(), 0);
+        AddMintCounts(pindex, vMintCounts);
+        if (!zerocoinDB->WriteMintCounts(pindex->nHeight, pindex->GetBlockHash(), vMintCounts))
+            return false;
+    }
+
+    if (pindex->vMintDenominationsInBlock.empty())
+        return true;
+
+    std::list<PublicCoin> listPubcoins;
+    if (!BlockToPubcoinList(block, listPubcoins))
+        return false;
+    WriteBlockPubcoins(pindex, listPubcoins);
+    return true;
+}
+
+void EraseBlockMints(const CBlockIndex* pindex)
+{
+    for (auto& denom : zerocoinDenomList) {
+        if (pindex->MintedDenomination(denom))
+            zerocoinDB->ErasePubcoins(denom, pindex->nHeight);
+    }
+    zerocoinDB->EraseMintCounts(pindex->nHeight);
+}
+
 //Get checkpoint value for a specific block height
 bool CalculateAccumulatorCheckpoint(int nHeight, uint256& nCheckpoint)
 {
@@ -165,9 +401,22 @@ bool CalculateAccumulatorCheckpoint(int nHeight, uint256& nCheckpoint)
         return true;
     }
 
-    //set the accumulators to last checkpoint value
+    //the checkpoint only depends on the chain up to the previous block, reuse it if it was calculated before
     AccumulatorMap mapAccumulators;
-    if (!mapAccumulators.Load(chainActive[nHeight - 1]->nAccumulatorCheckpoint)) {
+    const uint256 hashPrev = chainActive[nHeight - 1]->GetBlockHash();
+    const CAccumulatorState* pAccState = FindAccumulatorState(hashPrev);
+    if (pAccState) {
+        nCheckpoint = pAccState->nCheckpoint;
+        ApplyAccumulatorState(*pAccState, mapAccumulators);
+        DatabaseChecksums(mapAccumulators);
+        return true;
+    }
+
+    //set the accumulators to last checkpoint value
+    pAccState = FindAccumulatorState(chainActive[nHeight - 11]->GetBlockHash());
+    if (pAccState && pAccState->nCheckpoint == chainActive[nHeight - 1]->nAccumulatorCheckpoint) {
+        ApplyAccumulatorState(*pAccState, mapAccumulators);
+    } else if (!mapAccumulators.Load(chainActive[nHeight - 1]->nAccumulatorCheckpoint)) {
         if (chainActive[nHeight - 1]->nAccumulatorCheckpoint == 0) {
             //Before zerocoin is fully activated so set to init state
             mapAccumulators.Reset();
@@ -199,27 +448,17 @@ bool CalculateAccumulatorCheckpoint(int nHeight, uint256& nCheckpoint)
             continue;
         }
 
-        //grab mints from this block
-        CBlock block;
-        if(!ReadBlockFromDisk(block, pindex)) {
-            LogPrint("zero","%s: failed to read block from disk\n", __func__);
-            return false;
-        }
-
+        //grab the valid mints from this block
         std::list<PublicCoin> listPubcoins;
-        if (!BlockToPubcoinList(block, listPubcoins)) {
-            LogPrint("zero","%s: failed to get zerocoin mintlist from block %n\n", __func__, pindex->nHeight);
+        int nMints = 0;
+        if (!GetBlockPubcoins(pindex, listPubcoins, nMints))
             return false;
-        }
 
-        nTotalMintsFound += listPubcoins.size();
-        LogPrint("zero", "%s found %d mints\n", __func__, listPubcoins.size());
+        nTotalMintsFound += nMints;
+        LogPrint("zero", "%s found %d mints\n", __func__, nMints);
 
         //add the pubcoins to accumulator
-        for (const PublicCoin pubcoin : listPubcoins) {
-            if (!pubcoin.validate())
-                continue;
-
+        for (const PublicCoin& pubcoin : listPubcoins) {
             if(!mapAccumulators.Accumulate(pubcoin, true)) {
                 LogPrintf("%s: failed to add pubcoin to accumulator at height %n\n", __func__, pindex->nHeight);
                 return false;
@@ -238,6 +477,10 @@ bool CalculateAccumulatorCheckpoint(int nHeight, uint256& nCheckpoint)
     // make sure that these values are databased because reorgs may have deleted the checksums from DB
     DatabaseChecksums(mapAccumulators);
 
+    // a state whose values do not match its checkpoint cannot be the starting point of the next one
+    if (nCheckpoint == mapAccumulators.GetCheckpoint())
+        CacheAccumulatorState(hashPrev, nCheckpoint, mapAccumulators);
+
     LogPrint("zero", "%s checkpoint=%s\n", __func__, nCheckpoint.GetHex());
     return true;
 }
@@ -247,7 +490,41 @@ bool InvalidCheckpointRange(int nHeight)
     return nHeight > Params().Zerocoin_Block_LastGoodCheckpoint() && nHeight < Params().Zerocoin_Block_RecalculateAccumulators();
 }
 
-bool GenerateAccumulatorWitness(const PublicCoin &coin, Accumulator& accumulator, AccumulatorWitness& witness, int nSecurityLevel, int& nMintsAdded, string& strError)
+namespace {
+
+//! Pubcoins of the blocks from nHeight on that are added to a witness with a single exponentiation
+struct CWitnessStep {
+    int nHeight;
+    uint256 hashBlockPrev;
+    //! whether a spend may stop right before this step, so that the witness is worth keeping
+    bool fSnapshot;
+    int nCheckpointsAdded;
+    CBigNum bnProduct;
+    int nPubcoins;
+};
+
+//! What is read from the chain to compute a witness, so that the computation itself needs no locks
+struct CWitnessPlan {
+    int nAccStartHeight;
+    uint256 nCheckpointBeforeMint;
+    CBigNum bnWitness;
+    int nMintsAdded;
+    std::vector<CWitnessStep> vSteps;
+    //! first block that is not accumulated and the last one that is
+    int nHeightEnd;
+    uint256 hashBlockEnd;
+    int nCheckpointsAdded;
+    //! the accumulator to spend from, unless the chain is too short to stop at a checkpoint
+    bool fAccumulator;
+    CBigNum bnAccumulator;
+    //! mints that were in the accumulator before nAccStartHeight
+    int nMintsBefore;
+};
+
+//! Spends stop accumulating after at most this many checkpoints unless they use security level 100
+const int MAX_SNAPSHOT_CHECKPOINTS = 99;
+
+bool PrepareAccumulatorWitness(const PublicCoin& coin, int nSecurityLevel, CMintWitness* pMintWitness, CWitnessPlan& plan)
 {
     uint256 txid;
     if (!zerocoinDB->ReadCoinMint(coin.getValue(), txid)) {
@@ -296,13 +573,19 @@ bool GenerateAccumulatorWitness(const PublicCoin &coin, Accumulator& accumulator
         nCheckpointBeforeMint = chainActive[nHeight_LastGoodCheckpoint]->nAccumulatorCheckpoint;
         nAccStartHeight = nHeight_LastGoodCheckpoint - 10;
     }
+    plan.nAccStartHeight = nAccStartHeight;
+    plan.nCheckpointBeforeMint = nCheckpointBeforeMint;
 
     //Get the accumulator that is right before the cluster of blocks containing our mint was added to the accumulator
+    plan.bnWitness = Params().Zerocoin_Params()->accumulatorParams.accumulatorBase;
+    plan.nMintsAdded = 0;
+    plan.fAccumulator = false;
     CBigNum bnAccValue = 0;
     if (GetAccumulatorValueFromDB(nCheckpointBeforeMint, coin.getDenomination(), bnAccValue)) {
         if (bnAccValue > 0) {
-            accumulator.setValue(bnAccValue);
-            witness.resetValue(accumulator, coin);
+            plan.bnWitness = bnAccValue;
+            plan.bnAccumulator = bnAccValue;
+            plan.fAccumulator = true;
         }
     }
 
@@ -318,75 +601,202 @@ bool GenerateAccumulatorWitness(const PublicCoin &coin, Accumulator& accumulator
             nSecurityLevel = 99;
     }
 
-    //add the pubcoins (zerocoinmints that have been published to the chain) up to the next checksum starting from the block
+    //find the block to stop at: up to the next checksum starting from the block, at least two checkpoints deep
     pindex = chainActive[nAccStartHeight];
     int nChainHeight = chainActive.Height();
     int nHeightStop = nChainHeight % 10;
-    nHeightStop = nChainHeight - nHeightStop - 20; // at least two checkpoints deep
+    nHeightStop = nChainHeight - nHeightStop - 20;
     int nCheckpointsAdded = 0;
-    nMintsAdded = 0;
+    plan.nHeightEnd = nHeightStop + 1;
     while (pindex->nHeight < nHeightStop + 1) {
         if (pindex->nHeight != nAccStartHeight && pindex->pprev->nAccumulatorCheckpoint != pindex->nAccumulatorCheckpoint)
             ++nCheckpointsAdded;
 
         //if a new checkpoint was generated on this block, and we have added the specified amount of checkpointed accumulators,
-        //then initialize the accumulator at this point and break
+        //then initialize the accumulator at this point and stop
         if (!InvalidCheckpointRange(pindex->nHeight) && (pindex->nHeight == nHeightStop || (nSecurityLevel != 100 && nCheckpointsAdded >= nSecurityLevel))) {
             uint32_t nChecksum = ParseChecksum(chainActive[pindex->nHeight + 10]->nAccumulatorCheckpoint, coin.getDenomination());
-            CBigNum bnAccValue = 0;
-            if (!zerocoinDB->ReadAccumulatorValue(nChecksum, bnAccValue)) {
+            if (!zerocoinDB->ReadAccumulatorValue(nChecksum, plan.bnAccumulator)) {
                 LogPrintf("%s : failed to find checksum in database for accumulator\n", __func__);
                 return false;
             }
-            accumulator.setValue(bnAccValue);
+            plan.fAccumulator = true;
+            plan.nHeightEnd = pindex->nHeight;
             break;
         }
+        pindex = chainActive[pindex->nHeight + 1];
+    }
+
+    //continue from the furthest precomputed witness that is still in the chain and not beyond the stop
+    int nHeightResume = nAccStartHeight;
+    if (pMintWitness) {
+        if (pMintWitness->bnPubcoin != coin.getValue() || pMintWitness->nAccStartHeight != nAccStartHeight || pMintWitness->nCheckpointBeforeMint != nCheckpointBeforeMint) {
+            pMintWitness->SetNull();
+            pMintWitness->bnPubcoin = coin.getValue();
+            pMintWitness->nAccStartHeight = nAccStartHeight;
+            pMintWitness->nCheckpointBeforeMint = nCheckpointBeforeMint;
+        }
+
+        std::map<int, CWitnessSnapshot>::iterator it = pMintWitness->mapSnapshots.begin();
+        while (it != pMintWitness->mapSnapshots.end()) {
+            CBlockIndex* pindexLast = chainActive[it->first - 1];
+            if (it->first <= nAccStartHeight || !pindexLast || pindexLast->GetBlockHash() != it->second.hashBlock)
+                pMintWitness->mapSnapshots.erase(it++);
+            else
+                ++it;
+        }
+
+        it = pMintWitness->mapSnapshots.upper_bound(plan.nHeightEnd);
+        if (it != pMintWitness->mapSnapshots.begin()) {
+            --it;
+            nHeightResume = it->first;
+            plan.bnWitness = it->second.bnValue;
+            plan.nMintsAdded = it->second.nMintsAdded;
+        }
+    }
+
+    //collect the pubcoins of the spent denomination, one step per checkpoint
+    nCheckpointsAdded = 0;
+    for (int nHeight = nAccStartHeight; nHeight < plan.nHeightEnd; nHeight++) {
+        pindex = chainActive[nHeight];
+        bool fNewCheckpoint = nHeight != nAccStartHeight && pindex->pprev->nAccumulatorCheckpoint != pindex->nAccumulatorCheckpoint;
+        if (fNewCheckpoint)
+            ++nCheckpointsAdded;
+
+        if (nHeight < nHeightResume)
+            continue;
+
+        if (plan.vSteps.empty() || fNewCheckpoint) {
+            CWitnessStep step;
+            step.nHeight = nHeight;
+            step.hashBlockPrev = pindex->pprev ? pindex->pprev->GetBlockHash() : uint256(0);
+            step.fSnapshot = fNewCheckpoint && nHeight > nHeightResume && nCheckpointsAdded <= MAX_SNAPSHOT_CHECKPOINTS;
+            step.nCheckpointsAdded = nCheckpointsAdded;
+            step.bnProduct = 1;
+            step.nPubcoins = 0;
+            plan.vSteps.push_back(step);
+        }
 
         // if this block contains mints of the denomination that is being spent, then add them to the witness
         if (pindex->MintedDenomination(coin.getDenomination())) {
             //grab mints from this block
-            CBlock block;
-            if(!ReadBlockFromDisk(block, pindex)) {
-                LogPrintf("%s: failed to read block from disk while adding pubcoins to witness\n", __func__);
+            std::vector<CBigNum> vPubcoins;
+            if (!GetBlockPubcoinValues(pindex, coin.getDenomination(), vPubcoins)) {
+                LogPrintf("%s: failed to get the pubcoins of block %d while adding pubcoins to witness\n", __func__, nHeight);
                 return false;
             }
 
-            list<PublicCoin> listPubcoins;
-            if(!BlockToPubcoinList(block, listPubcoins)) {
-                LogPrintf("%s: failed to get zerocoin mintlist from block %n\n", __func__, pindex->nHeight);
-                return false;
+            CWitnessStep& step = plan.vSteps.back();
+            for (const CBigNum& bnPubcoin : vPubcoins) {
+                if (nHeight == nHeightMintAdded && bnPubcoin == coin.getValue())
+                    continue;
+
+                step.bnProduct *= bnPubcoin;
+                ++step.nPubcoins;
             }
+        }
+    }
+    plan.nCheckpointsAdded = nCheckpointsAdded;
+    plan.hashBlockEnd = plan.nHeightEnd > nAccStartHeight ? chainActive[plan.nHeightEnd - 1]->GetBlockHash() : uint256(0);
 
-            //add the mints to the witness
-            for (const PublicCoin pubcoin : listPubcoins) {
-                if (pubcoin.getDenomination() != coin.getDenomination())
-                    continue;
+    // calculate how many mints of this denomination existed in the accumulator we initialized
+    plan.nMintsBefore = 0;
+    if (nAccStartHeight > GetZerocoinStartHeight()) {
+        std::vector<int> vMintCounts = GetMintCounts(chainActive[nAccStartHeight - 1]);
+        int nDenom = std::distance(zerocoinDenomList.begin(), std::find(zerocoinDenomList.begin(), zerocoinDenomList.end(), coin.getDenomination()));
+        plan.nMintsBefore = vMintCounts[nDenom];
+    }
 
-                if (pindex->nHeight == nHeightMintAdded && pubcoin.getValue() == coin.getValue())
-                    continue;
+    return true;
+}
 
-                witness.addRawValue(pubcoin.getValue());
-                ++nMintsAdded;
-            }
+/**
+ * Raise the witness to the product of the pubcoins of each step, which gives the same value
+ * as adding them one by one. Keeps a snapshot before every step a spend may stop at.
+ */
+bool ApplyAccumulatorWitness(const CWitnessPlan& plan, CMintWitness* pMintWitness, CBigNum& bnWitness, int& nMintsAdded)
+{
+    const CBigNum& bnModulus = Params().Zerocoin_Params()->accumulatorParams.accumulatorModulus;
+    bnWitness = plan.bnWitness;
+    nMintsAdded = plan.nMintsAdded;
+
+    for (const CWitnessStep& step : plan.vSteps) {
+        // checking whether we should stop this process due to a shutdown request
+        if (ShutdownRequested())
+            return false;
+
+        if (pMintWitness && step.fSnapshot) {
+            CWitnessSnapshot& snapshot = pMintWitness->mapSnapshots[step.nHeight];
+            snapshot.hashBlock = step.hashBlockPrev;
+            snapshot.bnValue = bnWitness;
+            snapshot.nMintsAdded = nMintsAdded;
+            snapshot.nCheckpointsAdded = step.nCheckpointsAdded;
         }
 
-        pindex = chainActive[pindex->nHeight + 1];
+        if (step.nPubcoins > 0) {
+            bnWitness = bnWitness.pow_mod(step.bnProduct, bnModulus);
+            nMintsAdded += step.nPubcoins;
+        }
     }
 
+    if (!pMintWitness || plan.nHeightEnd <= plan.nAccStartHeight)
+        return true;
+
+    CWitnessSnapshot& snapshot = pMintWitness->mapSnapshots[plan.nHeightEnd];
+    snapshot.hashBlock = plan.hashBlockEnd;
+    snapshot.bnValue = bnWitness;
+    snapshot.nMintsAdded = nMintsAdded;
+    snapshot.nCheckpointsAdded = plan.nCheckpointsAdded;
+
+    //beyond the checkpoints a spend may stop at only the furthest snapshot is useful
+    std::map<int, CWitnessSnapshot>::iterator it = pMintWitness->mapSnapshots.begin();
+    while (it != pMintWitness->mapSnapshots.end()) {
+        if (it->second.nCheckpointsAdded > MAX_SNAPSHOT_CHECKPOINTS && it->first != pMintWitness->mapSnapshots.rbegin()->first)
+            pMintWitness->mapSnapshots.erase(it++);
+        else
+            ++it;
+    }
+    return true;
+}
+
+} // anonymous namespace
+
+bool GenerateAccumulatorWitness(const PublicCoin &coin, Accumulator& accumulator, AccumulatorWitness& witness, int nSecurityLevel, int& nMintsAdded, string& strError, CMintWitness* pMintWitness)
+{
+    CWitnessPlan plan;
+    if (!PrepareAccumulatorWitness(coin, nSecurityLevel, pMintWitness, plan))
+        return false;
+
+    CBigNum bnWitness;
+    if (!ApplyAccumulatorWitness(plan, pMintWitness, bnWitness, nMintsAdded))
+        return false;
+    witness.resetValue(Accumulator(Params().Zerocoin_Params(), coin.getDenomination(), bnWitness), coin);
+    if (plan.fAccumulator)
+        accumulator.setValue(plan.bnAccumulator);
+
     if (nMintsAdded < Params().Zerocoin_RequiredAccumulation()) {
         strError = _(strprintf("Less than %d mints added, unable to create spend", Params().Zerocoin_RequiredAccumulation()).c_str());
         LogPrintf("%s : %s\n", __func__, strError);
         return false;
     }
 
-    // calculate how many mints of this denomination existed in the accumulator we initialized
-    int nZerocoinStartHeight = GetZerocoinStartHeight();
-    pindex = chainActive[nZerocoinStartHeight];
-    while (pindex->nHeight < nAccStartHeight) {
-        nMintsAdded += count(pindex->vMintDenominationsInBlock.begin(), pindex->vMintDenominationsInBlock.end(), coin.getDenomination());
-        pindex = chainActive[pindex->nHeight + 1];
-    }
+    nMintsAdded += plan.nMintsBefore;
 
     LogPrint("zero","%s : %d mints added to witness\n", __func__, nMintsAdded);
     return true;
-}
\ No newline at end of file
+}
+
+bool PrecomputeAccumulatorWitness(const PublicCoin& coin, CMintWitness& mintWitness)
+{
+    CWitnessPlan plan;
+    {
+        LOCK(cs_main);
+        if (!PrepareAccumulatorWitness(coin, 100, &mintWitness, plan))
+            return false;
+    }
+
+    //the exponentiations are what takes long, they need no lock
+    CBigNum bnWitness;
+    int nMintsAdded = 0;
+    return ApplyAccumulatorWitness(plan, &mintWitness, bnWitness, nMintsAdded);
+}
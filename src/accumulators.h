@@ -11,10 +11,22 @@
 #include "primitives/zerocoin.h"
 #include "uint256.h"
 
-bool GenerateAccumulatorWitness(const libzerocoin::PublicCoin &coin, libzerocoin::Accumulator& accumulator, libzerocoin::AccumulatorWitness& witness, int nSecurityLevel, int& nMintsAdded, std::string& strError);
+class CBlock;
+class CBlockIndex;
+
+//! Blocks below the tip whose pubcoins are kept in memory for the checkpoint calculation
+static const int PUBCOIN_CACHE_DEPTH = 30;
+//! Number of recently calculated accumulator checkpoints kept in memory, for reorgs and block templates
+static const unsigned int ACCUMULATOR_STATE_CACHE_SIZE = 10;
+
+bool GenerateAccumulatorWitness(const libzerocoin::PublicCoin &coin, libzerocoin::Accumulator& accumulator, libzerocoin::AccumulatorWitness& witness, int nSecurityLevel, int& nMintsAdded, std::string& strError, CMintWitness* pMintWitness = NULL);
+bool PrecomputeAccumulatorWitness(const libzerocoin::PublicCoin& coin, CMintWitness& mintWitness);
 bool GetAccumulatorValueFromDB(uint256 nCheckpoint, libzerocoin::CoinDenomination denom, CBigNum& bnAccValue);
 bool GetAccumulatorValueFromChecksum(uint32_t nChecksum, bool fMemoryOnly, CBigNum& bnAccValue);
 void AddAccumulatorChecksum(const uint32_t nChecksum, const CBigNum &bnValue, bool fMemoryOnly);
+bool RecordBlockPubcoins(const CBlockIndex* pindex, const CBlock& block);
+bool IndexBlockMints(const CBlockIndex* pindex, const CBlock& block);
+void EraseBlockMints(const CBlockIndex* pindex);
 bool CalculateAccumulatorCheckpoint(int nHeight, uint256& nCheckpoint);
 bool LoadAccumulatorValuesFromDB(const uint256 nCheckpoint);
 bool EraseAccumulatorValues(const uint256& nCheckpointErase, const uint256& nCheckpointPrevious);
@@ -0,0 +1,97 @@
+// Copyright (c) 2018 The Slingcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockcache.h"
+
+#include "core_memusage.h"
+#include "memusage.h"
+#include "protocol.h"
+#include "streams.h"
+#include "version.h"
+
+#include <boost/foreach.hpp>
+
+CRecentBlockCache::CRecentBlockCache(size_t nMaxUsageIn) : nMaxUsage(nMaxUsageIn), nUsage(0)
+{
+}
+
+void CRecentBlockCache::Add(const CBlock& block)
+{
+    uint256 hash = block.GetHash();
+    {
+        LOCK(cs);
+        if (mapEntries.count(hash))
+            return;
+    }
+
+    // Serialize outside the lock, leaving room for the message header
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss.reserve(CMessageHeader::HEADER_SIZE + ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION));
+    ss.resize(CMessageHeader::HEADER_SIZE);
+    ss << block;
+    boost::shared_ptr<CSerializeData> message(new CSerializeData());
+    ss.GetAndClear(*message);
+    SetMessageHeader(*message, "block");
+
+    Entry entry;
+    entry.message = message;
+    entry.block.reset(new CBlock(block));
+    entry.nUsage = memusage::MallocUsage(message->capacity()) + memusage::MallocUsage(sizeof(CBlock)) +
+                   memusage::DynamicUsage(block.vtx) + memusage::DynamicUsage(block.vchBlockSig);
+    BOOST_FOREACH (const CTransaction& tx, block.vtx)
+        entry.nUsage += RecursiveDynamicUsage(tx);
+    if (entry.nUsage > nMaxUsage)
+        return;
+
+    LOCK(cs);
+    if (!mapEntries.insert(std::make_pair(hash, entry)).second)
+        return;
+    vOrder.push_back(hash);
+    nUsage += entry.nUsage;
+
+    while (nUsage > nMaxUsage) {
+        std::map<uint256, Entry>::iterator it = mapEntries.find(vOrder.front());
+        nUsage -= it->second.nUsage;
+        mapEntries.erase(it);
+        vOrder.pop_front();
+    }
+}
+
+CRecentBlockCache::MessagePtr CRecentBlockCache::GetMessage(const uint256& hash) const
+{
+    LOCK(cs);
+    std::map<uint256, Entry>::const_iterator it = mapEntries.find(hash);
+    if (it == mapEntries.end())
+        return MessagePtr();
+    return it->second.message;
+}
+
+CRecentBlockCache::BlockPtr CRecentBlockCache::GetBlock(const uint256& hash) const
+{
+    LOCK(cs);
+    std::map<uint256, Entry>::const_iterator it = mapEntries.find(hash);
+    if (it == mapEntries.end())
+        return BlockPtr();
+    return it->second.block;
+}
+
+void CRecentBlockCache::Clear()
+{
+    LOCK(cs);
+    mapEntries.clear();
+    vOrder.clear();
+    nUsage = 0;
+}
+
+size_t CRecentBlockCache::size() const
+{
+    LOCK(cs);
+    return mapEntries.size();
+}
+
+size_t CRecentBlockCache::DynamicMemoryUsage() const
+{
+    LOCK(cs);
+    return nUsage + memusage::DynamicUsage(mapEntries) + memusage::MallocUsage(sizeof(uint256)) * vOrder.size();
+}
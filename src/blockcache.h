@@ -0,0 +1,65 @@
+// Copyright (c) 2018 The Slingcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKCACHE_H
+#define BITCOIN_BLOCKCACHE_H
+
+#include "allocators.h"
+#include "primitives/block.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <deque>
+#include <map>
+
+#include <boost/shared_ptr.hpp>
+
+/** Default for the size of the recent block cache, in bytes */
+static const size_t DEFAULT_RECENT_BLOCK_CACHE_SIZE = 16 << 20;
+
+/**
+ * The most recently connected blocks, which every peer asks for right after
+ * we announce them. Each block is kept as the complete "block" message, header
+ * and checksum included, so getdata is answered without reading or
+ * serializing it again, and deserialized for building merkleblocks.
+ *
+ * Entries are shared: what a lookup returns stays valid after it is evicted.
+ */
+class CRecentBlockCache
+{
+public:
+    typedef boost::shared_ptr<const CSerializeData> MessagePtr;
+    typedef boost::shared_ptr<const CBlock> BlockPtr;
+
+    explicit CRecentBlockCache(size_t nMaxUsageIn = DEFAULT_RECENT_BLOCK_CACHE_SIZE);
+
+    //! Cache block, dropping the oldest entries beyond the size limit
+    void Add(const CBlock& block);
+
+    //! The "block" message for hash, or NULL when it isn't cached
+    MessagePtr GetMessage(const uint256& hash) const;
+
+    //! The block for hash, or NULL when it isn't cached
+    BlockPtr GetBlock(const uint256& hash) const;
+
+    void Clear();
+    size_t size() const;
+    size_t DynamicMemoryUsage() const;
+
+private:
+    struct Entry {
+        MessagePtr message;
+        BlockPtr block;
+        size_t nUsage;
+    };
+
+    mutable CCriticalSection cs;
+    size_t nMaxUsage;
+    size_t nUsage;
+    std::map<uint256, Entry> mapEntries;
+    //! Hashes in the order they were added, oldest first
+    std::deque<uint256> vOrder;
+};
+
+#endif // BITCOIN_BLOCKCACHE_H
@@ -0,0 +1,151 @@
+// Copyright (c) 2018 The Slingcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockencodings.h"
+
+#include "crypto/sha256.h"
+#include "hash.h"
+#include "random.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "util.h"
+#include "version.h"
+
+#include <boost/unordered_map.hpp>
+
+CCompactBlock::CCompactBlock(const CBlock& block) : header(block.GetBlockHeader()),
+                                                    nNonce(GetRand(std::numeric_limits<uint64_t>::max())),
+                                                    vchBlockSig(block.vchBlockSig)
+{
+    // Prefill the coinbase, and the coinstake right after it
+    size_t nPrefilled = block.IsProofOfStake() ? 2 : 1;
+    for (size_t i = 0; i < nPrefilled && i < block.vtx.size(); i++)
+        vPrefilled.push_back(CPrefilledTransaction(0, block.vtx[i]));
+
+    uint64_t k0, k1;
+    GetShortIdKeys(k0, k1);
+    for (size_t i = nPrefilled; i < block.vtx.size(); i++)
+        vShortIds.push_back(GetShortId(k0, k1, block.vtx[i].GetHash()));
+}
+
+void CCompactBlock::GetShortIdKeys(uint64_t& k0, uint64_t& k1) const
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << header << nNonce;
+    uint256 hash;
+    CSHA256().Write((const unsigned char*)&stream[0], stream.size()).Finalize(hash.begin());
+    k0 = hash.Get64(0);
+    k1 = hash.Get64(1);
+}
+
+uint64_t CCompactBlock::GetShortId(uint64_t k0, uint64_t k1, const uint256& txhash)
+{
+    return SipHashUint256(k0, k1, txhash) & 0xffffffffffffULL;
+}
+
+bool CCompactBlock::IsProofOfStake() const
+{
+    return vPrefilled.size() > 1 && vPrefilled[1].nIndex == 0 && vPrefilled[1].tx.IsCoinStake();
+}
+
+ReadStatus CPartialBlock::Init(const CCompactBlock& cmpctblock, const CTxMemPool& pool)
+{
+    if (cmpctblock.header.IsNull() || cmpctblock.BlockTxCount() == 0)
+        return READ_STATUS_INVALID;
+    static const size_t nMinTxSize = ::GetSerializeSize(CTransaction(), SER_NETWORK, PROTOCOL_VERSION);
+    if (cmpctblock.BlockTxCount() > MAX_BLOCK_SIZE_CURRENT / nMinTxSize ||
+        cmpctblock.BlockTxCount() > std::numeric_limits<uint16_t>::max())
+        return READ_STATUS_INVALID;
+
+    header = cmpctblock.header;
+    vchBlockSig = cmpctblock.vchBlockSig;
+    vtx.assign(cmpctblock.BlockTxCount(), CTransaction());
+    vHave.assign(cmpctblock.BlockTxCount(), false);
+
+    int nLastIndex = -1;
+    for (size_t i = 0; i < cmpctblock.vPrefilled.size(); i++) {
+        const CPrefilledTransaction& prefilled = cmpctblock.vPrefilled[i];
+        if (prefilled.tx.IsNull())
+            return READ_STATUS_INVALID;
+        nLastIndex += prefilled.nIndex + 1;
+        if ((size_t)nLastIndex >= vtx.size())
+            return READ_STATUS_INVALID;
+        vtx[nLastIndex] = prefilled.tx;
+        vHave[nLastIndex] = true;
+    }
+
+    // Position of every short id in the block
+    boost::unordered_map<uint64_t, uint16_t> mapShortIds;
+    size_t nIndex = 0;
+    for (size_t i = 0; i < cmpctblock.vShortIds.size(); i++) {
+        while (vHave[nIndex])
+            nIndex++;
+        mapShortIds[cmpctblock.vShortIds[i]] = nIndex++;
+    }
+    if (mapShortIds.size() != cmpctblock.vShortIds.size())
+        return READ_STATUS_FAILED;
+
+    uint64_t k0, k1;
+    cmpctblock.GetShortIdKeys(k0, k1);
+    size_t nFound = 0;
+    {
+        LOCK(pool.cs);
+        for (CTxMemPool::indexed_transaction_set::const_iterator it = pool.mapTx.begin(); it != pool.mapTx.end() && !mapShortIds.empty(); ++it) {
+            boost::unordered_map<uint64_t, uint16_t>::iterator itId = mapShortIds.find(CCompactBlock::GetShortId(k0, k1, it->GetTx().GetHash()));
+            if (itId == mapShortIds.end())
+                continue;
+            if (!vHave[itId->second]) {
+                vtx[itId->second] = it->GetTx();
+                vHave[itId->second] = true;
+                nFound++;
+            } else {
+                // Two mempool transactions with the same short id: ask for the real one
+                vtx[itId->second] = CTransaction();
+                vHave[itId->second] = false;
+                nFound--;
+                mapShortIds.erase(itId);
+            }
+        }
+    }
+
+    LogPrint("cmpctblock", "Initialized compact block %s: %u prefilled, %u of %u from mempool\n",
+        GetHash().ToString(), cmpctblock.vPrefilled.size(), nFound, cmpctblock.vShortIds.size());
+    return READ_STATUS_OK;
+}
+
+std::vector<uint16_t> CPartialBlock::GetMissing() const
+{
+    std::vector<uint16_t> vMissing;
+    for (size_t i = 0; i < vHave.size(); i++) {
+        if (!vHave[i])
+            vMissing.push_back(i);
+    }
+    return vMissing;
+}
+
+ReadStatus CPartialBlock::FillBlock(CBlock& block, const std::vector<CTransaction>& vtxMissing) const
+{
+    block = CBlock(header);
+    block.vchBlockSig = vchBlockSig;
+    block.vtx.reserve(vtx.size());
+    size_t nMissing = 0;
+    for (size_t i = 0; i < vtx.size(); i++) {
+        if (vHave[i]) {
+            block.vtx.push_back(vtx[i]);
+        } else {
+            if (nMissing >= vtxMissing.size())
+                return READ_STATUS_INVALID;
+            block.vtx.push_back(vtxMissing[nMissing++]);
+        }
+    }
+    if (nMissing != vtxMissing.size())
+        return READ_STATUS_INVALID;
+
+    bool fMutated;
+    if (block.BuildMerkleTree(&fMutated) != block.hashMerkleRoot || fMutated) {
+        LogPrint("cmpctblock", "Failed to reconstruct block %s, merkle root mismatch\n", GetHash().ToString());
+        return READ_STATUS_FAILED;
+    }
+    return READ_STATUS_OK;
+}
@@ -0,0 +1,221 @@
+// Copyright (c) 2018 The Slingcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKENCODINGS_H
+#define BITCOIN_BLOCKENCODINGS_H
+
+#include "primitives/block.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <ios>
+#include <limits>
+#include <vector>
+
+class CTxMemPool;
+
+//! Version of the compact block encoding announced in "sendcmpct"
+static const uint64_t COMPACT_BLOCKS_ENCODING_VERSION = 1;
+
+enum ReadStatus {
+    READ_STATUS_OK,
+    //! The peer sent something that can't be part of any valid block
+    READ_STATUS_INVALID,
+    //! Short id collision or similar: fall back to the full block
+    READ_STATUS_FAILED,
+};
+
+/** Transactions at these positions of a block, asked for with "getblocktxn" */
+class CBlockTransactionsRequest
+{
+public:
+    uint256 hash;
+    std::vector<uint16_t> vIndexes;
+
+    size_t GetSerializeSize(int nType, int nVersion) const
+    {
+        CSizeComputer s(nType, nVersion);
+        Serialize(s, nType, nVersion);
+        return s.size();
+    }
+
+    // Indexes go out in ascending order, each as the distance from the previous one
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        ::Serialize(s, hash, nType, nVersion);
+        WriteCompactSize(s, vIndexes.size());
+        for (size_t i = 0; i < vIndexes.size(); i++)
+            WriteCompactSize(s, i == 0 ? vIndexes[0] : vIndexes[i] - vIndexes[i - 1] - 1);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        ::Unserialize(s, hash, nType, nVersion);
+        uint64_t nSize = ReadCompactSize(s);
+        vIndexes.clear();
+        uint64_t nIndex = 0;
+        for (uint64_t i = 0; i < nSize; i++) {
+            nIndex += ReadCompactSize(s) + (i > 0);
+            if (nIndex > std::numeric_limits<uint16_t>::max())
+                throw std::ios_base::failure("index overflowed 16 bits");
+            vIndexes.push_back(nIndex);
+        }
+    }
+};
+
+/** The answer to a "getblocktxn", in "blocktxn" */
+class CBlockTransactions
+{
+public:
+    uint256 hash;
+    std::vector<CTransaction> vtx;
+
+    CBlockTransactions() {}
+    CBlockTransactions(const CBlockTransactionsRequest& req) : hash(req.hash), vtx(req.vIndexes.size()) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(hash);
+        READWRITE(vtx);
+    }
+};
+
+/** A transaction that goes out in full with a compact block */
+class CPrefilledTransaction
+{
+public:
+    //! Distance from the previous prefilled transaction, see CCompactBlock
+    uint16_t nIndex;
+    CTransaction tx;
+
+    CPrefilledTransaction() : nIndex(0) {}
+    CPrefilledTransaction(uint16_t nIndexIn, const CTransaction& txIn) : nIndex(nIndexIn), tx(txIn) {}
+
+    size_t GetSerializeSize(int nType, int nVersion) const
+    {
+        return GetSizeOfCompactSize(nIndex) + ::GetSerializeSize(tx, nType, nVersion);
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        WriteCompactSize(s, nIndex);
+        ::Serialize(s, tx, nType, nVersion);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        uint64_t n = ReadCompactSize(s);
+        if (n > std::numeric_limits<uint16_t>::max())
+            throw std::ios_base::failure("index overflowed 16 bits");
+        nIndex = n;
+        ::Unserialize(s, tx, nType, nVersion);
+    }
+};
+
+/**
+ * A block as sent in "cmpctblock": the header, the block signature, and 6
+ * byte short ids standing in for the transactions the receiver most likely
+ * has in its mempool. Short ids are SipHash-2-4 of the txid, keyed from the
+ * header and a random nonce, so they differ for every block and sender.
+ *
+ * The coinbase and the coinstake can't be in any mempool and are always
+ * prefilled. The position of a prefilled transaction is stored as the number
+ * of transactions between it and the previous prefilled one.
+ */
+class CCompactBlock
+{
+public:
+    CBlockHeader header;
+    uint64_t nNonce;
+    std::vector<uint64_t> vShortIds;
+    std::vector<CPrefilledTransaction> vPrefilled;
+    std::vector<unsigned char> vchBlockSig;
+
+    CCompactBlock() : nNonce(0) {}
+    explicit CCompactBlock(const CBlock& block);
+
+    //! SipHash keys for the short ids of this block
+    void GetShortIdKeys(uint64_t& k0, uint64_t& k1) const;
+    static uint64_t GetShortId(uint64_t k0, uint64_t k1, const uint256& txhash);
+
+    size_t BlockTxCount() const { return vShortIds.size() + vPrefilled.size(); }
+    bool IsProofOfStake() const;
+
+    size_t GetSerializeSize(int nType, int nVersion) const
+    {
+        CSizeComputer s(nType, nVersion);
+        Serialize(s, nType, nVersion);
+        return s.size();
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        ::Serialize(s, header, nType, nVersion);
+        ::Serialize(s, nNonce, nType, nVersion);
+        WriteCompactSize(s, vShortIds.size());
+        for (size_t i = 0; i < vShortIds.size(); i++) {
+            uint32_t nLow = vShortIds[i];
+            uint16_t nHigh = vShortIds[i] >> 32;
+            ::Serialize(s, nLow, nType, nVersion);
+            ::Serialize(s, nHigh, nType, nVersion);
+        }
+        ::Serialize(s, vPrefilled, nType, nVersion);
+        ::Serialize(s, vchBlockSig, nType, nVersion);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        ::Unserialize(s, header, nType, nVersion);
+        ::Unserialize(s, nNonce, nType, nVersion);
+        uint64_t nSize = ReadCompactSize(s);
+        vShortIds.clear();
+        for (uint64_t i = 0; i < nSize; i++) {
+            uint32_t nLow;
+            uint16_t nHigh;
+            ::Unserialize(s, nLow, nType, nVersion);
+            ::Unserialize(s, nHigh, nType, nVersion);
+            vShortIds.push_back((uint64_t)nHigh << 32 | nLow);
+        }
+        ::Unserialize(s, vPrefilled, nType, nVersion);
+        ::Unserialize(s, vchBlockSig, nType, nVersion);
+    }
+};
+
+/**
+ * A block being rebuilt from a compact block: the prefilled transactions and
+ * those found in the mempool, with the rest to be asked for by index.
+ */
+class CPartialBlock
+{
+public:
+    ReadStatus Init(const CCompactBlock& cmpctblock, const CTxMemPool& pool);
+
+    uint256 GetHash() const { return header.GetHash(); }
+    //! Positions of the transactions still missing, in ascending order
+    std::vector<uint16_t> GetMissing() const;
+
+    /**
+     * Assemble the block, taking the missing transactions from vtxMissing in
+     * order. Fails rather than return a block whose merkle root doesn't match,
+     * which is what a short id collision looks like.
+     */
+    ReadStatus FillBlock(CBlock& block, const std::vector<CTransaction>& vtxMissing) const;
+
+private:
+    CBlockHeader header;
+    std::vector<unsigned char> vchBlockSig;
+    std::vector<CTransaction> vtx;
+    std::vector<bool> vHave;
+};
+
+#endif // BITCOIN_BLOCKENCODINGS_H
@@ -76,7 +76,149 @@ bool CCoinsViewBacked::GetStats(CCoinsStats& stats) const { return base->GetStat
 
 CCoinsKeyHasher::CCoinsKeyHasher() : salt(GetRandHash()) {}
 
-CCoinsViewCache::CCoinsViewCache(CCoinsView* baseIn) : CCoinsViewBacked(baseIn), hasModifier(false), hashBlock(0) {}
+CCoinsMap::CCoinsMap() : salt(GetRandHash()), nAllocated(0), nSize(0), nDeleted(0) {}
+
+CCoinsMap::~CCoinsMap()
+{
+    clear();
+}
+
+size_t CCoinsMap::FindPos(const uint256& key, uint64_t nHash) const
+{
+    if (vSlots.empty())
+        return 0;
+    uint32_t nTag = nHash >> 32;
+    size_t nMask = vSlots.size() - 1;
+    for (size_t nPos = nHash & nMask;; nPos = (nPos + 1) & nMask) {
+        const Slot& slot = vSlots[nPos];
+        if (slot.nEntry == EMPTY)
+            return vSlots.size();
+        if (slot.nEntry != DELETED && slot.nTag == nTag && Entry(slot.nEntry)->first == key)
+            return nPos;
+    }
+}
+
+size_t CCoinsMap::NextPos(size_t nPos) const
+{
+    while (nPos < vSlots.size() && (vSlots[nPos].nEntry == EMPTY || vSlots[nPos].nEntry == DELETED))
+        nPos++;
+    return nPos;
+}
+
+size_t CCoinsMap::Resolve(size_t nPos, uint32_t nEntry) const
+{
+    if (nPos < vSlots.size() && vSlots[nPos].nEntry == nEntry)
+        return nPos;
+    const uint256& key = Entry(nEntry)->first;
+    return FindPos(key, key.GetHash(salt));
+}
+
+void CCoinsMap::Rehash(size_t nNewSize)
+{
+    std::vector<Slot> vOld(nNewSize);
+    vOld.swap(vSlots);
+    nDeleted = 0;
+    size_t nMask = nNewSize - 1;
+    for (size_t i = 0; i < vOld.size(); i++) {
+        if (vOld[i].nEntry == EMPTY || vOld[i].nEntry == DELETED)
+            continue;
+        size_t nPos = Entry(vOld[i].nEntry)->first.GetHash(salt) & nMask;
+        while (vSlots[nPos].nEntry != EMPTY)
+            nPos = (nPos + 1) & nMask;
+        vSlots[nPos] = vOld[i];
+    }
+}
+
+std::pair<CCoinsMap::iterator, bool> CCoinsMap::insert(const value_type& value)
+{
+    uint64_t nHash = value.first.GetHash(salt);
+    size_t nPos = FindPos(value.first, nHash);
+    if (nPos != vSlots.size())
+        return std::make_pair(iterator(this, nPos), false);
+
+    // Keep at least a quarter of the slots empty, so probes stay short
+    if ((nSize + nDeleted + 1) * 4 > vSlots.size() * 3) {
+        size_t nNewSize = 16;
+        while ((nSize + 1) * 2 > nNewSize)
+            nNewSize *= 2;
+        Rehash(nNewSize);
+    }
+
+    uint32_t nEntry;
+    if (!vFree.empty()) {
+        nEntry = vFree.back();
+        vFree.pop_back();
+    } else {
+        if ((nAllocated >> CHUNK_BITS) == vChunks.size())
+            vChunks.push_back(static_cast<value_type*>(::operator new(sizeof(value_type) << CHUNK_BITS)));
+        nEntry = ++nAllocated;
+    }
+    new (Entry(nEntry)) value_type(value);
+
+    size_t nMask = vSlots.size() - 1;
+    for (nPos = nHash & nMask; vSlots[nPos].nEntry != EMPTY && vSlots[nPos].nEntry != DELETED; nPos = (nPos + 1) & nMask) {}
+    if (vSlots[nPos].nEntry == DELETED)
+        nDeleted--;
+    vSlots[nPos].nTag = nHash >> 32;
+    vSlots[nPos].nEntry = nEntry;
+    nSize++;
+    return std::make_pair(iterator(this, nPos), true);
+}
+
+void CCoinsMap::erase(iterator it)
+{
+    size_t nPos = Resolve(it.nPos, it.nEntry);
+    Entry(it.nEntry)->~value_type();
+    vFree.push_back(it.nEntry);
+    nSize--;
+
+    size_t nMask = vSlots.size() - 1;
+    if (vSlots[(nPos + 1) & nMask].nEntry == EMPTY) {
+        // Probes stop at the empty slot that follows anyway, so this slot and
+        // the tombstones right before it can be emptied too
+        vSlots[nPos].nEntry = EMPTY;
+        for (nPos = (nPos - 1) & nMask; vSlots[nPos].nEntry == DELETED; nPos = (nPos - 1) & nMask) {
+            vSlots[nPos].nEntry = EMPTY;
+            nDeleted--;
+        }
+    } else {
+        vSlots[nPos].nEntry = DELETED;
+        nDeleted++;
+    }
+}
+
+size_t CCoinsMap::erase(const uint256& key)
+{
+    iterator it = find(key);
+    if (it == end())
+        return 0;
+    erase(it);
+    return 1;
+}
+
+void CCoinsMap::clear()
+{
+    for (size_t i = 0; i < vSlots.size(); i++) {
+        if (vSlots[i].nEntry != EMPTY && vSlots[i].nEntry != DELETED)
+            Entry(vSlots[i].nEntry)->~value_type();
+    }
+    for (size_t i = 0; i < vChunks.size(); i++)
+        ::operator delete(vChunks[i]);
+    std::vector<Slot>().swap(vSlots);
+    std::vector<value_type*>().swap(vChunks);
+    std::vector<uint32_t>().swap(vFree);
+    nAllocated = 0;
+    nSize = 0;
+    nDeleted = 0;
+}
+
+size_t CCoinsMap::DynamicMemoryUsage() const
+{
+    return memusage::DynamicUsage(vSlots) + memusage::DynamicUsage(vChunks) + memusage::DynamicUsage(vFree) +
+           vChunks.size() * memusage::MallocUsage(sizeof(value_type) << CHUNK_BITS);
+}
+
+CCoinsViewCache::CCoinsViewCache(CCoinsView* baseIn) : CCoinsViewBacked(baseIn), hasModifier(false), hashBlock(0), cachedCoinsUsage(0), nCacheHits(0), nCacheMisses(0) {}
 
 CCoinsViewCache::~CCoinsViewCache()
 {
@@ -86,8 +228,11 @@ CCoinsViewCache::~CCoinsViewCache()
 CCoinsMap::const_iterator CCoinsViewCache::FetchCoins(const uint256& txid) const
 {
     CCoinsMap::iterator it = cacheCoins.find(txid);
-    if (it != cacheCoins.end())
+    if (it != cacheCoins.end()) {
+        nCacheHits++;
         return it;
+    }
+    nCacheMisses++;
     CCoins tmp;
     if (!base->GetCoins(txid, tmp))
         return cacheCoins.end();
@@ -98,6 +243,7 @@ CCoinsMap::const_iterator CCoinsViewCache::FetchCoins(const uint256& txid) const
         // version as fresh.
         ret->second.flags = CCoinsCacheEntry::FRESH;
     }
+    cachedCoinsUsage += ret->second.coins.DynamicMemoryUsage();
     return ret;
 }
 
@@ -115,6 +261,7 @@ CCoinsModifier CCoinsViewCache::ModifyCoins(const uint256& txid)
 {
     assert(!hasModifier);
     std::pair<CCoinsMap::iterator, bool> ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry()));
+    size_t cachedCoinUsage = 0;
     if (ret.second) {
         if (!base->GetCoins(txid, ret.first->second.coins)) {
             // The parent view does not have this entry; mark it as fresh.
@@ -124,10 +271,12 @@ CCoinsModifier CCoinsViewCache::ModifyCoins(const uint256& txid)
             // The parent view only has a pruned entry for this; mark it as fresh.
             ret.first->second.flags = CCoinsCacheEntry::FRESH;
         }
+    } else {
+        cachedCoinUsage = ret.first->second.coins.DynamicMemoryUsage();
     }
     // Assume that whenever ModifyCoins is called, the entry will be modified.
     ret.first->second.flags |= CCoinsCacheEntry::DIRTY;
-    return CCoinsModifier(*this, ret.first);
+    return CCoinsModifier(*this, ret.first, cachedCoinUsage);
 }
 
 const CCoins* CCoinsViewCache::AccessCoins(const uint256& txid) const
@@ -177,6 +326,7 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlockIn
                     assert(it->second.flags & CCoinsCacheEntry::FRESH);
                     CCoinsCacheEntry& entry = cacheCoins[it->first];
                     entry.coins.swap(it->second.coins);
+                    cachedCoinsUsage += entry.coins.DynamicMemoryUsage();
                     entry.flags = CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH;
                 }
             } else {
@@ -184,10 +334,13 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlockIn
                     // The grandparent does not have an entry, and the child is
                     // modified and being pruned. This means we can just delete
                     // it from the parent.
+                    cachedCoinsUsage -= itUs->second.coins.DynamicMemoryUsage();
                     cacheCoins.erase(itUs);
                 } else {
                     // A normal modification.
+                    cachedCoinsUsage -= itUs->second.coins.DynamicMemoryUsage();
                     itUs->second.coins.swap(it->second.coins);
+                    cachedCoinsUsage += itUs->second.coins.DynamicMemoryUsage();
                     itUs->second.flags |= CCoinsCacheEntry::DIRTY;
                 }
             }
@@ -203,6 +356,7 @@ bool CCoinsViewCache::Flush()
 {
     bool fOk = base->BatchWrite(cacheCoins, hashBlock);
     cacheCoins.clear();
+    cachedCoinsUsage = 0;
     return fOk;
 }
 
@@ -211,6 +365,11 @@ unsigned int CCoinsViewCache::GetCacheSize() const
     return cacheCoins.size();
 }
 
+size_t CCoinsViewCache::DynamicMemoryUsage() const
+{
+    return cacheCoins.DynamicMemoryUsage() + cachedCoinsUsage;
+}
+
 const CTxOut& CCoinsViewCache::GetOutputFor(const CTxIn& input) const
 {
     const CCoins* coins = AccessCoins(input.prevout.hash);
@@ -264,7 +423,7 @@ double CCoinsViewCache::GetPriority(const CTransaction& tx, int nHeight) const
     return tx.ComputePriority(dResult);
 }
 
-CCoinsModifier::CCoinsModifier(CCoinsViewCache& cache_, CCoinsMap::iterator it_) : cache(cache_), it(it_)
+CCoinsModifier::CCoinsModifier(CCoinsViewCache& cache_, CCoinsMap::iterator it_, size_t usage) : cache(cache_), it(it_), cachedCoinUsage(usage)
 {
     assert(!cache.hasModifier);
     cache.hasModifier = true;
@@ -275,7 +434,11 @@ CCoinsModifier::~CCoinsModifier()
     assert(cache.hasModifier);
     cache.hasModifier = false;
     it->second.coins.Cleanup();
+    cache.cachedCoinsUsage -= cachedCoinUsage; // Subtract the old usage
     if ((it->second.flags & CCoinsCacheEntry::FRESH) && it->second.coins.IsPruned()) {
         cache.cacheCoins.erase(it);
+    } else {
+        // If the coin still exists after the modification, add the new usage
+        cache.cachedCoinsUsage += it->second.coins.DynamicMemoryUsage();
     }
 }
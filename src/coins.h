@@ -7,6 +7,8 @@
 #define BITCOIN_COINS_H
 
 #include "compressor.h"
+#include "core_memusage.h"
+#include "memusage.h"
 #include "script/standard.h"
 #include "serialize.h"
 #include "uint256.h"
@@ -16,7 +18,6 @@
 #include <stdint.h>
 
 #include <boost/foreach.hpp>
-#include <boost/unordered_map.hpp>
 
 /** 
 
@@ -283,6 +284,14 @@ public:
                 return false;
         return true;
     }
+
+    size_t DynamicMemoryUsage() const
+    {
+        size_t ret = memusage::DynamicUsage(vout);
+        BOOST_FOREACH (const CTxOut& out, vout)
+            ret += RecursiveDynamicUsage(out.scriptPubKey);
+        return ret;
+    }
 };
 
 class CCoinsKeyHasher
@@ -316,7 +325,127 @@ struct CCoinsCacheEntry {
     CCoinsCacheEntry() : coins(), flags(0) {}
 };
 
-typedef boost::unordered_map<uint256, CCoinsCacheEntry, CCoinsKeyHasher> CCoinsMap;
+/**
+ * Hash map from txid to cache entry, for the coins caches.
+ *
+ * Lookups probe a flat array of 8-byte slots, each holding part of the key's
+ * hash and the index of its entry, so a miss touches no entry at all. The
+ * entries are pooled in chunks and never move: pointers to them stay valid
+ * until they are erased, which AccessCoins() callers rely on, and iterators
+ * survive rehashing. Erased slots become tombstones until the next rehash.
+ */
+class CCoinsMap
+{
+public:
+    typedef uint256 key_type;
+    typedef CCoinsCacheEntry mapped_type;
+    typedef std::pair<const uint256, CCoinsCacheEntry> value_type;
+
+    template <typename Map, typename Value>
+    class Iterator
+    {
+    public:
+        Iterator() : pmap(NULL), nPos(0), nEntry(0) {}
+        Iterator(Map* pmapIn, size_t nPosIn) : pmap(pmapIn), nPos(nPosIn), nEntry(pmapIn->GetEntry(nPosIn)) {}
+        template <typename OtherMap, typename OtherValue>
+        Iterator(const Iterator<OtherMap, OtherValue>& other) : pmap(other.pmap), nPos(other.nPos), nEntry(other.nEntry) {}
+
+        Value& operator*() const { return *pmap->Entry(nEntry); }
+        Value* operator->() const { return pmap->Entry(nEntry); }
+
+        Iterator& operator++()
+        {
+            nPos = pmap->NextPos(pmap->Resolve(nPos, nEntry) + 1);
+            nEntry = pmap->GetEntry(nPos);
+            return *this;
+        }
+
+        Iterator operator++(int)
+        {
+            Iterator ret(*this);
+            ++*this;
+            return ret;
+        }
+
+        bool operator==(const Iterator& other) const { return nEntry == other.nEntry; }
+        bool operator!=(const Iterator& other) const { return nEntry != other.nEntry; }
+
+    private:
+        friend class CCoinsMap;
+        template <typename OtherMap, typename OtherValue>
+        friend class Iterator;
+
+        Map* pmap;
+        //! Slot as of the last lookup; a rehash may have moved the entry since
+        size_t nPos;
+        //! Entry index, 0 for end()
+        uint32_t nEntry;
+    };
+
+    typedef Iterator<CCoinsMap, value_type> iterator;
+    typedef Iterator<const CCoinsMap, const value_type> const_iterator;
+
+    CCoinsMap();
+    ~CCoinsMap();
+
+    iterator begin() { return iterator(this, NextPos(0)); }
+    iterator end() { return iterator(this, vSlots.size()); }
+    const_iterator begin() const { return const_iterator(this, NextPos(0)); }
+    const_iterator end() const { return const_iterator(this, vSlots.size()); }
+
+    size_t size() const { return nSize; }
+    bool empty() const { return nSize == 0; }
+
+    iterator find(const uint256& key) { return iterator(this, FindPos(key, key.GetHash(salt))); }
+    const_iterator find(const uint256& key) const { return const_iterator(this, FindPos(key, key.GetHash(salt))); }
+
+    std::pair<iterator, bool> insert(const value_type& value);
+    CCoinsCacheEntry& operator[](const uint256& key) { return insert(value_type(key, CCoinsCacheEntry())).first->second; }
+    void erase(iterator it);
+    size_t erase(const uint256& key);
+    void clear();
+
+    size_t DynamicMemoryUsage() const;
+
+private:
+    //! Slot states, other values are an entry index plus one
+    static const uint32_t EMPTY = 0;
+    static const uint32_t DELETED = 0xffffffff;
+    //! Entries are allocated 1 << CHUNK_BITS at a time
+    static const int CHUNK_BITS = 6;
+
+    struct Slot {
+        //! High half of the key's hash; the low half picks the first slot to probe
+        uint32_t nTag;
+        uint32_t nEntry;
+
+        Slot() : nTag(0), nEntry(EMPTY) {}
+    };
+
+    uint256 salt;
+    //! Power of two sized, or empty
+    std::vector<Slot> vSlots;
+    std::vector<value_type*> vChunks;
+    std::vector<uint32_t> vFree;
+    //! Entries handed out from the chunks so far, including freed ones
+    uint32_t nAllocated;
+    size_t nSize;
+    size_t nDeleted;
+
+    value_type* Entry(uint32_t nEntry) const
+    {
+        return vChunks[(nEntry - 1) >> CHUNK_BITS] + ((nEntry - 1) & ((1 << CHUNK_BITS) - 1));
+    }
+
+    uint32_t GetEntry(size_t nPos) const { return nPos < vSlots.size() ? vSlots[nPos].nEntry : 0; }
+    size_t FindPos(const uint256& key, uint64_t nHash) const;
+    size_t NextPos(size_t nPos) const;
+    size_t Resolve(size_t nPos, uint32_t nEntry) const;
+    void Rehash(size_t nNewSize);
+
+    CCoinsMap(const CCoinsMap&);
+    CCoinsMap& operator=(const CCoinsMap&);
+};
 
 struct CCoinsStats {
     int nHeight;
@@ -398,7 +527,8 @@ class CCoinsModifier
 private:
     CCoinsViewCache& cache;
     CCoinsMap::iterator it;
-    CCoinsModifier(CCoinsViewCache& cache_, CCoinsMap::iterator it_);
+    size_t cachedCoinUsage; // Cached memory usage of the CCoins object before modification
+    CCoinsModifier(CCoinsViewCache& cache_, CCoinsMap::iterator it_, size_t usage);
 
 public:
     CCoins* operator->() { return &it->second.coins; }
@@ -421,6 +551,13 @@ protected:
     mutable uint256 hashBlock;
     mutable CCoinsMap cacheCoins;
 
+    /* Cached dynamic memory usage for the inner CCoins objects. */
+    mutable size_t cachedCoinsUsage;
+
+    //! Lookups answered by this cache, and those passed on to the base view
+    mutable uint64_t nCacheHits;
+    mutable uint64_t nCacheMisses;
+
 public:
     CCoinsViewCache(CCoinsView* baseIn);
     ~CCoinsViewCache();
@@ -456,6 +593,12 @@ public:
     //! Calculate the size of the cache (in number of transactions)
     unsigned int GetCacheSize() const;
 
+    //! Calculate the size of the cache (in bytes)
+    size_t DynamicMemoryUsage() const;
+
+    uint64_t GetCacheHits() const { return nCacheHits; }
+    uint64_t GetCacheMisses() const { return nCacheMisses; }
+
     /** 
      * Amount of sling coming in to a transaction
      * Note that lightweight clients may not know anything besides the hash of previous transactions,
@@ -45,6 +45,17 @@
 #include <unistd.h>
 #endif
 
+// Without the FD_SETSIZE limit of select(), the socket handler can serve any
+// number of peers; Linux additionally gets an epoll event loop.
+#if !defined(WIN32) && defined(HAVE_POLL_H)
+#define USE_POLL
+#include <poll.h>
+#endif
+#if defined(USE_POLL) && defined(HAVE_SYS_EPOLL_H)
+#define USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #ifdef WIN32
 #define MSG_DONTWAIT 0
 #else
@@ -92,7 +103,7 @@ size_t strnlen_int(const char* start, size_t max_len);
 
 bool static inline IsSelectableSocket(SOCKET s)
 {
-#ifdef WIN32
+#if defined(WIN32) || defined(USE_POLL)
     return true;
 #else
     return (s < FD_SETSIZE);
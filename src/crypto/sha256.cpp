@@ -127,6 +127,107 @@ void Transform(uint32_t* s, const unsigned char* chunk)
     s[7] += h;
 }
 
+/** Message schedule word i >= 16. */
+uint32_t inline Expand(const uint32_t* w, int i)
+{
+    return sigma1(w[i - 2]) + w[i - 7] + sigma0(w[i - 15]) + w[i - 16];
+}
+
+/** Rounds 0 to 11 of a transformation with message schedule w, from and to the working variables v. */
+void inline FirstRounds12(uint32_t* v, const uint32_t* w)
+{
+    uint32_t a = v[0], b = v[1], c = v[2], d = v[3], e = v[4], f = v[5], g = v[6], h = v[7];
+
+    Round(a, b, c, d, e, f, g, h, 0x428a2f98, w[0]);
+    Round(h, a, b, c, d, e, f, g, 0x71374491, w[1]);
+    Round(g, h, a, b, c, d, e, f, 0xb5c0fbcf, w[2]);
+    Round(f, g, h, a, b, c, d, e, 0xe9b5dba5, w[3]);
+    Round(e, f, g, h, a, b, c, d, 0x3956c25b, w[4]);
+    Round(d, e, f, g, h, a, b, c, 0x59f111f1, w[5]);
+    Round(c, d, e, f, g, h, a, b, 0x923f82a4, w[6]);
+    Round(b, c, d, e, f, g, h, a, 0xab1c5ed5, w[7]);
+    Round(a, b, c, d, e, f, g, h, 0xd807aa98, w[8]);
+    Round(h, a, b, c, d, e, f, g, 0x12835b01, w[9]);
+    Round(g, h, a, b, c, d, e, f, 0x243185be, w[10]);
+    Round(f, g, h, a, b, c, d, e, 0x550c7dc3, w[11]);
+
+    v[0] = a;
+    v[1] = b;
+    v[2] = c;
+    v[3] = d;
+    v[4] = e;
+    v[5] = f;
+    v[6] = g;
+    v[7] = h;
+}
+
+/** Rounds 12 to 63 of a transformation, continuing from FirstRounds12(); w[0..18] must be filled in. */
+void inline LastRounds52(uint32_t* v, uint32_t* w)
+{
+    uint32_t a = v[0], b = v[1], c = v[2], d = v[3], e = v[4], f = v[5], g = v[6], h = v[7];
+
+    Round(e, f, g, h, a, b, c, d, 0x72be5d74, w[12]);
+    Round(d, e, f, g, h, a, b, c, 0x80deb1fe, w[13]);
+    Round(c, d, e, f, g, h, a, b, 0x9bdc06a7, w[14]);
+    Round(b, c, d, e, f, g, h, a, 0xc19bf174, w[15]);
+    Round(a, b, c, d, e, f, g, h, 0xe49b69c1, w[16]);
+    Round(h, a, b, c, d, e, f, g, 0xefbe4786, w[17]);
+    Round(g, h, a, b, c, d, e, f, 0x0fc19dc6, w[18]);
+    Round(f, g, h, a, b, c, d, e, 0x240ca1cc, w[19] = sigma1(w[17]) + w[12] + sigma0(w[4]) + w[3]);
+    Round(e, f, g, h, a, b, c, d, 0x2de92c6f, w[20] = sigma1(w[18]) + w[13] + sigma0(w[5]) + w[4]);
+    Round(d, e, f, g, h, a, b, c, 0x4a7484aa, w[21] = sigma1(w[19]) + w[14] + sigma0(w[6]) + w[5]);
+    Round(c, d, e, f, g, h, a, b, 0x5cb0a9dc, w[22] = sigma1(w[20]) + w[15] + sigma0(w[7]) + w[6]);
+    Round(b, c, d, e, f, g, h, a, 0x76f988da, w[23] = sigma1(w[21]) + w[16] + sigma0(w[8]) + w[7]);
+    Round(a, b, c, d, e, f, g, h, 0x983e5152, w[24] = sigma1(w[22]) + w[17] + sigma0(w[9]) + w[8]);
+    Round(h, a, b, c, d, e, f, g, 0xa831c66d, w[25] = sigma1(w[23]) + w[18] + sigma0(w[10]) + w[9]);
+    Round(g, h, a, b, c, d, e, f, 0xb00327c8, w[26] = sigma1(w[24]) + w[19] + sigma0(w[11]) + w[10]);
+    Round(f, g, h, a, b, c, d, e, 0xbf597fc7, w[27] = sigma1(w[25]) + w[20] + sigma0(w[12]) + w[11]);
+    Round(e, f, g, h, a, b, c, d, 0xc6e00bf3, w[28] = sigma1(w[26]) + w[21] + sigma0(w[13]) + w[12]);
+    Round(d, e, f, g, h, a, b, c, 0xd5a79147, w[29] = sigma1(w[27]) + w[22] + sigma0(w[14]) + w[13]);
+    Round(c, d, e, f, g, h, a, b, 0x06ca6351, w[30] = sigma1(w[28]) + w[23] + sigma0(w[15]) + w[14]);
+    Round(b, c, d, e, f, g, h, a, 0x14292967, w[31] = sigma1(w[29]) + w[24] + sigma0(w[16]) + w[15]);
+    Round(a, b, c, d, e, f, g, h, 0x27b70a85, w[32] = sigma1(w[30]) + w[25] + sigma0(w[17]) + w[16]);
+    Round(h, a, b, c, d, e, f, g, 0x2e1b2138, w[33] = sigma1(w[31]) + w[26] + sigma0(w[18]) + w[17]);
+    Round(g, h, a, b, c, d, e, f, 0x4d2c6dfc, w[34] = sigma1(w[32]) + w[27] + sigma0(w[19]) + w[18]);
+    Round(f, g, h, a, b, c, d, e, 0x53380d13, w[35] = sigma1(w[33]) + w[28] + sigma0(w[20]) + w[19]);
+    Round(e, f, g, h, a, b, c, d, 0x650a7354, w[36] = sigma1(w[34]) + w[29] + sigma0(w[21]) + w[20]);
+    Round(d, e, f, g, h, a, b, c, 0x766a0abb, w[37] = sigma1(w[35]) + w[30] + sigma0(w[22]) + w[21]);
+    Round(c, d, e, f, g, h, a, b, 0x81c2c92e, w[38] = sigma1(w[36]) + w[31] + sigma0(w[23]) + w[22]);
+    Round(b, c, d, e, f, g, h, a, 0x92722c85, w[39] = sigma1(w[37]) + w[32] + sigma0(w[24]) + w[23]);
+    Round(a, b, c, d, e, f, g, h, 0xa2bfe8a1, w[40] = sigma1(w[38]) + w[33] + sigma0(w[25]) + w[24]);
+    Round(h, a, b, c, d, e, f, g, 0xa81a664b, w[41] = sigma1(w[39]) + w[34] + sigma0(w[26]) + w[25]);
+    Round(g, h, a, b, c, d, e, f, 0xc24b8b70, w[42] = sigma1(w[40]) + w[35] + sigma0(w[27]) + w[26]);
+    Round(f, g, h, a, b, c, d, e, 0xc76c51a3, w[43] = sigma1(w[41]) + w[36] + sigma0(w[28]) + w[27]);
+    Round(e, f, g, h, a, b, c, d, 0xd192e819, w[44] = sigma1(w[42]) + w[37] + sigma0(w[29]) + w[28]);
+    Round(d, e, f, g, h, a, b, c, 0xd6990624, w[45] = sigma1(w[43]) + w[38] + sigma0(w[30]) + w[29]);
+    Round(c, d, e, f, g, h, a, b, 0xf40e3585, w[46] = sigma1(w[44]) + w[39] + sigma0(w[31]) + w[30]);
+    Round(b, c, d, e, f, g, h, a, 0x106aa070, w[47] = sigma1(w[45]) + w[40] + sigma0(w[32]) + w[31]);
+    Round(a, b, c, d, e, f, g, h, 0x19a4c116, w[48] = sigma1(w[46]) + w[41] + sigma0(w[33]) + w[32]);
+    Round(h, a, b, c, d, e, f, g, 0x1e376c08, w[49] = sigma1(w[47]) + w[42] + sigma0(w[34]) + w[33]);
+    Round(g, h, a, b, c, d, e, f, 0x2748774c, w[50] = sigma1(w[48]) + w[43] + sigma0(w[35]) + w[34]);
+    Round(f, g, h, a, b, c, d, e, 0x34b0bcb5, w[51] = sigma1(w[49]) + w[44] + sigma0(w[36]) + w[35]);
+    Round(e, f, g, h, a, b, c, d, 0x391c0cb3, w[52] = sigma1(w[50]) + w[45] + sigma0(w[37]) + w[36]);
+    Round(d, e, f, g, h, a, b, c, 0x4ed8aa4a, w[53] = sigma1(w[51]) + w[46] + sigma0(w[38]) + w[37]);
+    Round(c, d, e, f, g, h, a, b, 0x5b9cca4f, w[54] = sigma1(w[52]) + w[47] + sigma0(w[39]) + w[38]);
+    Round(b, c, d, e, f, g, h, a, 0x682e6ff3, w[55] = sigma1(w[53]) + w[48] + sigma0(w[40]) + w[39]);
+    Round(a, b, c, d, e, f, g, h, 0x748f82ee, w[56] = sigma1(w[54]) + w[49] + sigma0(w[41]) + w[40]);
+    Round(h, a, b, c, d, e, f, g, 0x78a5636f, w[57] = sigma1(w[55]) + w[50] + sigma0(w[42]) + w[41]);
+    Round(g, h, a, b, c, d, e, f, 0x84c87814, w[58] = sigma1(w[56]) + w[51] + sigma0(w[43]) + w[42]);
+    Round(f, g, h, a, b, c, d, e, 0x8cc70208, w[59] = sigma1(w[57]) + w[52] + sigma0(w[44]) + w[43]);
+    Round(e, f, g, h, a, b, c, d, 0x90befffa, w[60] = sigma1(w[58]) + w[53] + sigma0(w[45]) + w[44]);
+    Round(d, e, f, g, h, a, b, c, 0xa4506ceb, w[61] = sigma1(w[59]) + w[54] + sigma0(w[46]) + w[45]);
+    Round(c, d, e, f, g, h, a, b, 0xbef9a3f7, w[62] = sigma1(w[60]) + w[55] + sigma0(w[47]) + w[46]);
+    Round(b, c, d, e, f, g, h, a, 0xc67178f2, w[63] = sigma1(w[61]) + w[56] + sigma0(w[48]) + w[47]);
+
+    v[0] = a;
+    v[1] = b;
+    v[2] = c;
+    v[3] = d;
+    v[4] = e;
+    v[5] = f;
+    v[6] = g;
+    v[7] = h;
+}
 } // namespace sha256
 } // namespace
 
@@ -187,3 +288,58 @@ CSHA256& CSHA256::Reset()
     sha256::Initialize(s);
     return *this;
 }
+
+
+////// Double SHA-256 with a shared prefix
+
+CDoubleSHA256Prefix::CDoubleSHA256Prefix()
+{
+    static const unsigned char zero[PREFIX_SIZE] = {0};
+    SetPrefix(zero);
+}
+
+CDoubleSHA256Prefix::CDoubleSHA256Prefix(const unsigned char prefix[PREFIX_SIZE])
+{
+    SetPrefix(prefix);
+}
+
+void CDoubleSHA256Prefix::SetPrefix(const unsigned char prefix[PREFIX_SIZE])
+{
+    // Words 12 (the suffix) and 13 to 15 (padding and length) are filled in
+    // by Finalize(); 16 to 18 of the schedule do not depend on word 12.
+    uint32_t v[16];
+    for (int i = 0; i < 12; i++)
+        v[i] = ReadBE32(prefix + 4 * i);
+    v[12] = 0;
+    v[13] = 0x80000000ul;
+    v[14] = 0;
+    v[15] = (PREFIX_SIZE + SUFFIX_SIZE) * 8;
+    memcpy(w, v, sizeof(v));
+    for (int i = 16; i < 19; i++)
+        w[i] = sha256::Expand(w, i);
+
+    sha256::Initialize(mid);
+    sha256::FirstRounds12(mid, w);
+}
+
+void CDoubleSHA256Prefix::Finalize(const unsigned char suffix[SUFFIX_SIZE], unsigned char hash[OUTPUT_SIZE]) const
+{
+    uint32_t x[64];
+    memcpy(x, w, sizeof(w));
+    x[12] = ReadBE32(suffix);
+
+    uint32_t s[8], v[8];
+    sha256::Initialize(s);
+    memcpy(v, mid, sizeof(v));
+    sha256::LastRounds52(v, x);
+
+    // The first digest and its padding make up the single block of the second hash
+    unsigned char buf[64] = {0};
+    for (int i = 0; i < 8; i++)
+        WriteBE32(buf + 4 * i, s[i] + v[i]);
+    buf[32] = 0x80;
+    buf[62] = 0x01;
+    sha256::Transform(s, buf);
+    for (int i = 0; i < 8; i++)
+        WriteBE32(hash + 4 * i, s[i]);
+}
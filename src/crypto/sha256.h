@@ -25,4 +25,28 @@ public:
     CSHA256& Reset();
 };
 
+/**
+ * Double SHA-256 of many 52 byte messages that share their first 48 bytes.
+ * Such a message and its padding fit in a single block, so the state after
+ * the rounds that only see the shared prefix is computed once and every
+ * message only finishes the remaining rounds and the second hash.
+ */
+class CDoubleSHA256Prefix
+{
+private:
+    uint32_t mid[8];
+    uint32_t w[19];
+
+public:
+    static const size_t PREFIX_SIZE = 48;
+    static const size_t SUFFIX_SIZE = 4;
+    static const size_t OUTPUT_SIZE = 32;
+
+    CDoubleSHA256Prefix();
+    explicit CDoubleSHA256Prefix(const unsigned char prefix[PREFIX_SIZE]);
+    void SetPrefix(const unsigned char prefix[PREFIX_SIZE]);
+    /** SHA256(SHA256(prefix || suffix)) */
+    void Finalize(const unsigned char suffix[SUFFIX_SIZE], unsigned char hash[OUTPUT_SIZE]) const;
+};
+
 #endif // BITCOIN_CRYPTO_SHA256_H
@@ -0,0 +1,204 @@
+// Copyright (c) 2018 The Slingcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/xevan.h"
+
+#include "crypto/sph_blake.h"
+#include "crypto/sph_bmw.h"
+#include "crypto/sph_cubehash.h"
+#include "crypto/sph_echo.h"
+#include "crypto/sph_fugue.h"
+#include "crypto/sph_groestl.h"
+#include "crypto/sph_hamsi.h"
+#include "crypto/sph_haval.h"
+#include "crypto/sph_jh.h"
+#include "crypto/sph_keccak.h"
+#include "crypto/sph_luffa.h"
+#include "crypto/sph_sha2.h"
+#include "crypto/sph_shabal.h"
+#include "crypto/sph_shavite.h"
+#include "crypto/sph_simd.h"
+#include "crypto/sph_skein.h"
+#include "crypto/sph_whirlpool.h"
+
+#include <string.h>
+
+#if defined(ENABLE_AVX2) && (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+#include <cpuid.h>
+#define XEVAN_HAVE_X86_AVX2 1
+#endif
+
+#if defined(XEVAN_HAVE_X86_AVX2)
+namespace xevan_avx2
+{
+void Blake512_80(const unsigned char* in, unsigned char* out);
+void Blake512(const unsigned char* in, unsigned char* out);
+void Bmw512(const unsigned char* in, unsigned char* out);
+void Skein512(const unsigned char* in, unsigned char* out);
+void Keccak512(const unsigned char* in, unsigned char* out);
+}
+#endif
+
+// Internal implementation code.
+namespace
+{
+/** Every XEVAN stage after the first hashes a 128 byte buffer: the previous digest padded with zeros. */
+const size_t WORK_SIZE = 128;
+
+/** Number of stages in one pass; XEVAN runs the chain twice. */
+const int STAGES = 17;
+
+/** A single-message stage: hash len bytes at in, write the digest (at most 64 bytes) to out. */
+typedef void (*StageFn)(const unsigned char* in, size_t len, unsigned char* out);
+
+/**
+ * A multi-lane stage: hash XEVAN_LANES buffers of WORK_SIZE bytes laid out back to back at in,
+ * and write each 64 byte digest to the start of the matching WORK_SIZE slot at out.
+ */
+typedef void (*LaneStageFn)(const unsigned char* in, unsigned char* out);
+
+template <typename Context, void (*Init)(void*), void (*Update)(void*, const void*, size_t), void (*Close)(void*, void*)>
+void SphStage(const unsigned char* in, size_t len, unsigned char* out)
+{
+    Context ctx;
+    Init(&ctx);
+    Update(&ctx, in, len);
+    Close(&ctx, out);
+}
+
+/** The XEVAN chain, in order. */
+const StageFn stages[STAGES] = {
+    SphStage<sph_blake512_context, sph_blake512_init, sph_blake512, sph_blake512_close>,
+    SphStage<sph_bmw512_context, sph_bmw512_init, sph_bmw512, sph_bmw512_close>,
+    SphStage<sph_groestl512_context, sph_groestl512_init, sph_groestl512, sph_groestl512_close>,
+    SphStage<sph_skein512_context, sph_skein512_init, sph_skein512, sph_skein512_close>,
+    SphStage<sph_jh512_context, sph_jh512_init, sph_jh512, sph_jh512_close>,
+    SphStage<sph_keccak512_context, sph_keccak512_init, sph_keccak512, sph_keccak512_close>,
+    SphStage<sph_luffa512_context, sph_luffa512_init, sph_luffa512, sph_luffa512_close>,
+    SphStage<sph_cubehash512_context, sph_cubehash512_init, sph_cubehash512, sph_cubehash512_close>,
+    SphStage<sph_shavite512_context, sph_shavite512_init, sph_shavite512, sph_shavite512_close>,
+    SphStage<sph_simd512_context, sph_simd512_init, sph_simd512, sph_simd512_close>,
+    SphStage<sph_echo512_context, sph_echo512_init, sph_echo512, sph_echo512_close>,
+    SphStage<sph_hamsi512_context, sph_hamsi512_init, sph_hamsi512, sph_hamsi512_close>,
+    SphStage<sph_fugue512_context, sph_fugue512_init, sph_fugue512, sph_fugue512_close>,
+    SphStage<sph_shabal512_context, sph_shabal512_init, sph_shabal512, sph_shabal512_close>,
+    SphStage<sph_whirlpool_context, sph_whirlpool_init, sph_whirlpool, sph_whirlpool_close>,
+    SphStage<sph_sha512_context, sph_sha512_init, sph_sha512, sph_sha512_close>,
+    SphStage<sph_haval256_5_context, sph_haval256_5_init, sph_haval256_5, sph_haval256_5_close>,
+};
+
+/** Multi-lane replacements for entries of stages[]; NULL where no kernel is available. */
+LaneStageFn laneStages[STAGES] = {NULL};
+
+/** Multi-lane kernel for the first stage over 80 byte block headers, if available. */
+LaneStageFn laneHeaderStage = NULL;
+
+/** Run stage i on every lane of work, writing zero-padded results to next. */
+void RunLaneStage(int i, const unsigned char* work, unsigned char* next)
+{
+    memset(next, 0, XEVAN_LANES * WORK_SIZE);
+    if (laneStages[i]) {
+        laneStages[i](work, next);
+        return;
+    }
+    for (size_t lane = 0; lane < XEVAN_LANES; lane++)
+        stages[i](work + lane * WORK_SIZE, WORK_SIZE, next + lane * WORK_SIZE);
+}
+
+/** Hash XEVAN_LANES messages of len bytes each. */
+void XevanLanes(const unsigned char* data, size_t len, unsigned char* out)
+{
+    unsigned char work[2][XEVAN_LANES * WORK_SIZE];
+    unsigned char* cur = work[0];
+    unsigned char* next = work[1];
+
+    memset(cur, 0, sizeof(work[0]));
+    if (len == 80 && laneHeaderStage) {
+        laneHeaderStage(data, cur);
+    } else if (len == WORK_SIZE && laneStages[0]) {
+        laneStages[0](data, cur);
+    } else {
+        for (size_t lane = 0; lane < XEVAN_LANES; lane++)
+            stages[0](data + lane * len, len, cur + lane * WORK_SIZE);
+    }
+
+    for (int round = 1; round < 2 * STAGES; round++) {
+        RunLaneStage(round % STAGES, cur, next);
+        unsigned char* tmp = cur;
+        cur = next;
+        next = tmp;
+    }
+
+    for (size_t lane = 0; lane < XEVAN_LANES; lane++)
+        memcpy(out + lane * XEVAN_OUTPUT_SIZE, cur + lane * WORK_SIZE, XEVAN_OUTPUT_SIZE);
+}
+
+#if defined(XEVAN_HAVE_X86_AVX2)
+/** Check whether the OS saves the AVX register state on context switches. */
+bool AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+
+bool HaveAVX2()
+{
+    uint32_t eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return false;
+    // OSXSAVE and AVX
+    if (!((ecx >> 27) & 1) || !((ecx >> 28) & 1) || !AVXEnabled())
+        return false;
+    if (__get_cpuid_max(0, NULL) < 7)
+        return false;
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    return (ebx >> 5) & 1;
+}
+#endif
+} // namespace
+
+void XevanHash(const unsigned char* data, size_t len, unsigned char hash[XEVAN_OUTPUT_SIZE])
+{
+    unsigned char work[WORK_SIZE];
+    unsigned char next[64];
+
+    memset(work, 0, sizeof(work));
+    stages[0](data, len, work);
+    for (int round = 1; round < 2 * STAGES; round++) {
+        // haval only fills the low half of its output
+        memset(next, 0, sizeof(next));
+        stages[round % STAGES](work, WORK_SIZE, next);
+        memcpy(work, next, sizeof(next));
+    }
+    memcpy(hash, work, XEVAN_OUTPUT_SIZE);
+}
+
+void XevanHashMany(const unsigned char* data, size_t len, size_t n, unsigned char* out)
+{
+    size_t i = 0;
+    for (; i + XEVAN_LANES <= n; i += XEVAN_LANES)
+        XevanLanes(data + i * len, len, out + i * XEVAN_OUTPUT_SIZE);
+    for (; i < n; i++)
+        XevanHash(data + i * len, len, out + i * XEVAN_OUTPUT_SIZE);
+}
+
+std::string XevanAutoDetect()
+{
+    memset(laneStages, 0, sizeof(laneStages));
+    laneHeaderStage = NULL;
+
+#if defined(XEVAN_HAVE_X86_AVX2)
+    if (HaveAVX2()) {
+        laneHeaderStage = xevan_avx2::Blake512_80;
+        laneStages[0] = xevan_avx2::Blake512;
+        laneStages[1] = xevan_avx2::Bmw512;
+        laneStages[3] = xevan_avx2::Skein512;
+        laneStages[5] = xevan_avx2::Keccak512;
+        return "avx2(4way blake,bmw,skein,keccak)";
+    }
+#endif
+
+    return "standard";
+}
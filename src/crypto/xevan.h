@@ -0,0 +1,35 @@
+// Copyright (c) 2018 The Slingcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_XEVAN_H
+#define BITCOIN_CRYPTO_XEVAN_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+
+/** Size in bytes of a XEVAN digest. */
+static const size_t XEVAN_OUTPUT_SIZE = 32;
+
+/** Number of messages the multi-lane kernels hash in one pass. */
+static const size_t XEVAN_LANES = 4;
+
+/** Compute the XEVAN digest of a single message. */
+void XevanHash(const unsigned char* data, size_t len, unsigned char hash[XEVAN_OUTPUT_SIZE]);
+
+/**
+ * Compute the XEVAN digests of n messages that all have the same length.
+ * Message i is read from data + i * len and its digest is written to
+ * out + i * XEVAN_OUTPUT_SIZE. Full groups of XEVAN_LANES messages go
+ * through the multi-lane kernels selected by XevanAutoDetect(); any
+ * remainder is hashed one message at a time. No heap memory is used.
+ */
+void XevanHashMany(const unsigned char* data, size_t len, size_t n, unsigned char* out);
+
+/** Autodetect the best available XEVAN implementation.
+ *  Returns the name of the implementation.
+ */
+std::string XevanAutoDetect();
+
+#endif // BITCOIN_CRYPTO_XEVAN_H
@@ -0,0 +1,464 @@
+// Copyright (c) 2018 The Slingcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// Four-lane AVX2 kernels for the XEVAN stages built on 64-bit add/xor/rotate
+// (blake512, bmw512, skein512, keccak512). Each 256-bit register holds the
+// same state word of four independent messages. The kernels only handle the
+// fixed message lengths XEVAN produces, so padding is folded into constants.
+
+#ifdef ENABLE_AVX2
+
+#include "crypto/common.h"
+
+#include <immintrin.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace xevan_avx2
+{
+namespace
+{
+const size_t LANES = 4;
+const size_t STRIDE = 128;
+
+typedef __m256i V;
+
+inline V K(uint64_t x) { return _mm256_set1_epi64x(x); }
+inline V Add(V a, V b) { return _mm256_add_epi64(a, b); }
+inline V Sub(V a, V b) { return _mm256_sub_epi64(a, b); }
+inline V Xor(V a, V b) { return _mm256_xor_si256(a, b); }
+inline V Or(V a, V b) { return _mm256_or_si256(a, b); }
+inline V AndNot(V a, V b) { return _mm256_andnot_si256(a, b); }
+template <int n> inline V Shl(V x) { return _mm256_slli_epi64(x, n); }
+template <int n> inline V Shr(V x) { return _mm256_srli_epi64(x, n); }
+template <int n> inline V Rotl(V x) { return Or(Shl<n>(x), Shr<64 - n>(x)); }
+template <int n> inline V Rotr(V x) { return Or(Shr<n>(x), Shl<64 - n>(x)); }
+inline V RotlVar(V x, int n) { return Or(_mm256_sllv_epi64(x, K(n)), _mm256_srlv_epi64(x, K(64 - n))); }
+
+/** Gather word w (byte offset 8 * w) of every lane. */
+inline V LoadLE(const unsigned char* in, size_t stride, int w)
+{
+    return _mm256_set_epi64x(ReadLE64(in + 3 * stride + 8 * w), ReadLE64(in + 2 * stride + 8 * w),
+                             ReadLE64(in + stride + 8 * w), ReadLE64(in + 8 * w));
+}
+
+inline V LoadBE(const unsigned char* in, size_t stride, int w)
+{
+    return _mm256_set_epi64x(ReadBE64(in + 3 * stride + 8 * w), ReadBE64(in + 2 * stride + 8 * w),
+                             ReadBE64(in + stride + 8 * w), ReadBE64(in + 8 * w));
+}
+
+inline void StoreLE(unsigned char* out, int w, V x)
+{
+    uint64_t tmp[LANES];
+    _mm256_storeu_si256((V*)tmp, x);
+    for (size_t lane = 0; lane < LANES; lane++)
+        WriteLE64(out + lane * STRIDE + 8 * w, tmp[lane]);
+}
+
+inline void StoreBE(unsigned char* out, int w, V x)
+{
+    uint64_t tmp[LANES];
+    _mm256_storeu_si256((V*)tmp, x);
+    for (size_t lane = 0; lane < LANES; lane++)
+        WriteBE64(out + lane * STRIDE + 8 * w, tmp[lane]);
+}
+
+/** BLAKE-512 */
+namespace blake
+{
+const uint64_t IV[8] = {
+    0x6A09E667F3BCC908ULL, 0xBB67AE8584CAA73BULL, 0x3C6EF372FE94F82BULL, 0xA54FF53A5F1D36F1ULL,
+    0x510E527FADE682D1ULL, 0x9B05688C2B3E6C1FULL, 0x1F83D9ABFB41BD6BULL, 0x5BE0CD19137E2179ULL};
+
+const uint64_t C[16] = {
+    0x243F6A8885A308D3ULL, 0x13198A2E03707344ULL, 0xA4093822299F31D0ULL, 0x082EFA98EC4E6C89ULL,
+    0x452821E638D01377ULL, 0xBE5466CF34E90C6CULL, 0xC0AC29B7C97C50DDULL, 0x3F84D5B5B5470917ULL,
+    0x9216D5D98979FB1BULL, 0xD1310BA698DFB5ACULL, 0x2FFD72DBD01ADFB7ULL, 0xB8E1AFED6A267E96ULL,
+    0xBA7C9045F12C7F99ULL, 0x24A19947B3916CF7ULL, 0x0801F2E2858EFC16ULL, 0x636920D871574E69ULL};
+
+const unsigned char sigma[10][16] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3},
+    {11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4},
+    {7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8},
+    {9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13},
+    {2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9},
+    {12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11},
+    {13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10},
+    {6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5},
+    {10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0}};
+
+inline void G(V& a, V& b, V& c, V& d, const V* m, const unsigned char* s, int i)
+{
+    a = Add(Add(a, b), Xor(m[s[2 * i]], K(C[s[2 * i + 1]])));
+    d = Rotr<32>(Xor(d, a));
+    c = Add(c, d);
+    b = Rotr<25>(Xor(b, c));
+    a = Add(Add(a, b), Xor(m[s[2 * i + 1]], K(C[s[2 * i]])));
+    d = Rotr<16>(Xor(d, a));
+    c = Add(c, d);
+    b = Rotr<11>(Xor(b, c));
+}
+
+/** Compress one block (salt is always zero). */
+void Compress(V h[8], const V m[16], uint64_t t0, uint64_t t1)
+{
+    V v[16];
+    for (int i = 0; i < 8; i++)
+        v[i] = h[i];
+    for (int i = 0; i < 4; i++)
+        v[8 + i] = K(C[i]);
+    v[12] = K(t0 ^ C[4]);
+    v[13] = K(t0 ^ C[5]);
+    v[14] = K(t1 ^ C[6]);
+    v[15] = K(t1 ^ C[7]);
+    for (int r = 0; r < 16; r++) {
+        const unsigned char* s = sigma[r % 10];
+        G(v[0], v[4], v[8], v[12], m, s, 0);
+        G(v[1], v[5], v[9], v[13], m, s, 1);
+        G(v[2], v[6], v[10], v[14], m, s, 2);
+        G(v[3], v[7], v[11], v[15], m, s, 3);
+        G(v[0], v[5], v[10], v[15], m, s, 4);
+        G(v[1], v[6], v[11], v[12], m, s, 5);
+        G(v[2], v[7], v[8], v[13], m, s, 6);
+        G(v[3], v[4], v[9], v[14], m, s, 7);
+    }
+    for (int i = 0; i < 8; i++)
+        h[i] = Xor(h[i], Xor(v[i], v[i + 8]));
+}
+
+void Init(V h[8])
+{
+    for (int i = 0; i < 8; i++)
+        h[i] = K(IV[i]);
+}
+
+void Output(unsigned char* out, const V h[8])
+{
+    for (int i = 0; i < 8; i++)
+        StoreBE(out, i, h[i]);
+}
+} // namespace blake
+
+/** BLUE MIDNIGHT WISH-512 */
+namespace bmw
+{
+const uint64_t IV[16] = {
+    0x8081828384858687ULL, 0x88898A8B8C8D8E8FULL, 0x9091929394959697ULL, 0x98999A9B9C9D9E9FULL,
+    0xA0A1A2A3A4A5A6A7ULL, 0xA8A9AAABACADAEAFULL, 0xB0B1B2B3B4B5B6B7ULL, 0xB8B9BABBBCBDBEBFULL,
+    0xC0C1C2C3C4C5C6C7ULL, 0xC8C9CACBCCCDCECFULL, 0xD0D1D2D3D4D5D6D7ULL, 0xD8D9DADBDCDDDEDFULL,
+    0xE0E1E2E3E4E5E6E7ULL, 0xE8E9EAEBECEDEEEFULL, 0xF0F1F2F3F4F5F6F7ULL, 0xF8F9FAFBFCFDFEFFULL};
+
+inline V S0(V x) { return Xor(Xor(Shr<1>(x), Shl<3>(x)), Xor(Rotl<4>(x), Rotl<37>(x))); }
+inline V S1(V x) { return Xor(Xor(Shr<1>(x), Shl<2>(x)), Xor(Rotl<13>(x), Rotl<43>(x))); }
+inline V S2(V x) { return Xor(Xor(Shr<2>(x), Shl<1>(x)), Xor(Rotl<19>(x), Rotl<53>(x))); }
+inline V S3(V x) { return Xor(Xor(Shr<2>(x), Shl<2>(x)), Xor(Rotl<28>(x), Rotl<59>(x))); }
+inline V S4(V x) { return Xor(Shr<1>(x), x); }
+inline V S5(V x) { return Xor(Shr<2>(x), x); }
+
+inline V AddElt(const V* m, const V* h, int j)
+{
+    int j3 = (j + 3) & 15, j10 = (j + 10) & 15;
+    V t = Sub(Add(RotlVar(m[j], j + 1), RotlVar(m[j3], j3 + 1)), RotlVar(m[j10], j10 + 1));
+    return Xor(Add(t, K((uint64_t)(j + 16) * 0x0555555555555555ULL)), h[(j + 7) & 15]);
+}
+
+void Compress(const V m[16], const V h[16], V dh[16])
+{
+    V x[16], w[16], q[32];
+    for (int i = 0; i < 16; i++)
+        x[i] = Xor(m[i], h[i]);
+
+    w[0] = Add(Add(Add(Sub(x[5], x[7]), x[10]), x[13]), x[14]);
+    w[1] = Sub(Add(Add(Sub(x[6], x[8]), x[11]), x[14]), x[15]);
+    w[2] = Add(Sub(Add(Add(x[0], x[7]), x[9]), x[12]), x[15]);
+    w[3] = Add(Sub(Add(Sub(x[0], x[1]), x[8]), x[10]), x[13]);
+    w[4] = Sub(Sub(Add(Add(x[1], x[2]), x[9]), x[11]), x[14]);
+    w[5] = Add(Sub(Add(Sub(x[3], x[2]), x[10]), x[12]), x[15]);
+    w[6] = Add(Sub(Sub(Sub(x[4], x[0]), x[3]), x[11]), x[13]);
+    w[7] = Sub(Sub(Sub(Sub(x[1], x[4]), x[5]), x[12]), x[14]);
+    w[8] = Sub(Add(Sub(Sub(x[2], x[5]), x[6]), x[13]), x[15]);
+    w[9] = Add(Sub(Add(Sub(x[0], x[3]), x[6]), x[7]), x[14]);
+    w[10] = Add(Sub(Sub(Sub(x[8], x[1]), x[4]), x[7]), x[15]);
+    w[11] = Add(Sub(Sub(Sub(x[8], x[0]), x[2]), x[5]), x[9]);
+    w[12] = Add(Sub(Sub(Add(x[1], x[3]), x[6]), x[9]), x[10]);
+    w[13] = Add(Add(Add(Add(x[2], x[4]), x[7]), x[10]), x[11]);
+    w[14] = Sub(Sub(Add(Sub(x[3], x[5]), x[8]), x[11]), x[12]);
+    w[15] = Add(Sub(Sub(Sub(x[12], x[4]), x[6]), x[9]), x[13]);
+
+    for (int i = 0; i < 15; i += 5) {
+        q[i + 0] = Add(S0(w[i + 0]), h[i + 1]);
+        q[i + 1] = Add(S1(w[i + 1]), h[i + 2]);
+        q[i + 2] = Add(S2(w[i + 2]), h[i + 3]);
+        q[i + 3] = Add(S3(w[i + 3]), h[i + 4]);
+        q[i + 4] = Add(S4(w[i + 4]), h[i + 5]);
+    }
+    q[15] = Add(S0(w[15]), h[0]);
+
+    for (int i = 16; i < 18; i++) {
+        V t = AddElt(m, h, i - 16);
+        for (int k = 0; k < 16; k += 4) {
+            t = Add(t, S1(q[i - 16 + k]));
+            t = Add(t, S2(q[i - 15 + k]));
+            t = Add(t, S3(q[i - 14 + k]));
+            t = Add(t, S0(q[i - 13 + k]));
+        }
+        q[i] = t;
+    }
+    for (int i = 18; i < 32; i++) {
+        V t = AddElt(m, h, i - 16);
+        t = Add(t, Add(q[i - 16], Rotl<5>(q[i - 15])));
+        t = Add(t, Add(q[i - 14], Rotl<11>(q[i - 13])));
+        t = Add(t, Add(q[i - 12], Rotl<27>(q[i - 11])));
+        t = Add(t, Add(q[i - 10], Rotl<32>(q[i - 9])));
+        t = Add(t, Add(q[i - 8], Rotl<37>(q[i - 7])));
+        t = Add(t, Add(q[i - 6], Rotl<43>(q[i - 5])));
+        t = Add(t, Add(q[i - 4], Rotl<53>(q[i - 3])));
+        t = Add(t, Add(S4(q[i - 2]), S5(q[i - 1])));
+        q[i] = t;
+    }
+
+    V xl = Xor(Xor(Xor(q[16], q[17]), Xor(q[18], q[19])), Xor(Xor(q[20], q[21]), Xor(q[22], q[23])));
+    V xh = Xor(xl, Xor(Xor(Xor(q[24], q[25]), Xor(q[26], q[27])), Xor(Xor(q[28], q[29]), Xor(q[30], q[31]))));
+
+    dh[0] = Add(Xor(Xor(Shl<5>(xh), Shr<5>(q[16])), m[0]), Xor(Xor(xl, q[24]), q[0]));
+    dh[1] = Add(Xor(Xor(Shr<7>(xh), Shl<8>(q[17])), m[1]), Xor(Xor(xl, q[25]), q[1]));
+    dh[2] = Add(Xor(Xor(Shr<5>(xh), Shl<5>(q[18])), m[2]), Xor(Xor(xl, q[26]), q[2]));
+    dh[3] = Add(Xor(Xor(Shr<1>(xh), Shl<5>(q[19])), m[3]), Xor(Xor(xl, q[27]), q[3]));
+    dh[4] = Add(Xor(Xor(Shr<3>(xh), q[20]), m[4]), Xor(Xor(xl, q[28]), q[4]));
+    dh[5] = Add(Xor(Xor(Shl<6>(xh), Shr<6>(q[21])), m[5]), Xor(Xor(xl, q[29]), q[5]));
+    dh[6] = Add(Xor(Xor(Shr<4>(xh), Shl<6>(q[22])), m[6]), Xor(Xor(xl, q[30]), q[6]));
+    dh[7] = Add(Xor(Xor(Shr<11>(xh), Shl<2>(q[23])), m[7]), Xor(Xor(xl, q[31]), q[7]));
+    dh[8] = Add(Add(Rotl<9>(dh[4]), Xor(Xor(xh, q[24]), m[8])), Xor(Xor(Shl<8>(xl), q[23]), q[8]));
+    dh[9] = Add(Add(Rotl<10>(dh[5]), Xor(Xor(xh, q[25]), m[9])), Xor(Xor(Shr<6>(xl), q[16]), q[9]));
+    dh[10] = Add(Add(Rotl<11>(dh[6]), Xor(Xor(xh, q[26]), m[10])), Xor(Xor(Shl<6>(xl), q[17]), q[10]));
+    dh[11] = Add(Add(Rotl<12>(dh[7]), Xor(Xor(xh, q[27]), m[11])), Xor(Xor(Shl<4>(xl), q[18]), q[11]));
+    dh[12] = Add(Add(Rotl<13>(dh[0]), Xor(Xor(xh, q[28]), m[12])), Xor(Xor(Shr<3>(xl), q[19]), q[12]));
+    dh[13] = Add(Add(Rotl<14>(dh[1]), Xor(Xor(xh, q[29]), m[13])), Xor(Xor(Shr<4>(xl), q[20]), q[13]));
+    dh[14] = Add(Add(Rotl<15>(dh[2]), Xor(Xor(xh, q[30]), m[14])), Xor(Xor(Shr<7>(xl), q[21]), q[14]));
+    dh[15] = Add(Add(Rotl<16>(dh[3]), Xor(Xor(xh, q[31]), m[15])), Xor(Xor(Shr<2>(xl), q[22]), q[15]));
+}
+} // namespace bmw
+
+/** Skein-512-512 (Threefish-512 in UBI mode) */
+namespace skein
+{
+const uint64_t IV[8] = {
+    0x4903ADFF749C51CEULL, 0x0D95DE399746DF03ULL, 0x8FD1934127C79BCEULL, 0x9A255629FF352CB1ULL,
+    0x5DB62599DF6CA7B0ULL, 0xEABE394CA9D5C3F4ULL, 0x991112C71A75B523ULL, 0xAE18A40B660FCC33ULL};
+
+inline void Mix(V& x0, V& x1, int rc)
+{
+    x0 = Add(x0, x1);
+    x1 = Xor(RotlVar(x1, rc), x0);
+}
+
+/** Four Threefish rounds: the word permutation repeats every four rounds. */
+inline void Rounds4(V* p, const int* rc)
+{
+    Mix(p[0], p[1], rc[0]);
+    Mix(p[2], p[3], rc[1]);
+    Mix(p[4], p[5], rc[2]);
+    Mix(p[6], p[7], rc[3]);
+    Mix(p[2], p[1], rc[4]);
+    Mix(p[4], p[7], rc[5]);
+    Mix(p[6], p[5], rc[6]);
+    Mix(p[0], p[3], rc[7]);
+    Mix(p[4], p[1], rc[8]);
+    Mix(p[6], p[3], rc[9]);
+    Mix(p[0], p[5], rc[10]);
+    Mix(p[2], p[7], rc[11]);
+    Mix(p[6], p[1], rc[12]);
+    Mix(p[0], p[7], rc[13]);
+    Mix(p[2], p[5], rc[14]);
+    Mix(p[4], p[3], rc[15]);
+}
+
+const int RC_EVEN[16] = {46, 36, 19, 37, 33, 27, 14, 42, 17, 49, 36, 39, 44, 9, 54, 56};
+const int RC_ODD[16] = {39, 30, 34, 24, 13, 50, 10, 17, 25, 29, 39, 43, 8, 35, 56, 22};
+
+inline void AddKey(V* p, const V* k, const uint64_t* t, int s)
+{
+    for (int i = 0; i < 8; i++)
+        p[i] = Add(p[i], k[(s + i) % 9]);
+    p[5] = Add(p[5], K(t[s % 3]));
+    p[6] = Add(p[6], K(t[(s + 1) % 3]));
+    p[7] = Add(p[7], K(s));
+}
+
+/** One UBI block: h = E(h, tweak, m) ^ m. */
+void Ubi(V h[8], const V m[8], uint64_t t0, uint64_t t1)
+{
+    V k[9], p[8];
+    const uint64_t t[3] = {t0, t1, t0 ^ t1};
+    k[8] = K(0x1BD11BDAA9FC1A22ULL);
+    for (int i = 0; i < 8; i++) {
+        k[i] = h[i];
+        k[8] = Xor(k[8], h[i]);
+        p[i] = m[i];
+    }
+    for (int s = 0; s < 18; s += 2) {
+        AddKey(p, k, t, s);
+        Rounds4(p, RC_EVEN);
+        AddKey(p, k, t, s + 1);
+        Rounds4(p, RC_ODD);
+    }
+    AddKey(p, k, t, 18);
+    for (int i = 0; i < 8; i++)
+        h[i] = Xor(m[i], p[i]);
+}
+} // namespace skein
+
+/** Keccak-512 (original padding, as in sph_keccak) */
+namespace keccak
+{
+const uint64_t RC[24] = {
+    0x0000000000000001ULL, 0x0000000000008082ULL, 0x800000000000808AULL, 0x8000000080008000ULL,
+    0x000000000000808BULL, 0x0000000080000001ULL, 0x8000000080008081ULL, 0x8000000000008009ULL,
+    0x000000000000008AULL, 0x0000000000000088ULL, 0x0000000080008009ULL, 0x000000008000000AULL,
+    0x000000008000808BULL, 0x800000000000008BULL, 0x8000000000008089ULL, 0x8000000000008003ULL,
+    0x8000000000008002ULL, 0x8000000000000080ULL, 0x000000000000800AULL, 0x800000008000000AULL,
+    0x8000000080008081ULL, 0x8000000000008080ULL, 0x0000000080000001ULL, 0x8000000080008008ULL};
+
+const int ROTC[24] = {1, 3, 6, 10, 15, 21, 28, 36, 45, 55, 2, 14, 27, 41, 56, 8, 25, 43, 62, 18, 39, 61, 20, 44};
+const int PILN[24] = {10, 7, 11, 17, 18, 3, 5, 16, 8, 21, 24, 4, 15, 23, 19, 13, 12, 2, 20, 14, 22, 9, 6, 1};
+
+/** Rate of Keccak-512 in 64-bit words. */
+const int RATE = 9;
+
+void Permute(V a[25])
+{
+    V c[5];
+    for (int r = 0; r < 24; r++) {
+        // theta
+        for (int x = 0; x < 5; x++)
+            c[x] = Xor(Xor(Xor(a[x], a[x + 5]), Xor(a[x + 10], a[x + 15])), a[x + 20]);
+        for (int x = 0; x < 5; x++) {
+            V d = Xor(c[(x + 4) % 5], Rotl<1>(c[(x + 1) % 5]));
+            for (int y = 0; y < 25; y += 5)
+                a[y + x] = Xor(a[y + x], d);
+        }
+        // rho and pi
+        V t = a[1];
+        for (int i = 0; i < 24; i++) {
+            int j = PILN[i];
+            V tmp = a[j];
+            a[j] = RotlVar(t, ROTC[i]);
+            t = tmp;
+        }
+        // chi
+        for (int y = 0; y < 25; y += 5) {
+            for (int x = 0; x < 5; x++)
+                c[x] = a[y + x];
+            for (int x = 0; x < 5; x++)
+                a[y + x] = Xor(c[x], AndNot(c[(x + 1) % 5], c[(x + 2) % 5]));
+        }
+        // iota
+        a[0] = Xor(a[0], K(RC[r]));
+    }
+}
+} // namespace keccak
+} // namespace
+
+/** blake512 over four 80 byte block headers stored back to back. */
+void Blake512_80(const unsigned char* in, unsigned char* out)
+{
+    V h[8], m[16];
+    blake::Init(h);
+    for (int i = 0; i < 10; i++)
+        m[i] = LoadBE(in, 80, i);
+    m[10] = K(0x8000000000000000ULL);
+    m[11] = m[12] = K(0);
+    m[13] = K(1);
+    m[14] = K(0);
+    m[15] = K(640);
+    blake::Compress(h, m, 640, 0);
+    blake::Output(out, h);
+}
+
+void Blake512(const unsigned char* in, unsigned char* out)
+{
+    V h[8], m[16];
+    blake::Init(h);
+    for (int i = 0; i < 16; i++)
+        m[i] = LoadBE(in, STRIDE, i);
+    blake::Compress(h, m, 1024, 0);
+    m[0] = K(0x8000000000000000ULL);
+    for (int i = 1; i < 16; i++)
+        m[i] = K(0);
+    m[13] = K(1);
+    m[15] = K(1024);
+    blake::Compress(h, m, 0, 0);
+    blake::Output(out, h);
+}
+
+void Bmw512(const unsigned char* in, unsigned char* out)
+{
+    static const uint64_t FINAL[16] = {
+        0xaaaaaaaaaaaaaaa0ULL, 0xaaaaaaaaaaaaaaa1ULL, 0xaaaaaaaaaaaaaaa2ULL, 0xaaaaaaaaaaaaaaa3ULL,
+        0xaaaaaaaaaaaaaaa4ULL, 0xaaaaaaaaaaaaaaa5ULL, 0xaaaaaaaaaaaaaaa6ULL, 0xaaaaaaaaaaaaaaa7ULL,
+        0xaaaaaaaaaaaaaaa8ULL, 0xaaaaaaaaaaaaaaa9ULL, 0xaaaaaaaaaaaaaaaaULL, 0xaaaaaaaaaaaaaaabULL,
+        0xaaaaaaaaaaaaaaacULL, 0xaaaaaaaaaaaaaaadULL, 0xaaaaaaaaaaaaaaaeULL, 0xaaaaaaaaaaaaaaafULL};
+    V h[16], m[16], h1[16], h2[16];
+    for (int i = 0; i < 16; i++) {
+        h[i] = K(bmw::IV[i]);
+        m[i] = LoadLE(in, STRIDE, i);
+    }
+    bmw::Compress(m, h, h1);
+
+    // padding block: 0x80 then the 1024 bit message length
+    m[0] = K(0x80);
+    for (int i = 1; i < 15; i++)
+        m[i] = K(0);
+    m[15] = K(1024);
+    bmw::Compress(m, h1, h2);
+
+    for (int i = 0; i < 16; i++)
+        h[i] = K(FINAL[i]);
+    bmw::Compress(h2, h, h1);
+    for (int i = 0; i < 8; i++)
+        StoreLE(out, i, h1[8 + i]);
+}
+
+void Skein512(const unsigned char* in, unsigned char* out)
+{
+    V h[8], m[8];
+    for (int i = 0; i < 8; i++) {
+        h[i] = K(skein::IV[i]);
+        m[i] = LoadLE(in, STRIDE, i);
+    }
+    // message type, first block
+    skein::Ubi(h, m, 64, 224ULL << 55);
+    for (int i = 0; i < 8; i++)
+        m[i] = LoadLE(in + 64, STRIDE, i);
+    // message type, final block
+    skein::Ubi(h, m, 128, 352ULL << 55);
+    for (int i = 0; i < 8; i++)
+        m[i] = K(0);
+    // output type, first and final block
+    skein::Ubi(h, m, 8, 510ULL << 55);
+    for (int i = 0; i < 8; i++)
+        StoreLE(out, i, h[i]);
+}
+
+void Keccak512(const unsigned char* in, unsigned char* out)
+{
+    V a[25];
+    for (int i = 0; i < 25; i++)
+        a[i] = K(0);
+    for (int i = 0; i < keccak::RATE; i++)
+        a[i] = LoadLE(in, STRIDE, i);
+    keccak::Permute(a);
+    for (int i = 0; i < 7; i++)
+        a[i] = Xor(a[i], LoadLE(in, STRIDE, keccak::RATE + i));
+    a[7] = Xor(a[7], K(0x01));
+    a[8] = Xor(a[8], K(0x8000000000000000ULL));
+    keccak::Permute(a);
+    for (int i = 0; i < 8; i++)
+        StoreLE(out, i, a[i]);
+}
+} // namespace xevan_avx2
+
+#endif // ENABLE_AVX2
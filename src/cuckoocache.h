@@ -0,0 +1,239 @@
+// Copyright (c) 2018 The Slingcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CUCKOOCACHE_H
+#define BITCOIN_CUCKOOCACHE_H
+
+#include "crypto/common.h"
+#include "uint256.h"
+
+#include <atomic>
+#include <string.h>
+#include <vector>
+
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+
+/**
+ * Fixed size set of 256-bit keys, for remembering which expensive checks
+ * already passed. Keys must be uniformly distributed (salted hashes): their
+ * bytes pick the shard and the candidate slots directly.
+ *
+ * Lookups take no locks. Every slot has a sequence number that a writer
+ * keeps odd while it rewrites the key, so a lookup racing with a write
+ * sees a miss rather than a torn key. Writers lock one of SHARDS tables.
+ *
+ * A key can live in one of WAYS slots of its shard. When all of them are
+ * taken, inserting moves an occupant to one of its other slots, cuckoo
+ * style, and drops the last one moved if no free slot turns up.
+ */
+class CCuckooCache
+{
+public:
+    static const int SHARDS = 16;
+    //! Candidate slots per key, one for each 32-bit word of the key
+    static const int WAYS = 8;
+
+    struct Stats {
+        size_t nSlots;
+        size_t nBytes;
+        uint64_t nHits;
+        uint64_t nMisses;
+        uint64_t nInserts;
+        uint64_t nEvictions;
+    };
+
+    CCuckooCache() : nMaxDepth(0) {}
+
+    /**
+     * Drop all entries and size the cache to (at most) nBytes of slots.
+     * Must not run concurrently with any other method.
+     * @return the number of slots
+     */
+    size_t Setup(size_t nBytes)
+    {
+        size_t nPerShard = nBytes / sizeof(Slot) / SHARDS;
+        nMaxDepth = 0;
+        while (((size_t)1 << nMaxDepth) < nPerShard)
+            nMaxDepth++;
+        for (int i = 0; i < SHARDS; i++) {
+            std::vector<Slot>(nPerShard).swap(shards[i].vSlots);
+            shards[i].nHits = 0;
+            shards[i].nMisses = 0;
+            shards[i].nInserts = 0;
+            shards[i].nEvictions = 0;
+        }
+        return nPerShard * SHARDS;
+    }
+
+    /**
+     * Whether key is in the cache. With fErase the slot may be reused by
+     * later inserts, but the key keeps matching until it's overwritten.
+     */
+    bool Contains(const uint256& key, bool fErase)
+    {
+        uint32_t vWords[8];
+        GetWords(key, vWords);
+        Shard& shard = shards[vWords[0] % SHARDS];
+        size_t vPos[WAYS];
+        GetPositions(vWords, shard.vSlots.size(), vPos);
+        for (int i = 0; i < WAYS && !shard.vSlots.empty(); i++) {
+            Slot& slot = shard.vSlots[vPos[i]];
+            if (slot.Matches(vWords)) {
+                if (fErase)
+                    slot.fCollectable.store(true, std::memory_order_relaxed);
+                shard.nHits.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        shard.nMisses.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    void Insert(const uint256& key)
+    {
+        uint32_t vWords[8];
+        GetWords(key, vWords);
+        Shard& shard = shards[vWords[0] % SHARDS];
+        if (shard.vSlots.empty())
+            return;
+
+        boost::lock_guard<boost::mutex> lock(shard.cs);
+        shard.nInserts.fetch_add(1, std::memory_order_relaxed);
+
+        size_t nLast = shard.vSlots.size();
+        for (int nDepth = 0; nDepth <= nMaxDepth; nDepth++) {
+            size_t vPos[WAYS];
+            GetPositions(vWords, shard.vSlots.size(), vPos);
+            for (int i = 0; i < WAYS; i++) {
+                if (shard.vSlots[vPos[i]].Equals(vWords)) {
+                    shard.vSlots[vPos[i]].Write(vWords);
+                    return;
+                }
+            }
+            for (int i = 0; i < WAYS; i++) {
+                if (shard.vSlots[vPos[i]].fCollectable.load(std::memory_order_relaxed)) {
+                    shard.vSlots[vPos[i]].Write(vWords);
+                    return;
+                }
+            }
+
+            // Take the way after the one the key was pushed out of, so that
+            // two entries don't keep swapping the same slot between them
+            int nWay = 0;
+            for (int i = 0; i < WAYS; i++) {
+                if (vPos[i] == nLast) {
+                    nWay = (i + 1) % WAYS;
+                    break;
+                }
+            }
+            nLast = vPos[nWay];
+            uint32_t vDisplaced[8];
+            shard.vSlots[nLast].Read(vDisplaced);
+            shard.vSlots[nLast].Write(vWords);
+            memcpy(vWords, vDisplaced, sizeof(vWords));
+        }
+        shard.nEvictions.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    Stats GetStats() const
+    {
+        Stats stats;
+        stats.nSlots = 0;
+        stats.nHits = stats.nMisses = stats.nInserts = stats.nEvictions = 0;
+        for (int i = 0; i < SHARDS; i++) {
+            stats.nSlots += shards[i].vSlots.size();
+            stats.nHits += shards[i].nHits.load(std::memory_order_relaxed);
+            stats.nMisses += shards[i].nMisses.load(std::memory_order_relaxed);
+            stats.nInserts += shards[i].nInserts.load(std::memory_order_relaxed);
+            stats.nEvictions += shards[i].nEvictions.load(std::memory_order_relaxed);
+        }
+        stats.nBytes = stats.nSlots * sizeof(Slot);
+        return stats;
+    }
+
+private:
+    struct Slot {
+        //! Even when the key is stable, 0 while the slot was never written
+        std::atomic<uint32_t> nSequence;
+        std::atomic<bool> fCollectable;
+        std::atomic<uint32_t> vKey[8];
+
+        Slot() : nSequence(0), fCollectable(true)
+        {
+            for (int i = 0; i < 8; i++)
+                vKey[i].store(0, std::memory_order_relaxed);
+        }
+
+        bool Matches(const uint32_t* vWords) const
+        {
+            uint32_t nSeq = nSequence.load(std::memory_order_acquire);
+            if (nSeq == 0 || (nSeq & 1))
+                return false;
+            bool fMatch = true;
+            for (int i = 0; i < 8; i++)
+                fMatch &= vKey[i].load(std::memory_order_relaxed) == vWords[i];
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return fMatch && nSequence.load(std::memory_order_relaxed) == nSeq;
+        }
+
+        //! Only for writers, which hold the shard lock
+        bool Equals(const uint32_t* vWords) const
+        {
+            if (nSequence.load(std::memory_order_relaxed) == 0)
+                return false;
+            for (int i = 0; i < 8; i++) {
+                if (vKey[i].load(std::memory_order_relaxed) != vWords[i])
+                    return false;
+            }
+            return true;
+        }
+
+        void Read(uint32_t* vWords) const
+        {
+            for (int i = 0; i < 8; i++)
+                vWords[i] = vKey[i].load(std::memory_order_relaxed);
+        }
+
+        void Write(const uint32_t* vWords)
+        {
+            uint32_t nSeq = nSequence.load(std::memory_order_relaxed);
+            nSequence.store(nSeq + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            for (int i = 0; i < 8; i++)
+                vKey[i].store(vWords[i], std::memory_order_relaxed);
+            fCollectable.store(false, std::memory_order_relaxed);
+            nSequence.store(nSeq + 2, std::memory_order_release);
+        }
+    };
+
+    struct Shard {
+        boost::mutex cs;
+        std::vector<Slot> vSlots;
+        std::atomic<uint64_t> nHits;
+        std::atomic<uint64_t> nMisses;
+        std::atomic<uint64_t> nInserts;
+        std::atomic<uint64_t> nEvictions;
+
+        Shard() : nHits(0), nMisses(0), nInserts(0), nEvictions(0) {}
+    };
+
+    Shard shards[SHARDS];
+    //! Moves an insert may make before it gives up on the displaced entry
+    int nMaxDepth;
+
+    static void GetWords(const uint256& key, uint32_t* vWords)
+    {
+        for (int i = 0; i < 8; i++)
+            vWords[i] = ReadLE32(key.begin() + 4 * i);
+    }
+
+    static void GetPositions(const uint32_t* vWords, size_t nSize, size_t* vPos)
+    {
+        for (int i = 0; i < WAYS; i++)
+            vPos[i] = ((uint64_t)vWords[i] * nSize) >> 32;
+    }
+};
+
+#endif // BITCOIN_CUCKOOCACHE_H
@@ -72,6 +72,57 @@ unsigned int MurmurHash3(unsigned int nHashSeed, const std::vector<unsigned char
     return h1;
 }
 
+#define ROTL64(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPROUND                                 \
+    do {                                         \
+        v0 += v1;                                \
+        v1 = ROTL64(v1, 13);                     \
+        v1 ^= v0;                                \
+        v0 = ROTL64(v0, 32);                     \
+        v2 += v3;                                \
+        v3 = ROTL64(v3, 16);                     \
+        v3 ^= v2;                                \
+        v0 += v3;                                \
+        v3 = ROTL64(v3, 21);                     \
+        v3 ^= v0;                                \
+        v2 += v1;                                \
+        v1 = ROTL64(v1, 17);                     \
+        v1 ^= v2;                                \
+        v2 = ROTL64(v2, 32);                     \
+    } while (0)
+
+uint64_t SipHashUint256(uint64_t k0, uint64_t k1, const uint256& val)
+{
+    // SipHash-2-4, see https://131002.net/siphash/, unrolled for a 32 byte message
+    uint64_t v0 = 0x736f6d6570736575ULL ^ k0;
+    uint64_t v1 = 0x646f72616e646f6dULL ^ k1;
+    uint64_t v2 = 0x6c7967656e657261ULL ^ k0;
+    uint64_t v3 = 0x7465646279746573ULL ^ k1;
+
+    for (int i = 0; i < 4; i++) {
+        uint64_t m = val.Get64(i);
+        v3 ^= m;
+        SIPROUND;
+        SIPROUND;
+        v0 ^= m;
+    }
+
+    // Final block: just the message length
+    uint64_t m = ((uint64_t)32) << 56;
+    v3 ^= m;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= m;
+
+    v2 ^= 0xFF;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
 void BIP32Hash(const unsigned char chainCode[32], unsigned int nChild, unsigned char header, const unsigned char data[32], unsigned char output[64])
 {
     unsigned char num[4];
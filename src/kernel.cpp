@@ -6,8 +6,11 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <boost/assign/list_of.hpp>
+#include <boost/bind.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
 
+#include "crypto/common.h"
 #include "db.h"
 #include "kernel.h"
 #include "script/interpreter.h"
@@ -22,6 +25,7 @@ bool fTestNet = false; //Params().NetworkID() == CBaseChainParams::TESTNET;
 // Set to 3-hour for production network and 20-minute for test network
 unsigned int nModifierInterval;
 int nStakeTargetSpacing = 60;
+int nStakeThreads = 1;
 unsigned int getIntervalVersion(bool fTestNet)
 {
     if (fTestNet)
@@ -241,35 +245,103 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeMod
     return true;
 }
 
+// Index of the blocks of chainActive that generated a stake modifier, in
+// height order, so that kernel checks do not have to walk the chain
+namespace
+{
+struct CStakeModifierEntry {
+    const CBlockIndex* pindex;
+    // Largest block time of this and all earlier entries
+    int64_t nMaxTime;
+};
+
+CCriticalSection cs_stakeModifierIndex;
+std::vector<CStakeModifierEntry> vStakeModifierIndex;
+// Last block of chainActive that vStakeModifierIndex covers
+const CBlockIndex* pindexStakeModifierIndexed = NULL;
+
+bool CompareStakeModifierHeight(int nHeight, const CStakeModifierEntry& entry)
+{
+    return nHeight < entry.pindex->nHeight;
+}
+
+bool CompareStakeModifierMaxTime(const CStakeModifierEntry& entry, int64_t nTime)
+{
+    return entry.nMaxTime < nTime;
+}
+
+void SyncStakeModifierIndex()
+{
+    AssertLockHeld(cs_stakeModifierIndex);
+
+    // Rewind to the fork point with chainActive
+    while (pindexStakeModifierIndexed && !chainActive.Contains(pindexStakeModifierIndexed))
+        pindexStakeModifierIndexed = pindexStakeModifierIndexed->pprev;
+    int nHeight = pindexStakeModifierIndexed ? pindexStakeModifierIndexed->nHeight : -1;
+    while (!vStakeModifierIndex.empty() && vStakeModifierIndex.back().pindex->nHeight > nHeight)
+        vStakeModifierIndex.pop_back();
+
+    // and extend up to the tip
+    for (const CBlockIndex* pindex = chainActive[nHeight + 1]; pindex; pindex = chainActive.Next(pindex)) {
+        if (pindex->GeneratedStakeModifier()) {
+            CStakeModifierEntry entry;
+            entry.pindex = pindex;
+            entry.nMaxTime = pindex->GetBlockTime();
+            if (!vStakeModifierIndex.empty())
+                entry.nMaxTime = std::max(entry.nMaxTime, vStakeModifierIndex.back().nMaxTime);
+            vStakeModifierIndex.push_back(entry);
+        }
+        pindexStakeModifierIndexed = pindex;
+    }
+}
+} // anonymous namespace
+
+void UpdateStakeModifierIndex()
+{
+    LOCK(cs_stakeModifierIndex);
+    SyncStakeModifierIndex();
+}
+
 // The stake modifier used to hash for a stake kernel is chosen as the stake
-// modifier about a selection interval later than the coin generating the kernel
-bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifier, int& nStakeModifierHeight, int64_t& nStakeModifierTime, bool fPrintProofOfStake)
+// modifier about a selection interval later than the coin generating the kernel:
+// the modifier of the first block after it on chainActive that generated one
+// at least a selection interval after it.
+static bool GetKernelStakeModifier(const CBlockIndex* pindexFrom, uint64_t& nStakeModifier, int& nStakeModifierHeight, int64_t& nStakeModifierTime, bool fPrintProofOfStake)
 {
     nStakeModifier = 0;
-    if (!mapBlockIndex.count(hashBlockFrom))
+    if (!pindexFrom)
         return error("GetKernelStakeModifier() : block not indexed");
-    const CBlockIndex* pindexFrom = mapBlockIndex[hashBlockFrom];
     nStakeModifierHeight = pindexFrom->nHeight;
     nStakeModifierTime = pindexFrom->GetBlockTime();
-    int64_t nStakeModifierSelectionInterval = GetStakeModifierSelectionInterval();
-    const CBlockIndex* pindex = pindexFrom;
-    CBlockIndex* pindexNext = chainActive[pindexFrom->nHeight + 1];
-
-    // loop to find the stake modifier later by a selection interval
-    while (nStakeModifierTime < pindexFrom->GetBlockTime() + nStakeModifierSelectionInterval) {
-        if (!pindexNext) {
-            // Should never happen
-            return error("Null pindexNext\n");
-        }
+    int64_t nSelectionTime = pindexFrom->GetBlockTime() + GetStakeModifierSelectionInterval();
+    if (nStakeModifierTime >= nSelectionTime) {
+        nStakeModifier = pindexFrom->nStakeModifier;
+        return true;
+    }
 
-        pindex = pindexNext;
-        pindexNext = chainActive[pindexNext->nHeight + 1];
-        if (pindex->GeneratedStakeModifier()) {
-            nStakeModifierHeight = pindex->nHeight;
-            nStakeModifierTime = pindex->GetBlockTime();
-        }
+    LOCK(cs_stakeModifierIndex);
+    if (pindexStakeModifierIndexed != chainActive.Tip())
+        SyncStakeModifierIndex();
+
+    std::vector<CStakeModifierEntry>::iterator it = std::upper_bound(vStakeModifierIndex.begin(),
+        vStakeModifierIndex.end(), pindexFrom->nHeight, CompareStakeModifierHeight);
+    if (it == vStakeModifierIndex.begin() || (it - 1)->nMaxTime < nSelectionTime) {
+        // No earlier entry reaches nSelectionTime, so the first entry whose
+        // running maximum does is the first one that is late enough itself
+        it = std::lower_bound(it, vStakeModifierIndex.end(), nSelectionTime, CompareStakeModifierMaxTime);
+    } else {
+        // Block times went backwards past nSelectionTime; search linearly
+        while (it != vStakeModifierIndex.end() && it->pindex->GetBlockTime() < nSelectionTime)
+            ++it;
     }
-    nStakeModifier = pindex->nStakeModifier;
+    if (it == vStakeModifierIndex.end()) {
+        // Should never happen
+        return error("Null pindexNext\n");
+    }
+
+    nStakeModifierHeight = it->pindex->nHeight;
+    nStakeModifierTime = it->pindex->GetBlockTime();
+    nStakeModifier = it->pindex->nStakeModifier;
     return true;
 }
 
@@ -290,118 +362,246 @@ bool stakeTargetHit(uint256 hashProofOfStake, int64_t nValueIn, uint256 bnTarget
     return (uint256(hashProofOfStake) < bnCoinDayWeight * bnTargetPerCoinDay);
 }
 
-//instead of looping outside and reinitializing variables many times, we will give a nTimeTx and also search interval so that we can do all the hashing here
-bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTransaction txPrev, const COutPoint prevout, unsigned int& nTimeTx, unsigned int nHashDrift, bool fCheck, uint256& hashProofOfStake, bool fPrintProofOfStake)
+CStakeKernel::CStakeKernel() : pindexFrom(NULL), nValueIn(0), nStakeModifier(0), nStakeModifierHeight(0), nStakeModifierTime(0), nTimeBlockFrom(0)
 {
-    //assign new variables to make it easier to read
-    int64_t nValueIn = txPrev.vout[prevout.n].nValue;
-    unsigned int nTimeBlockFrom = blockFrom.GetBlockTime();
+}
 
+bool CStakeKernel::Init(const CBlockIndex* pindexFromIn, const CTxOut& txoutPrev, const COutPoint& prevoutIn, bool fPrintProofOfStake)
+{
+    //grab stake modifier
+    if (!GetKernelStakeModifier(pindexFromIn, nStakeModifier, nStakeModifierHeight, nStakeModifierTime, fPrintProofOfStake)) {
+        LogPrintf("CheckStakeKernelHash(): failed to get kernel stake modifier \n");
+        return false;
+    }
+
+    pindexFrom = pindexFromIn;
+    prevout = prevoutIn;
+    nValueIn = txoutPrev.nValue;
+    nTimeBlockFrom = pindexFrom->GetBlockTime();
+
+    // Laid out exactly as stakeHash() serializes them, only nTimeTx goes after
+    unsigned char vchPrefix[CDoubleSHA256Prefix::PREFIX_SIZE];
+    WriteLE64(vchPrefix, nStakeModifier);
+    WriteLE32(vchPrefix + 8, nTimeBlockFrom);
+    WriteLE32(vchPrefix + 12, prevout.n);
+    memcpy(vchPrefix + 16, prevout.hash.begin(), 32);
+    hasher.SetPrefix(vchPrefix);
+    return true;
+}
+
+uint256 CStakeKernel::GetHash(unsigned int nTimeTx) const
+{
+    unsigned char vchTime[CDoubleSHA256Prefix::SUFFIX_SIZE];
+    WriteLE32(vchTime, nTimeTx);
+    uint256 hash;
+    hasher.Finalize(vchTime, hash.begin());
+    return hash;
+}
+
+bool CStakeKernel::CheckTimes(unsigned int nTimeTx) const
+{
     if (nTimeTx < nTimeBlockFrom) // Transaction timestamp violation
         return error("CheckStakeKernelHash() : nTime violation");
 
     if (nTimeBlockFrom + nStakeMinAge > nTimeTx) // Min age requirement
         return error("CheckStakeKernelHash() : min age violation - nTimeBlockFrom=%d nStakeMinAge=%d nTimeTx=%d", nTimeBlockFrom, nStakeMinAge, nTimeTx);
 
-    //grab difficulty
+    return true;
+}
+
+void CStakeKernel::LogFound(unsigned int nTimeTx, const uint256& hashProofOfStake) const
+{
+    LogPrintf("CheckStakeKernelHash() : using modifier %s at height=%d timestamp=%s for block from height=%d timestamp=%s\n",
+        boost::lexical_cast<std::string>(nStakeModifier).c_str(), nStakeModifierHeight,
+        DateTimeStrFormat("%Y-%m-%d %H:%M:%S", nStakeModifierTime).c_str(),
+        pindexFrom->nHeight,
+        DateTimeStrFormat("%Y-%m-%d %H:%M:%S", pindexFrom->GetBlockTime()).c_str());
+    LogPrintf("CheckStakeKernelHash() : pass protocol=%s modifier=%s nTimeBlockFrom=%u prevoutHash=%s nTimeTxPrev=%u nPrevout=%u nTimeTx=%u hashProof=%s\n",
+        "0.3",
+        boost::lexical_cast<std::string>(nStakeModifier).c_str(),
+        nTimeBlockFrom, prevout.hash.ToString().c_str(), nTimeBlockFrom, prevout.n, nTimeTx,
+        hashProofOfStake.ToString().c_str());
+}
+
+namespace
+{
+/** State shared by the threads of one SearchStakeKernels() call */
+struct CStakeSearch {
+    const std::vector<CStakeKernel>* pvKernels;
     uint256 bnTargetPerCoinDay;
-    bnTargetPerCoinDay.SetCompact(nBits);
+    unsigned int nTimeTx;
+    unsigned int nHashDrift;
+    unsigned int nTimeMin;
+    int nHeightStart;
+
+    boost::mutex mutex;
+    // Next kernel to hand out to a thread
+    size_t nNext;
+    // Set once a kernel is found or the tip changed
+    bool fDone;
+    int nFound;
+    unsigned int nTimeFound;
+    uint256 hashFound;
+};
+
+void StakeSearchThread(CStakeSearch* search)
+{
+    const std::vector<CStakeKernel>& vKernels = *search->pvKernels;
+    while (true) {
+        size_t n;
+        {
+            boost::lock_guard<boost::mutex> lock(search->mutex);
+            if (search->fDone || search->nNext >= vKernels.size())
+                return;
+            n = search->nNext++;
+        }
 
-    //grab stake modifier
-    uint64_t nStakeModifier = 0;
-    int nStakeModifierHeight = 0;
-    int64_t nStakeModifierTime = 0;
-    if (!GetKernelStakeModifier(blockFrom.GetHash(), nStakeModifier, nStakeModifierHeight, nStakeModifierTime, fPrintProofOfStake)) {
-        LogPrintf("CheckStakeKernelHash(): failed to get kernel stake modifier \n");
-        return false;
+        const CStakeKernel& kernel = vKernels[n];
+        if (search->nTimeTx < kernel.nTimeBlockFrom || kernel.nTimeBlockFrom + nStakeMinAge > search->nTimeTx)
+            continue;
+
+        //get the stake weight - weight is equal to coin amount
+        uint256 bnTarget = uint256(kernel.nValueIn) / 100 * search->bnTargetPerCoinDay;
+
+        for (unsigned int i = 0; i < search->nHashDrift; i++) {
+            //new block came in, move on
+            if (chainActive.Height() != search->nHeightStart) {
+                boost::lock_guard<boost::mutex> lock(search->mutex);
+                search->fDone = true;
+                return;
+            }
+
+            //hash this iteration
+            unsigned int nTryTime = search->nTimeTx + search->nHashDrift - i;
+            uint256 hashProofOfStake = kernel.GetHash(nTryTime);
+
+            // if stake hash does not meet the target then continue to next iteration
+            if (!(hashProofOfStake < bnTarget))
+                continue;
+
+            //Double check that this will pass time requirements
+            if (nTryTime <= search->nTimeMin) {
+                LogPrintf("CreateCoinStake() : kernel found, but it is too far in the past \n");
+                break;
+            }
+
+            boost::lock_guard<boost::mutex> lock(search->mutex);
+            if (!search->fDone) {
+                search->fDone = true;
+                search->nFound = n;
+                search->nTimeFound = nTryTime;
+                search->hashFound = hashProofOfStake;
+            }
+            return;
+        }
     }
+}
+} // anonymous namespace
 
-    //create data stream once instead of repeating it in the loop
-    CDataStream ss(SER_GETHASH, 0);
-    ss << nStakeModifier;
+int SearchStakeKernels(const std::vector<CStakeKernel>& vKernels, unsigned int nBits, unsigned int nTimeTx, unsigned int nHashDrift, unsigned int nTimeMin, int nThreads, unsigned int& nTimeTxFound, uint256& hashProofOfStake, bool fPrintProofOfStake)
+{
+    CStakeSearch search;
+    search.pvKernels = &vKernels;
+    search.bnTargetPerCoinDay.SetCompact(nBits);
+    search.nTimeTx = nTimeTx;
+    search.nHashDrift = nHashDrift;
+    search.nTimeMin = nTimeMin;
+    search.nHeightStart = chainActive.Height();
+    search.nNext = 0;
+    search.fDone = false;
+    search.nFound = -1;
+    search.nTimeFound = 0;
+
+    nThreads = std::min(nThreads, (int)vKernels.size());
+    if (nThreads <= 1) {
+        StakeSearchThread(&search);
+    } else {
+        boost::thread_group threadGroup;
+        for (int i = 0; i < nThreads; i++)
+            threadGroup.create_thread(boost::bind(&StakeSearchThread, &search));
+        threadGroup.join_all();
+    }
 
-    //if wallet is simply checking to make sure a hash is valid
-    if (fCheck) {
-        hashProofOfStake = stakeHash(nTimeTx, ss, prevout.n, prevout.hash, nTimeBlockFrom);
-        return stakeTargetHit(hashProofOfStake, nValueIn, bnTargetPerCoinDay);
+    if (search.nFound >= 0) {
+        nTimeTxFound = search.nTimeFound;
+        hashProofOfStake = search.hashFound;
+        if (fDebug || fPrintProofOfStake)
+            vKernels[search.nFound].LogFound(nTimeTxFound, hashProofOfStake);
     }
 
-    bool fSuccess = false;
-    unsigned int nTryTime = 0;
-    unsigned int i;
-    int nHeightStart = chainActive.Height();
-    for (i = 0; i < (nHashDrift); i++) //iterate the hashing
-    {
-        //new block came in, move on
-        if (chainActive.Height() != nHeightStart)
-            break;
+    mapHashedBlocks.clear();
+    mapHashedBlocks[chainActive.Tip()->nHeight] = GetTime(); //store a time stamp of when we last hashed on this block
+    return search.nFound;
+}
 
-        //hash this iteration
-        nTryTime = nTimeTx + nHashDrift - i;
-        hashProofOfStake = stakeHash(nTryTime, ss, prevout.n, prevout.hash, nTimeBlockFrom);
+//instead of looping outside and reinitializing variables many times, we will give a nTimeTx and also search interval so that we can do all the hashing here
+bool CheckStakeKernelHash(unsigned int nBits, const CBlockIndex* pindexFrom, const CTxOut& txoutPrev, const COutPoint& prevout, unsigned int& nTimeTx, unsigned int nHashDrift, bool fCheck, uint256& hashProofOfStake, bool fPrintProofOfStake)
+{
+    CStakeKernel kernel;
+    if (!kernel.Init(pindexFrom, txoutPrev, prevout, fPrintProofOfStake) || !kernel.CheckTimes(nTimeTx))
+        return false;
 
-        // if stake hash does not meet the target then continue to next iteration
-        if (!stakeTargetHit(hashProofOfStake, nValueIn, bnTargetPerCoinDay))
-            continue;
+    //if wallet is simply checking to make sure a hash is valid
+    if (fCheck) {
+        //grab difficulty
+        uint256 bnTargetPerCoinDay;
+        bnTargetPerCoinDay.SetCompact(nBits);
 
-        fSuccess = true; // if we make it this far then we have successfully created a stake hash
-        nTimeTx = nTryTime;
-
-        if (fDebug || fPrintProofOfStake) {
-            LogPrintf("CheckStakeKernelHash() : using modifier %s at height=%d timestamp=%s for block from height=%d timestamp=%s\n",
-                boost::lexical_cast<std::string>(nStakeModifier).c_str(), nStakeModifierHeight,
-                DateTimeStrFormat("%Y-%m-%d %H:%M:%S", nStakeModifierTime).c_str(),
-                mapBlockIndex[blockFrom.GetHash()]->nHeight,
-                DateTimeStrFormat("%Y-%m-%d %H:%M:%S", blockFrom.GetBlockTime()).c_str());
-            LogPrintf("CheckStakeKernelHash() : pass protocol=%s modifier=%s nTimeBlockFrom=%u prevoutHash=%s nTimeTxPrev=%u nPrevout=%u nTimeTx=%u hashProof=%s\n",
-                "0.3",
-                boost::lexical_cast<std::string>(nStakeModifier).c_str(),
-                nTimeBlockFrom, prevout.hash.ToString().c_str(), nTimeBlockFrom, prevout.n, nTryTime,
-                hashProofOfStake.ToString().c_str());
-        }
-        break;
+        hashProofOfStake = kernel.GetHash(nTimeTx);
+        return stakeTargetHit(hashProofOfStake, kernel.nValueIn, bnTargetPerCoinDay);
     }
 
-    mapHashedBlocks.clear();
-    mapHashedBlocks[chainActive.Tip()->nHeight] = GetTime(); //store a time stamp of when we last hashed on this block
-    return fSuccess;
+    std::vector<CStakeKernel> vKernels(1, kernel);
+    return SearchStakeKernels(vKernels, nBits, nTimeTx, nHashDrift, 0, 1, nTimeTx, hashProofOfStake, fPrintProofOfStake) >= 0;
 }
 
 // Check kernel hash target and coinstake signature
-bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake)
+bool CheckProofOfStake(const CBlock& block, uint256& hashProofOfStake)
 {
-    const CTransaction tx = block.vtx[1];
+    const CTransaction& tx = block.vtx[1];
     if (!tx.IsCoinStake())
         return error("CheckProofOfStake() : called on non-coinstake %s", tx.GetHash().ToString().c_str());
 
     // Kernel (input 0) must match the stake hash target per coin age (nBits)
     const CTxIn& txin = tx.vin[0];
 
-    // First try finding the previous transaction in database
-    uint256 hashBlock;
-    CTransaction txPrev;
-    if (!GetTransaction(txin.prevout.hash, txPrev, hashBlock, true))
-        return error("CheckProofOfStake() : INFO: read txPrev failed");
+    // The kernel only needs the staked output and the time and hash of the
+    // block that created it. Take them from the UTXO set and the block index
+    // while the output is unspent there, which needs no disk access at all.
+    CTxOut txoutPrev;
+    const CBlockIndex* pindexFrom = NULL;
+    {
+        LOCK(cs_main);
+        const CCoins* coins = pcoinsTip->AccessCoins(txin.prevout.hash);
+        if (coins && coins->IsAvailable(txin.prevout.n) && coins->nHeight > 0) {
+            txoutPrev = coins->vout[txin.prevout.n];
+            pindexFrom = chainActive[coins->nHeight];
+        }
+    }
+
+    // Otherwise find the previous transaction in database
+    if (!pindexFrom) {
+        uint256 hashBlock;
+        CTransaction txPrev;
+        if (!GetTransaction(txin.prevout.hash, txPrev, hashBlock, true))
+            return error("CheckProofOfStake() : INFO: read txPrev failed");
+        if (txin.prevout.n >= txPrev.vout.size())
+            return error("CheckProofOfStake() : invalid prevout on coinstake %s", tx.GetHash().ToString().c_str());
+        txoutPrev = txPrev.vout[txin.prevout.n];
+
+        BlockMap::iterator it = mapBlockIndex.find(hashBlock);
+        if (it == mapBlockIndex.end())
+            return error("CheckProofOfStake() : read block failed");
+        pindexFrom = it->second;
+    }
 
     //verify signature and script
-    if (!VerifyScript(txin.scriptSig, txPrev.vout[txin.prevout.n].scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&tx, 0)))
+    if (!VerifyScript(txin.scriptSig, txoutPrev.scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&tx, 0)))
         return error("CheckProofOfStake() : VerifySignature failed on coinstake %s", tx.GetHash().ToString().c_str());
 
-    CBlockIndex* pindex = NULL;
-    BlockMap::iterator it = mapBlockIndex.find(hashBlock);
-    if (it != mapBlockIndex.end())
-        pindex = it->second;
-    else
-        return error("CheckProofOfStake() : read block failed");
-
-    // Read block header
-    CBlock blockprev;
-    if (!ReadBlockFromDisk(blockprev, pindex->GetBlockPos()))
-        return error("CheckProofOfStake(): INFO: failed to find block");
-
     unsigned int nInterval = 0;
     unsigned int nTime = block.nTime;
-    if (!CheckStakeKernelHash(block.nBits, blockprev, txPrev, txin.prevout, nTime, nInterval, true, hashProofOfStake, fDebug))
+    if (!CheckStakeKernelHash(block.nBits, pindexFrom, txoutPrev, txin.prevout, nTime, nInterval, true, hashProofOfStake, fDebug))
         return error("CheckProofOfStake() : INFO: check kernel failed on coinstake %s, hashProof=%s \n", tx.GetHash().ToString().c_str(), hashProofOfStake.ToString().c_str()); // may occur during initial download or if behind on block chain sync
 
     return true;
@@ -5,6 +5,7 @@
 #ifndef BITCOIN_KERNEL_H
 #define BITCOIN_KERNEL_H
 
+#include "crypto/sha256.h"
 #include "main.h"
 
 
@@ -21,15 +22,62 @@ static const int MODIFIER_INTERVAL_RATIO = 3;
 // Compute the hash modifier for proof-of-stake
 bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeModifier, bool& fGeneratedStakeModifier);
 
+// Bring the stake modifier index in line with chainActive; called whenever the tip changes
+void UpdateStakeModifierIndex();
+
+// Threads searching for stake kernels, see -stakethreads
+static const int DEFAULT_STAKE_THREADS = 0;
+static const int MAX_STAKE_THREADS = 16;
+extern int nStakeThreads;
+
+// The part of a stake kernel that does not depend on the coinstake time:
+// the stake modifier, the time of the block from and the prevout of one
+// staked output, prepared once per staking round
+class CStakeKernel
+{
+public:
+    const CBlockIndex* pindexFrom;
+    COutPoint prevout;
+    int64_t nValueIn;
+    uint64_t nStakeModifier;
+    int nStakeModifierHeight;
+    int64_t nStakeModifierTime;
+    unsigned int nTimeBlockFrom;
+
+    CStakeKernel();
+
+    // Look up the stake modifier for the output; fails if there is none yet
+    bool Init(const CBlockIndex* pindexFrom, const CTxOut& txoutPrev, const COutPoint& prevout, bool fPrintProofOfStake = false);
+
+    // The kernel hash for a coinstake at nTimeTx, same as stakeHash()
+    uint256 GetHash(unsigned int nTimeTx) const;
+
+    // Check the timestamp and min age of a coinstake at nTimeTx
+    bool CheckTimes(unsigned int nTimeTx) const;
+
+    void LogFound(unsigned int nTimeTx, const uint256& hashProofOfStake) const;
+
+private:
+    // SHA256 state after the fixed part of the kernel
+    CDoubleSHA256Prefix hasher;
+};
+
+// Search the times nTimeTx + nHashDrift down to nTimeTx + 1 of every kernel,
+// spreading the kernels over nThreads threads. All threads stop as soon as
+// one finds a kernel hash later than nTimeMin that meets the target, or when
+// the tip of chainActive changes. Returns the index of the kernel found, with
+// its time and hash in nTimeTxFound and hashProofOfStake, or -1.
+int SearchStakeKernels(const std::vector<CStakeKernel>& vKernels, unsigned int nBits, unsigned int nTimeTx, unsigned int nHashDrift, unsigned int nTimeMin, int nThreads, unsigned int& nTimeTxFound, uint256& hashProofOfStake, bool fPrintProofOfStake = false);
+
 // Check whether stake kernel meets hash target
 // Sets hashProofOfStake on success return
 uint256 stakeHash(unsigned int nTimeTx, CDataStream ss, unsigned int prevoutIndex, uint256 prevoutHash, unsigned int nTimeBlockFrom);
 bool stakeTargetHit(uint256 hashProofOfStake, int64_t nValueIn, uint256 bnTargetPerCoinDay);
-bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTransaction txPrev, const COutPoint prevout, unsigned int& nTimeTx, unsigned int nHashDrift, bool fCheck, uint256& hashProofOfStake, bool fPrintProofOfStake = false);
+bool CheckStakeKernelHash(unsigned int nBits, const CBlockIndex* pindexFrom, const CTxOut& txoutPrev, const COutPoint& prevout, unsigned int& nTimeTx, unsigned int nHashDrift, bool fCheck, uint256& hashProofOfStake, bool fPrintProofOfStake = false);
 
 // Check kernel hash target and coinstake signature
 // Sets hashProofOfStake on success return
-bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake);
+bool CheckProofOfStake(const CBlock& block, uint256& hashProofOfStake);
 
 // Check whether the coinstake timestamp meets protocol
 bool CheckCoinStakeTimestamp(int64_t nTimeBlock, int64_t nTimeTx);
@@ -11,6 +11,7 @@
  **/
 // Copyright (c) 2017 The PIVX developers
 #include "AccumulatorProofOfKnowledge.h"
+#include "MultiExp.h"
 #include "hash.h"
 
 namespace libzerocoin {
@@ -36,9 +37,13 @@ AccumulatorProofOfKnowledge::AccumulatorProofOfKnowledge(const AccumulatorAndPro
 	CBigNum r_2 = CBigNum::randBignum(params->accumulatorModulus/4);
 	CBigNum r_3 = CBigNum::randBignum(params->accumulatorModulus/4);
 
-	this->C_e = g_n.pow_mod(e, params->accumulatorModulus) * h_n.pow_mod(r_1, params->accumulatorModulus);
-	this->C_u = witness.getValue() * h_n.pow_mod(r_2, params->accumulatorModulus);
-	this->C_r = g_n.pow_mod(r_2, params->accumulatorModulus) * h_n.pow_mod(r_3, params->accumulatorModulus);
+	const CBigNum& N = params->accumulatorModulus;
+	const CBigNum& pokModulus = params->accumulatorPoKCommitmentGroup.modulus;
+
+	// C_e, C_u and C_r are published without a final reduction
+	this->C_e = MultiExp(N).AddFixed(g_n, e).Eval() * MultiExp(N).AddFixed(h_n, r_1).Eval();
+	this->C_u = witness.getValue() * MultiExp(N).AddFixed(h_n, r_2).Eval();
+	this->C_r = MultiExp(N).AddFixed(g_n, r_2).Eval() * MultiExp(N).AddFixed(h_n, r_3).Eval();
 
 	CBigNum r_alpha = CBigNum::randBignum(params->maxCoinValue * CBigNum(2).pow(params->k_prime + params->k_dprime));
 	if(!(CBigNum::randBignum(CBigNum(3)) % 2)) {
@@ -73,14 +78,17 @@ AccumulatorProofOfKnowledge::AccumulatorProofOfKnowledge(const AccumulatorAndPro
 		r_delta = 0-r_delta;
 	}
 
-	this->st_1 = (sg.pow_mod(r_alpha, params->accumulatorPoKCommitmentGroup.modulus) * sh.pow_mod(r_phi, params->accumulatorPoKCommitmentGroup.modulus)) % params->accumulatorPoKCommitmentGroup.modulus;
-	this->st_2 = (((commitmentToCoin.getCommitmentValue() * sg.inverse(params->accumulatorPoKCommitmentGroup.modulus)).pow_mod(r_gamma, params->accumulatorPoKCommitmentGroup.modulus)) * sh.pow_mod(r_psi, params->accumulatorPoKCommitmentGroup.modulus)) % params->accumulatorPoKCommitmentGroup.modulus;
-	this->st_3 = ((sg * commitmentToCoin.getCommitmentValue()).pow_mod(r_sigma, params->accumulatorPoKCommitmentGroup.modulus) * sh.pow_mod(r_xi, params->accumulatorPoKCommitmentGroup.modulus)) % params->accumulatorPoKCommitmentGroup.modulus;
+	const CBigNum& commitmentValue = commitmentToCoin.getCommitmentValue();
+
+	// (C * sg^-1)^x = C^x * sg^-x and (sg * C)^x = sg^x * C^x; (h_n^-1)^x = h_n^-x
+	this->st_1 = MultiExp(pokModulus).AddFixed(sg, r_alpha).AddFixed(sh, r_phi).Eval();
+	this->st_2 = MultiExp(pokModulus).Add(commitmentValue, r_gamma).AddFixed(sg, 0-r_gamma).AddFixed(sh, r_psi).Eval();
+	this->st_3 = MultiExp(pokModulus).Add(commitmentValue, r_sigma).AddFixed(sg, r_sigma).AddFixed(sh, r_xi).Eval();
 
-	this->t_1 = (h_n.pow_mod(r_zeta, params->accumulatorModulus) * g_n.pow_mod(r_epsilon, params->accumulatorModulus)) % params->accumulatorModulus;
-	this->t_2 = (h_n.pow_mod(r_eta, params->accumulatorModulus) * g_n.pow_mod(r_alpha, params->accumulatorModulus)) % params->accumulatorModulus;
-	this->t_3 = (C_u.pow_mod(r_alpha, params->accumulatorModulus) * ((h_n.inverse(params->accumulatorModulus)).pow_mod(r_beta, params->accumulatorModulus))) % params->accumulatorModulus;
-	this->t_4 = (C_r.pow_mod(r_alpha, params->accumulatorModulus) * ((h_n.inverse(params->accumulatorModulus)).pow_mod(r_delta, params->accumulatorModulus)) * ((g_n.inverse(params->accumulatorModulus)).pow_mod(r_beta, params->accumulatorModulus))) % params->accumulatorModulus;
+	this->t_1 = MultiExp(N).AddFixed(h_n, r_zeta).AddFixed(g_n, r_epsilon).Eval();
+	this->t_2 = MultiExp(N).AddFixed(h_n, r_eta).AddFixed(g_n, r_alpha).Eval();
+	this->t_3 = MultiExp(N).Add(C_u, r_alpha).AddFixed(h_n, 0-r_beta).Eval();
+	this->t_4 = MultiExp(N).Add(C_r, r_alpha).AddFixed(h_n, 0-r_delta).AddFixed(g_n, 0-r_beta).Eval();
 
 	CHashWriter hasher(0,0);
 	hasher << *params << sg << sh << g_n << h_n << commitmentToCoin.getCommitmentValue() << C_e << C_u << C_r << st_1 << st_2 << st_3 << t_1 << t_2 << t_3 << t_4;
@@ -116,14 +124,19 @@ bool AccumulatorProofOfKnowledge:: Verify(const Accumulator& a, const CBigNum& v
 
 	CBigNum c = CBigNum(hasher.GetHash()); //this hash should be of length k_prime bits
 
-	CBigNum st_1_prime = (valueOfCommitmentToCoin.pow_mod(c, params->accumulatorPoKCommitmentGroup.modulus) * sg.pow_mod(s_alpha, params->accumulatorPoKCommitmentGroup.modulus) * sh.pow_mod(s_phi, params->accumulatorPoKCommitmentGroup.modulus)) % params->accumulatorPoKCommitmentGroup.modulus;
-	CBigNum st_2_prime = (sg.pow_mod(c, params->accumulatorPoKCommitmentGroup.modulus) * ((valueOfCommitmentToCoin * sg.inverse(params->accumulatorPoKCommitmentGroup.modulus)).pow_mod(s_gamma, params->accumulatorPoKCommitmentGroup.modulus)) * sh.pow_mod(s_psi, params->accumulatorPoKCommitmentGroup.modulus)) % params->accumulatorPoKCommitmentGroup.modulus;
-	CBigNum st_3_prime = (sg.pow_mod(c, params->accumulatorPoKCommitmentGroup.modulus) * (sg * valueOfCommitmentToCoin).pow_mod(s_sigma, params->accumulatorPoKCommitmentGroup.modulus) * sh.pow_mod(s_xi, params->accumulatorPoKCommitmentGroup.modulus)) % params->accumulatorPoKCommitmentGroup.modulus;
+	const CBigNum& N = params->accumulatorModulus;
+	const CBigNum& pokModulus = params->accumulatorPoKCommitmentGroup.modulus;
+
+	// The same products as in the prover, with the challenge terms multiplied in:
+	// (C * sg^-1)^x = C^x * sg^-x, (sg * C)^x = sg^x * C^x and (h_n^-1)^x = h_n^-x
+	CBigNum st_1_prime = MultiExp(pokModulus).Add(valueOfCommitmentToCoin, c).AddFixed(sg, s_alpha).AddFixed(sh, s_phi).Eval();
+	CBigNum st_2_prime = MultiExp(pokModulus).AddFixed(sg, c).Add(valueOfCommitmentToCoin, s_gamma).AddFixed(sg, 0-s_gamma).AddFixed(sh, s_psi).Eval();
+	CBigNum st_3_prime = MultiExp(pokModulus).AddFixed(sg, c).Add(valueOfCommitmentToCoin, s_sigma).AddFixed(sg, s_sigma).AddFixed(sh, s_xi).Eval();
 
-	CBigNum t_1_prime = (C_r.pow_mod(c, params->accumulatorModulus) * h_n.pow_mod(s_zeta, params->accumulatorModulus) * g_n.pow_mod(s_epsilon, params->accumulatorModulus)) % params->accumulatorModulus;
-	CBigNum t_2_prime = (C_e.pow_mod(c, params->accumulatorModulus) * h_n.pow_mod(s_eta, params->accumulatorModulus) * g_n.pow_mod(s_alpha, params->accumulatorModulus)) % params->accumulatorModulus;
-	CBigNum t_3_prime = ((a.getValue()).pow_mod(c, params->accumulatorModulus) * C_u.pow_mod(s_alpha, params->accumulatorModulus) * ((h_n.inverse(params->accumulatorModulus)).pow_mod(s_beta, params->accumulatorModulus))) % params->accumulatorModulus;
-	CBigNum t_4_prime = (C_r.pow_mod(s_alpha, params->accumulatorModulus) * ((h_n.inverse(params->accumulatorModulus)).pow_mod(s_delta, params->accumulatorModulus)) * ((g_n.inverse(params->accumulatorModulus)).pow_mod(s_beta, params->accumulatorModulus))) % params->accumulatorModulus;
+	CBigNum t_1_prime = MultiExp(N).Add(C_r, c).AddFixed(h_n, s_zeta).AddFixed(g_n, s_epsilon).Eval();
+	CBigNum t_2_prime = MultiExp(N).Add(C_e, c).AddFixed(h_n, s_eta).AddFixed(g_n, s_alpha).Eval();
+	CBigNum t_3_prime = MultiExp(N).Add(a.getValue(), c).Add(C_u, s_alpha).AddFixed(h_n, 0-s_beta).Eval();
+	CBigNum t_4_prime = MultiExp(N).Add(C_r, s_alpha).AddFixed(h_n, 0-s_delta).AddFixed(g_n, 0-s_beta).Eval();
 
 	bool result = false;
 
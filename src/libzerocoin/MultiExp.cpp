@@ -0,0 +1,292 @@
+/**
+ * @file       MultiExp.cpp
+ *
+ * @brief      Multi-exponentiation and fixed-base exponentiation for the Zerocoin library.
+ *
+ * @copyright  Copyright 2018 The Slingcoin developers
+ * @license    This project is released under the MIT license.
+ **/
+
+#include "MultiExp.h"
+
+#include <algorithm>
+#include <map>
+
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace libzerocoin {
+
+/** Window size of the fixed-base tables */
+static const int FIXED_WINDOW = 5;
+
+/** Window size for variable bases */
+static const int VARIABLE_WINDOW = 4;
+
+/** Montgomery multiplication context for one odd modulus */
+class MontgomeryContext {
+public:
+	explicit MontgomeryContext(const CBigNum& m): modulus(m) {
+		CAutoBN_CTX pctx;
+		mont = BN_MONT_CTX_new();
+		if (mont == NULL || !BN_MONT_CTX_set(mont, &modulus, pctx))
+			throw bignum_error("MontgomeryContext : BN_MONT_CTX_set failed");
+		if (!BN_to_montgomery(&one, BN_value_one(), mont, pctx))
+			throw bignum_error("MontgomeryContext : BN_to_montgomery failed");
+	}
+
+	~MontgomeryContext() {
+		BN_MONT_CTX_free(mont);
+	}
+
+	void Mul(CBigNum& r, const CBigNum& a, const CBigNum& b, BN_CTX* pctx) const {
+		if (!BN_mod_mul_montgomery(&r, &a, &b, mont, pctx))
+			throw bignum_error("MontgomeryContext : BN_mod_mul_montgomery failed");
+	}
+
+	CBigNum To(const CBigNum& x, BN_CTX* pctx) const {
+		CBigNum reduced, ret;
+		if (!BN_nnmod(&reduced, &x, &modulus, pctx) || !BN_to_montgomery(&ret, &reduced, mont, pctx))
+			throw bignum_error("MontgomeryContext : BN_to_montgomery failed");
+		return ret;
+	}
+
+	CBigNum From(const CBigNum& x, BN_CTX* pctx) const {
+		CBigNum ret;
+		if (!BN_from_montgomery(&ret, &x, mont, pctx))
+			throw bignum_error("MontgomeryContext : BN_from_montgomery failed");
+		return ret;
+	}
+
+	const CBigNum modulus;
+	/** 1 in Montgomery form */
+	CBigNum one;
+
+private:
+	MontgomeryContext(const MontgomeryContext&);
+	MontgomeryContext& operator=(const MontgomeryContext&);
+
+	BN_MONT_CTX* mont;
+};
+
+namespace {
+
+boost::mutex csCache;
+std::map<CBigNum, boost::shared_ptr<const MontgomeryContext> > mapContexts;
+std::map<std::pair<CBigNum, CBigNum>, boost::shared_ptr<const FixedBaseTable> > mapTables;
+bool fMultiExpEnabled = true;
+
+boost::shared_ptr<const MontgomeryContext> GetContext(const CBigNum& modulus)
+{
+	if (!BN_is_odd(&modulus))
+		return boost::shared_ptr<const MontgomeryContext>();
+
+	boost::lock_guard<boost::mutex> lock(csCache);
+	boost::shared_ptr<const MontgomeryContext>& ctx = mapContexts[modulus];
+	if (!ctx)
+		ctx.reset(new MontgomeryContext(modulus));
+	return ctx;
+}
+
+/** The w-bit window i of e, least significant window first */
+unsigned int Window(const CBigNum& e, int i, int w)
+{
+	unsigned int d = 0;
+	for (int b = w - 1; b >= 0; b--)
+		d = (d << 1) | (BN_is_bit_set(&e, i * w + b) ? 1 : 0);
+	return d;
+}
+
+/** r = r * x, where r == one is tracked by fOne to skip useless multiplications */
+void MulInto(const MontgomeryContext& ctx, CBigNum& r, bool& fOne, const CBigNum& x, BN_CTX* pctx)
+{
+	if (fOne) {
+		r = x;
+		fOne = false;
+	} else {
+		ctx.Mul(r, r, x, pctx);
+	}
+}
+
+/** Fill powers[i] = x^(2^(w*i)) for as many entries as powers holds */
+void BuildPowers(const MontgomeryContext& ctx, const CBigNum& x, std::vector<CBigNum>& powers, BN_CTX* pctx)
+{
+	for (size_t i = 0; i < powers.size(); i++) {
+		if (i == 0) {
+			powers[i] = x;
+			continue;
+		}
+		powers[i] = powers[i - 1];
+		for (int s = 0; s < FIXED_WINDOW; s++)
+			ctx.Mul(powers[i], powers[i], powers[i], pctx);
+	}
+}
+
+} // anonymous namespace
+
+FixedBaseTable::FixedBaseTable(const CBigNum& base, const CBigNum& modulus, unsigned int maxExponentBits, bool fInverse):
+	base(base), modulus(modulus), ctx(GetContext(modulus)) {
+	if (!ctx)
+		return;
+
+	CAutoBN_CTX pctx;
+	size_t nWindows = (maxExponentBits + FIXED_WINDOW - 1) / FIXED_WINDOW;
+	vPowers.resize(nWindows);
+	BuildPowers(*ctx, ctx->To(base, pctx), vPowers, pctx);
+
+	if (fInverse) {
+		CBigNum inverse;
+		if (BN_mod_inverse(&inverse, &base, &modulus, pctx) != NULL) {
+			vInversePowers.resize(nWindows);
+			BuildPowers(*ctx, ctx->To(inverse, pctx), vInversePowers, pctx);
+		}
+	}
+}
+
+boost::shared_ptr<const FixedBaseTable> FixedBaseTable::Get(const CBigNum& base, const CBigNum& modulus)
+{
+	std::pair<CBigNum, CBigNum> key(base, modulus);
+	{
+		boost::lock_guard<boost::mutex> lock(csCache);
+		std::map<std::pair<CBigNum, CBigNum>, boost::shared_ptr<const FixedBaseTable> >::const_iterator it = mapTables.find(key);
+		if (it != mapTables.end())
+			return it->second;
+	}
+
+	// Proof exponents can exceed the modulus by the size of a second group
+	// order plus the statistical security margins; twice the modulus covers them.
+	boost::shared_ptr<const FixedBaseTable> table(new FixedBaseTable(base, modulus, 2 * modulus.bitSize() + 512));
+
+	boost::lock_guard<boost::mutex> lock(csCache);
+	return mapTables.insert(std::make_pair(key, table)).first->second;
+}
+
+MultiExp::MultiExp(const CBigNum& modulus): modulus(modulus) {}
+
+MultiExp& MultiExp::Add(const CBigNum& base, const CBigNum& exp) {
+	Term term;
+	term.base = base;
+	term.exp = exp;
+	term.table = NULL;
+	vTerms.push_back(term);
+	return *this;
+}
+
+MultiExp& MultiExp::Add(const FixedBaseTable& table, const CBigNum& exp) {
+	Term term;
+	term.base = table.getBase();
+	term.exp = exp;
+	term.table = &table;
+	vTerms.push_back(term);
+	return *this;
+}
+
+MultiExp& MultiExp::AddFixed(const CBigNum& base, const CBigNum& exp) {
+	if (!fMultiExpEnabled)
+		return Add(base, exp);
+
+	Term term;
+	term.base = base;
+	term.exp = exp;
+	term.sharedTable = FixedBaseTable::Get(base, modulus);
+	term.table = term.sharedTable.get();
+	vTerms.push_back(term);
+	return *this;
+}
+
+void MultiExp::SetEnabled(bool fEnabled) {
+	fMultiExpEnabled = fEnabled;
+}
+
+CBigNum MultiExp::EvalSimple() const {
+	CBigNum result = CBigNum(1) % modulus;
+	for (std::vector<Term>::const_iterator it = vTerms.begin(); it != vTerms.end(); ++it)
+		result = result.mul_mod(it->base.pow_mod(it->exp, modulus), modulus);
+	return result;
+}
+
+CBigNum MultiExp::Eval() const {
+	boost::shared_ptr<const MontgomeryContext> ctx;
+	if (fMultiExpEnabled)
+		ctx = GetContext(modulus);
+	if (!ctx)
+		return EvalSimple();
+
+	CAutoBN_CTX pctx;
+
+	// Sort the terms: fixed-base windows go into one bucket per window
+	// value, everything else is raised with a shared chain of squarings.
+	std::vector<const CBigNum*> vBuckets[1 << FIXED_WINDOW];
+	std::vector<std::vector<CBigNum> > vVariablePowers;
+	std::vector<CBigNum> vVariableExps;
+	int nVariableBits = 0;
+
+	for (std::vector<Term>::const_iterator it = vTerms.begin(); it != vTerms.end(); ++it) {
+		if (BN_is_zero(&it->exp))
+			continue;
+
+		bool fNegative = BN_is_negative(&it->exp);
+		CBigNum e = it->exp;
+		BN_set_negative(&e, 0);
+
+		const FixedBaseTable* table = it->table;
+		if (table && table->ctx && BN_cmp(&table->modulus, &modulus) == 0) {
+			const std::vector<CBigNum>& powers = fNegative ? table->vInversePowers : table->vPowers;
+			int nWindows = (e.bitSize() + FIXED_WINDOW - 1) / FIXED_WINDOW;
+			if (nWindows <= (int)powers.size()) {
+				for (int i = 0; i < nWindows; i++) {
+					unsigned int d = Window(e, i, FIXED_WINDOW);
+					if (d)
+						vBuckets[d].push_back(&powers[i]);
+				}
+				continue;
+			}
+		}
+
+		// g^-x = (g^-1)^x, throwing like pow_mod() if there is no inverse
+		CBigNum base = fNegative ? it->base.inverse(modulus) : it->base;
+		std::vector<CBigNum> powers(1 << VARIABLE_WINDOW);
+		powers[0] = ctx->one;
+		powers[1] = ctx->To(base, pctx);
+		for (size_t i = 2; i < powers.size(); i++)
+			ctx->Mul(powers[i], powers[i - 1], powers[1], pctx);
+		vVariablePowers.push_back(powers);
+		vVariableExps.push_back(e);
+		nVariableBits = std::max(nVariableBits, e.bitSize());
+	}
+
+	// Yao: prod_d (prod of table entries whose window is d)^d
+	CBigNum fixedResult, bucketProduct;
+	bool fFixedOne = true, fBucketOne = true;
+	for (int d = (1 << FIXED_WINDOW) - 1; d > 0; d--) {
+		for (size_t i = 0; i < vBuckets[d].size(); i++)
+			MulInto(*ctx, bucketProduct, fBucketOne, *vBuckets[d][i], pctx);
+		if (!fBucketOne)
+			MulInto(*ctx, fixedResult, fFixedOne, bucketProduct, pctx);
+	}
+
+	// Straus: one squaring chain for all variable bases
+	CBigNum variableResult;
+	bool fVariableOne = true;
+	for (int i = (nVariableBits + VARIABLE_WINDOW - 1) / VARIABLE_WINDOW - 1; i >= 0; i--) {
+		if (!fVariableOne) {
+			for (int s = 0; s < VARIABLE_WINDOW; s++)
+				ctx->Mul(variableResult, variableResult, variableResult, pctx);
+		}
+		for (size_t k = 0; k < vVariableExps.size(); k++) {
+			unsigned int d = Window(vVariableExps[k], i, VARIABLE_WINDOW);
+			if (d)
+				MulInto(*ctx, variableResult, fVariableOne, vVariablePowers[k][d], pctx);
+		}
+	}
+
+	CBigNum result = ctx->one;
+	bool fResultOne = true;
+	if (!fFixedOne)
+		MulInto(*ctx, result, fResultOne, fixedResult, pctx);
+	if (!fVariableOne)
+		MulInto(*ctx, result, fResultOne, variableResult, pctx);
+	return ctx->From(result, pctx);
+}
+
+} /* namespace libzerocoin */
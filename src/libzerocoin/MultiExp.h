@@ -0,0 +1,111 @@
+/**
+ * @file       MultiExp.h
+ *
+ * @brief      Multi-exponentiation and fixed-base exponentiation for the Zerocoin library.
+ *
+ * @copyright  Copyright 2018 The Slingcoin developers
+ * @license    This project is released under the MIT license.
+ **/
+
+#ifndef MULTIEXP_H_
+#define MULTIEXP_H_
+
+#include "bignum.h"
+
+#include <boost/shared_ptr.hpp>
+#include <vector>
+
+namespace libzerocoin {
+
+class MontgomeryContext;
+
+/**
+ * Powers base^(2^(w*i)) of a fixed base, and optionally of its inverse,
+ * modulo a fixed modulus. With these an exponentiation needs no
+ * squarings, only one multiplication per nonzero w-bit window of the
+ * exponent plus a small constant (Yao's method).
+ */
+class FixedBaseTable {
+public:
+	/**
+	 * Build the table for exponents of up to maxExponentBits bits.
+	 * Larger exponents still work, they just do not use the table.
+	 *
+	 * @param base the fixed base
+	 * @param modulus the modulus
+	 * @param maxExponentBits largest exponent size the table covers
+	 * @param fInverse also cover negative exponents
+	 */
+	FixedBaseTable(const CBigNum& base, const CBigNum& modulus, unsigned int maxExponentBits, bool fInverse = true);
+
+	/**
+	 * Returns the shared table for base modulo modulus, built on first use
+	 * and kept for the lifetime of the process. Only meant for the
+	 * generators of the Zerocoin parameters, never for values that come
+	 * from the network.
+	 */
+	static boost::shared_ptr<const FixedBaseTable> Get(const CBigNum& base, const CBigNum& modulus);
+
+	const CBigNum& getBase() const { return base; }
+	const CBigNum& getModulus() const { return modulus; }
+
+private:
+	friend class MultiExp;
+
+	CBigNum base;
+	CBigNum modulus;
+	/** NULL when the modulus is even and Montgomery arithmetic cannot be used */
+	boost::shared_ptr<const MontgomeryContext> ctx;
+	/** base^(2^(w*i)) in Montgomery form */
+	std::vector<CBigNum> vPowers;
+	/** base^-(2^(w*i)) in Montgomery form; empty if not built or base has no inverse */
+	std::vector<CBigNum> vInversePowers;
+};
+
+/**
+ * A product of powers modulo a single modulus,
+ * base_1^exp_1 * base_2^exp_2 * ... mod modulus.
+ *
+ * Eval() returns exactly what multiplying the pow_mod() of every term
+ * would, including for negative exponents (which raise the inverse of
+ * the base). Terms with a variable base share one chain of squarings
+ * (Straus' method) and terms with a fixed base use its FixedBaseTable.
+ */
+class MultiExp {
+public:
+	explicit MultiExp(const CBigNum& modulus);
+
+	/** @brief Multiply in base^exp */
+	MultiExp& Add(const CBigNum& base, const CBigNum& exp);
+
+	/** @brief Multiply in table.getBase()^exp. The table must outlive Eval(). */
+	MultiExp& Add(const FixedBaseTable& table, const CBigNum& exp);
+
+	/** @brief Multiply in base^exp for a parameter generator, see FixedBaseTable::Get() */
+	MultiExp& AddFixed(const CBigNum& base, const CBigNum& exp);
+
+	/** @brief The product of all terms, reduced modulo the modulus */
+	CBigNum Eval() const;
+
+	/**
+	 * Compute every product with plain pow_mod() calls instead. Only
+	 * meant for benchmarks and for testing both paths against each other.
+	 */
+	static void SetEnabled(bool fEnabled);
+
+private:
+	struct Term {
+		CBigNum base;
+		CBigNum exp;
+		const FixedBaseTable* table;
+		boost::shared_ptr<const FixedBaseTable> sharedTable;
+	};
+
+	CBigNum EvalSimple() const;
+
+	CBigNum modulus;
+	std::vector<Term> vTerms;
+};
+
+} /* namespace libzerocoin */
+#endif /* MULTIEXP_H_ */
@@ -12,6 +12,7 @@
 // Copyright (c) 2017 The PIVX developers
 #include <streams.h>
 #include "SerialNumberSignatureOfKnowledge.h"
+#include "MultiExp.h"
 
 namespace libzerocoin {
 
@@ -77,9 +78,10 @@ SerialNumberSignatureOfKnowledge::SerialNumberSignatureOfKnowledge(const
         }
 	}
 
+	CBigNum aSerial = MultiExp(params->serialNumberSoKCommitmentGroup.groupOrder).AddFixed(a, coin.getSerialNumber()).Eval();
 	for(uint32_t i=0; i < params->zkp_iterations; i++) {
 		// compute g^{ {a^x b^r} h^v} mod p2
-		c[i] = challengeCalculation(coin.getSerialNumber(), r[i], v_expanded[i]);
+		c[i] = challengeCalculation(aSerial, r[i], v_expanded[i]);
 	}
 
 	// We can't hash data in parallel either
@@ -102,23 +104,22 @@ SerialNumberSignatureOfKnowledge::SerialNumberSignatureOfKnowledge(const
 		} else {
 			s_notprime[i]       = r[i] - coin.getRandomness();
 			sprime[i]           = v_expanded[i] - (commitmentToCoin.getRandomness() *
-			                              b.pow_mod(r[i] - coin.getRandomness(), params->serialNumberSoKCommitmentGroup.groupOrder));
+			                              MultiExp(params->serialNumberSoKCommitmentGroup.groupOrder).AddFixed(b, r[i] - coin.getRandomness()).Eval());
 		}
 	}
 }
 
-inline CBigNum SerialNumberSignatureOfKnowledge::challengeCalculation(const CBigNum& a_exp,const CBigNum& b_exp,
+inline CBigNum SerialNumberSignatureOfKnowledge::challengeCalculation(const CBigNum& a_pow,const CBigNum& b_exp,
         const CBigNum& h_exp) const {
 
-	CBigNum a = params->coinCommitmentGroup.g;
-	CBigNum b = params->coinCommitmentGroup.h;
-	CBigNum g = params->serialNumberSoKCommitmentGroup.g;
-	CBigNum h = params->serialNumberSoKCommitmentGroup.h;
+	const CBigNum& b = params->coinCommitmentGroup.h;
+	const CBigNum& g = params->serialNumberSoKCommitmentGroup.g;
+	const CBigNum& h = params->serialNumberSoKCommitmentGroup.h;
+	const CBigNum& q = params->serialNumberSoKCommitmentGroup.groupOrder;
 
-	CBigNum exponent = (a.pow_mod(a_exp, params->serialNumberSoKCommitmentGroup.groupOrder)
-	                   * b.pow_mod(b_exp, params->serialNumberSoKCommitmentGroup.groupOrder)) % params->serialNumberSoKCommitmentGroup.groupOrder;
+	CBigNum exponent = a_pow.mul_mod(MultiExp(q).AddFixed(b, b_exp).Eval(), q);
 
-	return (g.pow_mod(exponent, params->serialNumberSoKCommitmentGroup.modulus) * h.pow_mod(h_exp, params->serialNumberSoKCommitmentGroup.modulus)) % params->serialNumberSoKCommitmentGroup.modulus;
+	return MultiExp(params->serialNumberSoKCommitmentGroup.modulus).AddFixed(g, exponent).AddFixed(h, h_exp).Eval();
 }
 
 bool SerialNumberSignatureOfKnowledge::Verify(const CBigNum& coinSerialNumber, const CBigNum& valueOfCommitmentToCoin,
@@ -133,17 +134,23 @@ bool SerialNumberSignatureOfKnowledge::Verify(const CBigNum& coinSerialNumber, c
 	vector<CBigNum> tprime(params->zkp_iterations);
 	unsigned char *hashbytes = (unsigned char*) &this->hash;
 
+	const CBigNum& p = params->serialNumberSoKCommitmentGroup.modulus;
+	const CBigNum& q = params->serialNumberSoKCommitmentGroup.groupOrder;
+
+	// a^serial is the same for every iteration, and the commitment is raised
+	// to a fresh exponent below q in about half of them
+	CBigNum aSerial = MultiExp(q).AddFixed(a, coinSerialNumber).Eval();
+	FixedBaseTable commitmentTable(valueOfCommitmentToCoin, p, q.bitSize(), false);
+
 	for(uint32_t i = 0; i < params->zkp_iterations; i++) {
 		int bit = i % 8;
 		int byte = i / 8;
 		bool challenge_bit = ((hashbytes[byte] >> bit) & 0x01);
 		if(challenge_bit) {
-			tprime[i] = challengeCalculation(coinSerialNumber, s_notprime[i], SeedTo1024(sprime[i].getuint256()));
+			tprime[i] = challengeCalculation(aSerial, s_notprime[i], SeedTo1024(sprime[i].getuint256()));
 		} else {
-			CBigNum exp = b.pow_mod(s_notprime[i], params->serialNumberSoKCommitmentGroup.groupOrder);
-			tprime[i] = ((valueOfCommitmentToCoin.pow_mod(exp, params->serialNumberSoKCommitmentGroup.modulus) % params->serialNumberSoKCommitmentGroup.modulus) *
-			             (h.pow_mod(sprime[i], params->serialNumberSoKCommitmentGroup.modulus) % params->serialNumberSoKCommitmentGroup.modulus)) %
-			            params->serialNumberSoKCommitmentGroup.modulus;
+			CBigNum exp = MultiExp(q).AddFixed(b, s_notprime[i]).Eval();
+			tprime[i] = MultiExp(p).Add(commitmentTable, exp).AddFixed(h, sprime[i]).Eval();
 		}
 	}
 	for(uint32_t i = 0; i < params->zkp_iterations; i++) {
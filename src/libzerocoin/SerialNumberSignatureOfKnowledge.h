@@ -67,7 +67,11 @@ private:
 	// define something named s and it conflicts
 	vector<CBigNum> s_notprime;
 	vector<CBigNum> sprime;
-	inline CBigNum challengeCalculation(const CBigNum& a_exp, const CBigNum& b_exp,
+	/**
+	 * g^{a^x b^r} h^v mod p, with a^x passed in precomputed as it
+	 * is the same (the serial number) for every iteration.
+	 */
+	inline CBigNum challengeCalculation(const CBigNum& a_pow, const CBigNum& b_exp,
 	                                   const CBigNum& h_exp) const;
 };
 
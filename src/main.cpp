@@ -11,6 +11,7 @@
 #include "accumulators.h"
 #include "addrman.h"
 #include "alert.h"
+#include "blockencodings.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
@@ -77,7 +78,7 @@ bool fTxIndex = true;
 bool fIsBareMultisigStd = true;
 bool fCheckBlockIndex = false;
 bool fVerifyingBlocks = false;
-unsigned int nCoinCacheSize = 5000;
+size_t nCoinCacheUsage = 5000 * 300;
 bool fAlerts = DEFAULT_ALERTS;
 
 unsigned int nStakeMinAge = 1 * 60 * 60;
@@ -90,6 +91,7 @@ int64_t nReserveBalance = 0;
 CFeeRate minRelayTxFee = CFeeRate(10000);
 
 CTxMemPool mempool(::minRelayTxFee);
+CRecentBlockCache recentBlockCache;
 
 struct COrphanTx {
     CTransaction tx;
@@ -179,6 +181,9 @@ int nQueuedValidatedHeaders = 0;
 /** Number of preferable block download peers. */
 int nPreferredDownload = 0;
 
+/** Peers we asked to announce new blocks with a compact block, oldest first. Protected by cs_main. */
+list<NodeId> lNodesAnnouncingCompact;
+
 /** Dirty block index entries. */
 set<CBlockIndex*> setDirtyBlockIndex;
 
@@ -298,6 +303,14 @@ struct CNodeState {
     int nBlocksInFlight;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
+    //! Whether the peer takes compact blocks, as it told us with "sendcmpct".
+    bool fSupportsCompactBlocks;
+    //! Whether the peer wants new blocks announced with a compact block instead of an inv.
+    bool fPreferCompactBlocks;
+    //! The block we're rebuilding from a compact block this peer sent, waiting for "blocktxn".
+    boost::shared_ptr<CPartialBlock> partialBlock;
+    //! Compact blocks we asked this peer for and haven't received yet, oldest first.
+    list<uint256> lCompactBlocksRequested;
 
     CNodeState()
     {
@@ -311,6 +324,8 @@ struct CNodeState {
         nStallingSince = 0;
         nBlocksInFlight = 0;
         fPreferredDownload = false;
+        fSupportsCompactBlocks = false;
+        fPreferCompactBlocks = false;
     }
 };
 
@@ -372,6 +387,7 @@ void FinalizeNode(NodeId nodeid)
         mapBlocksInFlight.erase(entry.hash);
     EraseOrphansFor(nodeid);
     nPreferredDownload -= state->fPreferredDownload;
+    lNodesAnnouncingCompact.remove(nodeid);
 
     mapNodeState.erase(nodeid);
 }
@@ -1309,7 +1325,7 @@ bool IsZerocoinSpendUnknown(CoinSpend coinSpend, uint256 hashTx, CValidationStat
     return true;
 }
 
-bool CheckZerocoinSpend(const CTransaction tx, bool fVerifySignature, CValidationState& state)
+bool CheckZerocoinSpend(const CTransaction tx, bool fVerifySignature, CValidationState& state, CZerocoinSpendBatch* pBatch)
 {
     //max needed non-mint outputs should be 2 - one for redemption address and a possible 2nd for change
     if (tx.vout.size() > 2) {
@@ -1332,7 +1348,6 @@ bool CheckZerocoinSpend(const CTransaction tx, bool fVerifySignature, CValidatio
 
     bool fValidated = false;
     set<CBigNum> serials;
-    list<CoinSpend> vSpends;
     CAmount nTotalRedeemed = 0;
     for (const CTxIn& txin : tx.vin) {
 
@@ -1341,7 +1356,6 @@ bool CheckZerocoinSpend(const CTransaction tx, bool fVerifySignature, CValidatio
             continue;
 
         CoinSpend newSpend = TxInToZerocoinSpend(txin);
-        vSpends.push_back(newSpend);
 
         //check that the denomination is valid
         if (newSpend.getDenomination() == ZQ_ERROR)
@@ -1359,14 +1373,25 @@ bool CheckZerocoinSpend(const CTransaction tx, bool fVerifySignature, CValidatio
         if (fVerifySignature) {
             //see if we have record of the accumulator used in the spend tx
             CBigNum bnAccumulatorValue = 0;
-            if(!zerocoinDB->ReadAccumulatorValue(newSpend.getAccumulatorChecksum(), bnAccumulatorValue))
-                return state.DoS(100, error("Zerocoinspend could not find accumulator associated with checksum"));
-
-            Accumulator accumulator(Params().Zerocoin_Params(), newSpend.getDenomination(), bnAccumulatorValue);
+            uint32_t nChecksum = newSpend.getAccumulatorChecksum();
+            std::map<uint32_t, CBigNum>::const_iterator itAcc;
+            if (pBatch && (itAcc = pBatch->mapAccumulatorValues.find(nChecksum)) != pBatch->mapAccumulatorValues.end()) {
+                bnAccumulatorValue = itAcc->second;
+            } else {
+                if(!zerocoinDB->ReadAccumulatorValue(nChecksum, bnAccumulatorValue))
+                    return state.DoS(100, error("Zerocoinspend could not find accumulator associated with checksum"));
+                if (pBatch)
+                    pBatch->mapAccumulatorValues.insert(make_pair(nChecksum, bnAccumulatorValue));
+            }
 
-            //Check that the coin is on the accumulator
-            if(!newSpend.Verify(accumulator))
-                return state.DoS(100, error("CheckZerocoinSpend(): zerocoin spend did not verify"));
+            if (pBatch) {
+                //the proof is verified together with the rest of the block, see CheckBlock()
+                pBatch->vChecks.push_back(CZerocoinSpendCheck(newSpend, bnAccumulatorValue));
+            } else {
+                //Check that the coin is on the accumulator
+                if (!CZerocoinSpendCheck(newSpend, bnAccumulatorValue)())
+                    return state.DoS(100, error("CheckZerocoinSpend(): zerocoin spend did not verify"));
+            }
         }
 
         if (serials.count(newSpend.getCoinSerialNumber()))
@@ -1383,23 +1408,10 @@ bool CheckZerocoinSpend(const CTransaction tx, bool fVerifySignature, CValidatio
         return state.DoS(100, error("Transaction spend more than was redeemed in zerocoins"));
     }
 
-    // Send signal to wallet if this is ours
-    if (pwalletMain) {
-        CWalletDB walletdb(pwalletMain->strWalletFile);
-        list <CBigNum> listMySerials = walletdb.ListMintedCoinsSerial();
-        for (const auto& newSpend : vSpends) {
-            list<CBigNum>::iterator it = find(listMySerials.begin(), listMySerials.end(), newSpend.getCoinSerialNumber());
-            if (it != listMySerials.end()) {
-                LogPrintf("%s: %s detected spent zerocoin mint in transaction %s \n", __func__, it->GetHex(), tx.GetHash().GetHex());
-                pwalletMain->NotifyZerocoinChanged(pwalletMain, it->GetHex(), "Used", CT_UPDATED);
-            }
-        }
-    }
-
     return fValidated;
 }
 
-bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state)
+bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state, CZerocoinSpendBatch* pZerocoinBatch)
 {
     // Basic checks that don't depend on any context
     if (tx.vin.empty())
@@ -1457,7 +1469,7 @@ bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fReject
 
             // Do not require signature verification if this is initial sync and a block over 24 hours old
             bool fVerifySignature = !IsInitialBlockDownload() && (GetTime() - chainActive.Tip()->GetBlockTime() < (60*60*24));
-            if (!CheckZerocoinSpend(tx, fVerifySignature, state))
+            if (!CheckZerocoinSpend(tx, fVerifySignature, state, pZerocoinBatch))
                 return state.DoS(100, error("CheckTransaction() : invalid zerocoin spend"));
         }
     }
@@ -1551,6 +1563,15 @@ CAmount GetMinRelayFee(const CTransaction& tx, unsigned int nBytes, bool fAllowF
 }
 
 
+static void LimitMempoolSize(CTxMemPool& pool, size_t limit, unsigned long age)
+{
+    int expired = pool.Expire(GetTime() - age);
+    if (expired != 0)
+        LogPrint("mempool", "Expired %i transactions from the memory pool\n", expired);
+
+    pool.TrimToSize(limit);
+}
+
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee, bool ignoreFees)
 {
     AssertLockHeld(cs_main);
@@ -1723,6 +1744,13 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
                 return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "insufficient priority");
             }
 
+            // Once the pool has been full, new transactions have to outbid what was evicted
+            CAmount mempoolRejectFee = pool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nSize);
+            if (fLimitFree && mempoolRejectFee > 0 && nFees < mempoolRejectFee && !tx.IsZerocoinSpend())
+                return state.DoS(0, error("AcceptToMemoryPool : mempool min fee not met %s, %d < %d",
+                                        hash.ToString(), nFees, mempoolRejectFee),
+                    REJECT_INSUFFICIENTFEE, "mempool min fee not met");
+
             // Continuously rate-limit free (really, very-low-fee) transactions
             // This mitigates 'penny-flooding' -- sending thousands of free transactions just to
             // be annoying or make others' transactions take longer to confirm.
@@ -1752,6 +1780,20 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
                 hash.ToString(),
                 nFees, ::minRelayTxFee.GetFee(nSize) * 10000);
 
+        // Long unconfirmed chains make every later add and removal walk them
+        {
+            LOCK(pool.cs);
+            CTxMemPool::setEntries setAncestors;
+            size_t nLimitAncestors = GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT);
+            size_t nLimitAncestorSize = GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT) * 1000;
+            size_t nLimitDescendants = GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT);
+            size_t nLimitDescendantSize = GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT) * 1000;
+            std::string errString;
+            if (!pool.CalculateMemPoolAncestors(entry, setAncestors, nLimitAncestors, nLimitAncestorSize, nLimitDescendants, nLimitDescendantSize, errString))
+                return state.DoS(0, error("AcceptToMemoryPool : too-long-mempool-chain %s, %s", hash.ToString(), errString),
+                    REJECT_NONSTANDARD, "too-long-mempool-chain");
+        }
+
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
         if (!CheckInputs(tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, true)) {
@@ -1773,6 +1815,11 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
 
         // Store transaction in memory
         pool.addUnchecked(hash, entry);
+
+        // Trim the pool and check whether the transaction survived
+        LimitMempoolSize(pool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+        if (!pool.exists(hash))
+            return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool full");
     }
 
     SyncWithWallets(tx, NULL);
@@ -2086,6 +2133,46 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
     return true;
 }
 
+bool ReadRawBlockFromDisk(CSerializeData& data, const CDiskBlockPos& pos, const uint256& hash, size_t nReserve)
+{
+    // The block is preceded by the message start and its size
+    if (pos.nPos < MESSAGE_START_SIZE + sizeof(unsigned int))
+        return error("%s : bad block position %d:%u", __func__, pos.nFile, pos.nPos);
+    CDiskBlockPos posHeader(pos.nFile, pos.nPos - MESSAGE_START_SIZE - sizeof(unsigned int));
+    CAutoFile filein(OpenBlockFile(posHeader, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s : OpenBlockFile failed", __func__);
+
+    unsigned char pchMessageStart[MESSAGE_START_SIZE];
+    unsigned int nSize;
+    try {
+        filein >> FLATDATA(pchMessageStart) >> nSize;
+    } catch (std::exception& e) {
+        return error("%s : I/O error - %s", __func__, e.what());
+    }
+    if (memcmp(pchMessageStart, Params().MessageStart(), MESSAGE_START_SIZE) != 0)
+        return error("%s : bad message start at %d:%u", __func__, pos.nFile, pos.nPos);
+    if (nSize < 80 || nSize > MAX_BLOCK_SIZE_CURRENT)
+        return error("%s : bad block size %u at %d:%u", __func__, nSize, pos.nFile, pos.nPos);
+
+    data.resize(nReserve + nSize);
+    if (fread(&data[nReserve], 1, nSize, filein.Get()) != nSize)
+        return error("%s : short read at %d:%u", __func__, pos.nFile, pos.nPos);
+
+    // Only the header is decoded, to make sure this is the block the index points to
+    CBlockHeader header;
+    try {
+        CDataStream ssHeader(&data[nReserve], &data[nReserve] + std::min(nSize, 256U), SER_NETWORK, PROTOCOL_VERSION);
+        ssHeader >> header;
+    } catch (std::exception& e) {
+        return error("%s : Deserialize error - %s", __func__, e.what());
+    }
+    if (header.GetHash() != hash)
+        return error("%s : block=%s expected=%s", __func__, header.GetHash().ToString(), hash.ToString());
+
+    return true;
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
 {
     if (!ReadBlockFromDisk(block, pindex->GetBlockPos()))
@@ -2097,6 +2184,19 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
     return true;
 }
 
+/** A block we have the data of, from the recent block cache when it's there */
+static CRecentBlockCache::BlockPtr GetRecentBlock(const CBlockIndex* pindex)
+{
+    CRecentBlockCache::BlockPtr pblock = recentBlockCache.GetBlock(pindex->GetBlockHash());
+    if (!pblock) {
+        CBlock* pblockRead = new CBlock();
+        pblock.reset(pblockRead);
+        if (!ReadBlockFromDisk(*pblockRead, pindex))
+            assert(!"cannot load block from disk");
+    }
+    return pblock;
+}
+
 
 double ConvertBitsToDouble(unsigned int nBits)
 {
@@ -2246,12 +2346,13 @@ void CheckForkWarningConditionsOnNewFork(CBlockIndex* pindexNewForkTip)
     CheckForkWarningConditions();
 }
 
-// Requires cs_main.
 void Misbehaving(NodeId pnode, int howmuch)
 {
     if (howmuch == 0)
         return;
 
+    // The masternode message handlers call this without cs_main
+    LOCK(cs_main);
     CNodeState* state = State(pnode);
     if (state == NULL)
         return;
@@ -2543,6 +2644,8 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
             if(!EraseAccumulatorValues(nCheckpoint, pindex->pprev->nAccumulatorCheckpoint))
                 return error("DisconnectBlock(): failed to erase checkpoint");
         }
+
+        EraseBlockMints(pindex);
     }
 
     if (pfClean) {
@@ -2586,6 +2689,49 @@ void ThreadScriptCheck()
     scriptcheckqueue.Thread();
 }
 
+bool CZerocoinSpendCheck::operator()()
+{
+    // may run on a worker thread, where an exception would not be caught
+    try {
+        Accumulator accumulator(Params().Zerocoin_Params(), spend->getDenomination(), bnAccumulatorValue);
+        return spend->Verify(accumulator);
+    } catch (std::exception& e) {
+        return ::error("CZerocoinSpendCheck(): %s", e.what());
+    }
+}
+
+/** Each zerocoin spend proof is expensive, so workers take them one at a time. */
+static CCheckQueue<CZerocoinSpendCheck> zerocoinspendcheckqueue(1);
+
+/** CheckBlock() is not always called with cs_main held; the queue serves one master at a time. */
+static CCriticalSection cs_zerocoinspendcheckqueue;
+
+void ThreadZerocoinSpendCheck()
+{
+    RenameThread("sling-zcspendch");
+    zerocoinspendcheckqueue.Thread();
+}
+
+/** Verify the zerocoin spend proofs of a block, spread over the -par threads when there are any. */
+static bool VerifyZerocoinSpends(std::vector<CZerocoinSpendCheck>& vChecks)
+{
+    if (vChecks.empty())
+        return true;
+
+    if (!nScriptCheckThreads || vChecks.size() == 1) {
+        for (CZerocoinSpendCheck& check : vChecks) {
+            if (!check())
+                return false;
+        }
+        return true;
+    }
+
+    LOCK(cs_zerocoinspendcheckqueue);
+    CCheckQueueControl<CZerocoinSpendCheck> control(&zerocoinspendcheckqueue);
+    control.Add(vChecks);
+    return control.Wait();
+}
+
 void RecalculateZSLINGMinted()
 {
     CBlockIndex *pindex = chainActive[Params().Zerocoin_AccumulatorStartHeight()];
@@ -2609,6 +2755,9 @@ void RecalculateZSLINGMinted()
         //Record mints to disk
         assert(pblocktree->WriteBlockIndex(CDiskBlockIndex(pindex)));
 
+        //rebuild the mint index from the corrected denominations
+        IndexBlockMints(pindex, block);
+
         if (pindex->nHeight < nHeightEnd)
             pindex = chainActive.Next(pindex);
         else
@@ -2713,6 +2862,7 @@ bool RecalculateSLINGSupply(int nHeightStart)
 
 static int64_t nTimeVerify = 0;
 static int64_t nTimeConnect = 0;
+static int64_t nTimeAccumulator = 0;
 static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
@@ -2958,6 +3108,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     // zerocoin accumulator: if a new accumulator checkpoint was generated, check that it is the correct value
     if (!fVerifyingBlocks && pindex->nHeight >= Params().Zerocoin_StartHeight() && pindex->nHeight % 10 == 0) {
+        int64_t nTimeAccumulatorStart = GetTimeMicros();
         uint256 nCheckpointCalculated = 0;
         if (!CalculateAccumulatorCheckpoint(pindex->nHeight, nCheckpointCalculated))
             return state.DoS(100, error("ConnectBlock() : failed to calculate accumulator checkpoint"));
@@ -2966,6 +3117,9 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             LogPrintf("%s: block=%d calculated: %s\n block: %s\n", __func__, pindex->nHeight, nCheckpointCalculated.GetHex(), block.nAccumulatorCheckpoint.GetHex());
             return state.DoS(100, error("ConnectBlock() : accumulator does not match calculated value"));
         }
+        int64_t nTimeAccumulatorEnd = GetTimeMicros();
+        nTimeAccumulator += nTimeAccumulatorEnd - nTimeAccumulatorStart;
+        LogPrint("bench", "      - Accumulator checkpoint: %.2fms [%.2fs]\n", 0.001 * (nTimeAccumulatorEnd - nTimeAccumulatorStart), nTimeAccumulator * 0.000001);
     } else if (!fVerifyingBlocks) {
         if (block.nAccumulatorCheckpoint != pindex->pprev->nAccumulatorCheckpoint) {
             return state.DoS(100, error("ConnectBlock() : new accumulator checkpoint generated on a block that is not multiple of 10"));
@@ -2981,6 +3135,15 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     if (fJustCheck)
         return true;
 
+    // Keep the mints of this block at hand for the accumulator checkpoints of the next blocks. If they
+    // cannot be parsed the checkpoint calculation reads the block from disk again and fails as before.
+    if (pindex->nHeight >= Params().Zerocoin_AccumulatorStartHeight() && !RecordBlockPubcoins(pindex, block))
+        LogPrint("zero", "%s : failed to record the zerocoin mints of block %d\n", __func__, pindex->nHeight);
+
+    // Index the mints of this block for witness generation. Blocks the index misses are read from disk later.
+    if (!IndexBlockMints(pindex, block))
+        LogPrint("zero", "%s : failed to index the zerocoin mints of block %d\n", __func__, pindex->nHeight);
+
     // Write undo information to disk
     if (pindex->GetUndoPos().IsNull() || !pindex->IsValid(BLOCK_VALID_SCRIPTS)) {
         if (pindex->GetUndoPos().IsNull()) {
@@ -3037,16 +3200,32 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
 {
     LOCK(cs_main);
     static int64_t nLastWrite = 0;
+    static int64_t nLastFlush = 0;
     try {
-        if ((mode == FLUSH_STATE_ALWAYS) ||
-            ((mode == FLUSH_STATE_PERIODIC || mode == FLUSH_STATE_IF_NEEDED) && pcoinsTip->GetCacheSize() > nCoinCacheSize) ||
-            (mode == FLUSH_STATE_PERIODIC && GetTimeMicros() > nLastWrite + DATABASE_WRITE_INTERVAL * 1000000)) {
+        int64_t nNow = GetTimeMicros();
+        // Avoid writing/flushing immediately after startup.
+        if (nLastWrite == 0)
+            nLastWrite = nNow;
+        if (nLastFlush == 0)
+            nLastFlush = nNow;
+        size_t cacheSize = pcoinsTip->DynamicMemoryUsage();
+        // The cache is large and close to the limit, but we have time now (not in the middle of a block processing).
+        bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && cacheSize * (10.0 / 9) > nCoinCacheUsage;
+        // The cache is over the limit, we have to write now.
+        bool fCacheCritical = mode == FLUSH_STATE_IF_NEEDED && cacheSize > nCoinCacheUsage;
+        // It's been a while since we wrote the block index to disk. Do this frequently, so we don't need to redownload after a crash.
+        bool fPeriodicWrite = mode == FLUSH_STATE_PERIODIC && nNow > nLastWrite + (int64_t)DATABASE_WRITE_INTERVAL * 1000000;
+        // It's been very long since we flushed the cache. Do this infrequently, to optimize cache usage.
+        bool fPeriodicFlush = mode == FLUSH_STATE_PERIODIC && nNow > nLastFlush + (int64_t)DATABASE_FLUSH_INTERVAL * 1000000;
+        // Combine all conditions that result in a full cache flush.
+        bool fDoFullFlush = (mode == FLUSH_STATE_ALWAYS) || fCacheLarge || fCacheCritical || fPeriodicFlush;
+        if (fDoFullFlush || fPeriodicWrite) {
             // Typical CCoins structures on disk are around 100 bytes in size.
             // Pushing a new one to the database can cause it to be written
             // twice (once in the log, and once in the tables). This is already
             // an overestimation, as most will delete an existing entry or
             // overwrite one. Still, use a conservative safety factor of 2.
-            if (!CheckDiskSpace(100 * 2 * 2 * pcoinsTip->GetCacheSize()))
+            if (!CheckDiskSpace(fDoFullFlush ? 100 * 2 * 2 * pcoinsTip->GetCacheSize() : 0))
                 return state.Error("out of disk space");
             // First make sure all block and undo data is flushed to disk.
             FlushBlockFile();
@@ -3070,13 +3249,20 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
             }
             pblocktree->Sync();
             // Finally flush the chainstate (which may refer to block index entries).
-            if (!pcoinsTip->Flush())
-                return state.Abort("Failed to write to coin database");
+            if (fDoFullFlush) {
+                int64_t nStart = GetTimeMicros();
+                unsigned int nCoins = pcoinsTip->GetCacheSize();
+                if (!pcoinsTip->Flush())
+                    return state.Abort("Failed to write to coin database");
+                LogPrint("bench", "    - Flush %u coins (%.1fMiB, %lu hits, %lu misses): %.2fms\n", nCoins, cacheSize * (1.0 / 1024 / 1024),
+                    (unsigned long)pcoinsTip->GetCacheHits(), (unsigned long)pcoinsTip->GetCacheMisses(), (GetTimeMicros() - nStart) * 0.001);
+                nLastFlush = nNow;
+            }
             // Update best block in wallet (so we can detect restored wallets).
             if (mode != FLUSH_STATE_IF_NEEDED) {
                 g_signals.SetBestChain(chainActive.GetLocator());
             }
-            nLastWrite = GetTimeMicros();
+            nLastWrite = nNow;
         }
     } catch (const std::runtime_error& e) {
         return state.Abort(std::string("System error while flushing: ") + e.what());
@@ -3094,6 +3280,7 @@ void FlushStateToDisk()
 void static UpdateTip(CBlockIndex* pindexNew)
 {
     chainActive.SetTip(pindexNew);
+    UpdateStakeModifierIndex();
 
     // If turned on AutoZeromint will automatically convert SLING to zSLING
     if (pwalletMain->isZeromintEnabled ())
@@ -3103,10 +3290,10 @@ void static UpdateTip(CBlockIndex* pindexNew)
     nTimeBestReceived = GetTime();
     mempool.AddTransactionsUpdated(1);
 
-    LogPrintf("UpdateTip: new best=%s  height=%d  log2_work=%.8g  tx=%lu  date=%s progress=%f  cache=%u\n",
+    LogPrintf("UpdateTip: new best=%s  height=%d  log2_work=%.8g  tx=%lu  date=%s progress=%f  cache=%.1fMiB(%utx)\n",
         chainActive.Tip()->GetBlockHash().ToString(), chainActive.Height(), log(chainActive.Tip()->nChainWork.getdouble()) / log(2.0), (unsigned long)chainActive.Tip()->nChainTx,
         DateTimeStrFormat("%Y-%m-%d %H:%M:%S", chainActive.Tip()->GetBlockTime()),
-        Checkpoints::GuessVerificationProgress(chainActive.Tip()), (unsigned int)pcoinsTip->GetCacheSize());
+        Checkpoints::GuessVerificationProgress(chainActive.Tip()), pcoinsTip->DynamicMemoryUsage() * (1.0 / (1 << 20)), (unsigned int)pcoinsTip->GetCacheSize());
 
     cvBlockChange.notify_all();
 
@@ -3250,6 +3437,10 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock*
         SyncWithWallets(tx, pblock);
     }
 
+    // Peers will ask for the new tip as soon as we announce it
+    if (!IsInitialBlockDownload())
+        recentBlockCache.Add(*pblock);
+
     int64_t nTime6 = GetTimeMicros();
     nTimePostConnect += nTime6 - nTime5;
     nTimeTotal += nTime6 - nTime1;
@@ -3498,6 +3689,7 @@ bool ActivateBestChain(CValidationState& state, CBlock* pblock, bool fAlreadyChe
         boost::this_thread::interruption_point();
 
         bool fInitialDownload;
+        set<NodeId> setCompactPeers;
         while (true) {
             TRY_LOCK(cs_main, lockMain);
             if (!lockMain) {
@@ -3516,6 +3708,12 @@ bool ActivateBestChain(CValidationState& state, CBlock* pblock, bool fAlreadyChe
 
             pindexNewTip = chainActive.Tip();
             fInitialDownload = IsInitialBlockDownload();
+            if (!fInitialDownload) {
+                for (map<NodeId, CNodeState>::iterator it = mapNodeState.begin(); it != mapNodeState.end(); ++it) {
+                    if (it->second.fPreferCompactBlocks)
+                        setCompactPeers.insert(it->first);
+                }
+            }
             break;
         }
         // When we reach this point, we switched to a new tip (stored in pindexNewTip).
@@ -3525,11 +3723,32 @@ bool ActivateBestChain(CValidationState& state, CBlock* pblock, bool fAlreadyChe
             uint256 hashNewTip = pindexNewTip->GetBlockHash();
             // Relay inventory, but don't relay old inventory during initial block download.
             int nBlockEstimate = Checkpoints::GetTotalBlocksEstimate();
+            // Peers that asked for it get the block itself, as a compact block
+            CCompactBlock cmpctblock;
+            if (!setCompactPeers.empty()) {
+                if (pblock && pblock->GetHash() == hashNewTip)
+                    cmpctblock = CCompactBlock(*pblock);
+                else
+                    cmpctblock = CCompactBlock(*GetRecentBlock(pindexNewTip));
+            }
             {
                 LOCK(cs_vNodes);
-                BOOST_FOREACH (CNode* pnode, vNodes)
-                    if (chainActive.Height() > (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : nBlockEstimate))
-                        pnode->PushInventory(CInv(MSG_BLOCK, hashNewTip));
+                CInv inv(MSG_BLOCK, hashNewTip);
+                BOOST_FOREACH (CNode* pnode, vNodes) {
+                    if (chainActive.Height() <= (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : nBlockEstimate))
+                        continue;
+                    if (setCompactPeers.count(pnode->GetId())) {
+                        {
+                            LOCK(pnode->cs_inventory);
+                            if (pnode->setInventoryKnown.count(inv))
+                                continue;
+                            pnode->setInventoryKnown.insert(inv);
+                        }
+                        pnode->PushMessage("cmpctblock", cmpctblock);
+                    } else {
+                        pnode->PushInventory(inv);
+                    }
+                }
             }
             // Notify external listeners about the new tip.
             uiInterface.NotifyBlockTip(hashNewTip);
@@ -3614,10 +3833,10 @@ bool ReconsiderBlock(CValidationState& state, CBlockIndex* pindex)
     return true;
 }
 
-CBlockIndex* AddToBlockIndex(const CBlock& block)
+CBlockIndex* AddToBlockIndex(const CBlock& block, const uint256* phash = NULL)
 {
     // Check for duplicate
-    uint256 hash = block.GetHash();
+    uint256 hash = phash ? *phash : block.GetHash();
     BlockMap::iterator it = mapBlockIndex.find(hash);
     if (it != mapBlockIndex.end())
         return it->second;
@@ -3943,8 +4162,9 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
     // Check transactions
     bool fZerocoinActive = true;
     vector<CBigNum> vBlockSerials;
+    CZerocoinSpendBatch zerocoinBatch;
     for (const CTransaction& tx : block.vtx) {
-        if (!CheckTransaction(tx, fZerocoinActive, chainActive.Height() + 1 >= Params().Zerocoin_StartHeight(), state))
+        if (!CheckTransaction(tx, fZerocoinActive, chainActive.Height() + 1 >= Params().Zerocoin_StartHeight(), state, &zerocoinBatch))
             return error("CheckBlock() : CheckTransaction failed");
 
         // double check that there are no double spent zSLING spends in this block
@@ -3971,6 +4191,10 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
         return state.DoS(100, error("CheckBlock() : out-of-bounds SigOpCount"),
             REJECT_INVALID, "bad-blk-sigops", true);
 
+    // Zerocoin spend proofs are by far the most expensive check, so they run last
+    if (!VerifyZerocoinSpends(zerocoinBatch.vChecks))
+        return state.DoS(100, error("CheckBlock() : zerocoin spend did not verify"));
+
     return true;
 }
 
@@ -4009,9 +4233,9 @@ bool CheckWork(const CBlock block, CBlockIndex* const pindexPrev)
     return true;
 }
 
-bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex* const pindexPrev)
+bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex* const pindexPrev, const uint256* phash)
 {
-    uint256 hash = block.GetHash();
+    uint256 hash = phash ? *phash : block.GetHash();
 
     if (hash == Params().HashGenesisBlock())
         return true;
@@ -4081,11 +4305,15 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
     return true;
 }
 
-bool AcceptBlockHeader(const CBlock& block, CValidationState& state, CBlockIndex** ppindex)
+/**
+ * phash may point to the already computed hash of block, as done for
+ * headers messages where the whole batch is hashed up front.
+ */
+bool AcceptBlockHeader(const CBlock& block, CValidationState& state, CBlockIndex** ppindex, const uint256* phash = NULL)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
-    uint256 hash = block.GetHash();
+    uint256 hash = phash ? *phash : block.GetHash();
     BlockMap::iterator miSelf = mapBlockIndex.find(hash);
     CBlockIndex* pindex = NULL;
 
@@ -4113,15 +4341,15 @@ bool AcceptBlockHeader(const CBlock& block, CValidationState& state, CBlockIndex
             return state.DoS(0, error("%s : prev block %s not found", __func__, block.hashPrevBlock.ToString().c_str()), 0, "bad-prevblk");
         pindexPrev = (*mi).second;
         if (pindexPrev->nStatus & BLOCK_FAILED_MASK)
-            return state.DoS(100, error("%s : prev block %s is invalid, unable to add block %s", __func__, block.hashPrevBlock.GetHex(), block.GetHash().GetHex()),
+            return state.DoS(100, error("%s : prev block %s is invalid, unable to add block %s", __func__, block.hashPrevBlock.GetHex(), hash.GetHex()),
                              REJECT_INVALID, "bad-prevblk");
     }
 
-    if (!ContextualCheckBlockHeader(block, state, pindexPrev))
+    if (!ContextualCheckBlockHeader(block, state, pindexPrev, &hash))
         return false;
 
     if (pindex == NULL)
-        pindex = AddToBlockIndex(block);
+        pindex = AddToBlockIndex(block, &hash);
 
     if (ppindex)
         *ppindex = pindex;
@@ -4684,7 +4912,7 @@ bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth
             }
         }
         // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
-        if (nCheckLevel >= 3 && pindex == pindexState && (coins.GetCacheSize() + pcoinsTip->GetCacheSize()) <= nCoinCacheSize) {
+        if (nCheckLevel >= 3 && pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
             bool fClean = true;
             if (!DisconnectBlock(block, state, pindex, coins, &fClean))
                 return error("VerifyDB() : *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
@@ -4726,6 +4954,7 @@ void UnloadBlockIndex()
     mapBlockIndex.clear();
     setBlockIndexCandidates.clear();
     chainActive.SetTip(NULL);
+    UpdateStakeModifierIndex();
     pindexBestInvalid = NULL;
 }
 
@@ -5079,6 +5308,52 @@ string GetWarnings(string strFor)
 //
 
 
+/**
+ * Serializes the masternode, budget, spork, obfuscation and swifttx message
+ * handlers. They were written for a single message handler thread and share
+ * state without locks. Taken before any lock those handlers take, and never
+ * with cs_main held. Readers of that state outside those handlers take it too.
+ */
+static CCriticalSection cs_mnMessages;
+
+/**
+ * Whether a message is handled by the block and transaction relay code of
+ * ProcessMessage, which takes cs_main only where it needs it. Message handler
+ * threads run these concurrently for different peers.
+ */
+static bool IsCoreMessage(const std::string& strCommand)
+{
+    static const char* const pszCoreMessages[] = {
+        "version", "verack", "addr", "inv", "getdata", "getblocks", "getheaders", "headers",
+        "tx", "block", "sendcmpct", "cmpctblock", "getblocktxn", "blocktxn", "getaddr",
+        "mempool", "ping", "pong", "alert", "filterload", "filteradd", "filterclear", "reject"};
+    for (unsigned int i = 0; i < ARRAYLEN(pszCoreMessages); i++) {
+        if (strCommand == pszCoreMessages[i])
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Whether an inventory item is a block or a transaction. The others belong to
+ * the masternode, budget, spork, obfuscation and swifttx code and are looked
+ * up under cs_mnMessages.
+ */
+static bool IsCoreInv(const CInv& inv)
+{
+    return inv.type == MSG_TX || inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK;
+}
+
+static bool HasMasternodeInv(const std::deque<CInv>& vInv)
+{
+    BOOST_FOREACH (const CInv& inv, vInv) {
+        if (!IsCoreInv(inv))
+            return true;
+    }
+    return false;
+}
+
+// Requires LOCK(cs_main) for blocks and transactions, LOCK(cs_mnMessages) for the rest
 bool static AlreadyHave(const CInv& inv)
 {
     switch (inv.type) {
@@ -5143,224 +5418,256 @@ bool static AlreadyHave(const CInv& inv)
 }
 
 
+// Requires LOCK(cs_mnMessages) if anything but blocks and transactions was asked for
 void static ProcessGetData(CNode* pfrom)
 {
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
 
     vector<CInv> vNotFound;
 
-    LOCK(cs_main);
+    // A block ends the pass; it is read and sent after cs_main is released
+    CDiskBlockPos posBlock;
+    uint256 hashBlock;
+    bool fContinue = false;
+    uint256 hashContinueTip;
 
-    while (it != pfrom->vRecvGetData.end()) {
-        // Don't bother if send buffer is too full to respond anyway
-        if (pfrom->nSendSize >= SendBufferSize())
-            break;
+    {
+        LOCK(cs_main);
 
-        const CInv& inv = *it;
-        {
-            boost::this_thread::interruption_point();
-            it++;
-
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK) {
-                bool send = false;
-                BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
-                if (mi != mapBlockIndex.end()) {
-                    if (chainActive.Contains(mi->second)) {
-                        send = true;
-                    } else {
-                        // To prevent fingerprinting attacks, only send blocks outside of the active
-                        // chain if they are valid, and no more than a max reorg depth than the best header
-                        // chain we know about.
-                        send = mi->second->IsValid(BLOCK_VALID_SCRIPTS) && (pindexBestHeader != NULL) &&
-                               (chainActive.Height() - mi->second->nHeight < Params().MaxReorganizationDepth());
-                        if (!send) {
-                            LogPrintf("ProcessGetData(): ignoring request from peer=%i for old block that isn't in the main chain\n", pfrom->GetId());
+        while (it != pfrom->vRecvGetData.end()) {
+            // Don't bother if send buffer is too full to respond anyway
+            if (pfrom->nSendSize >= SendBufferSize())
+                break;
+
+            const CInv& inv = *it;
+            {
+                boost::this_thread::interruption_point();
+                it++;
+
+                if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK) {
+                    bool send = false;
+                    BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
+                    if (mi != mapBlockIndex.end()) {
+                        if (chainActive.Contains(mi->second)) {
+                            send = true;
+                        } else {
+                            // To prevent fingerprinting attacks, only send blocks outside of the active
+                            // chain if they are valid, and no more than a max reorg depth than the best header
+                            // chain we know about.
+                            send = mi->second->IsValid(BLOCK_VALID_SCRIPTS) && (pindexBestHeader != NULL) &&
+                                   (chainActive.Height() - mi->second->nHeight < Params().MaxReorganizationDepth());
+                            if (!send) {
+                                LogPrintf("ProcessGetData(): ignoring request from peer=%i for old block that isn't in the main chain\n", pfrom->GetId());
+                            }
                         }
                     }
-                }
-                // Don't send not-validated blocks
-                if (send && (mi->second->nStatus & BLOCK_HAVE_DATA)) {
-                    // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second))
-                        assert(!"cannot load block from disk");
-                    if (inv.type == MSG_BLOCK)
-                        pfrom->PushMessage("block", block);
-                    else // MSG_FILTERED_BLOCK)
-                    {
-                        LOCK(pfrom->cs_filter);
-                        if (pfrom->pfilter) {
-                            CMerkleBlock merkleBlock(block, *pfrom->pfilter);
-                            pfrom->PushMessage("merkleblock", merkleBlock);
-                            // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
-                            // This avoids hurting performance by pointlessly requiring a round-trip
-                            // Note that there is currently no way for a node to request any single transactions we didnt send here -
-                            // they must either disconnect and retry or request the full block.
-                            // Thus, the protocol spec specified allows for us to provide duplicate txn here,
-                            // however we MUST always provide at least what the remote peer needs
-                            typedef std::pair<unsigned int, uint256> PairType;
-                            BOOST_FOREACH (PairType& pair, merkleBlock.vMatchedTxn)
-                                if (!pfrom->setInventoryKnown.count(CInv(MSG_TX, pair.second)))
-                                    pfrom->PushMessage("tx", block.vtx[pair.first]);
+                    // Don't send not-validated blocks
+                    if (send && (mi->second->nStatus & BLOCK_HAVE_DATA)) {
+                        // Peers catching up get old blocks in full, their mempool won't help
+                        bool fCompact = inv.type == MSG_CMPCT_BLOCK && mi->second->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH;
+                        if (inv.type == MSG_BLOCK || (inv.type == MSG_CMPCT_BLOCK && !fCompact)) {
+                            // Sent from the cache or the block file once cs_main is released
+                            posBlock = mi->second->GetBlockPos();
+                            hashBlock = inv.hash;
+                        } else if (fCompact) {
+                            pfrom->PushMessage("cmpctblock", CCompactBlock(*GetRecentBlock(mi->second)));
+                        } else // MSG_FILTERED_BLOCK)
+                        {
+                            CRecentBlockCache::BlockPtr pblock = GetRecentBlock(mi->second);
+                            const CBlock& block = *pblock;
+                            LOCK(pfrom->cs_filter);
+                            if (pfrom->pfilter) {
+                                CMerkleBlock merkleBlock(block, *pfrom->pfilter);
+                                pfrom->PushMessage("merkleblock", merkleBlock);
+                                // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
+                                // This avoids hurting performance by pointlessly requiring a round-trip
+                                // Note that there is currently no way for a node to request any single transactions we didnt send here -
+                                // they must either disconnect and retry or request the full block.
+                                // Thus, the protocol spec specified allows for us to provide duplicate txn here,
+                                // however we MUST always provide at least what the remote peer needs
+                                typedef std::pair<unsigned int, uint256> PairType;
+                                BOOST_FOREACH (PairType& pair, merkleBlock.vMatchedTxn)
+                                    if (!pfrom->setInventoryKnown.count(CInv(MSG_TX, pair.second)))
+                                        pfrom->PushMessage("tx", block.vtx[pair.first]);
+                            }
+                            // else
+                            // no response
                         }
-                        // else
-                        // no response
-                    }
 
-                    // Trigger them to send a getblocks request for the next batch of inventory
-                    if (inv.hash == pfrom->hashContinue) {
-                        // Bypass PushInventory, this must send even if redundant,
-                        // and we want it right after the last block so they don't
-                        // wait for other stuff first.
-                        vector<CInv> vInv;
-                        vInv.push_back(CInv(MSG_BLOCK, chainActive.Tip()->GetBlockHash()));
-                        pfrom->PushMessage("inv", vInv);
-                        pfrom->hashContinue = 0;
+                        // Trigger them to send a getblocks request for the next batch of inventory
+                        if (inv.hash == pfrom->hashContinue) {
+                            fContinue = true;
+                            hashContinueTip = chainActive.Tip()->GetBlockHash();
+                            pfrom->hashContinue = 0;
+                        }
                     }
-                }
-            } else if (inv.IsKnownType()) {
-                // Send stream from relay memory
-                bool pushed = false;
-                {
-                    LOCK(cs_mapRelay);
-                    map<CInv, CDataStream>::iterator mi = mapRelay.find(inv);
-                    if (mi != mapRelay.end()) {
-                        pfrom->PushMessage(inv.GetCommand(), (*mi).second);
-                        pushed = true;
+                } else if (inv.IsKnownType()) {
+                    // Send stream from relay memory
+                    bool pushed = false;
+                    {
+                        LOCK(cs_mapRelay);
+                        map<CInv, CDataStream>::iterator mi = mapRelay.find(inv);
+                        if (mi != mapRelay.end()) {
+                            pfrom->PushMessage(inv.GetCommand(), (*mi).second);
+                            pushed = true;
+                        }
                     }
-                }
 
-                if (!pushed && inv.type == MSG_TX) {
-                    CTransaction tx;
-                    if (mempool.lookup(inv.hash, tx)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << tx;
-                        pfrom->PushMessage("tx", ss);
-                        pushed = true;
+                    if (!pushed && inv.type == MSG_TX) {
+                        CTransaction tx;
+                        if (mempool.lookup(inv.hash, tx)) {
+                            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                            ss.reserve(1000);
+                            ss << tx;
+                            pfrom->PushMessage("tx", ss);
+                            pushed = true;
+                        }
                     }
-                }
-                if (!pushed && inv.type == MSG_TXLOCK_VOTE) {
-                    if (mapTxLockVote.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mapTxLockVote[inv.hash];
-                        pfrom->PushMessage("txlvote", ss);
-                        pushed = true;
+                    if (!pushed && inv.type == MSG_TXLOCK_VOTE) {
+                        if (mapTxLockVote.count(inv.hash)) {
+                            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                            ss.reserve(1000);
+                            ss << mapTxLockVote[inv.hash];
+                            pfrom->PushMessage("txlvote", ss);
+                            pushed = true;
+                        }
                     }
-                }
-                if (!pushed && inv.type == MSG_TXLOCK_REQUEST) {
-                    if (mapTxLockReq.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mapTxLockReq[inv.hash];
-                        pfrom->PushMessage("ix", ss);
-                        pushed = true;
+                    if (!pushed && inv.type == MSG_TXLOCK_REQUEST) {
+                        if (mapTxLockReq.count(inv.hash)) {
+                            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                            ss.reserve(1000);
+                            ss << mapTxLockReq[inv.hash];
+                            pfrom->PushMessage("ix", ss);
+                            pushed = true;
+                        }
                     }
-                }
-                if (!pushed && inv.type == MSG_SPORK) {
-                    if (mapSporks.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mapSporks[inv.hash];
-                        pfrom->PushMessage("spork", ss);
-                        pushed = true;
+                    if (!pushed && inv.type == MSG_SPORK) {
+                        if (mapSporks.count(inv.hash)) {
+                            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                            ss.reserve(1000);
+                            ss << mapSporks[inv.hash];
+                            pfrom->PushMessage("spork", ss);
+                            pushed = true;
+                        }
                     }
-                }
-                if (!pushed && inv.type == MSG_MASTERNODE_WINNER) {
-                    if (masternodePayments.mapMasternodePayeeVotes.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << masternodePayments.mapMasternodePayeeVotes[inv.hash];
-                        pfrom->PushMessage("mnw", ss);
-                        pushed = true;
+                    if (!pushed && inv.type == MSG_MASTERNODE_WINNER) {
+                        if (masternodePayments.mapMasternodePayeeVotes.count(inv.hash)) {
+                            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                            ss.reserve(1000);
+                            ss << masternodePayments.mapMasternodePayeeVotes[inv.hash];
+                            pfrom->PushMessage("mnw", ss);
+                            pushed = true;
+                        }
                     }
-                }
-                if (!pushed && inv.type == MSG_BUDGET_VOTE) {
-                    if (budget.mapSeenMasternodeBudgetVotes.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << budget.mapSeenMasternodeBudgetVotes[inv.hash];
-                        pfrom->PushMessage("mvote", ss);
-                        pushed = true;
+                    if (!pushed && inv.type == MSG_BUDGET_VOTE) {
+                        if (budget.mapSeenMasternodeBudgetVotes.count(inv.hash)) {
+                            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                            ss.reserve(1000);
+                            ss << budget.mapSeenMasternodeBudgetVotes[inv.hash];
+                            pfrom->PushMessage("mvote", ss);
+                            pushed = true;
+                        }
                     }
-                }
 
-                if (!pushed && inv.type == MSG_BUDGET_PROPOSAL) {
-                    if (budget.mapSeenMasternodeBudgetProposals.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << budget.mapSeenMasternodeBudgetProposals[inv.hash];
-                        pfrom->PushMessage("mprop", ss);
-                        pushed = true;
+                    if (!pushed && inv.type == MSG_BUDGET_PROPOSAL) {
+                        if (budget.mapSeenMasternodeBudgetProposals.count(inv.hash)) {
+                            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                            ss.reserve(1000);
+                            ss << budget.mapSeenMasternodeBudgetProposals[inv.hash];
+                            pfrom->PushMessage("mprop", ss);
+                            pushed = true;
+                        }
                     }
-                }
 
-                if (!pushed && inv.type == MSG_BUDGET_FINALIZED_VOTE) {
-                    if (budget.mapSeenFinalizedBudgetVotes.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << budget.mapSeenFinalizedBudgetVotes[inv.hash];
-                        pfrom->PushMessage("fbvote", ss);
-                        pushed = true;
+                    if (!pushed && inv.type == MSG_BUDGET_FINALIZED_VOTE) {
+                        if (budget.mapSeenFinalizedBudgetVotes.count(inv.hash)) {
+                            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                            ss.reserve(1000);
+                            ss << budget.mapSeenFinalizedBudgetVotes[inv.hash];
+                            pfrom->PushMessage("fbvote", ss);
+                            pushed = true;
+                        }
                     }
-                }
 
-                if (!pushed && inv.type == MSG_BUDGET_FINALIZED) {
-                    if (budget.mapSeenFinalizedBudgets.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << budget.mapSeenFinalizedBudgets[inv.hash];
-                        pfrom->PushMessage("fbs", ss);
-                        pushed = true;
+                    if (!pushed && inv.type == MSG_BUDGET_FINALIZED) {
+                        if (budget.mapSeenFinalizedBudgets.count(inv.hash)) {
+                            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                            ss.reserve(1000);
+                            ss << budget.mapSeenFinalizedBudgets[inv.hash];
+                            pfrom->PushMessage("fbs", ss);
+                            pushed = true;
+                        }
                     }
-                }
 
-                if (!pushed && inv.type == MSG_MASTERNODE_ANNOUNCE) {
-                    if (mnodeman.mapSeenMasternodeBroadcast.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mnodeman.mapSeenMasternodeBroadcast[inv.hash];
-                        pfrom->PushMessage("mnb", ss);
-                        pushed = true;
+                    if (!pushed && inv.type == MSG_MASTERNODE_ANNOUNCE) {
+                        if (mnodeman.mapSeenMasternodeBroadcast.count(inv.hash)) {
+                            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                            ss.reserve(1000);
+                            ss << mnodeman.mapSeenMasternodeBroadcast[inv.hash];
+                            pfrom->PushMessage("mnb", ss);
+                            pushed = true;
+                        }
                     }
-                }
 
-                if (!pushed && inv.type == MSG_MASTERNODE_PING) {
-                    if (mnodeman.mapSeenMasternodePing.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mnodeman.mapSeenMasternodePing[inv.hash];
-                        pfrom->PushMessage("mnp", ss);
-                        pushed = true;
+                    if (!pushed && inv.type == MSG_MASTERNODE_PING) {
+                        if (mnodeman.mapSeenMasternodePing.count(inv.hash)) {
+                            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                            ss.reserve(1000);
+                            ss << mnodeman.mapSeenMasternodePing[inv.hash];
+                            pfrom->PushMessage("mnp", ss);
+                            pushed = true;
+                        }
                     }
-                }
 
-                if (!pushed && inv.type == MSG_DSTX) {
-                    if (mapObfuscationBroadcastTxes.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mapObfuscationBroadcastTxes[inv.hash].tx << mapObfuscationBroadcastTxes[inv.hash].vin << mapObfuscationBroadcastTxes[inv.hash].vchSig << mapObfuscationBroadcastTxes[inv.hash].sigTime;
+                    if (!pushed && inv.type == MSG_DSTX) {
+                        if (mapObfuscationBroadcastTxes.count(inv.hash)) {
+                            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                            ss.reserve(1000);
+                            ss << mapObfuscationBroadcastTxes[inv.hash].tx << mapObfuscationBroadcastTxes[inv.hash].vin << mapObfuscationBroadcastTxes[inv.hash].vchSig << mapObfuscationBroadcastTxes[inv.hash].sigTime;
 
-                        pfrom->PushMessage("dstx", ss);
-                        pushed = true;
+                            pfrom->PushMessage("dstx", ss);
+                            pushed = true;
+                        }
                     }
-                }
 
 
-                if (!pushed) {
-                    vNotFound.push_back(inv);
+                    if (!pushed) {
+                        vNotFound.push_back(inv);
+                    }
                 }
-            }
 
-            // Track requests for our stuff.
-            g_signals.Inventory(inv.hash);
+                // Track requests for our stuff.
+                g_signals.Inventory(inv.hash);
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
-                break;
+                if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK)
+                    break;
+            }
         }
     }
 
+    if (!posBlock.IsNull()) {
+        CSerializeData data;
+        CRecentBlockCache::MessagePtr pmessage = recentBlockCache.GetMessage(hashBlock);
+        if (pmessage) {
+            data.assign(pmessage->begin(), pmessage->end());
+        } else {
+            // Send block from disk, without deserializing it
+            if (!ReadRawBlockFromDisk(data, posBlock, hashBlock, CMessageHeader::HEADER_SIZE))
+                assert(!"cannot load block from disk");
+            SetMessageHeader(data, "block");
+        }
+        pfrom->PushSerializedMessage(data);
+    }
+
+    if (fContinue) {
+        // Bypass PushInventory, this must send even if redundant,
+        // and we want it right after the last block so they don't
+        // wait for other stuff first.
+        vector<CInv> vInv;
+        vInv.push_back(CInv(MSG_BLOCK, hashContinueTip));
+        pfrom->PushMessage("inv", vInv);
+    }
+
     pfrom->vRecvGetData.erase(pfrom->vRecvGetData.begin(), it);
 
     if (!vNotFound.empty()) {
@@ -5375,6 +5682,80 @@ void static ProcessGetData(CNode* pfrom)
     }
 }
 
+/**
+ * Ask pfrom to announce new blocks with a compact block from now on, as it
+ * was first to deliver our new tip. Only the most recent few peers are
+ * asked, the one that was asked longest ago goes back to announcing with an
+ * inv. Requires cs_main.
+ */
+void static MaybeSetPeerAsAnnouncingCompact(CNode* pfrom)
+{
+    if (!State(pfrom->GetId())->fSupportsCompactBlocks || !GetBoolArg("-compactblocks", DEFAULT_COMPACT_BLOCKS))
+        return;
+    if (find(lNodesAnnouncingCompact.begin(), lNodesAnnouncingCompact.end(), pfrom->GetId()) != lNodesAnnouncingCompact.end())
+        return;
+
+    if (lNodesAnnouncingCompact.size() >= MAX_COMPACT_BLOCK_ANNOUNCERS) {
+        NodeId nodeid = lNodesAnnouncingCompact.front();
+        lNodesAnnouncingCompact.pop_front();
+        LOCK(cs_vNodes);
+        BOOST_FOREACH (CNode* pnode, vNodes) {
+            if (pnode->GetId() == nodeid) {
+                pnode->PushMessage("sendcmpct", false, COMPACT_BLOCKS_ENCODING_VERSION);
+                break;
+            }
+        }
+    }
+    pfrom->PushMessage("sendcmpct", true, COMPACT_BLOCKS_ENCODING_VERSION);
+    lNodesAnnouncingCompact.push_back(pfrom->GetId());
+}
+
+/** Give up on rebuilding a block from a compact block and ask for all of it */
+void static RequestFullBlock(CNode* pfrom, const uint256& hash)
+{
+    LogPrint("cmpctblock", "requesting full block %s from peer=%d\n", hash.ToString(), pfrom->id);
+    pfrom->PushMessage("getdata", vector<CInv>(1, CInv(MSG_BLOCK, hash)));
+}
+
+/** Validate and store a block a peer sent us, in full or as a compact block */
+void static ProcessBlockFromPeer(CNode* pfrom, CBlock& block, const string& strCommand)
+{
+    uint256 hashBlock = block.GetHash();
+    CInv inv(MSG_BLOCK, hashBlock);
+    pfrom->AddInventoryKnown(inv);
+
+    bool fHaveBlock;
+    {
+        LOCK(cs_main);
+        CNodeState* nodestate = State(pfrom->GetId());
+        if (nodestate->partialBlock && nodestate->partialBlock->GetHash() == hashBlock)
+            nodestate->partialBlock.reset();
+        fHaveBlock = mapBlockIndex.count(hashBlock);
+    }
+
+    CValidationState state;
+    if (!fHaveBlock) {
+        ProcessNewBlock(state, pfrom, &block);
+        int nDoS;
+        if(state.IsInvalid(nDoS)) {
+            pfrom->PushMessage("reject", strCommand, state.GetRejectCode(),
+                               state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash);
+            if(nDoS > 0) {
+                TRY_LOCK(cs_main, lockMain);
+                if(lockMain) Misbehaving(pfrom->GetId(), nDoS);
+            }
+        } else {
+            LOCK(cs_main);
+            if (chainActive.Tip()->GetBlockHash() == hashBlock && !IsInitialBlockDownload())
+                MaybeSetPeerAsAnnouncingCompact(pfrom);
+        }
+        //disconnect this node if its old protocol version
+        pfrom->DisconnectOldProtocol(ActiveProtocol(), strCommand);
+    } else {
+        LogPrint("net", "%s : Already processed block %s, skipping ProcessNewBlock()\n", __func__, hashBlock.GetHex());
+    }
+}
+
 bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv, int64_t nTimeReceived)
 {
     RandAddSeedPerfmon();
@@ -5445,7 +5826,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         pfrom->fClient = !(pfrom->nServices & NODE_NETWORK);
 
         // Potentially mark this peer as a preferred download peer.
-        UpdatePreferredDownload(pfrom, State(pfrom->GetId()));
+        {
+            LOCK(cs_main);
+            UpdatePreferredDownload(pfrom, State(pfrom->GetId()));
+        }
 
         // Change version
         pfrom->PushMessage("verack");
@@ -5515,6 +5899,11 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             LOCK(cs_main);
             State(pfrom->GetId())->fCurrentlyConnected = true;
         }
+
+        // We take compact blocks, but the peer keeps announcing with an inv
+        // until it is the first to bring us a new block
+        if (pfrom->nVersion >= SHORT_IDS_BLOCKS_VERSION && GetBoolArg("-compactblocks", DEFAULT_COMPACT_BLOCKS))
+            pfrom->PushMessage("sendcmpct", false, COMPACT_BLOCKS_ENCODING_VERSION);
     }
 
 
@@ -5588,17 +5977,35 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             return error("message inv size() = %u", vInv.size());
         }
 
+        // Masternode inventory is looked up first, as cs_mnMessages can't be
+        // taken with cs_main held
+        std::vector<char> vMnHave(vInv.size(), false);
+        for (unsigned int nInv = 0; nInv < vInv.size(); nInv++) {
+            if (!IsCoreInv(vInv[nInv])) {
+                LOCK(cs_mnMessages);
+                vMnHave[nInv] = AlreadyHave(vInv[nInv]);
+            }
+        }
+
         LOCK(cs_main);
 
         std::vector<CInv> vToFetch;
 
+        // A single new block is likely made of transactions we already have,
+        // a batch is a peer catching us up
+        int nBlocks = 0;
+        BOOST_FOREACH (const CInv& inv, vInv)
+            nBlocks += inv.type == MSG_BLOCK;
+        bool fFetchCompact = nBlocks == 1 && State(pfrom->GetId())->fSupportsCompactBlocks &&
+                             !IsInitialBlockDownload() && GetBoolArg("-compactblocks", DEFAULT_COMPACT_BLOCKS);
+
         for (unsigned int nInv = 0; nInv < vInv.size(); nInv++) {
             const CInv& inv = vInv[nInv];
 
             boost::this_thread::interruption_point();
             pfrom->AddInventoryKnown(inv);
 
-            bool fAlreadyHave = AlreadyHave(inv);
+            bool fAlreadyHave = IsCoreInv(inv) ? AlreadyHave(inv) : vMnHave[nInv];
             LogPrint("net", "got inv: %s  %s peer=%d\n", inv.ToString(), fAlreadyHave ? "have" : "new", pfrom->id);
 
             if (!fAlreadyHave && !fImporting && !fReindex && inv.type != MSG_BLOCK)
@@ -5609,7 +6016,13 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 UpdateBlockAvailability(pfrom->GetId(), inv.hash);
                 if (!fAlreadyHave && !fImporting && !fReindex && !mapBlocksInFlight.count(inv.hash)) {
                     // Add this to the list of blocks to request
-                    vToFetch.push_back(inv);
+                    vToFetch.push_back(fFetchCompact ? CInv(MSG_CMPCT_BLOCK, inv.hash) : inv);
+                    if (fFetchCompact) {
+                        list<uint256>& lRequested = State(pfrom->GetId())->lCompactBlocksRequested;
+                        if (lRequested.size() >= (unsigned int)MAX_BLOCKS_IN_TRANSIT_PER_PEER)
+                            lRequested.pop_front();
+                        lRequested.push_back(inv.hash);
+                    }
                     LogPrint("net", "getblocks (%d) %s to peer=%d\n", pindexBestHeader->nHeight, inv.hash.ToString(), pfrom->id);
                 }
             }
@@ -5642,8 +6055,9 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         if ((fDebug && vInv.size() > 0) || (vInv.size() == 1))
             LogPrint("net", "received getdata for: %s peer=%d\n", vInv[0].ToString(), pfrom->id);
 
+        // Answered by ProcessMessages when this node is next handled, which
+        // reads and sends blocks without holding any lock
         pfrom->vRecvGetData.insert(pfrom->vRecvGetData.end(), vInv.begin(), vInv.end());
-        ProcessGetData(pfrom);
     }
 
 
@@ -5897,8 +6311,12 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             // Nothing interesting. Stop asking this peers for more headers.
             return true;
         }
+        std::vector<uint256> vHashes(headers.size());
+        XevanBatch(headers.data(), headers.size(), vHashes.data());
+
         CBlockIndex* pindexLast = NULL;
-        BOOST_FOREACH (const CBlockHeader& header, headers) {
+        for (unsigned int n = 0; n < nCount; n++) {
+            const CBlockHeader& header = headers[n];
             CValidationState state;
             if (pindexLast != NULL && header.hashPrevBlock != pindexLast->GetBlockHash()) {
                 Misbehaving(pfrom->GetId(), 20);
@@ -5908,12 +6326,12 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             /*TODO: this has a CBlock cast on it so that it will compile. There should be a solution for this
              * before headers are reimplemented on mainnet
              */
-            if (!AcceptBlockHeader((CBlock)header, state, &pindexLast)) {
+            if (!AcceptBlockHeader((CBlock)header, state, &pindexLast, &vHashes[n])) {
                 int nDoS;
                 if (state.IsInvalid(nDoS)) {
                     if (nDoS > 0)
                         Misbehaving(pfrom->GetId(), nDoS);
-                    std::string strError = "invalid header received " + header.GetHash().ToString();
+                    std::string strError = "invalid header received " + vHashes[n].ToString();
                     return error(strError.c_str());
                 }
             }
@@ -5942,37 +6360,182 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         LogPrint("net", "received block %s peer=%d\n", inv.hash.ToString(), pfrom->id);
 
         //sometimes we will be sent their most recent block and its not the one we want, in that case tell where we are
-        if (!mapBlockIndex.count(block.hashPrevBlock)) {
-            if (find(pfrom->vBlockRequested.begin(), pfrom->vBlockRequested.end(), hashBlock) != pfrom->vBlockRequested.end()) {
-                //we already asked for this block, so lets work backwards and ask for the previous block
-                pfrom->PushMessage("getblocks", chainActive.GetLocator(), block.hashPrevBlock);
-                pfrom->vBlockRequested.push_back(block.hashPrevBlock);
-            } else {
-                //ask to sync to this block
-                pfrom->PushMessage("getblocks", chainActive.GetLocator(), hashBlock);
-                pfrom->vBlockRequested.push_back(hashBlock);
+        {
+            LOCK(cs_main);
+            if (!mapBlockIndex.count(block.hashPrevBlock)) {
+                if (find(pfrom->vBlockRequested.begin(), pfrom->vBlockRequested.end(), hashBlock) != pfrom->vBlockRequested.end()) {
+                    //we already asked for this block, so lets work backwards and ask for the previous block
+                    pfrom->PushMessage("getblocks", chainActive.GetLocator(), block.hashPrevBlock);
+                    pfrom->vBlockRequested.push_back(block.hashPrevBlock);
+                } else {
+                    //ask to sync to this block
+                    pfrom->PushMessage("getblocks", chainActive.GetLocator(), hashBlock);
+                    pfrom->vBlockRequested.push_back(hashBlock);
+                }
+                return true;
+            }
+        }
+        ProcessBlockFromPeer(pfrom, block, strCommand);
+    }
+
+
+    else if (strCommand == "sendcmpct") {
+        bool fAnnounce;
+        uint64_t nEncodingVersion;
+        vRecv >> fAnnounce >> nEncodingVersion;
+        if (nEncodingVersion == COMPACT_BLOCKS_ENCODING_VERSION) {
+            LOCK(cs_main);
+            CNodeState* nodestate = State(pfrom->GetId());
+            nodestate->fSupportsCompactBlocks = true;
+            nodestate->fPreferCompactBlocks = fAnnounce;
+        }
+    }
+
+
+    else if (strCommand == "cmpctblock" && !fImporting && !fReindex) {
+        CCompactBlock cmpctblock;
+        vRecv >> cmpctblock;
+        uint256 hashBlock = cmpctblock.header.GetHash();
+        LogPrint("net", "received compact block %s peer=%d\n", hashBlock.ToString(), pfrom->id);
+
+        pfrom->AddInventoryKnown(CInv(MSG_BLOCK, hashBlock));
+
+        CBlock block;
+        {
+            LOCK(cs_main);
+            UpdateBlockAvailability(pfrom->GetId(), hashBlock);
+
+            // Rebuilding scans the whole mempool, only do it for blocks we asked this peer for
+            // or that it announces because we asked it to
+            list<uint256>& lRequested = State(pfrom->GetId())->lCompactBlocksRequested;
+            list<uint256>::iterator itRequested = find(lRequested.begin(), lRequested.end(), hashBlock);
+            bool fRequested = itRequested != lRequested.end();
+            if (fRequested)
+                lRequested.erase(itRequested);
+            if (!fRequested && find(lNodesAnnouncingCompact.begin(), lNodesAnnouncingCompact.end(), pfrom->GetId()) == lNodesAnnouncingCompact.end()) {
+                LogPrint("net", "peer=%d sent compact block %s we didn't ask for\n", pfrom->id, hashBlock.ToString());
+                return true;
+            }
+
+            if (mapBlockIndex.count(hashBlock))
+                return true;
+
+            // Only blocks on top of our tip are rebuilt, anything else takes the usual route
+            if (cmpctblock.header.hashPrevBlock != chainActive.Tip()->GetBlockHash()) {
+                RequestFullBlock(pfrom, hashBlock);
+                return true;
             }
-        } else {
-            pfrom->AddInventoryKnown(inv);
 
             CValidationState state;
-            if (!mapBlockIndex.count(block.GetHash())) {
-                ProcessNewBlock(state, pfrom, &block);
+            if (!CheckBlockHeader(cmpctblock.header, state, !cmpctblock.IsProofOfStake())) {
                 int nDoS;
-                if(state.IsInvalid(nDoS)) {
-                    pfrom->PushMessage("reject", strCommand, state.GetRejectCode(),
-                                       state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash);
-                    if(nDoS > 0) {
-                        TRY_LOCK(cs_main, lockMain);
-                        if(lockMain) Misbehaving(pfrom->GetId(), nDoS);
-                    }
-                }
-                //disconnect this node if its old protocol version
-                pfrom->DisconnectOldProtocol(ActiveProtocol(), strCommand);
-            } else {
-                LogPrint("net", "%s : Already processed block %s, skipping ProcessNewBlock()\n", __func__, block.GetHash().GetHex());
+                if (state.IsInvalid(nDoS) && nDoS > 0)
+                    Misbehaving(pfrom->GetId(), nDoS);
+                return error("cmpctblock : invalid header for block %s peer=%d", hashBlock.ToString(), pfrom->id);
+            }
+
+            // A proof-of-stake header skips the proof-of-work check, so it must at least be signed
+            // by the key of the prefilled coinstake before we look at our mempool for it
+            CBlock blockPrefilled(cmpctblock.header);
+            for (size_t i = 0; i < cmpctblock.vPrefilled.size() && i < (cmpctblock.IsProofOfStake() ? 2 : 1); i++)
+                blockPrefilled.vtx.push_back(cmpctblock.vPrefilled[i].tx);
+            blockPrefilled.vchBlockSig = cmpctblock.vchBlockSig;
+            if (!blockPrefilled.CheckBlockSignature()) {
+                Misbehaving(pfrom->GetId(), 100);
+                return error("cmpctblock : bad block signature for block %s peer=%d", hashBlock.ToString(), pfrom->id);
+            }
+
+            boost::shared_ptr<CPartialBlock> partialBlock(new CPartialBlock());
+            ReadStatus status = partialBlock->Init(cmpctblock, mempool);
+            if (status == READ_STATUS_INVALID) {
+                Misbehaving(pfrom->GetId(), 100);
+                return error("cmpctblock : invalid compact block %s peer=%d", hashBlock.ToString(), pfrom->id);
+            }
+            if (status == READ_STATUS_FAILED) {
+                // A short id collision can break a block we asked for, a pushed one pays for the scan
+                if (!fRequested)
+                    Misbehaving(pfrom->GetId(), 20);
+                RequestFullBlock(pfrom, hashBlock);
+                return true;
+            }
+
+            CBlockTransactionsRequest req;
+            req.vIndexes = partialBlock->GetMissing();
+            if (!req.vIndexes.empty()) {
+                req.hash = hashBlock;
+                State(pfrom->GetId())->partialBlock = partialBlock;
+                pfrom->PushMessage("getblocktxn", req);
+                return true;
+            }
+
+            if (partialBlock->FillBlock(block, vector<CTransaction>()) != READ_STATUS_OK) {
+                if (!fRequested)
+                    Misbehaving(pfrom->GetId(), 20);
+                RequestFullBlock(pfrom, hashBlock);
+                return true;
+            }
+        }
+        ProcessBlockFromPeer(pfrom, block, strCommand);
+    }
+
+
+    else if (strCommand == "getblocktxn") {
+        CBlockTransactionsRequest req;
+        vRecv >> req;
+
+        LOCK(cs_main);
+
+        BlockMap::iterator mi = mapBlockIndex.find(req.hash);
+        if (mi == mapBlockIndex.end() || !(mi->second->nStatus & BLOCK_HAVE_DATA)) {
+            LogPrint("net", "peer=%d asked for transactions of unknown block %s\n", pfrom->id, req.hash.ToString());
+            return true;
+        }
+
+        // Nobody rebuilds an old block from its mempool, send it whole
+        if (!chainActive.Contains(mi->second) || mi->second->nHeight < chainActive.Height() - MAX_BLOCKTXN_DEPTH) {
+            pfrom->vRecvGetData.push_back(CInv(MSG_BLOCK, req.hash));
+            return true;
+        }
+
+        CRecentBlockCache::BlockPtr pblock = GetRecentBlock(mi->second);
+        CBlockTransactions resp(req);
+        for (size_t i = 0; i < req.vIndexes.size(); i++) {
+            if (req.vIndexes[i] >= pblock->vtx.size()) {
+                Misbehaving(pfrom->GetId(), 100);
+                return error("getblocktxn : out of bounds index %u for block %s peer=%d", req.vIndexes[i], req.hash.ToString(), pfrom->id);
+            }
+            resp.vtx[i] = pblock->vtx[req.vIndexes[i]];
+        }
+        pfrom->PushMessage("blocktxn", resp);
+    }
+
+
+    else if (strCommand == "blocktxn" && !fImporting && !fReindex) {
+        CBlockTransactions resp;
+        vRecv >> resp;
+
+        boost::shared_ptr<CPartialBlock> partialBlock;
+        {
+            LOCK(cs_main);
+            CNodeState* nodestate = State(pfrom->GetId());
+            if (!nodestate->partialBlock || nodestate->partialBlock->GetHash() != resp.hash) {
+                LogPrint("net", "peer=%d sent transactions of block %s we didn't ask for\n", pfrom->id, resp.hash.ToString());
+                return true;
             }
+            partialBlock.swap(nodestate->partialBlock);
+        }
+
+        CBlock block;
+        ReadStatus status = partialBlock->FillBlock(block, resp.vtx);
+        if (status == READ_STATUS_INVALID) {
+            Misbehaving(pfrom->GetId(), 100);
+            return error("blocktxn : wrong transaction count for block %s peer=%d", resp.hash.ToString(), pfrom->id);
         }
+        if (status == READ_STATUS_FAILED) {
+            RequestFullBlock(pfrom, resp.hash);
+            return true;
+        }
+        ProcessBlockFromPeer(pfrom, block, strCommand);
     }
 
 
@@ -6241,8 +6804,14 @@ bool ProcessMessages(CNode* pfrom)
     //
     bool fOk = true;
 
-    if (!pfrom->vRecvGetData.empty())
-        ProcessGetData(pfrom);
+    if (!pfrom->vRecvGetData.empty()) {
+        if (HasMasternodeInv(pfrom->vRecvGetData)) {
+            LOCK(cs_mnMessages);
+            ProcessGetData(pfrom);
+        } else {
+            ProcessGetData(pfrom);
+        }
+    }
 
     // this maintains the order of responses
     if (!pfrom->vRecvGetData.empty()) return fOk;
@@ -6300,7 +6869,15 @@ bool ProcessMessages(CNode* pfrom)
         // Process message
         bool fRet = false;
         try {
-            fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime);
+            if (pfrom->nVersion == 0 || IsCoreMessage(strCommand)) {
+                fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime);
+            } else {
+                // Masternode pings are plentiful; check their signature before queueing for the lock
+                if (strCommand == "mnp")
+                    mnodeman.PrecheckPing(vRecv);
+                LOCK(cs_mnMessages);
+                fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime);
+            }
             boost::this_thread::interruption_point();
         } catch (std::ios_base::failure& e) {
             pfrom->PushMessage("reject", strCommand, REJECT_MALFORMED, string("error parsing message"));
@@ -6542,9 +7119,15 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         //
         // Message: getdata (non-blocks)
         //
+        // cs_mnMessages can only be tried with cs_main held; masternode
+        // inventory that can't be looked up now waits for the next pass
+        TRY_LOCK(cs_mnMessages, lockMn);
+        std::vector<std::pair<int64_t, CInv> > vAskLater;
         while (!pto->fDisconnect && !pto->mapAskFor.empty() && (*pto->mapAskFor.begin()).first <= nNow) {
             const CInv& inv = (*pto->mapAskFor.begin()).second;
-            if (!AlreadyHave(inv)) {
+            if (!lockMn && !IsCoreInv(inv)) {
+                vAskLater.push_back(*pto->mapAskFor.begin());
+            } else if (!AlreadyHave(inv)) {
                 if (fDebug)
                     LogPrint("net", "Requesting %s peer=%d\n", inv.ToString(), pto->id);
                 vGetData.push_back(inv);
@@ -6555,6 +7138,7 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             }
             pto->mapAskFor.erase(pto->mapAskFor.begin());
         }
+        pto->mapAskFor.insert(vAskLater.begin(), vAskLater.end());
         if (!vGetData.empty())
             pto->PushMessage("getdata", vGetData);
     }
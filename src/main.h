@@ -14,6 +14,7 @@
 #endif
 
 #include "amount.h"
+#include "blockcache.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "coins.h"
@@ -42,6 +43,7 @@
 
 #include "libzerocoin/CoinSpend.h"
 
+#include <boost/shared_ptr.hpp>
 #include <boost/unordered_map.hpp>
 
 class CBlockIndex;
@@ -51,6 +53,7 @@ class CSporkDB;
 class CBloomFilter;
 class CInv;
 class CScriptCheck;
+struct CZerocoinSpendBatch;
 class CValidationInterface;
 class CValidationState;
 
@@ -103,14 +106,25 @@ static const unsigned int MAX_HEADERS_RESULTS = 2000;
  *  degree of disordering of blocks on disk (which make reindexing and in the future perhaps pruning
  *  harder). We'll probably want to make this a per-peer adaptive value at some point. */
 static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
-/** Time to wait (in seconds) between writing blockchain state to disk. */
-static const unsigned int DATABASE_WRITE_INTERVAL = 3600;
+/** Time to wait (in seconds) between writing blocks/block index to disk. */
+static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
+/** Time to wait (in seconds) between flushing chainstate to disk. */
+static const unsigned int DATABASE_FLUSH_INTERVAL = 24 * 60 * 60;
 /** Maximum length of reject messages. */
 static const unsigned int MAX_REJECT_MESSAGE_LENGTH = 111;
 
 /** Enable bloom filter */
 static constexpr bool DEFAULT_PEERBLOOMFILTERS = true;
 
+/** Default for -compactblocks, fetching new blocks as short transaction ids */
+static const bool DEFAULT_COMPACT_BLOCKS = true;
+/** Number of peers asked to announce new blocks with a compact block right away */
+static const unsigned int MAX_COMPACT_BLOCK_ANNOUNCERS = 3;
+/** Blocks deeper than this are sent in full when asked for a compact block */
+static const int MAX_CMPCTBLOCK_DEPTH = 5;
+/** Blocks deeper than this are sent in full when asked for some of their transactions */
+static const int MAX_BLOCKTXN_DEPTH = 10;
+
 /** check https://blox.slingcoin.rocks for total amount of coins generated on old chain **/
 static constexpr CAmount STATIC_SWAP_BLOCK_AMOUNT = 1900000 * COIN; //TODO: (Sling) Adjust to total amount of old chain for swap.
 static constexpr CAmount STATIC_POW_PAYMENT_AMOUNT = 7.731 * COIN; //TODO: (Sling) Change to zero
@@ -136,6 +150,7 @@ struct BlockHasher {
 extern CScript COINBASE_FLAGS;
 extern CCriticalSection cs_main;
 extern CTxMemPool mempool;
+extern CRecentBlockCache recentBlockCache;
 typedef boost::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
 extern BlockMap mapBlockIndex;
 extern uint64_t nLastBlockTx;
@@ -150,7 +165,7 @@ extern int nScriptCheckThreads;
 extern bool fTxIndex;
 extern bool fIsBareMultisigStd;
 extern bool fCheckBlockIndex;
-extern unsigned int nCoinCacheSize;
+extern size_t nCoinCacheUsage;
 extern CFeeRate minRelayTxFee;
 extern bool fAlerts;
 extern bool fVerifyingBlocks;
@@ -228,6 +243,8 @@ bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto, bool fSendTrickle);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the zerocoin spend checking thread */
+void ThreadZerocoinSpendCheck();
 
 // ***TODO*** probably not the right place for these 2
 /** Check whether a block hash satisfies the proof-of-work requirement specified by nBits */
@@ -358,9 +375,9 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
 void UpdateCoins(const CTransaction& tx, CValidationState& state, CCoinsViewCache& inputs, CTxUndo& txundo, int nHeight);
 
 /** Context-independent validity checks */
-bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state);
+bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state, CZerocoinSpendBatch* pZerocoinBatch = NULL);
 bool CheckZerocoinMint(const uint256& txHash, const CTxOut& txout, CValidationState& state, bool fCheckOnly = false);
-bool CheckZerocoinSpend(const CTransaction tx, bool fVerifySignature, CValidationState& state);
+bool CheckZerocoinSpend(const CTransaction tx, bool fVerifySignature, CValidationState& state, CZerocoinSpendBatch* pBatch = NULL);
 libzerocoin::CoinSpend TxInToZerocoinSpend(const CTxIn& txin);
 bool TxOutToPublicCoin(const CTxOut txout, libzerocoin::PublicCoin& pubCoin, CValidationState& state);
 bool BlockToPubcoinList(const CBlock& block, list<libzerocoin::PublicCoin>& listPubcoins);
@@ -449,11 +466,48 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
+/**
+ * Closure representing one zerocoin spend proof verification
+ * against the accumulator value the spend was made from
+ */
+class CZerocoinSpendCheck
+{
+private:
+    boost::shared_ptr<libzerocoin::CoinSpend> spend;
+    CBigNum bnAccumulatorValue;
+
+public:
+    CZerocoinSpendCheck() {}
+    CZerocoinSpendCheck(const libzerocoin::CoinSpend& spendIn, const CBigNum& bnAccumulatorValueIn) : spend(new libzerocoin::CoinSpend(spendIn)),
+                                                                                                      bnAccumulatorValue(bnAccumulatorValueIn) {}
+
+    bool operator()();
+
+    void swap(CZerocoinSpendCheck& check)
+    {
+        spend.swap(check.spend);
+        std::swap(bnAccumulatorValue, check.bnAccumulatorValue);
+    }
+};
+
+/**
+ * Zerocoin spend proofs collected while checking the transactions of a block,
+ * so that they can be verified together once all cheaper checks have passed.
+ */
+struct CZerocoinSpendBatch
+{
+    std::vector<CZerocoinSpendCheck> vChecks;
+    //! Accumulator values already read for this block, by checksum
+    std::map<uint32_t, CBigNum> mapAccumulatorValues;
+};
+
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
+/** Read the block at pos as serialized on disk into data, after nReserve bytes at the front that are left alone */
+bool ReadRawBlockFromDisk(CSerializeData& data, const CDiskBlockPos& pos, const uint256& hash, size_t nReserve);
 
 
 /** Functions for validating blocks and updating the block tree */
@@ -476,7 +530,7 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW = t
 bool CheckWork(const CBlock block, CBlockIndex* const pindexPrev);
 
 /** Context-dependent validity checks */
-bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex* pindexPrev);
+bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex* pindexPrev, const uint256* phash = NULL);
 bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindexPrev);
 
 /** Check a block is completely valid from start to finish (only works on top of our current best block, with cs_main held) */
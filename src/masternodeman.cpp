@@ -26,22 +26,6 @@ struct CompareLastPaid {
     }
 };
 
-struct CompareScoreTxIn {
-    bool operator()(const pair<int64_t, CTxIn>& t1,
-        const pair<int64_t, CTxIn>& t2) const
-    {
-        return t1.first < t2.first;
-    }
-};
-
-struct CompareScoreMN {
-    bool operator()(const pair<int64_t, CMasternode>& t1,
-        const pair<int64_t, CMasternode>& t2) const
-    {
-        return t1.first < t2.first;
-    }
-};
-
 //
 // CMasternodeDB
 //
@@ -209,12 +193,80 @@ bool CMasternodeMan::Add(CMasternode& mn)
     if (pmn == NULL) {
         LogPrint("masternode", "CMasternodeMan: Adding new Masternode %s - %i now\n", mn.vin.prevout.hash.ToString(), size() + 1);
         vMasternodes.push_back(mn);
+        mapScoreTables.clear();
+        {
+            LOCK(cs_collaterals);
+            setCollaterals.insert(mn.vin.prevout);
+        }
         return true;
     }
 
     return false;
 }
 
+void CMasternodeMan::UpdateCollaterals()
+{
+    AssertLockHeld(cs);
+
+    std::set<COutPoint> setCollateralsNew;
+    BOOST_FOREACH (const CMasternode& mn, vMasternodes)
+        setCollateralsNew.insert(mn.vin.prevout);
+
+    LOCK(cs_collaterals);
+    setCollaterals.swap(setCollateralsNew);
+
+    // forget the spends of masternodes that are gone, the outpoints cannot come back
+    std::set<COutPoint>::iterator it = setSpentCollaterals.begin();
+    while (it != setSpentCollaterals.end()) {
+        if (setCollaterals.count(*it))
+            ++it;
+        else
+            setSpentCollaterals.erase(it++);
+    }
+
+    // a masternode that is listed again is validated again
+    it = setCheckedCollaterals.begin();
+    while (it != setCheckedCollaterals.end()) {
+        if (setCollaterals.count(*it))
+            ++it;
+        else
+            setCheckedCollaterals.erase(it++);
+    }
+}
+
+bool CMasternodeMan::IsCollateralSpent(const COutPoint& outpoint) const
+{
+    LOCK(cs_collaterals);
+    return setSpentCollaterals.count(outpoint) > 0;
+}
+
+bool CMasternodeMan::IsCollateralChecked(const COutPoint& outpoint) const
+{
+    LOCK(cs_collaterals);
+    return setCheckedCollaterals.count(outpoint) > 0;
+}
+
+void CMasternodeMan::SetCollateralChecked(const COutPoint& outpoint)
+{
+    LOCK(cs_collaterals);
+    if (setCollaterals.count(outpoint))
+        setCheckedCollaterals.insert(outpoint);
+}
+
+void CMasternodeMan::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
+{
+    if (tx.IsCoinBase() || tx.IsZerocoinSpend())
+        return;
+
+    LOCK(cs_collaterals);
+    BOOST_FOREACH (const CTxIn& txin, tx.vin) {
+        if (setCollaterals.count(txin.prevout)) {
+            LogPrint("masternode", "CMasternodeMan::SyncTransaction - collateral %s spent by %s\n", txin.prevout.ToStringShort(), tx.GetHash().ToString());
+            setSpentCollaterals.insert(txin.prevout);
+        }
+    }
+}
+
 void CMasternodeMan::AskForMN(CNode* pnode, CTxIn& vin)
 {
     std::map<COutPoint, int64_t>::iterator i = mWeAskedForMasternodeListEntry.find(vin.prevout);
@@ -279,6 +331,8 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
             }
 
             it = vMasternodes.erase(it);
+            mapScoreTables.clear();
+            UpdateCollaterals();
         } else {
             ++it;
         }
@@ -340,6 +394,8 @@ void CMasternodeMan::Clear()
 {
     LOCK(cs);
     vMasternodes.clear();
+    mapScoreTables.clear();
+    UpdateCollaterals();
     mAskedUsForMasternodeList.clear();
     mWeAskedForMasternodeList.clear();
     mWeAskedForMasternodeListEntry.clear();
@@ -567,42 +623,72 @@ CMasternode* CMasternodeMan::FindRandomNotInVec(std::vector<CTxIn>& vecToExclude
     return NULL;
 }
 
+const std::vector<CMasternodeMan::CMasternodeScore>* CMasternodeMan::GetScoreTable(int64_t nBlockHeight)
+{
+    AssertLockHeld(cs);
+
+    //make sure we know about this block
+    uint256 hash = 0;
+    if (!GetBlockHash(hash, nBlockHeight)) return NULL;
+
+    std::map<int64_t, std::pair<uint256, std::vector<CMasternodeScore> > >::iterator it = mapScoreTables.find(nBlockHeight);
+    if (it != mapScoreTables.end() && it->second.first == hash)
+        return &it->second.second;
+
+    std::vector<CMasternodeScore> vScores;
+    vScores.reserve(vMasternodes.size());
+    for (unsigned int i = 0; i < vMasternodes.size(); i++) {
+        CMasternodeScore score;
+        score.nScore = vMasternodes[i].CalculateScore(hash).GetCompact(false);
+        score.nIndex = i;
+        vScores.push_back(score);
+    }
+    sort(vScores.begin(), vScores.end());
+
+    // ranks are mostly asked for around the tip, so forget the lowest heights first
+    if (it == mapScoreTables.end() && mapScoreTables.size() >= MASTERNODES_SCORE_CACHE_HEIGHTS)
+        mapScoreTables.erase(mapScoreTables.begin());
+
+    std::pair<uint256, std::vector<CMasternodeScore> >& table = mapScoreTables[nBlockHeight];
+    table.first = hash;
+    table.second.swap(vScores);
+    return &table.second;
+}
+
 CMasternode* CMasternodeMan::GetCurrentMasterNode(int mod, int64_t nBlockHeight, int minProtocol)
 {
-    int64_t score = 0;
-    CMasternode* winner = NULL;
+    LOCK(cs);
 
-    // scan for winner
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
+    const std::vector<CMasternodeScore>* pvScores = GetScoreTable(nBlockHeight);
+    if (pvScores == NULL) return NULL;
+
+    // the enabled Masternode with the best score wins
+    BOOST_FOREACH (const CMasternodeScore& score, *pvScores) {
+        if (score.nScore == 0) break;
+
+        CMasternode& mn = vMasternodes[score.nIndex];
         mn.Check();
         if (mn.protocolVersion < minProtocol || !mn.IsEnabled()) continue;
 
-        // calculate the score for each Masternode
-        uint256 n = mn.CalculateScore(mod, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        // determine the winner
-        if (n2 > score) {
-            score = n2;
-            winner = &mn;
-        }
+        return &mn;
     }
 
-    return winner;
+    return NULL;
 }
 
 int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
 {
-    std::vector<pair<int64_t, CTxIn> > vecMasternodeScores;
+    LOCK(cs);
+
     int64_t nMasternode_Min_Age = MN_WINNER_MINIMUM_AGE;
     int64_t nMasternode_Age = 0;
 
-    //make sure we know about this block
-    uint256 hash = 0;
-    if (!GetBlockHash(hash, nBlockHeight)) return -1;
+    const std::vector<CMasternodeScore>* pvScores = GetScoreTable(nBlockHeight);
+    if (pvScores == NULL) return -1;
 
-    // scan for winner
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
+    int rank = 0;
+    BOOST_FOREACH (const CMasternodeScore& score, *pvScores) {
+        CMasternode& mn = vMasternodes[score.nIndex];
         if (mn.protocolVersion < minProtocol) {
             LogPrint("masternode","Skipping Masternode with obsolete version %d\n", mn.protocolVersion);
             continue;                                                       // Skip obsolete versions
@@ -619,18 +705,9 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
             mn.Check();
             if (!mn.IsEnabled()) continue;
         }
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        vecMasternodeScores.push_back(make_pair(n2, mn.vin));
-    }
-
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreTxIn());
 
-    int rank = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CTxIn) & s, vecMasternodeScores) {
         rank++;
-        if (s.second.prevout == vin.prevout) {
+        if (mn.vin.prevout == vin.prevout) {
             return rank;
         }
     }
@@ -640,36 +717,31 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
 
 std::vector<pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t nBlockHeight, int minProtocol)
 {
-    std::vector<pair<int64_t, CMasternode> > vecMasternodeScores;
+    LOCK(cs);
+
     std::vector<pair<int, CMasternode> > vecMasternodeRanks;
 
-    //make sure we know about this block
-    uint256 hash = 0;
-    if (!GetBlockHash(hash, nBlockHeight)) return vecMasternodeRanks;
+    const std::vector<CMasternodeScore>* pvScores = GetScoreTable(nBlockHeight);
+    if (pvScores == NULL) return vecMasternodeRanks;
 
-    // scan for winner
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
+    // enabled Masternodes by score, the others after them
+    std::vector<const CMasternode*> vecDisabled;
+    BOOST_FOREACH (const CMasternodeScore& score, *pvScores) {
+        CMasternode& mn = vMasternodes[score.nIndex];
         mn.Check();
 
         if (mn.protocolVersion < minProtocol) continue;
 
         if (!mn.IsEnabled()) {
-            vecMasternodeScores.push_back(make_pair(9999, mn));
+            vecDisabled.push_back(&mn);
             continue;
         }
 
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        vecMasternodeScores.push_back(make_pair(n2, mn));
+        vecMasternodeRanks.push_back(make_pair(vecMasternodeRanks.size() + 1, mn));
     }
 
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreMN());
-
-    int rank = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CMasternode) & s, vecMasternodeScores) {
-        rank++;
-        vecMasternodeRanks.push_back(make_pair(rank, s.second));
+    BOOST_FOREACH (const CMasternode* pmn, vecDisabled) {
+        vecMasternodeRanks.push_back(make_pair(vecMasternodeRanks.size() + 1, *pmn));
     }
 
     return vecMasternodeRanks;
@@ -677,29 +749,29 @@ std::vector<pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t
 
 CMasternode* CMasternodeMan::GetMasternodeByRank(int nRank, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
 {
-    std::vector<pair<int64_t, CTxIn> > vecMasternodeScores;
+    LOCK(cs);
 
-    // scan for winner
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
+    const std::vector<CMasternodeScore>* pvScores = GetScoreTable(nBlockHeight);
+    if (pvScores == NULL) return NULL;
+
+    // without filters the rank is the position in the table
+    if (minProtocol == 0 && !fOnlyActive) {
+        if (nRank < 1 || nRank > (int)pvScores->size()) return NULL;
+        return &vMasternodes[(*pvScores)[nRank - 1].nIndex];
+    }
+
+    int rank = 0;
+    BOOST_FOREACH (const CMasternodeScore& score, *pvScores) {
+        CMasternode& mn = vMasternodes[score.nIndex];
         if (mn.protocolVersion < minProtocol) continue;
         if (fOnlyActive) {
             mn.Check();
             if (!mn.IsEnabled()) continue;
         }
 
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        vecMasternodeScores.push_back(make_pair(n2, mn.vin));
-    }
-
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreTxIn());
-
-    int rank = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CTxIn) & s, vecMasternodeScores) {
         rank++;
         if (rank == nRank) {
-            return Find(s.second);
+            return &mn;
         }
     }
 
@@ -722,6 +794,38 @@ void CMasternodeMan::ProcessMasternodeConnections()
     }
 }
 
+void CMasternodeMan::PrecheckPing(const CDataStream& vRecvIn)
+{
+    // Message handler threads call this before waiting for cs_main, so that
+    // the signature check in ProcessMessage only hits the signature cache
+    if (fLiteMode) return;
+    if (!masternodeSync.IsBlockchainSynced()) return;
+
+    CDataStream vRecv(vRecvIn);
+    CMasternodePing mnp;
+    try {
+        vRecv >> mnp;
+    } catch (std::exception& e) {
+        return;
+    }
+
+    {
+        TRY_LOCK(cs_process_message, lockProcess);
+        if (lockProcess && mapSeenMasternodePing.count(mnp.GetHash())) return;
+    }
+
+    CPubKey pubKeyMasternode;
+    {
+        LOCK(cs);
+        CMasternode* pmn = Find(mnp.vin);
+        if (pmn == NULL) return;
+        pubKeyMasternode = pmn->pubKeyMasternode;
+    }
+
+    std::string errorMessage;
+    mnp.VerifySignature(pubKeyMasternode, errorMessage);
+}
+
 void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
 {
     if (fLiteMode) return; //disable all Obfuscation/Masternode related functionality
@@ -1140,6 +1244,8 @@ void CMasternodeMan::Remove(CTxIn vin)
         if ((*it).vin == vin) {
             LogPrint("masternode", "CMasternodeMan: Removing Masternode %s - %i now\n", (*it).vin.prevout.hash.ToString(), size() - 1);
             vMasternodes.erase(it);
+            mapScoreTables.clear();
+            UpdateCollaterals();
             break;
         }
         ++it;
@@ -13,9 +13,11 @@
 #include "net.h"
 #include "sync.h"
 #include "util.h"
+#include "validationinterface.h"
 
 #define MASTERNODES_DUMP_SECONDS (15 * 60)
 #define MASTERNODES_DSEG_SECONDS (3 * 60 * 60)
+#define MASTERNODES_SCORE_CACHE_HEIGHTS 128
 
 using namespace std;
 
@@ -48,7 +50,7 @@ public:
     ReadResult Read(CMasternodeMan& mnodemanToLoad, bool fDryRun = false);
 };
 
-class CMasternodeMan
+class CMasternodeMan : public CValidationInterface
 {
 private:
     // critical section to protect the inner data structures
@@ -66,6 +68,38 @@ private:
     // which Masternodes we've asked for
     std::map<COutPoint, int64_t> mWeAskedForMasternodeListEntry;
 
+    // score of the masternode at nIndex in vMasternodes
+    struct CMasternodeScore {
+        uint32_t nScore;
+        uint32_t nIndex;
+
+        // best score first, ties in list order
+        bool operator<(const CMasternodeScore& other) const
+        {
+            return nScore != other.nScore ? nScore > other.nScore : nIndex < other.nIndex;
+        }
+    };
+    // scores of all masternodes by height, best first, with the block hash they were calculated from.
+    // Indexes into vMasternodes, so cleared whenever it changes.
+    std::map<int64_t, std::pair<uint256, std::vector<CMasternodeScore> > > mapScoreTables;
+
+    const std::vector<CMasternodeScore>* GetScoreTable(int64_t nBlockHeight);
+
+    // critical section for the collateral sets only, nothing else is locked while holding it
+    mutable CCriticalSection cs_collaterals;
+    // collaterals of the masternodes in vMasternodes, those of them spent in a block or the mempool,
+    // and those whose inputs were validated once. Kept by outpoint, as masternodes move around in
+    // vMasternodes and are copied by value.
+    std::set<COutPoint> setCollaterals;
+    std::set<COutPoint> setSpentCollaterals;
+    std::set<COutPoint> setCheckedCollaterals;
+
+    void UpdateCollaterals();
+
+protected:
+    // flag the masternodes whose collateral the transaction spends
+    void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
+
 public:
     // Keep track of all broadcasts I've seen
     map<uint256, CMasternodeBroadcast> mapSeenMasternodeBroadcast;
@@ -81,7 +115,11 @@ public:
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
     {
         LOCK(cs);
+        if (ser_action.ForRead())
+            mapScoreTables.clear();
         READWRITE(vMasternodes);
+        if (ser_action.ForRead())
+            UpdateCollaterals();
         READWRITE(mAskedUsForMasternodeList);
         READWRITE(mWeAskedForMasternodeList);
         READWRITE(mWeAskedForMasternodeListEntry);
@@ -120,6 +158,12 @@ public:
     CMasternode* Find(const CTxIn& vin);
     CMasternode* Find(const CPubKey& pubKeyMasternode);
 
+    /// Whether the collateral of a masternode in the list was seen spent
+    bool IsCollateralSpent(const COutPoint& outpoint) const;
+    /// Whether the inputs of a listed masternode's collateral were validated, after which spends are seen here
+    bool IsCollateralChecked(const COutPoint& outpoint) const;
+    void SetCollateralChecked(const COutPoint& outpoint);
+
     /// Find an entry in the masternode list that is next to be paid
     CMasternode* GetNextMasternodeInQueueForPayment(int nBlockHeight, bool fFilterSigTime, int& nCount);
 
@@ -142,6 +186,8 @@ public:
     void ProcessMasternodeConnections();
 
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
+    /// Check the signature of a masternode ping ahead of ProcessMessage
+    void PrecheckPing(const CDataStream& vRecv);
 
     /// Return the number of (unique) Masternodes
     int size() { return vMasternodes.size(); }
@@ -36,51 +36,20 @@ using namespace std;
 // SlingcoinMiner
 //
 
-//
-// Unconfirmed transactions in the memory pool often depend on other
-// transactions in the memory pool. When we select transactions from the
-// pool, we select by highest priority or fee rate, so we might consider
-// transactions that depend on transactions that aren't yet in the block.
-// The COrphan class keeps track of these 'temporary orphans' while
-// CreateBlock is figuring out which transactions to include.
-//
-class COrphan
-{
-public:
-    const CTransaction* ptx;
-    set<uint256> setDependsOn;
-    CFeeRate feeRate;
-    double dPriority;
-
-    COrphan(const CTransaction* ptxIn) : ptx(ptxIn), feeRate(0), dPriority(0)
-    {
-    }
-};
-
 uint64_t nLastBlockTx = 0;
 uint64_t nLastBlockSize = 0;
 int64_t nLastCoinStakeSearchInterval = 0;
 
-// We want to sort transactions by priority and fee rate, so:
-typedef boost::tuple<double, CFeeRate, const CTransaction*> TxPriority;
+// The high-priority area of a block is filled by priority, so:
+typedef boost::tuple<double, CFeeRate, CTxMemPool::txiter> TxPriority;
 class TxPriorityCompare
 {
-    bool byFee;
-
 public:
-    TxPriorityCompare(bool _byFee) : byFee(_byFee) {}
-
     bool operator()(const TxPriority& a, const TxPriority& b)
     {
-        if (byFee) {
-            if (a.get<1>() == b.get<1>())
-                return a.get<0>() < b.get<0>();
+        if (a.get<0>() == b.get<0>())
             return a.get<1>() < b.get<1>();
-        } else {
-            if (a.get<0>() == b.get<0>())
-                return a.get<1>() < b.get<1>();
-            return a.get<0>() < b.get<0>();
-        }
+        return a.get<0>() < b.get<0>();
     }
 };
 
@@ -93,65 +62,41 @@ void UpdateTime(CBlockHeader* pblock, const CBlockIndex* pindexPrev)
         pblock->nBits = GetNextWorkRequired(pindexPrev, pblock);
 }
 
-std::pair<int, uint256> nCheckpointLast;
-CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet, bool fProofOfStake)
-{
-    CReserveKey reservekey(pwallet);
-
-    // Create new block
-    unique_ptr<CBlockTemplate> pblocktemplate(new CBlockTemplate());
-    if (!pblocktemplate.get())
-        return NULL;
-    CBlock* pblock = &pblocktemplate->block; // pointer for convenience
-
-    // -regtest only: allow overriding block.nVersion with
-    // -blockversion=N to test forking scenarios
-    if (Params().MineBlocksOnDemand())
-        pblock->nVersion = GetArg("-blockversion", pblock->nVersion);
-
-    // Make sure to create the correct block version after zerocoin is enabled
-    bool fZerocoinActive = chainActive.Height() + 1 >= Params().Zerocoin_StartHeight();
-    if (fZerocoinActive)
-        pblock->nVersion = 4;
-    else
-        pblock->nVersion = 3;
-
-    // Create coinbase tx
-    CMutableTransaction txNew;
-    txNew.vin.resize(1);
-    txNew.vin[0].prevout.SetNull();
-    txNew.vout.resize(1);
-    txNew.vout[0].scriptPubKey = scriptPubKeyIn;
-    pblock->vtx.push_back(txNew);
-    pblocktemplate->vTxFees.push_back(-1);   // updated at end
-    pblocktemplate->vTxSigOps.push_back(-1); // updated at end
+// The mempool transactions CreateNewBlock() last put into a template,
+// reused while neither the tip, the mempool nor zerocoin maintenance mode
+// changes. Guarded by cs_main.
+struct CTemplateTransactions {
+    const CBlockIndex* pindexPrev;
+    unsigned int nTransactionsUpdated;
+    bool fZerocoinMaintenance;
+    std::vector<CTransaction> vtx;
+    std::vector<CAmount> vTxFees;
+    std::vector<int64_t> vTxSigOps;
+    uint64_t nBlockSize;
+    CAmount nFees;
+
+    CTemplateTransactions() : pindexPrev(NULL), nTransactionsUpdated(0), fZerocoinMaintenance(false), nBlockSize(0), nFees(0) {}
+};
+static CTemplateTransactions templateTxCache;
 
-    // ppcoin: if coinstake available add coinstake tx
-    static int64_t nLastCoinStakeSearchTime = GetAdjustedTime(); // only initialized at startup
+// Transactions that passed CheckInputs() on top of pindexChecked, with
+// the fee and P2SH sigops it found. Guarded by cs_main.
+struct CCheckedTx {
+    CAmount nFees;
+    unsigned int nSigOps;
+};
+static const CBlockIndex* pindexChecked = NULL;
+static map<uint256, CCheckedTx> mapCheckedTx;
 
-    if (fProofOfStake) {
-        boost::this_thread::interruption_point();
-        pblock->nTime = GetAdjustedTime();
-        CBlockIndex* pindexPrev = chainActive.Tip();
-        pblock->nBits = GetNextWorkRequired(pindexPrev, pblock);
-        CMutableTransaction txCoinStake;
-        int64_t nSearchTime = pblock->nTime; // search to current time
-        bool fStakeFound = false;
-        if (nSearchTime >= nLastCoinStakeSearchTime) {
-            unsigned int nTxNewTime = 0;
-            if (pwallet->CreateCoinStake(*pwallet, pblock->nBits, nSearchTime - nLastCoinStakeSearchTime, txCoinStake, nTxNewTime)) {
-                pblock->nTime = nTxNewTime;
-                pblock->vtx[0].vout[0].SetEmpty();
-                pblock->vtx.push_back(CTransaction(txCoinStake));
-                fStakeFound = true;
-            }
-            nLastCoinStakeSearchInterval = nSearchTime - nLastCoinStakeSearchTime;
-            nLastCoinStakeSearchTime = nSearchTime;
-        }
+static void SelectTransactions(const CBlockIndex* pindexPrev, CTemplateTransactions& selected)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(mempool.cs);
 
-        if (!fStakeFound)
-            return NULL;
-    }
+    selected.vtx.clear();
+    selected.vTxFees.clear();
+    selected.vTxSigOps.clear();
+    selected.nFees = 0;
 
     // Largest block you're willing to create:
     unsigned int nBlockMaxSize = GetArg("-blockmaxsize", DEFAULT_BLOCK_MAX_SIZE);
@@ -169,155 +114,170 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
     unsigned int nBlockMinSize = GetArg("-blockminsize", DEFAULT_BLOCK_MIN_SIZE);
     nBlockMinSize = std::min(nBlockMaxSize, nBlockMinSize);
 
-    // Collect memory pool transactions into the block
-    CAmount nFees = 0;
-
-    {
-        LOCK2(cs_main, mempool.cs);
+    const int nHeight = pindexPrev->nHeight + 1;
+    CCoinsViewCache view(pcoinsTip);
+
+    // What CheckInputs() found stays true on a longer chain: the inputs of
+    // a transaction cannot change and coinbase maturity only improves. Only
+    // a reorg, or a transaction that was not checked before, needs a check.
+    if (!pindexChecked || pindexPrev->GetAncestor(pindexChecked->nHeight) != pindexChecked)
+        mapCheckedTx.clear();
+    map<uint256, CCheckedTx> mapChecked;
+    bool fPrintPriority = GetBoolArg("-printpriority", false);
+
+    // Collect transactions into block
+    uint64_t nBlockSize = 1000;
+    int nBlockSigOps = 100;
+    bool fSortedByFee = (nBlockPrioritySize <= 0);
+
+    // Mempool entries already in the block, and entries that cannot go
+    // into it (and so neither can their descendants)
+    CTxMemPool::setEntries inBlock;
+    CTxMemPool::setEntries failedTx;
+
+    // The high-priority area is filled from a heap of all entries by
+    // priority. Entries whose parents are not in the block yet wait in
+    // waitPriMap until the last of them is added.
+    vector<TxPriority> vecPriority;
+    map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash> waitPriMap;
+    TxPriorityCompare comparer;
+    if (!fSortedByFee) {
+        vecPriority.reserve(mempool.mapTx.size());
+        for (CTxMemPool::indexed_transaction_set::iterator mi = mempool.mapTx.begin();
+             mi != mempool.mapTx.end(); ++mi) {
+            double dPriority = mi->GetPriority(nHeight);
+            CAmount dummy = 0;
+            mempool.ApplyDeltas(mi->GetTx().GetHash(), dPriority, dummy);
+            vecPriority.push_back(TxPriority(dPriority, CFeeRate(mi->GetModifiedFee(), mi->GetTxSize()), mi));
+        }
+        std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
+    }
 
-        CBlockIndex* pindexPrev = chainActive.Tip();
-        const int nHeight = pindexPrev->nHeight + 1;
-        CCoinsViewCache view(pcoinsTip);
+    // The rest of the block is filled by the fee rate of each entry
+    // together with the ancestors it needs, best first.
+    CTxMemPool::indexed_transaction_set::index<ancestor_score>::type::iterator mi = mempool.mapTx.get<ancestor_score>().begin();
 
-        // Priority order to process transactions
-        list<COrphan> vOrphan; // list memory doesn't move
-        map<uint256, vector<COrphan*> > mapDependers;
-        bool fPrintPriority = GetBoolArg("-printpriority", false);
+    vector<CBigNum> vBlockSerials;
+    vector<CBigNum> vTxSerials;
+    vector<CTxMemPool::txiter> vPackage;
+    while (true) {
+        vPackage.clear();
 
-        // This vector will be sorted into a priority queue:
-        vector<TxPriority> vecPriority;
-        vecPriority.reserve(mempool.mapTx.size());
-        for (map<uint256, CTxMemPoolEntry>::iterator mi = mempool.mapTx.begin();
-             mi != mempool.mapTx.end(); ++mi) {
-            const CTransaction& tx = mi->second.GetTx();
-            if (tx.IsCoinBase() || tx.IsCoinStake() || !IsFinalTx(tx, nHeight)){
+        if (!fSortedByFee) {
+            if (vecPriority.empty()) {
+                fSortedByFee = true;
                 continue;
             }
 
-            if (GetAdjustedTime() > GetSporkValue(SPORK_16_ZEROCOIN_MAINTENANCE_MODE) && tx.ContainsZerocoins())
+            // Take highest priority transaction off the priority queue:
+            double dPriority = vecPriority.front().get<0>();
+            CTxMemPool::txiter iter = vecPriority.front().get<2>();
+            std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
+            vecPriority.pop_back();
+
+            if (inBlock.count(iter) || failedTx.count(iter))
                 continue;
 
-            COrphan* porphan = NULL;
-            double dPriority = 0;
-            CAmount nTotalIn = 0;
-            bool fMissingInputs = false;
-            for (const CTxIn& txin : tx.vin) {
-                //zerocoinspend has special vin
-                if (tx.IsZerocoinSpend()) {
-                    nTotalIn = tx.GetZerocoinSpent();
+            // Prioritise by fee once past the priority size or we run out of high-priority
+            // transactions:
+            if ((nBlockSize + iter->GetTxSize() >= nBlockPrioritySize) || !AllowFree(dPriority)) {
+                fSortedByFee = true;
+                continue;
+            }
+
+            bool fParentsInBlock = true;
+            BOOST_FOREACH (CTxMemPool::txiter parent, mempool.GetMemPoolParents(iter)) {
+                if (!inBlock.count(parent)) {
+                    fParentsInBlock = false;
                     break;
                 }
+            }
+            if (!fParentsInBlock) {
+                waitPriMap.insert(make_pair(iter, dPriority));
+                continue;
+            }
+            vPackage.push_back(iter);
+        } else {
+            if (mi == mempool.mapTx.get<ancestor_score>().end())
+                break;
+            CTxMemPool::txiter iter = mempool.mapTx.project<0>(mi);
+            ++mi;
 
-                // Read prev transaction
-                if (!view.HaveCoins(txin.prevout.hash)) {
-                    // This should never happen; all transactions in the memory
-                    // pool should connect to either transactions in the chain
-                    // or other transactions in the memory pool.
-                    if (!mempool.mapTx.count(txin.prevout.hash)) {
-                        LogPrintf("ERROR: mempool transaction missing input\n");
-                        if (fDebug) assert("mempool transaction missing input" == 0);
-                        fMissingInputs = true;
-                        if (porphan)
-                            vOrphan.pop_back();
-                        break;
-                    }
+            if (inBlock.count(iter) || failedTx.count(iter))
+                continue;
 
-                    // Has to wait for dependencies
-                    if (!porphan) {
-                        // Use list for automatic deletion
-                        vOrphan.push_back(COrphan(&tx));
-                        porphan = &vOrphan.back();
-                    }
-                    mapDependers[txin.prevout.hash].push_back(porphan);
-                    porphan->setDependsOn.insert(txin.prevout.hash);
-                    nTotalIn += mempool.mapTx[txin.prevout.hash].GetTx().vout[txin.prevout.n].nValue;
-                    continue;
+            CTxMemPool::setEntries setAncestors;
+            mempool.CalculateMemPoolAncestors(*iter, setAncestors);
+            bool fFailedAncestor = false;
+            BOOST_FOREACH (CTxMemPool::txiter ancestor, setAncestors) {
+                if (failedTx.count(ancestor)) {
+                    fFailedAncestor = true;
+                    break;
                 }
-
-                const CCoins* coins = view.AccessCoins(txin.prevout.hash);
-                assert(coins);
-
-                CAmount nValueIn = coins->vout[txin.prevout.n].nValue;
-                nTotalIn += nValueIn;
-
-                int nConf = nHeight - coins->nHeight;
-
-                dPriority += (double)nValueIn * nConf;
+                if (!inBlock.count(ancestor))
+                    vPackage.push_back(ancestor);
+            }
+            if (fFailedAncestor) {
+                failedTx.insert(iter);
+                continue;
+            }
+            vPackage.push_back(iter);
+            std::sort(vPackage.begin(), vPackage.end(), CTxMemPool::CompareIteratorByAncestorCount());
+
+            uint64_t nPackageSize = 0;
+            CAmount nPackageFees = 0;
+            BOOST_FOREACH (CTxMemPool::txiter it, vPackage) {
+                nPackageSize += it->GetTxSize();
+                nPackageFees += it->GetModifiedFee();
             }
-            if (fMissingInputs) continue;
-
-            // Priority is sum(valuein * age) / modified_txsize
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            dPriority = tx.ComputePriority(dPriority, nTxSize);
-
-            uint256 hash = tx.GetHash();
-            mempool.ApplyDeltas(hash, dPriority, nTotalIn);
 
-            CFeeRate feeRate(nTotalIn - tx.GetValueOut(), nTxSize);
+            // Size limits
+            if (nBlockSize + nPackageSize >= nBlockMaxSize)
+                continue;
 
-            if (porphan) {
-                porphan->dPriority = dPriority;
-                porphan->feeRate = feeRate;
-            } else
-                vecPriority.push_back(TxPriority(dPriority, feeRate, &mi->second.GetTx()));
+            // Skip free transactions if we're past the minimum block size:
+            const CTransaction& tx = iter->GetTx();
+            double dPriorityDelta = 0;
+            CAmount nFeeDelta = 0;
+            mempool.ApplyDeltas(tx.GetHash(), dPriorityDelta, nFeeDelta);
+            CFeeRate feeRate(nPackageFees, nPackageSize);
+            if (!tx.IsZerocoinSpend() && (dPriorityDelta <= 0) && (nFeeDelta <= 0) && (feeRate < ::minRelayTxFee) && (nBlockSize + nPackageSize >= nBlockMinSize))
+                continue;
         }
 
-        // Collect transactions into block
-        uint64_t nBlockSize = 1000;
-        uint64_t nBlockTx = 0;
-        int nBlockSigOps = 100;
-        bool fSortedByFee = (nBlockPrioritySize <= 0);
+        for (vector<CTxMemPool::txiter>::const_iterator pit = vPackage.begin(); pit != vPackage.end(); ++pit) {
+            CTxMemPool::txiter iter = *pit;
+            const CTransaction& tx = iter->GetTx();
+            const uint256& hash = tx.GetHash();
 
-        TxPriorityCompare comparer(fSortedByFee);
-        std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
+            // Anything that fails here stays out of this block, with its descendants
+            failedTx.insert(iter);
 
-        vector<CBigNum> vBlockSerials;
-        vector<CBigNum> vTxSerials;
-        while (!vecPriority.empty()) {
-            // Take highest priority transaction off the priority queue:
-            double dPriority = vecPriority.front().get<0>();
-            CFeeRate feeRate = vecPriority.front().get<1>();
-            const CTransaction& tx = *(vecPriority.front().get<2>());
+            if (tx.IsCoinBase() || tx.IsCoinStake() || !IsFinalTx(tx, nHeight))
+                break;
 
-            std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            vecPriority.pop_back();
+            if (GetAdjustedTime() > GetSporkValue(SPORK_16_ZEROCOIN_MAINTENANCE_MODE) && tx.ContainsZerocoins())
+                break;
 
             // Size limits
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+            unsigned int nTxSize = iter->GetTxSize();
             if (nBlockSize + nTxSize >= nBlockMaxSize)
-                continue;
+                break;
 
             // Legacy limits on sigOps:
             unsigned int nMaxBlockSigOps = MAX_BLOCK_SIGOPS_CURRENT;
             unsigned int nTxSigOps = GetLegacySigOpCount(tx);
             if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps)
-                continue;
-
-            // Skip free transactions if we're past the minimum block size:
-            const uint256& hash = tx.GetHash();
-            double dPriorityDelta = 0;
-            CAmount nFeeDelta = 0;
-            mempool.ApplyDeltas(hash, dPriorityDelta, nFeeDelta);
-            if (!tx.IsZerocoinSpend() && fSortedByFee && (dPriorityDelta <= 0) && (nFeeDelta <= 0) && (feeRate < ::minRelayTxFee) && (nBlockSize + nTxSize >= nBlockMinSize))
-                continue;
-
-            // Prioritise by fee once past the priority size or we run out of high-priority
-            // transactions:
-            if (!fSortedByFee &&
-                ((nBlockSize + nTxSize >= nBlockPrioritySize) || !AllowFree(dPriority))) {
-                fSortedByFee = true;
-                comparer = TxPriorityCompare(fSortedByFee);
-                std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            }
+                break;
 
             if (!view.HaveInputs(tx))
-                continue;
+                break;
 
             // double check that there are no double spent zSLING spends in this block or tx
             if (tx.IsZerocoinSpend()) {
                 int nHeightTx = 0;
                 if (IsTransactionInChain(tx.GetHash(), nHeightTx))
-                    continue;
+                    break;
 
                 bool fDoubleSerial = false;
                 for (const CTxIn txIn : tx.vin) {
@@ -336,55 +296,161 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
                 }
                 //This zSLING serial has already been included in the block, do not add this tx.
                 if (fDoubleSerial)
-                    continue;
+                    break;
             }
 
-            CAmount nTxFees = view.GetValueIn(tx) - tx.GetValueOut();
+            CCheckedTx checked;
+            map<uint256, CCheckedTx>::const_iterator itChecked = mapCheckedTx.find(hash);
+            bool fChecked = itChecked != mapCheckedTx.end();
+            if (fChecked) {
+                checked = itChecked->second;
+            } else {
+                checked.nFees = view.GetValueIn(tx) - tx.GetValueOut();
+                checked.nSigOps = GetP2SHSigOpCount(tx, view);
+            }
+            CAmount nTxFees = checked.nFees;
 
-            nTxSigOps += GetP2SHSigOpCount(tx, view);
+            nTxSigOps += checked.nSigOps;
             if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps)
-                continue;
+                break;
 
             // Note that flags: we don't want to set mempool/IsStandard()
             // policy here, but we still have to ensure that the block we
             // create only contains transactions that are valid in new blocks.
             CValidationState state;
-            if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true))
-                continue;
+            if (!fChecked && !CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true))
+                break;
+            mapChecked[hash] = checked;
 
             CTxUndo txundo;
             UpdateCoins(tx, state, view, txundo, nHeight);
 
             // Added
-            pblock->vtx.push_back(tx);
-            pblocktemplate->vTxFees.push_back(nTxFees);
-            pblocktemplate->vTxSigOps.push_back(nTxSigOps);
+            failedTx.erase(iter);
+            inBlock.insert(iter);
+            selected.vtx.push_back(tx);
+            selected.vTxFees.push_back(nTxFees);
+            selected.vTxSigOps.push_back(nTxSigOps);
             nBlockSize += nTxSize;
-            ++nBlockTx;
             nBlockSigOps += nTxSigOps;
-            nFees += nTxFees;
+            selected.nFees += nTxFees;
 
             for (const CBigNum bnSerial : vTxSerials)
                 vBlockSerials.emplace_back(bnSerial);
 
             if (fPrintPriority) {
                 LogPrintf("priority %.1f fee %s txid %s\n",
-                    dPriority, feeRate.ToString(), tx.GetHash().ToString());
+                    iter->GetPriority(nHeight), CFeeRate(iter->GetModifiedFee(), nTxSize).ToString(), hash.ToString());
             }
 
             // Add transactions that depend on this one to the priority queue
-            if (mapDependers.count(hash)) {
-                BOOST_FOREACH (COrphan* porphan, mapDependers[hash]) {
-                    if (!porphan->setDependsOn.empty()) {
-                        porphan->setDependsOn.erase(hash);
-                        if (porphan->setDependsOn.empty()) {
-                            vecPriority.push_back(TxPriority(porphan->dPriority, porphan->feeRate, porphan->ptx));
-                            std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
-                        }
+            if (!fSortedByFee) {
+                BOOST_FOREACH (CTxMemPool::txiter child, mempool.GetMemPoolChildren(iter)) {
+                    map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash>::iterator wpiter = waitPriMap.find(child);
+                    if (wpiter != waitPriMap.end()) {
+                        vecPriority.push_back(TxPriority(wpiter->second, CFeeRate(child->GetModifiedFee(), child->GetTxSize()), child));
+                        std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
+                        waitPriMap.erase(wpiter);
                     }
                 }
             }
         }
+    }
+
+    selected.nBlockSize = nBlockSize;
+    pindexChecked = pindexPrev;
+    mapCheckedTx.swap(mapChecked);
+}
+
+std::pair<int, uint256> nCheckpointLast;
+CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet, bool fProofOfStake)
+{
+    CReserveKey reservekey(pwallet);
+
+    // Create new block
+    unique_ptr<CBlockTemplate> pblocktemplate(new CBlockTemplate());
+    if (!pblocktemplate.get())
+        return NULL;
+    CBlock* pblock = &pblocktemplate->block; // pointer for convenience
+
+    // -regtest only: allow overriding block.nVersion with
+    // -blockversion=N to test forking scenarios
+    if (Params().MineBlocksOnDemand())
+        pblock->nVersion = GetArg("-blockversion", pblock->nVersion);
+
+    // Make sure to create the correct block version after zerocoin is enabled
+    bool fZerocoinActive = chainActive.Height() + 1 >= Params().Zerocoin_StartHeight();
+    if (fZerocoinActive)
+        pblock->nVersion = 4;
+    else
+        pblock->nVersion = 3;
+
+    // Create coinbase tx
+    CMutableTransaction txNew;
+    txNew.vin.resize(1);
+    txNew.vin[0].prevout.SetNull();
+    txNew.vout.resize(1);
+    txNew.vout[0].scriptPubKey = scriptPubKeyIn;
+    pblock->vtx.push_back(txNew);
+    pblocktemplate->vTxFees.push_back(-1);   // updated at end
+    pblocktemplate->vTxSigOps.push_back(-1); // updated at end
+
+    // ppcoin: if coinstake available add coinstake tx
+    static int64_t nLastCoinStakeSearchTime = GetAdjustedTime(); // only initialized at startup
+
+    if (fProofOfStake) {
+        boost::this_thread::interruption_point();
+        pblock->nTime = GetAdjustedTime();
+        CBlockIndex* pindexPrev = chainActive.Tip();
+        pblock->nBits = GetNextWorkRequired(pindexPrev, pblock);
+        CMutableTransaction txCoinStake;
+        int64_t nSearchTime = pblock->nTime; // search to current time
+        bool fStakeFound = false;
+        if (nSearchTime >= nLastCoinStakeSearchTime) {
+            unsigned int nTxNewTime = 0;
+            if (pwallet->CreateCoinStake(*pwallet, pblock->nBits, nSearchTime - nLastCoinStakeSearchTime, txCoinStake, nTxNewTime)) {
+                pblock->nTime = nTxNewTime;
+                pblock->vtx[0].vout[0].SetEmpty();
+                pblock->vtx.push_back(CTransaction(txCoinStake));
+                fStakeFound = true;
+            }
+            nLastCoinStakeSearchInterval = nSearchTime - nLastCoinStakeSearchTime;
+            nLastCoinStakeSearchTime = nSearchTime;
+        }
+
+        if (!fStakeFound)
+            return NULL;
+    }
+
+    // Collect memory pool transactions into the block
+    CAmount nFees = 0;
+
+    {
+        LOCK2(cs_main, mempool.cs);
+
+        CBlockIndex* pindexPrev = chainActive.Tip();
+        const int nHeight = pindexPrev->nHeight + 1;
+
+        // Reuse the last selection while neither the tip nor the mempool has changed.
+        // Spork 16 decides whether zerocoin transactions may be selected, and
+        // neither a spork message nor its time passing touches the mempool.
+        const bool fZerocoinMaintenance = GetAdjustedTime() > GetSporkValue(SPORK_16_ZEROCOIN_MAINTENANCE_MODE);
+        if (templateTxCache.pindexPrev != pindexPrev || templateTxCache.nTransactionsUpdated != mempool.GetTransactionsUpdated() ||
+            templateTxCache.fZerocoinMaintenance != fZerocoinMaintenance) {
+            int64_t nTimeStart = GetTimeMicros();
+            templateTxCache.pindexPrev = NULL;
+            SelectTransactions(pindexPrev, templateTxCache);
+            templateTxCache.pindexPrev = pindexPrev;
+            templateTxCache.nTransactionsUpdated = mempool.GetTransactionsUpdated();
+            templateTxCache.fZerocoinMaintenance = fZerocoinMaintenance;
+            LogPrint("bench", "    - Select transactions: %.2fms (%u txs)\n", 0.001 * (GetTimeMicros() - nTimeStart), templateTxCache.vtx.size());
+        }
+        pblock->vtx.insert(pblock->vtx.end(), templateTxCache.vtx.begin(), templateTxCache.vtx.end());
+        pblocktemplate->vTxFees.insert(pblocktemplate->vTxFees.end(), templateTxCache.vTxFees.begin(), templateTxCache.vTxFees.end());
+        pblocktemplate->vTxSigOps.insert(pblocktemplate->vTxSigOps.end(), templateTxCache.vTxSigOps.begin(), templateTxCache.vTxSigOps.end());
+        uint64_t nBlockSize = templateTxCache.nBlockSize;
+        uint64_t nBlockTx = templateTxCache.vtx.size();
+        nFees = templateTxCache.nFees;
 
         if (!fProofOfStake) {
             //Masternode and general budget payments
@@ -427,6 +493,9 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
         CValidationState state;
         if (!TestBlockValidity(state, *pblock, pindexPrev, false, false)) {
             LogPrintf("CreateNewBlock() : TestBlockValidity failed\n");
+            templateTxCache.pindexPrev = NULL;
+            pindexChecked = NULL;
+            mapCheckedTx.clear();
             mempool.clear();
             return NULL;
         }
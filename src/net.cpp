@@ -106,7 +106,32 @@ NodeId nLastNodeId = 0;
 CCriticalSection cs_nLastNodeId;
 
 static CSemaphore* semOutbound = NULL;
-boost::condition_variable messageHandlerCondition;
+
+// Nodes waiting for a message handler thread, each holding a reference
+static std::deque<CNode*> vProcessQueue;
+static boost::mutex mutexProcessQueue;
+static boost::condition_variable condProcessQueue;
+
+/**
+ * Have a message handler thread process pnode's messages and call
+ * SendMessages for it, with trickle if fTrickle. A node that is already
+ * being handled is queued again once that thread is done with it.
+ */
+static void ScheduleMessageHandler(CNode* pnode, bool fTrickle = false)
+{
+    boost::unique_lock<boost::mutex> lock(mutexProcessQueue);
+    if (fTrickle)
+        pnode->fProcessTrickle = true;
+    if (pnode->fProcessScheduled) {
+        if (pnode->fProcessRunning)
+            pnode->fProcessAgain = true;
+        return;
+    }
+    pnode->fProcessScheduled = true;
+    pnode->AddRef();
+    vProcessQueue.push_back(pnode);
+    condProcessQueue.notify_one();
+}
 
 // Signals for message handling
 static CNodeSignals g_signals;
@@ -446,9 +471,14 @@ CNode* ConnectNode(CAddress addrConnect, const char* pszDest, bool obfuScationMa
 void CNode::CloseSocketDisconnect()
 {
     fDisconnect = true;
-    if (hSocket != INVALID_SOCKET) {
-        LogPrint("net", "disconnecting peer=%d\n", id);
-        CloseSocket(hSocket);
+    {
+        // Other threads change the epoll interest of hSocket under cs_vSend,
+        // so the descriptor must not be closed (and maybe reused) meanwhile
+        LOCK(cs_vSend);
+        if (hSocket != INVALID_SOCKET) {
+            LogPrint("net", "disconnecting peer=%d\n", id);
+            CloseSocket(hSocket);
+        }
     }
 
     // in case this fails, we'll empty the recv buffer when the CNode is deleted
@@ -582,6 +612,7 @@ void CNode::copyStats(CNodeStats& stats)
 // requires LOCK(cs_vRecvMsg)
 bool CNode::ReceiveMsgBytes(const char* pch, unsigned int nBytes)
 {
+    bool fComplete = false;
     while (nBytes > 0) {
         // get current incomplete message, or create a new one
         if (vRecvMsg.empty() ||
@@ -610,10 +641,13 @@ bool CNode::ReceiveMsgBytes(const char* pch, unsigned int nBytes)
 
         if (msg.complete()) {
             msg.nTime = GetTimeMicros();
-            messageHandlerCondition.notify_one();
+            fComplete = true;
         }
     }
 
+    if (fComplete)
+        ScheduleMessageHandler(this);
+
     return true;
 }
 
@@ -664,9 +698,294 @@ int CNetMessage::readData(const char* pch, unsigned int nBytes)
 }
 
 
+/**
+ * Tells ThreadSocketHandler which sockets are ready, through the
+ * fSocketRecvReady and fSocketSendReady flags of their nodes.
+ *
+ * With epoll, nodes register their socket once, edge-triggered, and send
+ * readiness is only armed while vSendMsg holds data; the flags then stay set
+ * until the socket would block. Otherwise every wait polls all sockets again,
+ * level-triggered, and the flags only describe the last wait.
+ */
+class CSocketEvents
+{
+public:
+    CSocketEvents()
+    {
+#ifdef USE_EPOLL
+        hEpoll = epoll_create1(EPOLL_CLOEXEC);
+        fListenRegistered = false;
+        vEvents.resize(256);
+#endif
+    }
+
+    ~CSocketEvents()
+    {
+#ifdef USE_EPOLL
+        if (hEpoll != -1)
+            close(hEpoll);
+#endif
+    }
+
+    //! Start watching the socket of a new node
+    void Add(CNode* pnode)
+    {
+        pnode->fPollSend = false;
+#ifdef USE_EPOLL
+        if (hEpoll != -1) {
+            struct epoll_event event = {};
+            event.events = EPOLLIN | EPOLLET;
+            event.data.ptr = pnode;
+            if (epoll_ctl(hEpoll, EPOLL_CTL_ADD, pnode->hSocket, &event) == -1)
+                LogPrintf("socket epoll_ctl error %s\n", NetworkErrorString(errno));
+        }
+#endif
+    }
+
+    /**
+     * Wait for send readiness while the node has data queued. Requires
+     * LOCK(pnode->cs_vSend), which CNode::CloseSocketDisconnect also holds
+     * while closing hSocket.
+     */
+    void WantSend(CNode* pnode, bool fWant)
+    {
+        if (pnode->fPollSend == fWant || pnode->hSocket == INVALID_SOCKET)
+            return;
+        pnode->fPollSend = fWant;
+#ifdef USE_EPOLL
+        if (hEpoll != -1) {
+            // Arming EPOLLOUT reports the socket at once if it can already take data
+            struct epoll_event event = {};
+            event.events = EPOLLIN | EPOLLET;
+            if (fWant)
+                event.events |= EPOLLOUT;
+            event.data.ptr = pnode;
+            if (epoll_ctl(hEpoll, EPOLL_CTL_MOD, pnode->hSocket, &event) == -1)
+                LogPrintf("socket epoll_ctl error %s\n", NetworkErrorString(errno));
+        }
+#endif
+    }
+
+    /**
+     * Wait up to nTimeout milliseconds for any of the sockets to become
+     * ready. Readable listening sockets are returned in vListenReady.
+     */
+    void Wait(const std::vector<CNode*>& vNodes, int nTimeout, std::vector<SOCKET>& vListenReady)
+    {
+        vListenReady.clear();
+#ifdef USE_EPOLL
+        if (hEpoll != -1) {
+            WaitEpoll(nTimeout, vListenReady);
+            return;
+        }
+#endif
+        WaitLevelTriggered(vNodes, nTimeout, vListenReady);
+    }
+
+private:
+#ifdef USE_EPOLL
+    int hEpoll;
+    bool fListenRegistered;
+    std::vector<struct epoll_event> vEvents;
+
+    void WaitEpoll(int nTimeout, std::vector<SOCKET>& vListenReady)
+    {
+        if (!fListenRegistered) {
+            // Level-triggered, so that pending connections keep being reported
+            // while we accept one per pass
+            BOOST_FOREACH (const ListenSocket& hListenSocket, vhListenSocket) {
+                struct epoll_event event = {};
+                event.events = EPOLLIN;
+                event.data.ptr = NULL;
+                if (epoll_ctl(hEpoll, EPOLL_CTL_ADD, hListenSocket.socket, &event) == -1)
+                    LogPrintf("socket epoll_ctl error %s\n", NetworkErrorString(errno));
+            }
+            fListenRegistered = true;
+        }
+
+        int nEvents = epoll_wait(hEpoll, &vEvents[0], vEvents.size(), nTimeout);
+        boost::this_thread::interruption_point();
+        if (nEvents == -1) {
+            if (errno != EINTR) {
+                LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(errno));
+                MilliSleep(nTimeout);
+            }
+            return;
+        }
+
+        bool fListen = false;
+        for (int i = 0; i < nEvents; i++) {
+            CNode* pnode = static_cast<CNode*>(vEvents[i].data.ptr);
+            if (pnode == NULL) {
+                // Listening sockets are non-blocking, so trying them all is fine
+                fListen = true;
+                continue;
+            }
+            // Nodes are only deleted after their socket was closed, which
+            // removes it from the epoll set
+            if (vEvents[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+                pnode->fSocketRecvReady = true;
+            if (vEvents[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+                pnode->fSocketSendReady = true;
+        }
+        if (fListen) {
+            BOOST_FOREACH (const ListenSocket& hListenSocket, vhListenSocket)
+                vListenReady.push_back(hListenSocket.socket);
+        }
+    }
+#endif
+
+    static bool ShouldSend(CNode* pnode)
+    {
+        TRY_LOCK(pnode->cs_vSend, lockSend);
+        return lockSend && !pnode->vSendMsg.empty();
+    }
+
+    void WaitLevelTriggered(const std::vector<CNode*>& vNodes, int nTimeout, std::vector<SOCKET>& vListenReady)
+    {
+        std::vector<CNode*> vNodesWaiting;
+#ifdef USE_POLL
+        std::vector<struct pollfd> vPollFds;
+        BOOST_FOREACH (const ListenSocket& hListenSocket, vhListenSocket) {
+            struct pollfd pollfd = {};
+            pollfd.fd = hListenSocket.socket;
+            pollfd.events = POLLIN;
+            vPollFds.push_back(pollfd);
+        }
+#else
+        fd_set fdsetRecv;
+        fd_set fdsetSend;
+        fd_set fdsetError;
+        FD_ZERO(&fdsetRecv);
+        FD_ZERO(&fdsetSend);
+        FD_ZERO(&fdsetError);
+        SOCKET hSocketMax = 0;
+        bool have_fds = false;
+
+        BOOST_FOREACH (const ListenSocket& hListenSocket, vhListenSocket) {
+            FD_SET(hListenSocket.socket, &fdsetRecv);
+            hSocketMax = max(hSocketMax, hListenSocket.socket);
+            have_fds = true;
+        }
+#endif
+
+        BOOST_FOREACH (CNode* pnode, vNodes) {
+            pnode->fSocketRecvReady = false;
+            pnode->fSocketSendReady = false;
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+            bool fSend = ShouldSend(pnode);
+            bool fRecv = !fSend && ShouldReceive(pnode);
+            vNodesWaiting.push_back(pnode);
+#ifdef USE_POLL
+            struct pollfd pollfd = {};
+            pollfd.fd = pnode->hSocket;
+            pollfd.events = (fSend ? POLLOUT : 0) | (fRecv ? POLLIN : 0);
+            vPollFds.push_back(pollfd);
+#else
+            FD_SET(pnode->hSocket, &fdsetError);
+            hSocketMax = max(hSocketMax, pnode->hSocket);
+            have_fds = true;
+            if (fSend)
+                FD_SET(pnode->hSocket, &fdsetSend);
+            if (fRecv)
+                FD_SET(pnode->hSocket, &fdsetRecv);
+#endif
+        }
+
+#ifdef USE_POLL
+        int nPoll = poll(vPollFds.empty() ? NULL : &vPollFds[0], vPollFds.size(), nTimeout);
+        boost::this_thread::interruption_point();
+        if (nPoll == SOCKET_ERROR) {
+            int nErr = WSAGetLastError();
+            if (nErr != WSAEINTR) {
+                LogPrintf("socket poll error %s\n", NetworkErrorString(nErr));
+                MilliSleep(nTimeout);
+            }
+            return;
+        }
+
+        for (size_t i = 0; i < vPollFds.size(); i++) {
+            if (i < vhListenSocket.size()) {
+                if (vPollFds[i].revents & POLLIN)
+                    vListenReady.push_back(vPollFds[i].fd);
+                continue;
+            }
+            CNode* pnode = vNodesWaiting[i - vhListenSocket.size()];
+            if (vPollFds[i].revents & (POLLIN | POLLERR | POLLHUP | POLLNVAL))
+                pnode->fSocketRecvReady = true;
+            if (vPollFds[i].revents & POLLOUT)
+                pnode->fSocketSendReady = true;
+        }
+#else
+        struct timeval timeout;
+        timeout.tv_sec = nTimeout / 1000;
+        timeout.tv_usec = (nTimeout % 1000) * 1000;
+
+        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+            &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+        boost::this_thread::interruption_point();
+
+        if (nSelect == SOCKET_ERROR) {
+            if (have_fds) {
+                int nErr = WSAGetLastError();
+                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+                BOOST_FOREACH (const ListenSocket& hListenSocket, vhListenSocket)
+                    vListenReady.push_back(hListenSocket.socket);
+                BOOST_FOREACH (CNode* pnode, vNodesWaiting)
+                    pnode->fSocketRecvReady = true;
+            }
+            MilliSleep(nTimeout);
+            return;
+        }
+
+        BOOST_FOREACH (const ListenSocket& hListenSocket, vhListenSocket) {
+            if (FD_ISSET(hListenSocket.socket, &fdsetRecv))
+                vListenReady.push_back(hListenSocket.socket);
+        }
+        BOOST_FOREACH (CNode* pnode, vNodesWaiting) {
+            if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError))
+                pnode->fSocketRecvReady = true;
+            if (FD_ISSET(pnode->hSocket, &fdsetSend))
+                pnode->fSocketSendReady = true;
+        }
+#endif
+    }
+
+public:
+    /**
+     * Implement the following logic:
+     * * If there is data to send, wait for sending data. As this only
+     *   happens when optimistic write failed, we choose to first drain the
+     *   write buffer in this case before receiving more. This avoids
+     *   needlessly queueing received data, if the remote peer is not themselves
+     *   receiving data. This means properly utilizing TCP flow control signalling.
+     * * Otherwise, if there is no (complete) message in the receive buffer,
+     *   or there is space left in the buffer, receive data.
+     * * (if neither of the above applies, there is certainly one message
+     *   in the receiver buffer ready to be processed).
+     * Together, that means that at least one of the following is always possible,
+     * so we don't deadlock:
+     * * We send some data.
+     * * We wait for data to be received (and disconnect after timeout).
+     * * We process a message in the buffer (message handler thread).
+     */
+    static bool ShouldReceive(CNode* pnode)
+    {
+        if (ShouldSend(pnode))
+            return false;
+        TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+        return lockRecv && (pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
+                               pnode->GetTotalRecvSize() <= ReceiveFloodSize());
+    }
+};
+
+static CSocketEvents socketEvents;
+
 // requires LOCK(cs_vSend)
 void SocketSendData(CNode* pnode)
 {
+    bool fWasFull = pnode->nSendSize >= SendBufferSize();
     std::deque<CSerializeData>::iterator it = pnode->vSendMsg.begin();
 
     while (it != pnode->vSendMsg.end()) {
@@ -705,6 +1024,11 @@ void SocketSendData(CNode* pnode)
         assert(pnode->nSendSize == 0);
     }
     pnode->vSendMsg.erase(pnode->vSendMsg.begin(), it);
+    socketEvents.WantSend(pnode, !pnode->vSendMsg.empty());
+
+    // ProcessMessages stops while the send buffer is full
+    if (fWasFull && pnode->nSendSize < SendBufferSize())
+        ScheduleMessageHandler(pnode);
 }
 
 static list<CNode*> vNodesDisconnected;
@@ -712,6 +1036,7 @@ static list<CNode*> vNodesDisconnected;
 void ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
+    bool fMoreWork = false;
     while (true) {
         //
         // Disconnect nodes
@@ -775,88 +1100,27 @@ void ThreadSocketHandler()
         }
 
         //
-        // Find which sockets have data to receive
+        // Wait for sockets to become ready
         //
-        struct timeval timeout;
-        timeout.tv_sec = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        BOOST_FOREACH (const ListenSocket& hListenSocket, vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
-
+        vector<CNode*> vNodesCopy;
         {
             LOCK(cs_vNodes);
-            BOOST_FOREACH (CNode* pnode, vNodes) {
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is no (complete) message in the receive buffer,
-                //   or there is space left in the buffer, select() for receiving data.
-                // * (if neither of the above applies, there is certainly one message
-                //   in the receiver buffer ready to be processed).
-                // Together, that means that at least one of the following is always possible,
-                // so we don't deadlock:
-                // * We send some data.
-                // * We wait for data to be received (and disconnect after timeout).
-                // * We process a message in the buffer (message handler thread).
-                {
-                    TRY_LOCK(pnode->cs_vSend, lockSend);
-                    if (lockSend && !pnode->vSendMsg.empty()) {
-                        FD_SET(pnode->hSocket, &fdsetSend);
-                        continue;
-                    }
-                }
-                {
-                    TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                    if (lockRecv && (pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
-                                        pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
-                        FD_SET(pnode->hSocket, &fdsetRecv);
-                }
-            }
+            vNodesCopy = vNodes;
+            BOOST_FOREACH (CNode* pnode, vNodesCopy)
+                pnode->AddRef();
         }
 
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-            &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
-        boost::this_thread::interruption_point();
-
-        if (nSelect == SOCKET_ERROR) {
-            if (have_fds) {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            MilliSleep(timeout.tv_usec / 1000);
-        }
+        // Don't sleep while a socket may still have data left from the last pass
+        vector<SOCKET> vListenReady;
+        socketEvents.Wait(vNodesCopy, fMoreWork ? 0 : 50, vListenReady);
+        fMoreWork = false;
 
         //
         // Accept new connections
         //
         BOOST_FOREACH (const ListenSocket& hListenSocket, vhListenSocket) {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv)) {
+            if (hListenSocket.socket != INVALID_SOCKET &&
+                find(vListenReady.begin(), vListenReady.end(), hListenSocket.socket) != vListenReady.end()) {
                 struct sockaddr_storage sockaddr;
                 socklen_t len = sizeof(sockaddr);
                 SOCKET hSocket = accept(hListenSocket.socket, (struct sockaddr*)&sockaddr, &len);
@@ -904,13 +1168,6 @@ void ThreadSocketHandler()
         //
         // Service each socket
         //
-        vector<CNode*> vNodesCopy;
-        {
-            LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            BOOST_FOREACH (CNode* pnode, vNodesCopy)
-                pnode->AddRef();
-        }
         BOOST_FOREACH (CNode* pnode, vNodesCopy) {
             boost::this_thread::interruption_point();
 
@@ -919,7 +1176,7 @@ void ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError)) {
+            if (pnode->fSocketRecvReady && CSocketEvents::ShouldReceive(pnode)) {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
                 if (lockRecv) {
                     {
@@ -932,6 +1189,8 @@ void ThreadSocketHandler()
                             pnode->nLastRecv = GetTime();
                             pnode->nRecvBytes += nBytes;
                             pnode->RecordBytesRecv(nBytes);
+                            // Keep reading until the socket would block
+                            fMoreWork = true;
                         } else if (nBytes == 0) {
                             // socket closed gracefully
                             if (!pnode->fDisconnect)
@@ -940,7 +1199,9 @@ void ThreadSocketHandler()
                         } else if (nBytes < 0) {
                             // error
                             int nErr = WSAGetLastError();
-                            if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS) {
+                            if (nErr == WSAEWOULDBLOCK) {
+                                pnode->fSocketRecvReady = false;
+                            } else if (nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS) {
                                 if (!pnode->fDisconnect)
                                     LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
                                 pnode->CloseSocketDisconnect();
@@ -955,10 +1216,12 @@ void ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetSend)) {
+            if (pnode->fSocketSendReady) {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
-                if (lockSend)
+                if (lockSend) {
                     SocketSendData(pnode);
+                    pnode->fSocketSendReady = false;
+                }
             }
 
             //
@@ -1360,13 +1623,79 @@ bool OpenNetworkConnection(const CAddress& addrConnect, CSemaphoreGrant* grantOu
 }
 
 
-void ThreadMessageHandler()
+// Handle one node for a message handler thread, returns whether it has more work
+static bool HandleNodeMessages(CNode* pnode, bool fTrickle)
 {
-    boost::mutex condition_mutex;
-    boost::unique_lock<boost::mutex> lock(condition_mutex);
+    if (pnode->fDisconnect)
+        return false;
+
+    // Receive messages
+    bool fMore = false;
+    {
+        LOCK(pnode->cs_vRecvMsg);
+        if (!g_signals.ProcessMessages(pnode))
+            pnode->CloseSocketDisconnect();
+
+        if (pnode->nSendSize < SendBufferSize()) {
+            if (!pnode->vRecvGetData.empty() || (!pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].complete())) {
+                fMore = true;
+            }
+        }
+    }
+    boost::this_thread::interruption_point();
+
+    // Send messages
+    {
+        TRY_LOCK(pnode->cs_vSend, lockSend);
+        if (lockSend)
+            g_signals.SendMessages(pnode, fTrickle || pnode->fWhitelisted);
+    }
+    boost::this_thread::interruption_point();
 
+    return fMore && !pnode->fDisconnect;
+}
+
+void ThreadMessageHandler()
+{
     SetThreadPriority(THREAD_PRIORITY_BELOW_NORMAL);
     while (true) {
+        CNode* pnode;
+        bool fTrickle;
+        {
+            boost::unique_lock<boost::mutex> lock(mutexProcessQueue);
+            while (vProcessQueue.empty())
+                condProcessQueue.wait(lock);
+            pnode = vProcessQueue.front();
+            vProcessQueue.pop_front();
+            pnode->fProcessRunning = true;
+            pnode->fProcessAgain = false;
+            fTrickle = pnode->fProcessTrickle;
+            pnode->fProcessTrickle = false;
+        }
+
+        bool fMore = HandleNodeMessages(pnode, fTrickle);
+
+        {
+            boost::unique_lock<boost::mutex> lock(mutexProcessQueue);
+            pnode->fProcessRunning = false;
+            if (fMore || (pnode->fProcessAgain && !pnode->fDisconnect)) {
+                // Back of the queue, so one busy peer doesn't hold up the others
+                vProcessQueue.push_back(pnode);
+                condProcessQueue.notify_one();
+            } else {
+                pnode->fProcessScheduled = false;
+                pnode->Release();
+            }
+        }
+    }
+}
+
+// Periodically have every node's SendMessages run, for pings and trickled inventory
+void ThreadMessageTimer()
+{
+    while (true) {
+        MilliSleep(100);
+
         vector<CNode*> vNodesCopy;
         {
             LOCK(cs_vNodes);
@@ -1376,51 +1705,20 @@ void ThreadMessageHandler()
             }
         }
 
-        // Poll the connected nodes for messages
         CNode* pnodeTrickle = NULL;
         if (!vNodesCopy.empty())
             pnodeTrickle = vNodesCopy[GetRand(vNodesCopy.size())];
 
-        bool fSleep = true;
-
         BOOST_FOREACH (CNode* pnode, vNodesCopy) {
-            if (pnode->fDisconnect)
-                continue;
-
-            // Receive messages
-            {
-                TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                if (lockRecv) {
-                    if (!g_signals.ProcessMessages(pnode))
-                        pnode->CloseSocketDisconnect();
-
-                    if (pnode->nSendSize < SendBufferSize()) {
-                        if (!pnode->vRecvGetData.empty() || (!pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].complete())) {
-                            fSleep = false;
-                        }
-                    }
-                }
-            }
-            boost::this_thread::interruption_point();
-
-            // Send messages
-            {
-                TRY_LOCK(pnode->cs_vSend, lockSend);
-                if (lockSend)
-                    g_signals.SendMessages(pnode, pnode == pnodeTrickle || pnode->fWhitelisted);
-            }
-            boost::this_thread::interruption_point();
+            if (!pnode->fDisconnect)
+                ScheduleMessageHandler(pnode, pnode == pnodeTrickle);
         }
 
-
         {
             LOCK(cs_vNodes);
             BOOST_FOREACH (CNode* pnode, vNodesCopy)
                 pnode->Release();
         }
-
-        if (fSleep)
-            messageHandlerCondition.timed_wait(lock, boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(100));
     }
 }
 
@@ -1619,7 +1917,12 @@ void StartNode(boost::thread_group& threadGroup)
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "opencon", &ThreadOpenConnections));
 
     // Process messages
-    threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msghand", &ThreadMessageHandler));
+    int nMessageThreads = GetArg("-msghandlerthreads", DEFAULT_MSGHANDLER_THREADS);
+    nMessageThreads = std::max(1, std::min(nMessageThreads, MAX_MSGHANDLER_THREADS));
+    LogPrintf("Using %d threads for message handling\n", nMessageThreads);
+    for (int i = 0; i < nMessageThreads; i++)
+        threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msghand", &ThreadMessageHandler));
+    threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msgtimer", &ThreadMessageTimer));
 
     // Dump network addresses
     threadGroup.create_thread(boost::bind(&LoopForever<void (*)()>, "dumpaddr", &DumpAddresses, DUMP_ADDRESSES_INTERVAL * 1000));
@@ -1939,6 +2242,12 @@ CNode::CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn, bool fIn
     nPingUsecTime = 0;
     fPingQueued = false;
     fObfuScationMaster = false;
+    fSocketRecvReady = false;
+    fSocketSendReady = false;
+    fProcessScheduled = false;
+    fProcessRunning = false;
+    fProcessAgain = false;
+    fProcessTrickle = false;
 
     {
         LOCK(cs_nLastNodeId);
@@ -1950,6 +2259,9 @@ CNode::CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn, bool fIn
     else
         LogPrint("net", "Added connection peer=%d\n", id);
 
+    if (hSocket != INVALID_SOCKET)
+        socketEvents.Add(this);
+
     // Be shy and don't send version until we hear
     if (hSocket != INVALID_SOCKET && !fInbound)
         PushVersion();
@@ -2014,6 +2326,23 @@ void CNode::AbortMessage() UNLOCK_FUNCTION(cs_vSend)
     LogPrint("net", "(aborted)\n");
 }
 
+void CNode::PushSerializedMessage(CSerializeData& data)
+{
+    assert(data.size() >= CMessageHeader::HEADER_SIZE);
+
+    LOCK(cs_vSend);
+    LogPrint("net", "sending: %s (%d bytes) peer=%d\n", std::string(&data[MESSAGE_START_SIZE], CMessageHeader::COMMAND_SIZE).c_str(),
+        data.size() - CMessageHeader::HEADER_SIZE, id);
+
+    std::deque<CSerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), CSerializeData());
+    it->swap(data);
+    nSendSize += it->size();
+
+    // If write queue empty, attempt "optimistic write"
+    if (it == vSendMsg.begin())
+        SocketSendData(this);
+}
+
 void CNode::EndMessage() UNLOCK_FUNCTION(cs_vSend)
 {
     // The -*messagestest options are intentionally not documented in the help message,
@@ -20,6 +20,7 @@
 #include "uint256.h"
 #include "utilstrencodings.h"
 
+#include <atomic>
 #include <deque>
 #include <stdint.h>
 
@@ -60,6 +61,10 @@ static const bool DEFAULT_UPNP = false;
 #endif
 /** The maximum number of entries in mapAskFor */
 static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
+/** Default number of threads handling peer messages */
+static const int DEFAULT_MSGHANDLER_THREADS = 4;
+/** Maximum number of threads handling peer messages */
+static const int MAX_MSGHANDLER_THREADS = 16;
 
 unsigned int ReceiveFloodSize();
 unsigned int SendBufferSize();
@@ -225,6 +230,20 @@ public:
     uint64_t nSendBytes;
     std::deque<CSerializeData> vSendMsg;
     CCriticalSection cs_vSend;
+    // Whether the event loop is asked for send readiness; protected by cs_vSend
+    bool fPollSend;
+
+    // Socket readiness, only used by ThreadSocketHandler. With epoll these
+    // stay set until recv() or send() would block.
+    bool fSocketRecvReady;
+    bool fSocketSendReady;
+
+    // Message handler scheduling, protected by the handler queue in net.cpp.
+    // A node is queued or handled by at most one handler thread at a time.
+    bool fProcessScheduled;
+    bool fProcessRunning;
+    bool fProcessAgain;
+    bool fProcessTrickle;
 
     std::deque<CInv> vRecvGetData;
     std::deque<CNetMessage> vRecvMsg;
@@ -265,7 +284,7 @@ public:
     CSemaphoreGrant grantOutbound;
     CCriticalSection cs_filter;
     CBloomFilter* pfilter;
-    int nRefCount;
+    std::atomic<int> nRefCount;
     NodeId id;
 
 protected:
@@ -418,6 +437,11 @@ public:
 
     void PushVersion();
 
+    /**
+     * Queue a message that is already serialized, header included (see
+     * SetMessageHeader). The buffer is swapped into vSendMsg without a copy.
+     */
+    void PushSerializedMessage(CSerializeData& data);
 
     void PushMessage(const char* pszCommand)
     {
@@ -9,6 +9,7 @@
 #include "main.h"
 #include "masternodeman.h"
 #include "script/sign.h"
+#include "script/sigcache.h"
 #include "swifttx.h"
 #include "ui_interface.h"
 #include "util.h"
@@ -2167,9 +2168,13 @@ bool CObfuScationSigner::VerifyMessage(CPubKey pubkey, vector<unsigned char>& vc
     CHashWriter ss(SER_GETHASH, 0);
     ss << strMessageMagic;
     ss << strMessage;
+    uint256 hash = ss.GetHash();
+
+    if (IsMessageSignatureCached(hash, vchSig, pubkey))
+        return true;
 
     CPubKey pubkey2;
-    if (!pubkey2.RecoverCompact(ss.GetHash(), vchSig)) {
+    if (!pubkey2.RecoverCompact(hash, vchSig)) {
         errorMessage = _("Error recovering public key.");
         return false;
     }
@@ -2177,7 +2182,11 @@ bool CObfuScationSigner::VerifyMessage(CPubKey pubkey, vector<unsigned char>& vc
     if (fDebug && pubkey2.GetID() != pubkey.GetID())
         LogPrintf("CObfuScationSigner::VerifyMessage -- keys don't match: %s %s\n", pubkey2.GetID().ToString(), pubkey.GetID().ToString());
 
-    return (pubkey2.GetID() == pubkey.GetID());
+    if (pubkey2.GetID() != pubkey.GetID())
+        return false;
+
+    CacheMessageSignature(hash, vchSig, pubkey);
+    return true;
 }
 
 bool CObfuscationQueue::Sign()
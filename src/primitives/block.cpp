@@ -6,6 +6,7 @@
 
 #include "primitives/block.h"
 
+#include "crypto/xevan.h"
 #include "hash.h"
 #include "script/standard.h"
 #include "script/sign.h"
@@ -21,6 +22,39 @@ uint256 CBlockHeader::GetHash() const
     return Hash(BEGIN(nVersion), END(nAccumulatorCheckpoint));
 }
 
+void XevanBatch(const CBlockHeader* headers, size_t count, uint256* hashes)
+{
+    static const size_t HEADER_SIZE = 80;
+    static const size_t BATCH = 4 * XEVAN_LANES;
+
+    unsigned char data[BATCH * HEADER_SIZE];
+    unsigned char out[BATCH * XEVAN_OUTPUT_SIZE];
+    size_t index[BATCH];
+    size_t n = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        const CBlockHeader& header = headers[i];
+        if (header.nVersion >= 4) {
+            hashes[i] = header.GetHash();
+            continue;
+        }
+        assert(END(header.nNonce) - BEGIN(header.nVersion) == (ptrdiff_t)HEADER_SIZE);
+        memcpy(data + n * HEADER_SIZE, BEGIN(header.nVersion), HEADER_SIZE);
+        index[n++] = i;
+        if (n == BATCH) {
+            XevanHashMany(data, HEADER_SIZE, n, out);
+            for (size_t j = 0; j < n; j++)
+                memcpy(hashes[index[j]].begin(), out + j * XEVAN_OUTPUT_SIZE, XEVAN_OUTPUT_SIZE);
+            n = 0;
+        }
+    }
+    if (n > 0) {
+        XevanHashMany(data, HEADER_SIZE, n, out);
+        for (size_t j = 0; j < n; j++)
+            memcpy(hashes[index[j]].begin(), out + j * XEVAN_OUTPUT_SIZE, XEVAN_OUTPUT_SIZE);
+    }
+}
+
 uint256 CBlock::BuildMerkleTree(bool* fMutated) const
 {
     /* WARNING! If you're reading this because you're learning about crypto
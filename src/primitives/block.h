@@ -170,6 +170,13 @@ public:
     void print() const;
 };
 
+/**
+ * Compute the hashes of count headers, as CBlockHeader::GetHash() would.
+ * XEVAN headers are hashed several at a time through XevanHashMany, so
+ * callers that have a run of headers (headers messages, block index
+ * loading) should prefer this over calling GetHash() in a loop.
+ */
+void XevanBatch(const CBlockHeader* headers, size_t count, uint256* hashes);
 
 /** Describes a place in the block chain to another node such that if the
  * other node doesn't have the same branch, it can find a recent common trunk.
@@ -6,6 +6,7 @@
 
 #include <amount.h>
 #include <limits.h>
+#include <map>
 #include "libzerocoin/bignum.h"
 #include "libzerocoin/Denominations.h"
 #include "serialize.h"
@@ -172,6 +173,69 @@ public:
     };
 };
 
+//! Witness of a mint after accumulating the pubcoins of every block below a certain height
+class CWitnessSnapshot
+{
+public:
+    //! the last block accumulated
+    uint256 hashBlock;
+    CBigNum bnValue;
+    int nMintsAdded;
+    int nCheckpointsAdded;
+
+    CWitnessSnapshot()
+    {
+        hashBlock = 0;
+        bnValue = 0;
+        nMintsAdded = 0;
+        nCheckpointsAdded = 0;
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(hashBlock);
+        READWRITE(bnValue);
+        READWRITE(nMintsAdded);
+        READWRITE(nCheckpointsAdded);
+    };
+};
+
+//! Precomputed witness of a wallet mint, see GenerateAccumulatorWitness()
+class CMintWitness
+{
+public:
+    CBigNum bnPubcoin;
+    int nAccStartHeight;
+    uint256 nCheckpointBeforeMint;
+    //! snapshots by height, at the blocks a spend may stop accumulating at
+    std::map<int, CWitnessSnapshot> mapSnapshots;
+
+    CMintWitness()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        bnPubcoin = 0;
+        nAccStartHeight = 0;
+        nCheckpointBeforeMint = 0;
+        mapSnapshots.clear();
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(bnPubcoin);
+        READWRITE(nAccStartHeight);
+        READWRITE(nCheckpointBeforeMint);
+        READWRITE(mapSnapshots);
+    };
+};
+
 class CZerocoinSpendReceipt
 {
 private:
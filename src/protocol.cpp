@@ -6,6 +6,8 @@
 #include "protocol.h"
 
 #include "chainparams.h"
+#include "hash.h"
+#include "streams.h"
 #include "util.h"
 #include "utilstrencodings.h"
 
@@ -31,7 +33,8 @@ static const char* ppszTypeName[] =
         "mn quorum",
         "mn announce",
         "mn ping",
-        "dstx"};
+        "dstx",
+        "compact block"};
 
 CMessageHeader::CMessageHeader()
 {
@@ -81,6 +84,19 @@ bool CMessageHeader::IsValid() const
     return true;
 }
 
+void SetMessageHeader(CSerializeData& data, const char* pszCommand)
+{
+    assert(data.size() >= CMessageHeader::HEADER_SIZE);
+    CMessageHeader hdr(pszCommand, data.size() - CMessageHeader::HEADER_SIZE);
+    uint256 hash = Hash(data.begin() + CMessageHeader::HEADER_SIZE, data.end());
+    memcpy(&hdr.nChecksum, &hash, sizeof(hdr.nChecksum));
+
+    CDataStream ssHeader(SER_NETWORK, INIT_PROTO_VERSION);
+    ssHeader << hdr;
+    assert(ssHeader.size() == CMessageHeader::HEADER_SIZE);
+    memcpy(&data[0], &ssHeader[0], CMessageHeader::HEADER_SIZE);
+}
+
 
 CAddress::CAddress() : CService()
 {
@@ -137,7 +153,7 @@ bool CInv::IsKnownType() const
 }
 
 bool CInv::IsMasterNodeType() const{
- 	return (type >= 6);
+ 	return (type >= 6 && type <= MSG_DSTX);
 }
 
 const char* CInv::GetCommand() const
@@ -10,6 +10,7 @@
 #ifndef BITCOIN_PROTOCOL_H
 #define BITCOIN_PROTOCOL_H
 
+#include "allocators.h"
 #include "netbase.h"
 #include "serialize.h"
 #include "uint256.h"
@@ -63,6 +64,12 @@ public:
     unsigned int nChecksum;
 };
 
+/**
+ * Fill in the header of a serialized message, whose payload follows the
+ * CMessageHeader::HEADER_SIZE bytes left for it at the front of data.
+ */
+void SetMessageHeader(CSerializeData& data, const char* pszCommand);
+
 /** nServices flags */
 enum {
     NODE_NETWORK = (1 << 0),
@@ -170,7 +177,9 @@ enum {
     MSG_MASTERNODE_QUORUM,
     MSG_MASTERNODE_ANNOUNCE,
     MSG_MASTERNODE_PING,
-    MSG_DSTX
+    MSG_DSTX,
+    // Only in getdata, for a block to be sent as a "cmpctblock"
+    MSG_CMPCT_BLOCK
 };
 
 #endif // BITCOIN_PROTOCOL_H
@@ -181,6 +181,12 @@ Value getrawmempool(const Array& params, bool fHelp)
             "    \"height\" : n,           (numeric) block height when transaction entered pool\n"
             "    \"startingpriority\" : n, (numeric) priority when transaction entered pool\n"
             "    \"currentpriority\" : n,  (numeric) transaction priority now\n"
+            "    \"descendantcount\" : n,  (numeric) number of in-mempool descendant transactions (including this one)\n"
+            "    \"descendantsize\" : n,   (numeric) size of in-mempool descendants (including this one)\n"
+            "    \"descendantfees\" : n,   (numeric) fees in satoshis, with prioritisation, of in-mempool descendants (including this one)\n"
+            "    \"ancestorcount\" : n,    (numeric) number of in-mempool ancestor transactions (including this one)\n"
+            "    \"ancestorsize\" : n,     (numeric) size of in-mempool ancestors (including this one)\n"
+            "    \"ancestorfees\" : n,     (numeric) fees in satoshis, with prioritisation, of in-mempool ancestors (including this one)\n"
             "    \"depends\" : [           (array) unconfirmed transactions used as inputs for this transaction\n"
             "        \"transactionid\",    (string) parent transaction id\n"
             "       ... ]\n"
@@ -196,9 +202,11 @@ Value getrawmempool(const Array& params, bool fHelp)
     if (fVerbose) {
         LOCK(mempool.cs);
         Object o;
-        BOOST_FOREACH (const PAIRTYPE(uint256, CTxMemPoolEntry) & entry, mempool.mapTx) {
-            const uint256& hash = entry.first;
-            const CTxMemPoolEntry& e = entry.second;
+        // In the order a miner would pick the transactions
+        const CTxMemPool::indexed_transaction_set::index<ancestor_score>::type& index = mempool.mapTx.get<ancestor_score>();
+        for (CTxMemPool::indexed_transaction_set::index<ancestor_score>::type::const_iterator it = index.begin(); it != index.end(); ++it) {
+            const CTxMemPoolEntry& e = *it;
+            const uint256& hash = e.GetTx().GetHash();
             Object info;
             info.push_back(Pair("size", (int)e.GetTxSize()));
             info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
@@ -206,12 +214,15 @@ Value getrawmempool(const Array& params, bool fHelp)
             info.push_back(Pair("height", (int)e.GetHeight()));
             info.push_back(Pair("startingpriority", e.GetPriority(e.GetHeight())));
             info.push_back(Pair("currentpriority", e.GetPriority(chainActive.Height())));
-            const CTransaction& tx = e.GetTx();
+            info.push_back(Pair("descendantcount", e.GetCountWithDescendants()));
+            info.push_back(Pair("descendantsize", e.GetSizeWithDescendants()));
+            info.push_back(Pair("descendantfees", e.GetModFeesWithDescendants()));
+            info.push_back(Pair("ancestorcount", e.GetCountWithAncestors()));
+            info.push_back(Pair("ancestorsize", e.GetSizeWithAncestors()));
+            info.push_back(Pair("ancestorfees", e.GetModFeesWithAncestors()));
             set<string> setDepends;
-            BOOST_FOREACH (const CTxIn& txin, tx.vin) {
-                if (mempool.exists(txin.prevout.hash))
-                    setDepends.insert(txin.prevout.hash.ToString());
-            }
+            BOOST_FOREACH (CTxMemPool::txiter parent, mempool.GetMemPoolParents(mempool.mapTx.project<0>(it)))
+                setDepends.insert(parent->GetTx().GetHash().ToString());
             Array depends(setDepends.begin(), setDepends.end());
             info.push_back(Pair("depends", depends));
             o.push_back(Pair(hash.ToString(), info));
@@ -643,6 +654,9 @@ Value getmempoolinfo(const Array& params, bool fHelp)
             "{\n"
             "  \"size\": xxxxx                (numeric) Current tx count\n"
             "  \"bytes\": xxxxx               (numeric) Sum of all tx sizes\n"
+            "  \"usage\": xxxxx               (numeric) Total memory usage for the mempool\n"
+            "  \"maxmempool\": xxxxx          (numeric) Maximum memory usage for the mempool\n"
+            "  \"mempoolminfee\": xxxxx       (numeric) Minimum fee for tx to be accepted\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getmempoolinfo", "") + HelpExampleRpc("getmempoolinfo", ""));
@@ -650,6 +664,75 @@ Value getmempoolinfo(const Array& params, bool fHelp)
     Object ret;
     ret.push_back(Pair("size", (int64_t)mempool.size()));
     ret.push_back(Pair("bytes", (int64_t)mempool.GetTotalTxSize()));
+    ret.push_back(Pair("usage", (int64_t)mempool.DynamicMemoryUsage()));
+    size_t maxmempool = GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
+    ret.push_back(Pair("maxmempool", (int64_t)maxmempool));
+    ret.push_back(Pair("mempoolminfee", ValueFromAmount(mempool.GetMinFee(maxmempool).GetFeePerK())));
+
+    return ret;
+}
+
+Value getcoinscacheinfo(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getcoinscacheinfo\n"
+            "\nReturns details on the in-memory cache of the unspent transaction output set.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"transactions\": xxxxx        (numeric) Transactions with cached outputs\n"
+            "  \"usage\": xxxxx               (numeric) Memory used by the cache\n"
+            "  \"maxusage\": xxxxx            (numeric) Usage at which the cache is written to disk (set by -dbcache)\n"
+            "  \"hits\": xxxxx                (numeric) Lookups answered from memory since startup\n"
+            "  \"misses\": xxxxx              (numeric) Lookups that went to the database\n"
+            "  \"hitrate\": x.xxx             (numeric) hits / (hits + misses)\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getcoinscacheinfo", "") + HelpExampleRpc("getcoinscacheinfo", ""));
+
+    LOCK(cs_main);
+    uint64_t nHits = pcoinsTip->GetCacheHits();
+    uint64_t nLookups = nHits + pcoinsTip->GetCacheMisses();
+
+    Object ret;
+    ret.push_back(Pair("transactions", (int64_t)pcoinsTip->GetCacheSize()));
+    ret.push_back(Pair("usage", (int64_t)pcoinsTip->DynamicMemoryUsage()));
+    ret.push_back(Pair("maxusage", (int64_t)nCoinCacheUsage));
+    ret.push_back(Pair("hits", (int64_t)nHits));
+    ret.push_back(Pair("misses", (int64_t)pcoinsTip->GetCacheMisses()));
+    ret.push_back(Pair("hitrate", nLookups ? (double)nHits / nLookups : 0.0));
+
+    return ret;
+}
+
+Value getsigcacheinfo(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getsigcacheinfo\n"
+            "\nReturns details on the signature cache.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"capacity\": xxxxx            (numeric) Number of signatures the cache can hold\n"
+            "  \"usage\": xxxxx               (numeric) Memory used by the cache\n"
+            "  \"hits\": xxxxx                (numeric) Lookups that found the signature since startup\n"
+            "  \"misses\": xxxxx              (numeric) Lookups that had to verify the signature\n"
+            "  \"hitrate\": x.xxx             (numeric) hits / (hits + misses)\n"
+            "  \"evictions\": xxxxx           (numeric) Signatures dropped to make room for others\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getsigcacheinfo", "") + HelpExampleRpc("getsigcacheinfo", ""));
+
+    CSignatureCacheStats stats = GetSignatureCacheStats();
+    uint64_t nLookups = stats.nHits + stats.nMisses;
+
+    Object ret;
+    ret.push_back(Pair("capacity", (int64_t)stats.nCapacity));
+    ret.push_back(Pair("usage", (int64_t)stats.nBytes));
+    ret.push_back(Pair("hits", (int64_t)stats.nHits));
+    ret.push_back(Pair("misses", (int64_t)stats.nMisses));
+    ret.push_back(Pair("hitrate", nLookups ? (double)stats.nHits / nLookups : 0.0));
+    ret.push_back(Pair("evictions", (int64_t)stats.nEvictions));
 
     return ret;
 }
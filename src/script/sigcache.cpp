@@ -5,14 +5,13 @@
 
 #include "sigcache.h"
 
+#include "crypto/sha256.h"
+#include "cuckoocache.h"
 #include "pubkey.h"
 #include "random.h"
 #include "uint256.h"
 #include "util.h"
 
-#include <boost/thread.hpp>
-#include <boost/tuple/tuple_comparison.hpp>
-
 namespace {
 
 /**
@@ -23,68 +22,99 @@ namespace {
 class CSignatureCache
 {
 private:
-     //! sigdata_type is (signature hash, signature, public key):
-    typedef boost::tuple<uint256, std::vector<unsigned char>, CPubKey> sigdata_type;
-    std::set< sigdata_type> setValid;
-    boost::shared_mutex cs_sigcache;
+    //! Salts the entries, so that peers can't steer signatures into the same slots
+    uint256 nonce;
+    CCuckooCache setValid;
 
 public:
-    bool
-    Get(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
+    void Setup(size_t nBytes)
     {
-        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+        GetRandBytes(nonce.begin(), 32);
+        setValid.Setup(nBytes);
+    }
 
-        sigdata_type k(hash, vchSig, pubKey);
-        std::set<sigdata_type>::iterator mi = setValid.find(k);
-        if (mi != setValid.end())
-            return true;
-        return false;
+    //! Entries are SHA256(nonce || signature hash || public key || signature)
+    void ComputeEntry(uint256& entry, const uint256& hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey) const
+    {
+        CSHA256().Write(nonce.begin(), 32).Write(hash.begin(), 32).Write(pubkey.begin(), pubkey.size()).Write(vchSig.data(), vchSig.size()).Finalize(entry.begin());
+    }
+
+    //! Message entries are SHA256(nonce || 'M' || message hash || public key || signature)
+    void ComputeMessageEntry(uint256& entry, const uint256& hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey) const
+    {
+        static const unsigned char chTag = 'M';
+        CSHA256().Write(nonce.begin(), 32).Write(&chTag, 1).Write(hash.begin(), 32).Write(pubkey.begin(), pubkey.size()).Write(vchSig.data(), vchSig.size()).Finalize(entry.begin());
+    }
+
+    bool Get(const uint256& entry, bool fErase)
+    {
+        return setValid.Contains(entry, fErase);
+    }
+
+    void Set(const uint256& entry)
+    {
+        setValid.Insert(entry);
     }
 
-    void Set(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
+    CCuckooCache::Stats GetStats() const
     {
-        // DoS prevention: limit cache size to less than 10MB
-        // (~200 bytes per cache entry times 50,000 entries)
-        // Since there are a maximum of 20,000 signature operations per block
-        // 50,000 is a reasonable default.
-        int64_t nMaxCacheSize = GetArg("-maxsigcachesize", 50000);
-        if (nMaxCacheSize <= 0) return;
-
-        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
-
-        while (static_cast<int64_t>(setValid.size()) > nMaxCacheSize)
-        {
-            // Evict a random entry. Random because that helps
-            // foil would-be DoS attackers who might try to pre-generate
-            // and re-use a set of valid signatures just-slightly-greater
-            // than our cache size.
-            uint256 randomHash = GetRandHash();
-            std::vector<unsigned char> unused;
-            std::set<sigdata_type>::iterator it =
-                setValid.lower_bound(sigdata_type(randomHash, unused, unused));
-            if (it == setValid.end())
-                it = setValid.begin();
-            setValid.erase(*it);
-        }
-
-        sigdata_type k(hash, vchSig, pubKey);
-        setValid.insert(k);
+        return setValid.GetStats();
     }
 };
 
+/* The cache is sized and salted by InitSignatureCache(); until then it holds nothing. */
+CSignatureCache signatureCache;
+
+}
+
+void InitSignatureCache()
+{
+    int64_t nMaxCacheSize = std::max((int64_t)0, std::min(MAX_MAX_SIG_CACHE_SIZE, GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE)));
+    signatureCache.Setup(nMaxCacheSize << 20);
+    CCuckooCache::Stats stats = signatureCache.GetStats();
+    LogPrintf("Using %u MiB out of %u requested for signature cache, able to store %u elements\n",
+        stats.nBytes >> 20, nMaxCacheSize, stats.nSlots);
+}
+
+CSignatureCacheStats GetSignatureCacheStats()
+{
+    CCuckooCache::Stats stats = signatureCache.GetStats();
+    CSignatureCacheStats ret;
+    ret.nCapacity = stats.nSlots;
+    ret.nBytes = stats.nBytes;
+    ret.nHits = stats.nHits;
+    ret.nMisses = stats.nMisses;
+    ret.nEvictions = stats.nEvictions;
+    return ret;
+}
+
+bool IsMessageSignatureCached(const uint256& hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey)
+{
+    uint256 entry;
+    signatureCache.ComputeMessageEntry(entry, hash, vchSig, pubkey);
+    return signatureCache.Get(entry, false);
+}
+
+void CacheMessageSignature(const uint256& hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey)
+{
+    uint256 entry;
+    signatureCache.ComputeMessageEntry(entry, hash, vchSig, pubkey);
+    signatureCache.Set(entry);
 }
 
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
-    static CSignatureCache signatureCache;
+    uint256 entry;
+    signatureCache.ComputeEntry(entry, sighash, vchSig, pubkey);
 
-    if (signatureCache.Get(sighash, vchSig, pubkey))
+    // Signatures checked again in a block won't be needed a third time
+    if (signatureCache.Get(entry, !store))
         return true;
 
     if (!TransactionSignatureChecker::VerifySignature(vchSig, pubkey, sighash))
         return false;
 
     if (store)
-        signatureCache.Set(sighash, vchSig, pubkey);
+        signatureCache.Set(entry);
     return true;
 }
@@ -8,10 +8,24 @@
 
 #include "script/interpreter.h"
 
+#include <stdint.h>
 #include <vector>
 
+//! Default for -maxsigcachesize, in MB. That's room for ~800000 signatures.
+static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 32;
+//! Largest -maxsigcachesize accepted
+static const int64_t MAX_MAX_SIG_CACHE_SIZE = 16384;
+
 class CPubKey;
 
+struct CSignatureCacheStats {
+    size_t nCapacity;
+    size_t nBytes;
+    uint64_t nHits;
+    uint64_t nMisses;
+    uint64_t nEvictions;
+};
+
 class CachingTransactionSignatureChecker : public TransactionSignatureChecker
 {
 private:
@@ -23,4 +37,15 @@ public:
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 };
 
+void InitSignatureCache();
+CSignatureCacheStats GetSignatureCacheStats();
+
+/**
+ * Signed messages (masternode and spork messages) that recovered to pubkey,
+ * so that checking one again, e.g. under cs_main after a message handler
+ * thread checked it without, is cheap.
+ */
+bool IsMessageSignatureCached(const uint256& hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey);
+void CacheMessageSignature(const uint256& hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey);
+
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
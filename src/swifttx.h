@@ -39,7 +39,7 @@ extern map<uint256, CTransaction> mapTxLockReq;
 extern map<uint256, CTransaction> mapTxLockReqRejected;
 extern map<uint256, CConsensusVote> mapTxLockVote;
 extern map<uint256, CTransactionLock> mapTxLocks;
-extern std::map<COutPoint, uint256> mapLockedInputs;
+extern std::map<COutPoint, uint256> mapLockedInputs; // protected by cs_main
 extern int nCompleteTXLocks;
 
 
@@ -16,6 +16,7 @@
 #include <iostream>
 #include <fstream>
 // #include <curses.h>
+#include <algorithm>
 #include <exception>
 #include <cstdlib>
 #include <sys/time.h>
@@ -25,6 +26,7 @@
 #include "libzerocoin/Coin.h"
 #include "libzerocoin/CoinSpend.h"
 #include "libzerocoin/Accumulator.h"
+#include "libzerocoin/MultiExp.h"
 
 using namespace std;
 using namespace libzerocoin;
@@ -34,6 +36,7 @@ using namespace libzerocoin;
 #define COLOR_STR_RED     "\033[31m"
 
 #define TESTS_COINS_TO_ACCUMULATE   50
+#define TESTS_SPENDS_TO_VERIFY      10
 
 // Global test counters
 uint32_t    ggNumTests        = 0;
@@ -369,6 +372,61 @@ Testb_MintAndSpend()
 	return false;
 }
 
+bool
+Testb_SpendVerifyRate()
+{
+	try {
+		if (ggCoins[0] == NULL) {
+			return false;
+		}
+
+		Accumulator acc(&gg_Params->accumulatorParams,CoinDenomination::ZQ_ONE);
+		AccumulatorWitness wAcc(gg_Params, acc, ggCoins[0]->getPublicCoin());
+		for (uint32_t i = 0; i < TESTS_COINS_TO_ACCUMULATE; i++) {
+			acc += ggCoins[i]->getPublicCoin();
+			wAcc += ggCoins[i]->getPublicCoin();
+		}
+
+		CoinSpend spend(gg_Params, *(ggCoins[0]), acc, 0, wAcc, 0);
+
+		// A spend with a wrong accumulator value must fail on both paths
+		Accumulator accWrong(&gg_Params->accumulatorParams,CoinDenomination::ZQ_ONE);
+		accWrong += ggCoins[1]->getPublicCoin();
+
+		// Verify the same spend with plain pow_mod() (the old code path)
+		// and with multi-exponentiation and fixed-base tables
+		double rate[2];
+		for (int fast = 0; fast < 2; fast++) {
+			MultiExp::SetEnabled(fast != 0);
+			// Warm up the shared fixed-base tables outside the timer
+			if (!spend.Verify(acc) || spend.Verify(accWrong)) {
+				MultiExp::SetEnabled(true);
+				return false;
+			}
+
+			timer.start();
+			for (uint32_t i = 0; i < TESTS_SPENDS_TO_VERIFY; i++) {
+				if (!spend.Verify(acc)) {
+					MultiExp::SetEnabled(true);
+					return false;
+				}
+			}
+			timer.stop();
+
+			rate[fast] = TESTS_SPENDS_TO_VERIFY * 1000.0 / std::max(timer.duration(), 1);
+			cout << "\t" << (fast ? "MULTIEXP" : "POW_MOD") << " SPEND VERIFY: " << timer.duration() / TESTS_SPENDS_TO_VERIFY << " ms per spend\t" << rate[fast] << " spends/s" << endl;
+		}
+		MultiExp::SetEnabled(true);
+
+		cout << "\tSPEND VERIFY SPEEDUP: " << rate[1] / rate[0] << "x" << endl;
+		return true;
+	} catch (runtime_error &e) {
+		MultiExp::SetEnabled(true);
+		cout << e.what() << endl;
+		return false;
+	}
+}
+
 void
 Testb_RunAllTests()
 {
@@ -388,6 +446,7 @@ Testb_RunAllTests()
 	gLogTestResult("coins can be minted", Testb_MintCoin);
 	gLogTestResult("the accumulator works", Testb_Accumulator);
 	gLogTestResult("a minted coin can be spent", Testb_MintAndSpend);
+	gLogTestResult("spends verify faster with multi-exponentiation", Testb_SpendVerifyRate);
 
 	// Summarize test results
 	if (ggSuccessfulTests < ggNumTests) {
@@ -0,0 +1,90 @@
+// Copyright (c) 2018 The Slingcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockcache.h"
+
+#include "chainparams.h"
+#include "hash.h"
+#include "protocol.h"
+#include "streams.h"
+#include "version.h"
+
+#include <boost/test/unit_test.hpp>
+
+static CBlock TestBlock(unsigned int nNonce)
+{
+    CBlock block = Params().GenesisBlock();
+    block.nNonce = nNonce;
+    return block;
+}
+
+BOOST_AUTO_TEST_SUITE(blockcache_tests)
+
+BOOST_AUTO_TEST_CASE(blockcache_message)
+{
+    CRecentBlockCache cache;
+    CBlock block = TestBlock(1);
+    cache.Add(block);
+    BOOST_CHECK_EQUAL(cache.size(), 1U);
+
+    CRecentBlockCache::MessagePtr pmessage = cache.GetMessage(block.GetHash());
+    BOOST_REQUIRE(pmessage);
+    BOOST_CHECK(!cache.GetMessage(TestBlock(2).GetHash()));
+
+    // A complete "block" message, ready to be sent
+    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+    ssBlock << block;
+    BOOST_REQUIRE_EQUAL(pmessage->size(), CMessageHeader::HEADER_SIZE + ssBlock.size());
+    BOOST_CHECK(std::equal(ssBlock.begin(), ssBlock.end(), pmessage->begin() + CMessageHeader::HEADER_SIZE));
+
+    CMessageHeader hdr;
+    CDataStream ssHeader(pmessage->begin(), pmessage->begin() + CMessageHeader::HEADER_SIZE, SER_NETWORK, PROTOCOL_VERSION);
+    ssHeader >> hdr;
+    BOOST_CHECK(hdr.IsValid());
+    BOOST_CHECK_EQUAL(hdr.GetCommand(), "block");
+    BOOST_CHECK_EQUAL(hdr.nMessageSize, ssBlock.size());
+    uint256 hash = Hash(ssBlock.begin(), ssBlock.end());
+    BOOST_CHECK(memcmp(&hdr.nChecksum, &hash, sizeof(hdr.nChecksum)) == 0);
+
+    CRecentBlockCache::BlockPtr pblock = cache.GetBlock(block.GetHash());
+    BOOST_REQUIRE(pblock);
+    BOOST_CHECK(pblock->GetHash() == block.GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(blockcache_eviction)
+{
+    CRecentBlockCache cache(4096);
+    for (unsigned int i = 0; i < 100; i++)
+        cache.Add(TestBlock(i));
+
+    // Oldest blocks go first
+    BOOST_CHECK(cache.size() > 0);
+    BOOST_CHECK(cache.size() < 100);
+    BOOST_CHECK(cache.GetMessage(TestBlock(99).GetHash()));
+    BOOST_CHECK(!cache.GetMessage(TestBlock(0).GetHash()));
+
+    // Blocks that don't fit at all aren't cached
+    CRecentBlockCache cacheTiny(16);
+    cacheTiny.Add(TestBlock(0));
+    BOOST_CHECK_EQUAL(cacheTiny.size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(blockcache_shared)
+{
+    CRecentBlockCache cache;
+    CBlock block = TestBlock(1);
+    cache.Add(block);
+    CRecentBlockCache::MessagePtr pmessage = cache.GetMessage(block.GetHash());
+    CRecentBlockCache::BlockPtr pblock = cache.GetBlock(block.GetHash());
+
+    // What a lookup returned outlives the entry
+    cache.Clear();
+    BOOST_CHECK_EQUAL(cache.size(), 0U);
+    BOOST_CHECK(!cache.GetMessage(block.GetHash()));
+    BOOST_REQUIRE(pmessage && pblock);
+    BOOST_CHECK_EQUAL(pmessage->size(), CMessageHeader::HEADER_SIZE + ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION));
+    BOOST_CHECK(pblock->GetHash() == block.GetHash());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
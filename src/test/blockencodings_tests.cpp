@@ -0,0 +1,165 @@
+// Copyright (c) 2018 The Slingcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockencodings.h"
+
+#include "main.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "utilstrencodings.h"
+#include "version.h"
+
+#include <boost/test/unit_test.hpp>
+
+static CBlock BuildBlock(unsigned int nTx)
+{
+    CBlock block;
+    block.nVersion = 1;
+    block.nTime = 1500000000;
+    block.nBits = 0x207fffff;
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig = CScript() << OP_1 << OP_2;
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = 50 * COIN;
+    coinbase.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    block.vtx.push_back(coinbase);
+
+    // A chain of transactions, each spending the previous one
+    uint256 hashPrev = block.vtx[0].GetHash();
+    for (unsigned int i = 1; i < nTx; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(hashPrev, 0);
+        tx.vin[0].scriptSig = CScript() << OP_11;
+        tx.vout.resize(1);
+        tx.vout[0].nValue = (50 - i) * COIN;
+        tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+        block.vtx.push_back(tx);
+        hashPrev = tx.GetHash();
+    }
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+static CCompactBlock RoundTrip(const CCompactBlock& cmpctblock)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << cmpctblock;
+    BOOST_CHECK_EQUAL(ss.size(), cmpctblock.GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION));
+    CCompactBlock cmpctblockRet;
+    ss >> cmpctblockRet;
+    return cmpctblockRet;
+}
+
+BOOST_AUTO_TEST_SUITE(blockencodings_tests)
+
+BOOST_AUTO_TEST_CASE(compact_block_from_mempool)
+{
+    CBlock block = BuildBlock(10);
+    CTxMemPool pool(CFeeRate(0));
+    for (unsigned int i = 1; i < block.vtx.size(); i++)
+        pool.addUnchecked(block.vtx[i].GetHash(), CTxMemPoolEntry(block.vtx[i], 0, 0, 0.0, 1));
+
+    CCompactBlock cmpctblock = RoundTrip(CCompactBlock(block));
+    BOOST_CHECK(cmpctblock.header.GetHash() == block.GetHash());
+    BOOST_CHECK_EQUAL(cmpctblock.vPrefilled.size(), 1U);
+    BOOST_CHECK_EQUAL(cmpctblock.vShortIds.size(), 9U);
+    BOOST_CHECK(::GetSerializeSize(cmpctblock, SER_NETWORK, PROTOCOL_VERSION) < ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION));
+
+    // Everything but the coinbase comes from the mempool
+    CPartialBlock partialBlock;
+    BOOST_CHECK_EQUAL(partialBlock.Init(cmpctblock, pool), READ_STATUS_OK);
+    BOOST_CHECK(partialBlock.GetHash() == block.GetHash());
+    BOOST_CHECK(partialBlock.GetMissing().empty());
+
+    CBlock blockRet;
+    BOOST_CHECK_EQUAL(partialBlock.FillBlock(blockRet, std::vector<CTransaction>()), READ_STATUS_OK);
+    BOOST_CHECK(blockRet.GetHash() == block.GetHash());
+    BOOST_CHECK(blockRet.BuildMerkleTree() == block.hashMerkleRoot);
+}
+
+BOOST_AUTO_TEST_CASE(compact_block_missing_transactions)
+{
+    CBlock block = BuildBlock(10);
+    CTxMemPool pool(CFeeRate(0));
+    for (unsigned int i = 1; i < block.vtx.size(); i++) {
+        if (i != 2 && i != 7)
+            pool.addUnchecked(block.vtx[i].GetHash(), CTxMemPoolEntry(block.vtx[i], 0, 0, 0.0, 1));
+    }
+
+    CPartialBlock partialBlock;
+    BOOST_CHECK_EQUAL(partialBlock.Init(RoundTrip(CCompactBlock(block)), pool), READ_STATUS_OK);
+    std::vector<uint16_t> vMissing = partialBlock.GetMissing();
+    BOOST_REQUIRE_EQUAL(vMissing.size(), 2U);
+    BOOST_CHECK_EQUAL(vMissing[0], 2);
+    BOOST_CHECK_EQUAL(vMissing[1], 7);
+
+    CBlock blockRet;
+    std::vector<CTransaction> vtxMissing;
+    vtxMissing.push_back(block.vtx[2]);
+    BOOST_CHECK_EQUAL(partialBlock.FillBlock(blockRet, vtxMissing), READ_STATUS_INVALID);
+
+    // The wrong transaction doesn't match the merkle root
+    vtxMissing.push_back(block.vtx[3]);
+    BOOST_CHECK_EQUAL(partialBlock.FillBlock(blockRet, vtxMissing), READ_STATUS_FAILED);
+
+    vtxMissing[1] = block.vtx[7];
+    BOOST_CHECK_EQUAL(partialBlock.FillBlock(blockRet, vtxMissing), READ_STATUS_OK);
+    BOOST_CHECK(blockRet.GetHash() == block.GetHash());
+    BOOST_CHECK(blockRet.BuildMerkleTree() == block.hashMerkleRoot);
+}
+
+BOOST_AUTO_TEST_CASE(compact_block_bad_encoding)
+{
+    CBlock block = BuildBlock(4);
+    CTxMemPool pool(CFeeRate(0));
+    CPartialBlock partialBlock;
+
+    // Two transactions with the same short id can't be told apart
+    CCompactBlock cmpctblock(block);
+    cmpctblock.vShortIds[1] = cmpctblock.vShortIds[0];
+    BOOST_CHECK_EQUAL(partialBlock.Init(cmpctblock, pool), READ_STATUS_FAILED);
+
+    // Prefilled transactions must be inside the block
+    cmpctblock = CCompactBlock(block);
+    cmpctblock.vPrefilled[0].nIndex = 4;
+    BOOST_CHECK_EQUAL(partialBlock.Init(cmpctblock, pool), READ_STATUS_INVALID);
+
+    cmpctblock = CCompactBlock(block);
+    cmpctblock.vPrefilled.clear();
+    cmpctblock.vShortIds.clear();
+    BOOST_CHECK_EQUAL(partialBlock.Init(cmpctblock, pool), READ_STATUS_INVALID);
+}
+
+BOOST_AUTO_TEST_CASE(block_transactions_request)
+{
+    CBlockTransactionsRequest req;
+    req.hash = uint256(1);
+    req.vIndexes.push_back(0);
+    req.vIndexes.push_back(1);
+    req.vIndexes.push_back(3);
+    req.vIndexes.push_back(100);
+
+    // Each index is the distance from the previous one
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << req;
+    BOOST_CHECK_EQUAL(HexStr(ss.begin() + 32, ss.end()), "0400000160");
+
+    CBlockTransactionsRequest reqRet;
+    ss >> reqRet;
+    BOOST_CHECK(reqRet.hash == req.hash);
+    BOOST_CHECK(reqRet.vIndexes == req.vIndexes);
+
+    // Indexes past 16 bits are refused
+    CDataStream ssBad(SER_NETWORK, PROTOCOL_VERSION);
+    ssBad << req.hash;
+    WriteCompactSize(ssBad, 2);
+    WriteCompactSize(ssBad, 0xffff);
+    WriteCompactSize(ssBad, 0);
+    BOOST_CHECK_THROW(ssBad >> reqRet, std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -58,6 +58,22 @@ public:
 
     bool GetStats(CCoinsStats& stats) const { return false; }
 };
+
+class CCoinsViewCacheTest : public CCoinsViewCache
+{
+public:
+    CCoinsViewCacheTest(CCoinsView* base) : CCoinsViewCache(base) {}
+
+    void SelfTest() const
+    {
+        // Manually recompute the dynamic usage of the whole data, and compare it.
+        size_t ret = cacheCoins.DynamicMemoryUsage();
+        for (CCoinsMap::const_iterator it = cacheCoins.begin(); it != cacheCoins.end(); it++) {
+            ret += it->second.coins.DynamicMemoryUsage();
+        }
+        BOOST_CHECK_EQUAL(DynamicMemoryUsage(), ret);
+    }
+};
 }
 
 BOOST_AUTO_TEST_SUITE(coins_tests)
@@ -89,8 +105,8 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
 
     // The cache stack.
     CCoinsViewTest base; // A CCoinsViewTest at the bottom.
-    std::vector<CCoinsViewCache*> stack; // A stack of CCoinsViewCaches on top.
-    stack.push_back(new CCoinsViewCache(&base)); // Start with one cache.
+    std::vector<CCoinsViewCacheTest*> stack; // A stack of CCoinsViewCaches on top.
+    stack.push_back(new CCoinsViewCacheTest(&base)); // Start with one cache.
 
     // Use a limited set of random transaction ids, so we do test overwriting entries.
     std::vector<uint256> txids;
@@ -135,6 +151,9 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
                     missed_an_entry = true;
                 }
             }
+            BOOST_FOREACH (const CCoinsViewCacheTest* test, stack) {
+                test->SelfTest();
+            }
         }
 
         if (insecure_rand() % 100 == 0) {
@@ -151,7 +170,7 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
                 } else {
                     removed_all_caches = true;
                 }
-                stack.push_back(new CCoinsViewCache(tip));
+                stack.push_back(new CCoinsViewCacheTest(tip));
                 if (stack.size() == 4) {
                     reached_4_caches = true;
                 }
@@ -175,4 +194,74 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     BOOST_CHECK(missed_an_entry);
 }
 
+// Check CCoinsMap against std::map, including erasing while iterating and
+// entries keeping their address while the table grows.
+BOOST_AUTO_TEST_CASE(coins_map_test)
+{
+    CCoinsMap map;
+    std::map<uint256, int> expected;
+    std::map<uint256, const CCoinsCacheEntry*> addresses;
+
+    for (int i = 0; i < 20000; i++) {
+        uint256 txid = GetRandHash();
+        CCoinsCacheEntry entry;
+        entry.coins.nHeight = i;
+        std::pair<CCoinsMap::iterator, bool> ret = map.insert(std::make_pair(txid, entry));
+        BOOST_CHECK(ret.second);
+        BOOST_CHECK(ret.first->first == txid);
+        expected[txid] = i;
+        addresses[txid] = &ret.first->second;
+
+        // Duplicate inserts leave the entry alone
+        entry.coins.nHeight = -1;
+        BOOST_CHECK(!map.insert(std::make_pair(txid, entry)).second);
+
+        // Erase some of them again, leaving tombstones behind
+        if (insecure_rand() % 4 == 0) {
+            std::map<uint256, int>::iterator victim = expected.lower_bound(GetRandHash());
+            if (victim == expected.end())
+                victim = expected.begin();
+            uint256 erase = victim->first;
+            BOOST_CHECK_EQUAL(map.erase(erase), 1U);
+            BOOST_CHECK_EQUAL(map.erase(erase), 0U);
+            expected.erase(erase);
+            addresses.erase(erase);
+        }
+    }
+    BOOST_CHECK_EQUAL(map.size(), expected.size());
+
+    for (std::map<uint256, int>::const_iterator it = expected.begin(); it != expected.end(); it++) {
+        CCoinsMap::iterator found = map.find(it->first);
+        BOOST_CHECK(found != map.end());
+        BOOST_CHECK_EQUAL(found->second.coins.nHeight, it->second);
+        BOOST_CHECK(&found->second == addresses[it->first]);
+    }
+    BOOST_CHECK(map.find(GetRandHash()) == map.end());
+
+    // Walk the map, erasing every other entry
+    size_t nBefore = map.size();
+    size_t nSeen = 0;
+    for (CCoinsMap::iterator it = map.begin(); it != map.end();) {
+        BOOST_CHECK(expected.count(it->first));
+        if (nSeen++ % 2 == 0) {
+            expected.erase(it->first);
+            map.erase(it++);
+        } else {
+            it++;
+        }
+    }
+    BOOST_CHECK_EQUAL(nSeen, nBefore);
+    BOOST_CHECK_EQUAL(map.size(), nBefore / 2);
+    BOOST_CHECK_EQUAL(map.size(), expected.size());
+    for (CCoinsMap::const_iterator it = map.begin(); it != map.end(); it++)
+        BOOST_CHECK(expected.count(it->first));
+
+    size_t nUsage = map.DynamicMemoryUsage();
+    BOOST_CHECK(nUsage > map.size() * sizeof(CCoinsMap::value_type));
+    map.clear();
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(map.begin() == map.end());
+    BOOST_CHECK_EQUAL(map.DynamicMemoryUsage(), 0U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
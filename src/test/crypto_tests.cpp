@@ -131,6 +131,24 @@ BOOST_AUTO_TEST_CASE(sha256_testvectors) {
     TestSHA256(test1, "a316d55510b49662420f49d145d42fb83f31ef8dc016aa4e32df049991a91e26");
 }
 
+BOOST_AUTO_TEST_CASE(sha256d_prefix) {
+    unsigned char msg[CDoubleSHA256Prefix::PREFIX_SIZE + CDoubleSHA256Prefix::SUFFIX_SIZE];
+    unsigned char hash[CSHA256::OUTPUT_SIZE], expected[CSHA256::OUTPUT_SIZE];
+    for (int i = 0; i < 100; i++) {
+        for (size_t j = 0; j < sizeof(msg); j++)
+            msg[j] = insecure_rand();
+        CDoubleSHA256Prefix hasher(msg);
+        for (int k = 0; k < 4; k++) {
+            // Only the suffix changes between messages with the same prefix
+            msg[CDoubleSHA256Prefix::PREFIX_SIZE + k] ^= insecure_rand();
+            hasher.Finalize(msg + CDoubleSHA256Prefix::PREFIX_SIZE, hash);
+            CSHA256().Write(msg, sizeof(msg)).Finalize(expected);
+            CSHA256().Write(expected, sizeof(expected)).Finalize(expected);
+            BOOST_CHECK(memcmp(hash, expected, sizeof(hash)) == 0);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_CASE(sha512_testvectors) {
     TestSHA512("",
                "cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce"
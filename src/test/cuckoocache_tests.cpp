@@ -0,0 +1,142 @@
+// Copyright (c) 2018 The Slingcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "cuckoocache.h"
+
+#include "crypto/common.h"
+#include "crypto/sha256.h"
+#include "pubkey.h"
+#include "script/sigcache.h"
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+static uint256 TestKey(uint32_t n)
+{
+    unsigned char buf[4];
+    WriteLE32(buf, n);
+    uint256 key;
+    CSHA256().Write(buf, sizeof(buf)).Finalize(key.begin());
+    return key;
+}
+
+static void LookupMissing(CCuckooCache* cache, uint32_t nBegin, uint32_t nEnd, bool* pfFound)
+{
+    for (int nPass = 0; nPass < 20; nPass++) {
+        for (uint32_t i = nBegin; i < nEnd; i++) {
+            if (cache->Contains(TestKey(i), false))
+                *pfFound = true;
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(cuckoocache_tests)
+
+BOOST_AUTO_TEST_CASE(cuckoocache_contains)
+{
+    CCuckooCache cache;
+    size_t nSlots = cache.Setup(1 << 20);
+    BOOST_CHECK(nSlots > 0);
+    BOOST_CHECK(cache.GetStats().nBytes <= (1 << 20));
+
+    // At half the capacity everything fits
+    uint32_t nKeys = nSlots / 2;
+    for (uint32_t i = 0; i < nKeys; i++)
+        cache.Insert(TestKey(i));
+    for (uint32_t i = 0; i < nKeys; i++)
+        BOOST_CHECK(cache.Contains(TestKey(i), false));
+    for (uint32_t i = nKeys; i < 2 * nKeys; i++)
+        BOOST_CHECK(!cache.Contains(TestKey(i), false));
+
+    CCuckooCache::Stats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nHits, nKeys);
+    BOOST_CHECK_EQUAL(stats.nMisses, nKeys);
+    BOOST_CHECK_EQUAL(stats.nInserts, nKeys);
+    BOOST_CHECK_EQUAL(stats.nEvictions, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_bounded)
+{
+    CCuckooCache cache;
+    size_t nSlots = cache.Setup(1 << 16);
+
+    // Twice the capacity: the cache drops entries rather than grow
+    for (uint32_t i = 0; i < 2 * nSlots; i++)
+        cache.Insert(TestKey(i));
+    CCuckooCache::Stats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nSlots, nSlots);
+    BOOST_CHECK(stats.nEvictions >= nSlots);
+
+    size_t nFound = 0;
+    for (uint32_t i = 0; i < 2 * nSlots; i++)
+        nFound += cache.Contains(TestKey(i), false);
+    BOOST_CHECK(nFound <= nSlots);
+    BOOST_CHECK(nFound > nSlots * 9 / 10);
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_erase)
+{
+    CCuckooCache cache;
+    size_t nSlots = cache.Setup(1 << 20);
+
+    uint32_t nKeys = nSlots / 2;
+    for (uint32_t i = 0; i < nKeys; i++)
+        cache.Insert(TestKey(i));
+
+    // Erased entries still match until something else takes their slot
+    for (uint32_t i = 0; i < nKeys; i++)
+        BOOST_CHECK(cache.Contains(TestKey(i), true));
+    for (uint32_t i = 0; i < nKeys; i++)
+        BOOST_CHECK(cache.Contains(TestKey(i), false));
+
+    // ... and new entries go there without pushing anything out
+    uint64_t nEvictions = cache.GetStats().nEvictions;
+    for (uint32_t i = nKeys; i < 2 * nKeys; i++)
+        cache.Insert(TestKey(i));
+    BOOST_CHECK_EQUAL(cache.GetStats().nEvictions, nEvictions);
+    for (uint32_t i = nKeys; i < 2 * nKeys; i++)
+        BOOST_CHECK(cache.Contains(TestKey(i), false));
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_disabled)
+{
+    CCuckooCache cache;
+    BOOST_CHECK_EQUAL(cache.Setup(0), 0U);
+    cache.Insert(TestKey(0));
+    BOOST_CHECK(!cache.Contains(TestKey(0), false));
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_concurrent)
+{
+    CCuckooCache cache;
+    size_t nSlots = cache.Setup(1 << 16);
+
+    // Readers racing with a writer that keeps rewriting slots must never
+    // see a key that was not inserted
+    bool vfFound[4] = {false, false, false, false};
+    boost::thread_group threads;
+    for (int i = 0; i < 4; i++)
+        threads.create_thread(boost::bind(&LookupMissing, &cache, 1000000, 1000000 + 1000, &vfFound[i]));
+    for (uint32_t i = 0; i < 8 * nSlots; i++)
+        cache.Insert(TestKey(i));
+    threads.join_all();
+
+    for (int i = 0; i < 4; i++)
+        BOOST_CHECK(!vfFound[i]);
+}
+
+BOOST_AUTO_TEST_CASE(signature_cache_setup)
+{
+    // The test fixture sets up the signature cache like init does
+    BOOST_CHECK(GetSignatureCacheStats().nCapacity > 0);
+
+    std::vector<unsigned char> vchSig(65, 1);
+    CPubKey pubkey;
+    BOOST_CHECK(!IsMessageSignatureCached(TestKey(0), vchSig, pubkey));
+    CacheMessageSignature(TestKey(0), vchSig, pubkey);
+    BOOST_CHECK(IsMessageSignatureCached(TestKey(0), vchSig, pubkey));
+    BOOST_CHECK(!IsMessageSignatureCached(TestKey(1), vchSig, pubkey));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
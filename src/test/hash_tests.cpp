@@ -3,6 +3,9 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "hash.h"
+#include "crypto/xevan.h"
+#include "primitives/block.h"
+#include "random.h"
 #include "utilstrencodings.h"
 
 #include <vector>
@@ -46,4 +49,46 @@ BOOST_AUTO_TEST_CASE(murmurhash3)
 #undef T
 }
 
+BOOST_AUTO_TEST_CASE(siphash)
+{
+    // Reference SipHash-2-4 vector for the 32 byte message 00..1f, keyed with 00..0f
+    BOOST_CHECK_EQUAL(SipHashUint256(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL, uint256("1f1e1d1c1b1a191817161514131211100f0e0d0c0b0a09080706050403020100")), 0x7127512f72f27cceULL);
+}
+
+BOOST_AUTO_TEST_CASE(xevan_batch)
+{
+    // Headers of both hash versions, enough for several full lane groups plus a remainder
+    std::vector<CBlockHeader> headers(2 * 4 * XEVAN_LANES + 3);
+    for (size_t i = 0; i < headers.size(); i++) {
+        CBlockHeader& header = headers[i];
+        header.nVersion = (i % 7 == 6) ? 4 : 1 + i % 3;
+        header.hashPrevBlock = GetRandHash();
+        header.hashMerkleRoot = GetRandHash();
+        header.nTime = GetRand(0xffffffff);
+        header.nBits = GetRand(0xffffffff);
+        header.nNonce = i;
+        header.nAccumulatorCheckpoint = GetRandHash();
+    }
+
+    std::vector<uint256> hashes(headers.size());
+    XevanBatch(headers.data(), headers.size(), hashes.data());
+    for (size_t i = 0; i < headers.size(); i++)
+        BOOST_CHECK(hashes[i] == headers[i].GetHash());
+
+    // Arbitrary message lengths through the multi-lane and single message paths
+    for (size_t len = 0; len < 200; len += 37) {
+        const size_t n = XEVAN_LANES + 1;
+        std::vector<unsigned char> data(n * len + 1);
+        for (size_t i = 0; i < data.size(); i++)
+            data[i] = insecure_rand();
+        std::vector<unsigned char> out(n * XEVAN_OUTPUT_SIZE);
+        XevanHashMany(data.data(), len, n, out.data());
+        for (size_t i = 0; i < n; i++) {
+            unsigned char single[XEVAN_OUTPUT_SIZE];
+            XevanHash(data.data() + i * len, len, single);
+            BOOST_CHECK(memcmp(single, out.data() + i * XEVAN_OUTPUT_SIZE, XEVAN_OUTPUT_SIZE) == 0);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
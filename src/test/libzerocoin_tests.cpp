@@ -23,6 +23,7 @@
 #include "libzerocoin/Coin.h"
 #include "libzerocoin/CoinSpend.h"
 #include "libzerocoin/Accumulator.h"
+#include "libzerocoin/MultiExp.h"
 
 using namespace std;
 using namespace libzerocoin;
@@ -442,6 +443,44 @@ Test_MintAndSpend()
 	return false;
 }
 
+bool
+Test_MultiExp()
+{
+	try {
+		const CBigNum& p = g_Params->serialNumberSoKCommitmentGroup.modulus;
+		const CBigNum& q = g_Params->serialNumberSoKCommitmentGroup.groupOrder;
+		const CBigNum& g = g_Params->serialNumberSoKCommitmentGroup.g;
+		const CBigNum& h = g_Params->serialNumberSoKCommitmentGroup.h;
+
+		for (int i = 0; i < 20; i++) {
+			CBigNum x = CBigNum::randBignum(p);
+			CBigNum e1 = CBigNum::randBignum(q);
+			CBigNum e2 = CBigNum::randBignum(p * q);
+			CBigNum e3 = CBigNum::randBignum(q);
+			FixedBaseTable table(x, p, q.bitSize());
+
+			// Negative exponents raise the inverse, exponents larger than
+			// the table covers and zero exponents are allowed
+			CBigNum expected = g.pow_mod(e1, p).mul_mod(h.pow_mod(0-e2, p), p).mul_mod(x.pow_mod(e3, p), p)
+			                    .mul_mod(x.pow_mod(0-e2, p), p);
+			CBigNum result = MultiExp(p).AddFixed(g, e1).AddFixed(h, 0-e2).Add(table, e3).Add(table, 0-e2)
+			                    .Add(x, CBigNum(0)).Eval();
+			if (result != expected)
+				return false;
+
+			// Even moduli fall back to pow_mod()
+			CBigNum m = p + 1;
+			if (MultiExp(m).Add(x, e1).AddFixed(g, e3).Eval() != x.pow_mod(e1, m).mul_mod(g.pow_mod(e3, m), m))
+				return false;
+		}
+	} catch (runtime_error &e) {
+		cout << e.what() << endl;
+		return false;
+	}
+
+	return true;
+}
+
 void
 Test_RunAllTests()
 {
@@ -461,6 +500,7 @@ Test_RunAllTests()
 	LogTestResult("coins can be minted", Test_MintCoin);
 	LogTestResult("invalid coins will be rejected", Test_InvalidCoin);
 	LogTestResult("the accumulator works", Test_Accumulator);
+	LogTestResult("multi-exponentiation matches pow_mod", Test_MultiExp);
 	LogTestResult("the commitment equality PoK works", Test_EqualityPoK);
 	LogTestResult("a minted coin can be spent", Test_MintAndSpend);
 
@@ -6,8 +6,13 @@
 
 #include "primitives/transaction.h"
 #include "main.h"
+#include "masternode-sync.h"
+#include "masternodeman.h"
+#include "net.h"
+#include "protocol.h"
 
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
 
 BOOST_AUTO_TEST_SUITE(main_tests)
 
@@ -48,4 +53,114 @@ BOOST_AUTO_TEST_CASE(subsidy_limit_test)
     BOOST_CHECK(nSum == 4109975100000000ULL);
 }
 
+BOOST_AUTO_TEST_CASE(read_raw_block_test)
+{
+    LOCK(cs_main);
+    CBlockIndex* pindex = chainActive.Genesis();
+    BOOST_REQUIRE(pindex != NULL);
+
+    CBlock block;
+    BOOST_REQUIRE(ReadBlockFromDisk(block, pindex));
+    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+    ssBlock << block;
+
+    // The bytes on disk are the network serialization, after the reserved room
+    CSerializeData data;
+    BOOST_CHECK(ReadRawBlockFromDisk(data, pindex->GetBlockPos(), pindex->GetBlockHash(), CMessageHeader::HEADER_SIZE));
+    BOOST_CHECK_EQUAL(data.size(), CMessageHeader::HEADER_SIZE + ssBlock.size());
+    BOOST_CHECK(std::equal(ssBlock.begin(), ssBlock.end(), data.begin() + CMessageHeader::HEADER_SIZE));
+
+    // A position that doesn't hold the expected block is refused
+    BOOST_CHECK(!ReadRawBlockFromDisk(data, pindex->GetBlockPos(), uint256(1), 0));
+}
+
+static void QueueMessage(CNode* pnode, const char* pszCommand, CDataStream& ssPayload)
+{
+    CMessageHeader hdr(pszCommand, ssPayload.size());
+    uint256 hash = Hash(ssPayload.begin(), ssPayload.end());
+    memcpy(&hdr.nChecksum, &hash, sizeof(hdr.nChecksum));
+    CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+    ssHeader << hdr;
+
+    CNetMessage msg(SER_NETWORK, PROTOCOL_VERSION);
+    msg.readHeader(&ssHeader[0], ssHeader.size());
+    msg.readData(&ssPayload[0], ssPayload.size());
+    pnode->vRecvMsg.push_back(msg);
+}
+
+static void ProcessQueued(CNode* pnode)
+{
+    {
+        LOCK(pnode->cs_vRecvMsg);
+        ProcessMessages(pnode);
+    }
+
+    // The node has no socket: drop whatever it answered and keep it connected
+    LOCK(pnode->cs_vSend);
+    pnode->vSendMsg.clear();
+    pnode->nSendSize = 0;
+    pnode->nSendOffset = 0;
+    pnode->fDisconnect = false;
+}
+
+static CMasternodePing TestPing(int i)
+{
+    CMasternodePing mnp;
+    mnp.vin = CTxIn(COutPoint(uint256(i + 1), 0));
+    return mnp;
+}
+
+static void RelayPings(CNode* pnode, int nPings)
+{
+    for (int i = 0; i < nPings; i++) {
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << TestPing(i);
+        QueueMessage(pnode, "mnp", ss);
+        ProcessQueued(pnode);
+    }
+}
+
+static void RequestPings(CNode* pnode, int nPings)
+{
+    for (int i = 0; i < nPings; i++) {
+        std::vector<CInv> vInv;
+        for (int j = 0; j <= i; j++)
+            vInv.push_back(CInv(MSG_MASTERNODE_PING, TestPing(j).GetHash()));
+        CDataStream ssInv(SER_NETWORK, PROTOCOL_VERSION);
+        ssInv << vInv;
+        QueueMessage(pnode, "inv", ssInv);
+        CDataStream ssGetData(SER_NETWORK, PROTOCOL_VERSION);
+        ssGetData << vInv;
+        QueueMessage(pnode, "getdata", ssGetData);
+        ProcessQueued(pnode);
+        ProcessQueued(pnode);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_masternode_messages)
+{
+    // Masternode messages are only handled once the chain is synced
+    SetMockTime(chainActive.Tip()->GetBlockTime());
+    BOOST_REQUIRE(masternodeSync.IsBlockchainSynced());
+
+    CNode nodeMn(INVALID_SOCKET, CAddress(CService("10.0.0.1")), "", true);
+    nodeMn.nVersion = PROTOCOL_VERSION;
+    CNode nodeCore(INVALID_SOCKET, CAddress(CService("10.0.0.2")), "", true);
+    nodeCore.nVersion = PROTOCOL_VERSION;
+
+    // One peer relays pings while another asks for them, as two message
+    // handler threads would
+    const int nPings = 200;
+    boost::thread threadMn(RelayPings, &nodeMn, nPings);
+    boost::thread threadCore(RequestPings, &nodeCore, nPings);
+    threadMn.join();
+    threadCore.join();
+
+    for (int i = 0; i < nPings; i++)
+        BOOST_CHECK(mnodeman.mapSeenMasternodePing.count(TestPing(i).GetHash()));
+
+    mnodeman.mapSeenMasternodePing.clear();
+    SetMockTime(0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,52 @@
+// Copyright (c) 2018 The Slingcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "masternodeman.h"
+
+#include "masternode.h"
+#include "primitives/transaction.h"
+
+#include <boost/test/unit_test.hpp>
+
+static CMasternode TestMasternode(int i)
+{
+    CMasternode mn;
+    mn.vin = CTxIn(COutPoint(uint256(i + 1), 0));
+    return mn;
+}
+
+BOOST_AUTO_TEST_SUITE(masternode_tests)
+
+BOOST_AUTO_TEST_CASE(collateral_checked_follows_masternode)
+{
+    CMasternodeMan manager;
+    for (int i = 0; i < 4; i++) {
+        CMasternode mn = TestMasternode(i);
+        BOOST_REQUIRE(manager.Add(mn));
+    }
+
+    // Only listed collaterals can be marked
+    manager.SetCollateralChecked(TestMasternode(4).vin.prevout);
+    BOOST_CHECK(!manager.IsCollateralChecked(TestMasternode(4).vin.prevout));
+
+    manager.SetCollateralChecked(TestMasternode(0).vin.prevout);
+    manager.SetCollateralChecked(TestMasternode(1).vin.prevout);
+    manager.SetCollateralChecked(TestMasternode(3).vin.prevout);
+
+    // Erasing from the middle moves the later masternodes down a slot; the
+    // unchecked one must not pick up the state of the one it replaces
+    manager.Remove(TestMasternode(1).vin);
+    BOOST_CHECK_EQUAL(manager.size(), 3);
+    BOOST_CHECK(manager.IsCollateralChecked(TestMasternode(0).vin.prevout));
+    BOOST_CHECK(!manager.IsCollateralChecked(TestMasternode(1).vin.prevout));
+    BOOST_CHECK(!manager.IsCollateralChecked(TestMasternode(2).vin.prevout));
+    BOOST_CHECK(manager.IsCollateralChecked(TestMasternode(3).vin.prevout));
+
+    // A masternode that comes back is validated again
+    CMasternode mn = TestMasternode(1);
+    BOOST_REQUIRE(manager.Add(mn));
+    BOOST_CHECK(!manager.IsCollateralChecked(TestMasternode(1).vin.prevout));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
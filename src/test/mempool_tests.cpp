@@ -99,4 +99,222 @@ BOOST_AUTO_TEST_CASE(MempoolRemoveTest)
     removed.clear();
 }
 
+BOOST_AUTO_TEST_CASE(MempoolPackageStateTest)
+{
+    // Parent with two children, one of which has a child of its own
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_11;
+    txParent.vout.resize(2);
+    for (int i = 0; i < 2; i++)
+    {
+        txParent.vout[i].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txParent.vout[i].nValue = 33000LL;
+    }
+    CMutableTransaction txChild[2];
+    for (int i = 0; i < 2; i++)
+    {
+        txChild[i].vin.resize(1);
+        txChild[i].vin[0].scriptSig = CScript() << OP_11;
+        txChild[i].vin[0].prevout.hash = txParent.GetHash();
+        txChild[i].vin[0].prevout.n = i;
+        txChild[i].vout.resize(1);
+        txChild[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txChild[i].vout[0].nValue = 11000LL;
+    }
+    CMutableTransaction txGrandChild;
+    txGrandChild.vin.resize(1);
+    txGrandChild.vin[0].scriptSig = CScript() << OP_11;
+    txGrandChild.vin[0].prevout.hash = txChild[0].GetHash();
+    txGrandChild.vin[0].prevout.n = 0;
+    txGrandChild.vout.resize(1);
+    txGrandChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txGrandChild.vout[0].nValue = 10000LL;
+
+    CTxMemPoolEntry entryParent(txParent, 0, 1, 0.0, 1);
+    CTxMemPoolEntry entryChild0(txChild[0], 1000, 2, 0.0, 1);
+    CTxMemPoolEntry entryChild1(txChild[1], 2000, 3, 0.0, 1);
+    // Pays for the whole package
+    CTxMemPoolEntry entryGrandChild(txGrandChild, 100000, 4, 0.0, 1);
+    uint64_t nSizeParent = entryParent.GetTxSize();
+    uint64_t nSizeChild = entryChild0.GetTxSize();
+    uint64_t nSizeGrandChild = entryGrandChild.GetTxSize();
+
+    CTxMemPool testPool(CFeeRate(0));
+    testPool.addUnchecked(txParent.GetHash(), entryParent);
+    testPool.addUnchecked(txChild[0].GetHash(), entryChild0);
+    testPool.addUnchecked(txChild[1].GetHash(), entryChild1);
+    testPool.addUnchecked(txGrandChild.GetHash(), entryGrandChild);
+
+    CTxMemPool::txiter itParent = testPool.mapTx.find(txParent.GetHash());
+    CTxMemPool::txiter itChild0 = testPool.mapTx.find(txChild[0].GetHash());
+    CTxMemPool::txiter itGrandChild = testPool.mapTx.find(txGrandChild.GetHash());
+    BOOST_CHECK_EQUAL(itParent->GetCountWithDescendants(), 4);
+    BOOST_CHECK_EQUAL(itParent->GetSizeWithDescendants(), nSizeParent + 2 * nSizeChild + nSizeGrandChild);
+    BOOST_CHECK_EQUAL(itParent->GetModFeesWithDescendants(), 103000);
+    BOOST_CHECK_EQUAL(itChild0->GetCountWithDescendants(), 2);
+    BOOST_CHECK_EQUAL(itChild0->GetCountWithAncestors(), 2);
+    BOOST_CHECK_EQUAL(itGrandChild->GetCountWithAncestors(), 3);
+    BOOST_CHECK_EQUAL(itGrandChild->GetSizeWithAncestors(), nSizeParent + nSizeChild + nSizeGrandChild);
+    BOOST_CHECK_EQUAL(itGrandChild->GetModFeesWithAncestors(), 101000);
+    BOOST_CHECK(testPool.GetMemPoolParents(itGrandChild).count(itChild0));
+    BOOST_CHECK_EQUAL(testPool.GetMemPoolChildren(itParent).size(), 2);
+
+    // The grandchild's package is the best to mine, the parent pays nothing
+    BOOST_CHECK(testPool.mapTx.get<ancestor_score>().begin()->GetTx().GetHash() == txGrandChild.GetHash());
+    BOOST_CHECK(testPool.mapTx.get<entry_time>().begin()->GetTx().GetHash() == txParent.GetHash());
+    // ... but the parent is not the cheapest to evict, its descendants pay for it
+    BOOST_CHECK(testPool.mapTx.get<fee_rate>().begin()->GetTx().GetHash() == txChild[1].GetHash());
+
+    // Entries with the same fee rate and time are still strictly ordered
+    CompareTxMemPoolEntryByFeeRate feeRateCmp;
+    CTxMemPoolEntry entrySame0(txChild[0], 1000, 2, 0.0, 1);
+    CTxMemPoolEntry entrySame1(txChild[1], 1000, 2, 0.0, 1);
+    BOOST_CHECK(!feeRateCmp(entrySame0, entrySame0));
+    BOOST_CHECK(feeRateCmp(entrySame0, entrySame1) != feeRateCmp(entrySame1, entrySame0));
+
+    // Prioritising a transaction carries over to the totals of its package
+    testPool.PrioritiseTransaction(txChild[0].GetHash(), txChild[0].GetHash().ToString(), 0.0, 500);
+    BOOST_CHECK_EQUAL(itParent->GetModFeesWithDescendants(), 103500);
+    BOOST_CHECK_EQUAL(itGrandChild->GetModFeesWithAncestors(), 101500);
+
+    // Removing the parent without its descendants leaves them as roots
+    std::list<CTransaction> removed;
+    testPool.remove(txParent, removed, false);
+    BOOST_CHECK_EQUAL(removed.size(), 1);
+    BOOST_CHECK_EQUAL(itChild0->GetCountWithAncestors(), 1);
+    BOOST_CHECK_EQUAL(itChild0->GetCountWithDescendants(), 2);
+    BOOST_CHECK_EQUAL(itGrandChild->GetCountWithAncestors(), 2);
+    BOOST_CHECK_EQUAL(itGrandChild->GetModFeesWithAncestors(), 101500);
+    BOOST_CHECK(testPool.GetMemPoolParents(itChild0).empty());
+
+    // Adding it back, as after a reorg, links it to the transactions spending it
+    testPool.addUnchecked(txParent.GetHash(), entryParent);
+    itParent = testPool.mapTx.find(txParent.GetHash());
+    BOOST_CHECK_EQUAL(itParent->GetCountWithDescendants(), 4);
+    BOOST_CHECK_EQUAL(itParent->GetModFeesWithDescendants(), 103500);
+    BOOST_CHECK_EQUAL(itChild0->GetCountWithAncestors(), 2);
+    BOOST_CHECK_EQUAL(itGrandChild->GetCountWithAncestors(), 3);
+    BOOST_CHECK_EQUAL(itGrandChild->GetSizeWithAncestors(), nSizeParent + nSizeChild + nSizeGrandChild);
+
+    // Expiry removes old transactions together with their descendants
+    BOOST_CHECK_EQUAL(testPool.Expire(1), 0);
+    BOOST_CHECK_EQUAL(testPool.Expire(2), 4);
+    BOOST_CHECK_EQUAL(testPool.size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
+{
+    CTxMemPool pool(CFeeRate(1000));
+    SetMockTime(42);
+
+    CMutableTransaction tx[3];
+    for (int i = 0; i < 3; i++)
+    {
+        tx[i].vin.resize(1);
+        tx[i].vin[0].scriptSig = CScript() << OP_11;
+        tx[i].vin[0].prevout.n = i;
+        tx[i].vout.resize(1);
+        tx[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx[i].vout[0].nValue = 10 * COIN;
+        pool.addUnchecked(tx[i].GetHash(), CTxMemPoolEntry(tx[i], 10000 * (i + 1), 0, 0.0, 1));
+    }
+    BOOST_CHECK(pool.DynamicMemoryUsage() > 0);
+    BOOST_CHECK_EQUAL(pool.GetMinFee(1).GetFeePerK(), 0);
+
+    // Going one byte over the limit evicts the lowest fee rate
+    size_t nUsage = pool.DynamicMemoryUsage();
+    pool.TrimToSize(nUsage - 1);
+    BOOST_CHECK(!pool.exists(tx[0].GetHash()));
+    BOOST_CHECK(pool.exists(tx[1].GetHash()));
+    BOOST_CHECK(pool.exists(tx[2].GetHash()));
+    BOOST_CHECK(pool.DynamicMemoryUsage() < nUsage);
+
+    // ... and the rolling minimum fee is what it paid plus the relay fee
+    CAmount nRate = CFeeRate(10000, ::GetSerializeSize(tx[0], SER_NETWORK, PROTOCOL_VERSION)).GetFeePerK() + 1000;
+    size_t nLimit = pool.DynamicMemoryUsage();
+    BOOST_CHECK_EQUAL(pool.GetMinFee(nLimit).GetFeePerK(), nRate);
+
+    // It does not decay before a block comes in
+    SetMockTime(42 + CTxMemPool::ROLLING_FEE_HALFLIFE);
+    BOOST_CHECK_EQUAL(pool.GetMinFee(nLimit).GetFeePerK(), nRate);
+
+    std::vector<CTransaction> vtx;
+    std::list<CTransaction> conflicts;
+    pool.removeForBlock(vtx, 1, conflicts);
+    SetMockTime(42 + 2 * CTxMemPool::ROLLING_FEE_HALFLIFE);
+    BOOST_CHECK_EQUAL(pool.GetMinFee(nLimit).GetFeePerK(), nRate / 2);
+
+    // Once below half the relay fee it drops to zero
+    SetMockTime(42 + 20 * CTxMemPool::ROLLING_FEE_HALFLIFE);
+    BOOST_CHECK_EQUAL(pool.GetMinFee(nLimit).GetFeePerK(), 0);
+
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolAncestorLimitTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    LOCK(pool.cs);
+    CTxMemPool::setEntries setAncestors;
+    std::string errString;
+
+    // A chain as long as the limit; the first one can be spent twice
+    const unsigned int nChain = DEFAULT_ANCESTOR_LIMIT;
+    CMutableTransaction tx[nChain + 1];
+    for (unsigned int i = 0; i <= nChain; i++) {
+        tx[i].vin.resize(1);
+        tx[i].vin[0].scriptSig = CScript() << OP_11;
+        if (i > 0)
+            tx[i].vin[0].prevout = COutPoint(tx[i - 1].GetHash(), 0);
+        tx[i].vout.resize(i == 0 ? 2 : 1);
+        for (unsigned int j = 0; j < tx[i].vout.size(); j++) {
+            tx[i].vout[j].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+            tx[i].vout[j].nValue = 10 * COIN;
+        }
+        if (i == nChain)
+            break;
+        CTxMemPoolEntry entry(tx[i], 0, 0, 0.0, 1);
+        BOOST_CHECK(pool.CalculateMemPoolAncestors(entry, setAncestors, DEFAULT_ANCESTOR_LIMIT, DEFAULT_ANCESTOR_SIZE_LIMIT * 1000,
+            DEFAULT_DESCENDANT_LIMIT, DEFAULT_DESCENDANT_SIZE_LIMIT * 1000, errString));
+        pool.addUnchecked(tx[i].GetHash(), entry);
+    }
+    BOOST_CHECK_EQUAL(pool.mapTx.find(tx[nChain - 1].GetHash())->GetCountWithAncestors(), nChain);
+
+    // One more would have too many ancestors...
+    CTxMemPoolEntry entryLong(tx[nChain], 0, 0, 0.0, 1);
+    setAncestors.clear();
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(entryLong, setAncestors, DEFAULT_ANCESTOR_LIMIT, DEFAULT_ANCESTOR_SIZE_LIMIT * 1000,
+        DEFAULT_DESCENDANT_LIMIT, DEFAULT_DESCENDANT_SIZE_LIMIT * 1000, errString));
+    BOOST_CHECK(errString.find("too many unconfirmed ancestors") != std::string::npos);
+    setAncestors.clear();
+    BOOST_CHECK(pool.CalculateMemPoolAncestors(entryLong, setAncestors, nChain + 1, DEFAULT_ANCESTOR_SIZE_LIMIT * 1000,
+        nChain + 1, DEFAULT_DESCENDANT_SIZE_LIMIT * 1000, errString));
+    BOOST_CHECK_EQUAL(setAncestors.size(), nChain);
+
+    // ... and a second child of the first one would give it too many descendants
+    CMutableTransaction txWide;
+    txWide.vin.resize(1);
+    txWide.vin[0].scriptSig = CScript() << OP_11;
+    txWide.vin[0].prevout = COutPoint(tx[0].GetHash(), 1);
+    txWide.vout.resize(1);
+    txWide.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txWide.vout[0].nValue = 10 * COIN;
+    CTxMemPoolEntry entryWide(txWide, 0, 0, 0.0, 1);
+    setAncestors.clear();
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(entryWide, setAncestors, DEFAULT_ANCESTOR_LIMIT, DEFAULT_ANCESTOR_SIZE_LIMIT * 1000,
+        DEFAULT_DESCENDANT_LIMIT, DEFAULT_DESCENDANT_SIZE_LIMIT * 1000, errString));
+    BOOST_CHECK(errString.find("too many descendants") != std::string::npos);
+
+    // The sizes are limited the same way
+    setAncestors.clear();
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(entryWide, setAncestors, DEFAULT_ANCESTOR_LIMIT, DEFAULT_ANCESTOR_SIZE_LIMIT * 1000,
+        nChain + 1, entryWide.GetTxSize() * nChain, errString));
+    BOOST_CHECK(errString.find("exceeds descendant size limit") != std::string::npos);
+    setAncestors.clear();
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(entryLong, setAncestors, nChain + 1, entryLong.GetTxSize() * nChain,
+        nChain + 1, DEFAULT_DESCENDANT_SIZE_LIMIT * 1000, errString));
+    BOOST_CHECK(errString.find("exceeds ancestor size limit") != std::string::npos);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
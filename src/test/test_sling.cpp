@@ -4,8 +4,10 @@
 
 #define BOOST_TEST_MODULE Slingcoin Test Suite
 
+#include "crypto/xevan.h"
 #include "main.h"
 #include "random.h"
+#include "script/sigcache.h"
 #include "txdb.h"
 #include "ui_interface.h"
 #include "util.h"
@@ -31,10 +33,12 @@ struct TestingSetup {
 
     TestingSetup() {
         SetupEnvironment();
+        XevanAutoDetect();
         fPrintToDebugLog = false; // don't want to write to debug.log file
         fCheckBlockIndex = true;
         SelectParams(CBaseChainParams::UNITTEST);
         noui_connect();
+        InitSignatureCache();
 #ifdef ENABLE_WALLET
         bitdb.MakeMock();
 #endif
@@ -54,6 +58,8 @@ struct TestingSetup {
         nScriptCheckThreads = 3;
         for (int i=0; i < nScriptCheckThreads-1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
+        for (int i=0; i < nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadZerocoinSpendCheck);
         RegisterNodeSignals(GetNodeSignals());
     }
     ~TestingSetup()
@@ -208,6 +208,71 @@ bool CBlockTreeDB::ReadInt(const std::string& name, int& nValue)
     return Read(std::make_pair('I', name), nValue);
 }
 
+/** Number of block index entries whose hashes are computed together while loading. */
+static const size_t BLOCK_INDEX_LOAD_BATCH = 1024;
+
+static bool LoadDiskBlockIndexBatch(const std::vector<CDiskBlockIndex>& vDiskIndex, uint256& nPreviousCheckpoint)
+{
+    std::vector<CBlockHeader> vHeaders;
+    vHeaders.reserve(vDiskIndex.size());
+    for (const CDiskBlockIndex& diskindex : vDiskIndex)
+        vHeaders.push_back(diskindex.GetBlockHeader());
+    std::vector<uint256> vHashes(vHeaders.size());
+    XevanBatch(vHeaders.data(), vHeaders.size(), vHashes.data());
+
+    for (size_t i = 0; i < vDiskIndex.size(); i++) {
+        const CDiskBlockIndex& diskindex = vDiskIndex[i];
+
+        // Construct block index object
+        CBlockIndex* pindexNew = InsertBlockIndex(vHashes[i]);
+        pindexNew->pprev = InsertBlockIndex(diskindex.hashPrev);
+        pindexNew->pnext = InsertBlockIndex(diskindex.hashNext);
+        pindexNew->nHeight = diskindex.nHeight;
+        pindexNew->nFile = diskindex.nFile;
+        pindexNew->nDataPos = diskindex.nDataPos;
+        pindexNew->nUndoPos = diskindex.nUndoPos;
+        pindexNew->nVersion = diskindex.nVersion;
+        pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+        pindexNew->nTime = diskindex.nTime;
+        pindexNew->nBits = diskindex.nBits;
+        pindexNew->nNonce = diskindex.nNonce;
+        pindexNew->nStatus = diskindex.nStatus;
+        pindexNew->nTx = diskindex.nTx;
+
+        //zerocoin
+        pindexNew->nAccumulatorCheckpoint = diskindex.nAccumulatorCheckpoint;
+        pindexNew->mapZerocoinSupply = diskindex.mapZerocoinSupply;
+        pindexNew->vMintDenominationsInBlock = diskindex.vMintDenominationsInBlock;
+
+        //Proof Of Stake
+        pindexNew->nMint = diskindex.nMint;
+        pindexNew->nMoneySupply = diskindex.nMoneySupply;
+        pindexNew->nFlags = diskindex.nFlags;
+        pindexNew->nStakeModifier = diskindex.nStakeModifier;
+        pindexNew->prevoutStake = diskindex.prevoutStake;
+        pindexNew->nStakeTime = diskindex.nStakeTime;
+        pindexNew->hashProofOfStake = diskindex.hashProofOfStake;
+
+        if (pindexNew->nHeight <= Params().LAST_POW_BLOCK()) {
+            if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits))
+                return error("LoadBlockIndex() : CheckProofOfWork failed: %s", pindexNew->ToString());
+        }
+        // ppcoin: build setStakeSeen
+        if (pindexNew->IsProofOfStake())
+            setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
+
+        //populate accumulator checksum map in memory
+        if(pindexNew->nAccumulatorCheckpoint != 0 && pindexNew->nAccumulatorCheckpoint != nPreviousCheckpoint) {
+            //Don't load any invalid checkpoints
+            if (!InvalidCheckpointRange(pindexNew->nHeight))
+                LoadAccumulatorValuesFromDB(pindexNew->nAccumulatorCheckpoint);
+
+            nPreviousCheckpoint = pindexNew->nAccumulatorCheckpoint;
+        }
+    }
+    return true;
+}
+
 bool CBlockTreeDB::LoadBlockIndexGuts()
 {
     boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
@@ -216,74 +281,39 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
     ssKeySet << make_pair('b', uint256(0));
     pcursor->Seek(ssKeySet.str());
 
-    // Load mapBlockIndex
+    // Load mapBlockIndex, hashing the headers in batches
     uint256 nPreviousCheckpoint;
-    while (pcursor->Valid()) {
+    std::vector<CDiskBlockIndex> vBatch;
+    vBatch.reserve(BLOCK_INDEX_LOAD_BATCH);
+    bool fDone = false;
+    while (!fDone) {
         boost::this_thread::interruption_point();
-        try {
-            leveldb::Slice slKey = pcursor->key();
-            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
-            char chType;
-            ssKey >> chType;
-            if (chType == 'b') {
-                leveldb::Slice slValue = pcursor->value();
-                CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
-                CDiskBlockIndex diskindex;
-                ssValue >> diskindex;
-
-                // Construct block index object
-                CBlockIndex* pindexNew = InsertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev = InsertBlockIndex(diskindex.hashPrev);
-                pindexNew->pnext = InsertBlockIndex(diskindex.hashNext);
-                pindexNew->nHeight = diskindex.nHeight;
-                pindexNew->nFile = diskindex.nFile;
-                pindexNew->nDataPos = diskindex.nDataPos;
-                pindexNew->nUndoPos = diskindex.nUndoPos;
-                pindexNew->nVersion = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime = diskindex.nTime;
-                pindexNew->nBits = diskindex.nBits;
-                pindexNew->nNonce = diskindex.nNonce;
-                pindexNew->nStatus = diskindex.nStatus;
-                pindexNew->nTx = diskindex.nTx;
-
-                //zerocoin
-                pindexNew->nAccumulatorCheckpoint = diskindex.nAccumulatorCheckpoint;
-                pindexNew->mapZerocoinSupply = diskindex.mapZerocoinSupply;
-                pindexNew->vMintDenominationsInBlock = diskindex.vMintDenominationsInBlock;
-
-                //Proof Of Stake
-                pindexNew->nMint = diskindex.nMint;
-                pindexNew->nMoneySupply = diskindex.nMoneySupply;
-                pindexNew->nFlags = diskindex.nFlags;
-                pindexNew->nStakeModifier = diskindex.nStakeModifier;
-                pindexNew->prevoutStake = diskindex.prevoutStake;
-                pindexNew->nStakeTime = diskindex.nStakeTime;
-                pindexNew->hashProofOfStake = diskindex.hashProofOfStake;
-
-                if (pindexNew->nHeight <= Params().LAST_POW_BLOCK()) {
-                    if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits))
-                        return error("LoadBlockIndex() : CheckProofOfWork failed: %s", pindexNew->ToString());
-                }
-                // ppcoin: build setStakeSeen
-                if (pindexNew->IsProofOfStake())
-                    setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
-
-                //populate accumulator checksum map in memory
-                if(pindexNew->nAccumulatorCheckpoint != 0 && pindexNew->nAccumulatorCheckpoint != nPreviousCheckpoint) {
-                    //Don't load any invalid checkpoints
-                    if (!InvalidCheckpointRange(pindexNew->nHeight))
-                        LoadAccumulatorValuesFromDB(pindexNew->nAccumulatorCheckpoint);
-
-                    nPreviousCheckpoint = pindexNew->nAccumulatorCheckpoint;
+        fDone = !pcursor->Valid();
+        if (!fDone) {
+            try {
+                leveldb::Slice slKey = pcursor->key();
+                CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+                char chType;
+                ssKey >> chType;
+                if (chType == 'b') {
+                    leveldb::Slice slValue = pcursor->value();
+                    CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+                    CDiskBlockIndex diskindex;
+                    ssValue >> diskindex;
+                    vBatch.push_back(diskindex);
+                    pcursor->Next();
+                } else {
+                    fDone = true; // if shutdown requested or finished loading block index
                 }
-
-                pcursor->Next();
-            } else {
-                break; // if shutdown requested or finished loading block index
+            } catch (std::exception& e) {
+                return error("%s : Deserialize or I/O error - %s", __func__, e.what());
             }
-        } catch (std::exception& e) {
-            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+
+        if (vBatch.size() == BLOCK_INDEX_LOAD_BATCH || (fDone && !vBatch.empty())) {
+            if (!LoadDiskBlockIndexBatch(vBatch, nPreviousCheckpoint))
+                return false;
+            vBatch.clear();
         }
     }
 
@@ -365,3 +395,45 @@ bool CZerocoinDB::EraseAccumulatorValue(const uint32_t& nChecksum)
     LogPrint("zero", "%s : checksum:%d\n", __func__, nChecksum);
     return Erase(make_pair('a', nChecksum));
 }
+
+bool CZerocoinDB::WritePubcoins(CoinDenomination denom, int nHeight, const uint256& hashBlock, const std::vector<CBigNum>& vPubcoins)
+{
+    return Write(make_pair('p', make_pair((int)denom, nHeight)), make_pair(hashBlock, vPubcoins));
+}
+
+bool CZerocoinDB::ReadPubcoins(CoinDenomination denom, int nHeight, uint256& hashBlock, std::vector<CBigNum>& vPubcoins)
+{
+    std::pair<uint256, std::vector<CBigNum> > value;
+    if (!Read(make_pair('p', make_pair((int)denom, nHeight)), value))
+        return false;
+
+    hashBlock = value.first;
+    vPubcoins.swap(value.second);
+    return true;
+}
+
+bool CZerocoinDB::ErasePubcoins(CoinDenomination denom, int nHeight)
+{
+    return Erase(make_pair('p', make_pair((int)denom, nHeight)));
+}
+
+bool CZerocoinDB::WriteMintCounts(int nHeight, const uint256& hashBlock, const std::vector<int>& vMintCounts)
+{
+    return Write(make_pair('c', nHeight), make_pair(hashBlock, vMintCounts));
+}
+
+bool CZerocoinDB::ReadMintCounts(int nHeight, uint256& hashBlock, std::vector<int>& vMintCounts)
+{
+    std::pair<uint256, std::vector<int> > value;
+    if (!Read(make_pair('c', nHeight), value))
+        return false;
+
+    hashBlock = value.first;
+    vMintCounts.swap(value.second);
+    return true;
+}
+
+bool CZerocoinDB::EraseMintCounts(int nHeight)
+{
+    return Erase(make_pair('c', nHeight));
+}
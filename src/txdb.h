@@ -89,6 +89,12 @@ public:
     bool WriteAccumulatorValue(const uint32_t& nChecksum, const CBigNum& bnValue);
     bool ReadAccumulatorValue(const uint32_t& nChecksum, CBigNum& bnValue);
     bool EraseAccumulatorValue(const uint32_t& nChecksum);
+    bool WritePubcoins(libzerocoin::CoinDenomination denom, int nHeight, const uint256& hashBlock, const std::vector<CBigNum>& vPubcoins);
+    bool ReadPubcoins(libzerocoin::CoinDenomination denom, int nHeight, uint256& hashBlock, std::vector<CBigNum>& vPubcoins);
+    bool ErasePubcoins(libzerocoin::CoinDenomination denom, int nHeight);
+    bool WriteMintCounts(int nHeight, const uint256& hashBlock, const std::vector<int>& vMintCounts);
+    bool ReadMintCounts(int nHeight, uint256& hashBlock, std::vector<int>& vMintCounts);
+    bool EraseMintCounts(int nHeight);
 };
 
 #endif // BITCOIN_TXDB_H
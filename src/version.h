@@ -12,7 +12,7 @@
  * network protocol versioning
  */
 
-static const int PROTOCOL_VERSION = 70002;
+static const int PROTOCOL_VERSION = 70003;
 
 //! initial proto version, to be increased after version/verack negotiation
 static const int INIT_PROTO_VERSION = 209;
@@ -37,5 +37,8 @@ static const int MEMPOOL_GD_VERSION = 60002;
 //! "filter*" commands are disabled without NODE_BLOOM after and including this version
 static const int NO_BLOOM_VERSION = 70000;
 
+//! "sendcmpct", "cmpctblock", "getblocktxn" and "blocktxn" start with this version
+static const int SHORT_IDS_BLOCKS_VERSION = 70003;
+
 
 #endif // BITCOIN_VERSION_H
@@ -51,6 +51,7 @@ bool fPayAtLeastCustomFee = true;
  * Override with -mintxfee
  */
 CFeeRate CWallet::minTxFee = CFeeRate(10000);
+CCriticalSection CWallet::cs_witness;
 int64_t nStartupTime = GetAdjustedTime();
 
 /** @defgroup mapWallet
@@ -165,6 +166,8 @@ bool CWallet::AddCScript(const CScript& redeemScript)
 {
     if (!CCryptoKeyStore::AddCScript(redeemScript))
         return false;
+    // Outputs already in the wallet may be ours now
+    fWalletUTXODirty = true;
     if (!fFileBacked)
         return true;
     return CWalletDB(strWalletFile).WriteCScript(Hash160(redeemScript), redeemScript);
@@ -189,6 +192,7 @@ bool CWallet::AddWatchOnly(const CScript& dest)
 {
     if (!CCryptoKeyStore::AddWatchOnly(dest))
         return false;
+    fWalletUTXODirty = true;
     nTimeFirstKey = 1; // No birthday information for watch-only keys.
     NotifyWatchonlyChanged(true);
     if (!fFileBacked)
@@ -201,6 +205,7 @@ bool CWallet::RemoveWatchOnly(const CScript& dest)
     AssertLockHeld(cs_wallet);
     if (!CCryptoKeyStore::RemoveWatchOnly(dest))
         return false;
+    fWalletUTXODirty = true;
     if (!HaveWatchOnly())
         NotifyWatchonlyChanged(false);
     if (fFileBacked)
@@ -219,6 +224,7 @@ bool CWallet::AddMultiSig(const CScript& dest)
 {
     if (!CCryptoKeyStore::AddMultiSig(dest))
         return false;
+    fWalletUTXODirty = true;
     nTimeFirstKey = 1; // No birthday information
     NotifyMultiSigChanged(true);
     if (!fFileBacked)
@@ -231,6 +237,7 @@ bool CWallet::RemoveMultiSig(const CScript& dest)
     AssertLockHeld(cs_wallet);
     if (!CCryptoKeyStore::RemoveMultiSig(dest))
         return false;
+    fWalletUTXODirty = true;
     if (!HaveMultiSig())
         NotifyMultiSigChanged(false);
     if (fFileBacked)
@@ -459,6 +466,82 @@ void CWallet::AddToSpends(const uint256& wtxid)
         AddToSpends(txin.prevout, wtxid);
 }
 
+void CWallet::UpdateWalletUTXO(const COutPoint& outpoint) const
+{
+    map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(outpoint.hash);
+    bool fUnspent = mi != mapWallet.end() && outpoint.n < mi->second.vout.size() &&
+                    IsMine(mi->second.vout[outpoint.n]) != ISMINE_NO;
+
+    // Unlike IsSpent() a spend still in the mempool keeps the output, as
+    // that spend can be conflicted without the output's transaction changing
+    if (fUnspent) {
+        pair<TxSpends::const_iterator, TxSpends::const_iterator> range = mapTxSpends.equal_range(outpoint);
+        for (TxSpends::const_iterator it = range.first; it != range.second; ++it) {
+            map<uint256, CWalletTx>::const_iterator mit = mapWallet.find(it->second);
+            if (mit != mapWallet.end() && mit->second.GetDepthInMainChain(false) > 0) {
+                fUnspent = false;
+                break;
+            }
+        }
+    }
+
+    if (fUnspent)
+        setWalletUTXO.insert(outpoint);
+    else
+        setWalletUTXO.erase(outpoint);
+}
+
+void CWallet::SyncWalletUTXO() const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    if (fWalletUTXODirty) {
+        setWalletUTXO.clear();
+        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
+            for (unsigned int i = 0; i < it->second.vout.size(); i++)
+                UpdateWalletUTXO(COutPoint(it->first, i));
+        }
+        setWalletUTXOPending.clear();
+        fWalletUTXODirty = false;
+        fBalancesCached = false;
+        return;
+    }
+
+    BOOST_FOREACH (const uint256& hash, setWalletUTXOPending) {
+        map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(hash);
+        if (mi == mapWallet.end()) {
+            std::set<COutPoint>::iterator it = setWalletUTXO.lower_bound(COutPoint(hash, 0));
+            while (it != setWalletUTXO.end() && it->hash == hash)
+                setWalletUTXO.erase(it++);
+            continue;
+        }
+
+        // A change in depth of a transaction changes whether the outputs it spends are spent
+        const CWalletTx& wtx = mi->second;
+        for (unsigned int i = 0; i < wtx.vout.size(); i++)
+            UpdateWalletUTXO(COutPoint(hash, i));
+        BOOST_FOREACH (const CTxIn& txin, wtx.vin)
+            UpdateWalletUTXO(txin.prevout);
+    }
+    setWalletUTXOPending.clear();
+}
+
+void CWallet::GetWalletUTXOTxs(std::vector<const CWalletTx*>& vTxs) const
+{
+    SyncWalletUTXO();
+
+    vTxs.clear();
+    for (std::set<COutPoint>::const_iterator it = setWalletUTXO.begin(); it != setWalletUTXO.end(); ++it) {
+        // Outputs of one transaction are next to each other
+        if (!vTxs.empty() && vTxs.back()->GetHash() == it->hash)
+            continue;
+        map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(it->hash);
+        if (mi != mapWallet.end())
+            vTxs.push_back(&mi->second);
+    }
+}
+
 bool CWallet::GetMasternodeVinAndKeys(CTxIn& txinRet, CPubKey& pubKeyRet, CKey& keyRet, std::string strTxHash, std::string strOutputIndex)
 {
     // wait for reindex and/or import to finish
@@ -653,6 +736,7 @@ void CWallet::MarkDirty()
         LOCK(cs_wallet);
         BOOST_FOREACH (PAIRTYPE(const uint256, CWalletTx) & item, mapWallet)
             item.second.MarkDirty();
+        fWalletUTXODirty = true;
     }
 }
 
@@ -664,6 +748,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
         mapWallet[hash] = wtxIn;
         mapWallet[hash].BindWallet(this);
         AddToSpends(hash);
+        fWalletUTXODirty = true;
     } else {
         LOCK(cs_wallet);
         // Inserts only if not already there, returns tx inserted or tx found
@@ -744,6 +829,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
 
         // Break debit/credit balance caches:
         wtx.MarkDirty();
+        setWalletUTXOPending.insert(hash);
 
         // Notify UI of new or updated transaction
         NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
@@ -784,6 +870,20 @@ bool CWallet::AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pbl
 void CWallet::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
 {
     LOCK2(cs_main, cs_wallet);
+
+    // Spends of our mints are not in mapWallet; recognize them by their serial
+    if (tx.IsZerocoinSpend()) {
+        for (const CTxIn& txin : tx.vin) {
+            if (!txin.scriptSig.IsZerocoinSpend())
+                continue;
+            CBigNum bnSerial = TxInToZerocoinSpend(txin).getCoinSerialNumber();
+            if (IsMyZerocoinMintSerial(bnSerial)) {
+                LogPrintf("%s: %s detected spent zerocoin mint in transaction %s \n", __func__, bnSerial.GetHex(), tx.GetHash().GetHex());
+                NotifyZerocoinChanged(this, bnSerial.GetHex(), "Used", CT_UPDATED);
+            }
+        }
+    }
+
     if (!AddToWalletIfInvolvingMe(tx, pblock, true))
         return; // Not one of ours
 
@@ -802,6 +902,14 @@ void CWallet::EraseFromWallet(const uint256& hash)
         return;
     {
         LOCK(cs_wallet);
+        map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(hash);
+        if (mi != mapWallet.end()) {
+            // The outputs it spent are unspent again
+            BOOST_FOREACH (const CTxIn& txin, mi->second.vin)
+                setWalletUTXOPending.insert(txin.prevout.hash);
+            setWalletUTXOPending.insert(hash);
+            fBalancesCached = false;
+        }
         if (mapWallet.erase(hash))
             CWalletDB(strWalletFile).EraseTx(hash);
     }
@@ -823,6 +931,23 @@ isminetype CWallet::IsMine(const CTxIn& txin) const
     return ISMINE_NO;
 }
 
+void CWallet::UpdateMintSerial(const CZerocoinMint& mint, bool fErased)
+{
+    LOCK(cs_wallet);
+    if (fErased || mint.IsUsed()) {
+        mapMintSerials.erase(mint.GetSerialNumber());
+        return;
+    }
+
+    mapMintSerials[mint.GetSerialNumber()] = mint;
+}
+
+bool CWallet::IsMyZerocoinMintSerial(const CBigNum& bnSerial) const
+{
+    LOCK(cs_wallet);
+    return mapMintSerials.count(bnSerial) > 0;
+}
+
 bool CWallet::IsMyZerocoinSpend(const CBigNum& bnSerial) const
 {
     return CWalletDB(strWalletFile).ReadZerocoinSpendSerialEntry(bnSerial);
@@ -1269,19 +1394,63 @@ void CWallet::ResendWalletTransactions()
  * @{
  */
 
-CAmount CWallet::GetBalance() const
+const CWallet::CWalletBalances& CWallet::GetBalances() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableCredit();
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    if (fBalancesCached && !fWalletUTXODirty && setWalletUTXOPending.empty() &&
+        pindexBalancesCached == chainActive.Tip() &&
+        nBalancesMempoolUpdated == mempool.GetTransactionsUpdated() &&
+        nBalancesZeromintPercentage == nZeromintPercentage)
+        return balancesCached;
+
+    CWalletBalances balances = {};
+    std::vector<const CWalletTx*> vTxs;
+    GetWalletUTXOTxs(vTxs);
+    BOOST_FOREACH (const CWalletTx* pcoin, vTxs) {
+        bool fTrusted = pcoin->IsTrusted();
+        int nDepth = pcoin->GetDepthInMainChain();
+        bool fUnconfirmed = !IsFinalTx(*pcoin) || (!fTrusted && nDepth == 0);
+
+        if (fTrusted) {
+            balances.nBalance += pcoin->GetAvailableCredit();
+            balances.nWatchOnly += pcoin->GetAvailableWatchOnlyCredit();
+        }
+        if (fUnconfirmed) {
+            balances.nUnconfirmed += pcoin->GetAvailableCredit();
+            balances.nUnconfirmedWatchOnly += pcoin->GetAvailableWatchOnlyCredit();
+        }
+        balances.nImmature += pcoin->GetImmatureCredit();
+        balances.nImmatureWatchOnly += pcoin->GetImmatureWatchOnlyCredit();
+
+        if (fLiteMode)
+            continue;
+
+        if (fTrusted && nDepth > 0) {
+            balances.nUnlocked += pcoin->GetUnlockedCredit();
+            balances.nLocked += pcoin->GetLockedCredit();
         }
+        if (fTrusted) {
+            balances.nAnonymizable += pcoin->GetAnonymizableCredit();
+            balances.nAnonymized += pcoin->GetAnonymizedCredit();
+        }
+        balances.nDenominatedConf += pcoin->GetDenominatedCredit(false);
+        balances.nDenominatedUnconf += pcoin->GetDenominatedCredit(true);
     }
 
-    return nTotal;
+    balancesCached = balances;
+    fBalancesCached = true;
+    pindexBalancesCached = chainActive.Tip();
+    nBalancesMempoolUpdated = mempool.GetTransactionsUpdated();
+    nBalancesZeromintPercentage = nZeromintPercentage;
+    return balancesCached;
+}
+
+CAmount CWallet::GetBalance() const
+{
+    LOCK2(cs_main, cs_wallet);
+    return GetBalances().nBalance;
 }
 
 CAmount CWallet::GetZerocoinBalance(bool fMatureOnly) const
@@ -1355,36 +1524,16 @@ CAmount CWallet::GetUnlockedCoins() const
 {
     if (fLiteMode) return 0;
 
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-
-            if (pcoin->IsTrusted() && pcoin->GetDepthInMainChain() > 0)
-                nTotal += pcoin->GetUnlockedCredit();
-        }
-    }
-
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetBalances().nUnlocked;
 }
 
 CAmount CWallet::GetLockedCoins() const
 {
     if (fLiteMode) return 0;
 
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-
-            if (pcoin->IsTrusted() && pcoin->GetDepthInMainChain() > 0)
-                nTotal += pcoin->GetLockedCredit();
-        }
-    }
-
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetBalances().nLocked;
 }
 
 // Get a Map pairing the Denominations with the amount of Zerocoin for each Denomination
@@ -1407,36 +1556,16 @@ CAmount CWallet::GetAnonymizableBalance() const
 {
     if (fLiteMode) return 0;
 
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAnonymizableCredit();
-        }
-    }
-
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetBalances().nAnonymizable;
 }
 
 CAmount CWallet::GetAnonymizedBalance() const
 {
     if (fLiteMode) return 0;
 
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAnonymizedCredit();
-        }
-    }
-
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetBalances().nAnonymized;
 }
 
 // Note: calculated including unconfirmed,
@@ -1450,10 +1579,10 @@ double CWallet::GetAverageAnonymizedRounds() const
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-
-            uint256 hash = (*it).first;
+        std::vector<const CWalletTx*> vTxs;
+        GetWalletUTXOTxs(vTxs);
+        BOOST_FOREACH (const CWalletTx* pcoin, vTxs) {
+            uint256 hash = pcoin->GetHash();
 
             for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
                 CTxIn vin = CTxIn(hash, i);
@@ -1482,10 +1611,10 @@ CAmount CWallet::GetNormalizedAnonymizedBalance() const
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-
-            uint256 hash = (*it).first;
+        std::vector<const CWalletTx*> vTxs;
+        GetWalletUTXOTxs(vTxs);
+        BOOST_FOREACH (const CWalletTx* pcoin, vTxs) {
+            uint256 hash = pcoin->GetHash();
 
             for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
                 CTxIn vin = CTxIn(hash, i);
@@ -1506,86 +1635,39 @@ CAmount CWallet::GetDenominatedBalance(bool unconfirmed) const
 {
     if (fLiteMode) return 0;
 
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-
-            nTotal += pcoin->GetDenominatedCredit(unconfirmed);
-        }
-    }
-
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    const CWalletBalances& balances = GetBalances();
+    return unconfirmed ? balances.nDenominatedUnconf : balances.nDenominatedConf;
 }
 
 CAmount CWallet::GetUnconfirmedBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!IsFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
-                nTotal += pcoin->GetAvailableCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetBalances().nUnconfirmed;
 }
 
 CAmount CWallet::GetImmatureBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetBalances().nImmature;
 }
 
 CAmount CWallet::GetWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetBalances().nWatchOnly;
 }
 
 CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!IsFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetBalances().nUnconfirmedWatchOnly;
 }
 
 CAmount CWallet::GetImmatureWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetBalances().nImmatureWatchOnly;
 }
 
 /**
@@ -1597,9 +1679,10 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const uint256& wtxid = it->first;
-            const CWalletTx* pcoin = &(*it).second;
+        std::vector<const CWalletTx*> vTxs;
+        GetWalletUTXOTxs(vTxs);
+        BOOST_FOREACH (const CWalletTx* pcoin, vTxs) {
+            const uint256& wtxid = pcoin->GetHash();
 
             if (!CheckFinalTx(*pcoin))
                 continue;
@@ -1650,11 +1733,11 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
                 if (mine == ISMINE_WATCH_ONLY)
                     continue;
 
-                if (IsLockedCoin((*it).first, i) && nCoinType != ONLY_10000)
+                if (IsLockedCoin(wtxid, i) && nCoinType != ONLY_10000)
                     continue;
                 if (pcoin->vout[i].nValue <= 0 && !fIncludeZeroValue)
                     continue;
-                if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected((*it).first, i))
+                if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(wtxid, i))
                     continue;
 
                 bool fIsSpendable = false;
@@ -2563,87 +2646,81 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
     if (GetAdjustedTime() <= chainActive.Tip()->nTime)
         MilliSleep(10000);
 
+    // Prepare the kernel of every stake coin once, then search them all at once
+    vector<pair<const CWalletTx*, unsigned int> > vStakeCoins;
+    vector<CStakeKernel> vKernels;
+    vStakeCoins.reserve(setStakeCoins.size());
+    vKernels.reserve(setStakeCoins.size());
     BOOST_FOREACH (PAIRTYPE(const CWalletTx*, unsigned int) pcoin, setStakeCoins) {
         //make sure that enough time has elapsed between
-        CBlockIndex* pindex = NULL;
         BlockMap::iterator it = mapBlockIndex.find(pcoin.first->hashBlock);
-        if (it != mapBlockIndex.end())
-            pindex = it->second;
-        else {
+        if (it == mapBlockIndex.end()) {
             if (fDebug)
                 LogPrintf("CreateCoinStake() failed to find block index \n");
             continue;
         }
 
-        // Read block header
-        CBlockHeader block = pindex->GetBlockHeader();
-
-        bool fKernelFound = false;
-        uint256 hashProofOfStake = 0;
-        COutPoint prevoutStake = COutPoint(pcoin.first->GetHash(), pcoin.second);
-        nTxNewTime = GetAdjustedTime();
-
-        //iterates each utxo inside of CheckStakeKernelHash()
-        if (CheckStakeKernelHash(nBits, block, *pcoin.first, prevoutStake, nTxNewTime, nHashDrift, false, hashProofOfStake, true)) {
-            //Double check that this will pass time requirements
-            if (nTxNewTime <= chainActive.Tip()->GetMedianTimePast()) {
-                LogPrintf("CreateCoinStake() : kernel found, but it is too far in the past \n");
-                continue;
-            }
-
-            // Found a kernel
-            if (fDebug && GetBoolArg("-printcoinstake", false))
-                LogPrintf("CreateCoinStake : kernel found\n");
-
-            vector<valtype> vSolutions;
-            txnouttype whichType;
-            CScript scriptPubKeyOut;
-            scriptPubKeyKernel = pcoin.first->vout[pcoin.second].scriptPubKey;
-            if (!Solver(scriptPubKeyKernel, whichType, vSolutions)) {
-                LogPrintf("CreateCoinStake : failed to parse kernel\n");
-                break;
-            }
+        CStakeKernel kernel;
+        if (!kernel.Init(it->second, pcoin.first->vout[pcoin.second], COutPoint(pcoin.first->GetHash(), pcoin.second), true))
+            continue;
+        vStakeCoins.push_back(pcoin);
+        vKernels.push_back(kernel);
+    }
+
+    uint256 hashProofOfStake = 0;
+    nTxNewTime = GetAdjustedTime();
+    int nKernel = SearchStakeKernels(vKernels, nBits, nTxNewTime, nHashDrift, chainActive.Tip()->GetMedianTimePast(), nStakeThreads, nTxNewTime, hashProofOfStake, true);
+    if (nKernel >= 0) {
+        const pair<const CWalletTx*, unsigned int>& pcoin = vStakeCoins[nKernel];
+
+        // Found a kernel
+        if (fDebug && GetBoolArg("-printcoinstake", false))
+            LogPrintf("CreateCoinStake : kernel found\n");
+
+        vector<valtype> vSolutions;
+        txnouttype whichType;
+        CScript scriptPubKeyOut;
+        scriptPubKeyKernel = pcoin.first->vout[pcoin.second].scriptPubKey;
+        if (!Solver(scriptPubKeyKernel, whichType, vSolutions)) {
+            LogPrintf("CreateCoinStake : failed to parse kernel\n");
+            return false;
+        }
+        if (fDebug && GetBoolArg("-printcoinstake", false))
+            LogPrintf("CreateCoinStake : parsed kernel type=%d\n", whichType);
+        if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH) {
             if (fDebug && GetBoolArg("-printcoinstake", false))
-                LogPrintf("CreateCoinStake : parsed kernel type=%d\n", whichType);
-            if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH) {
+                LogPrintf("CreateCoinStake : no support for kernel type=%d\n", whichType);
+            return false; // only support pay to public key and pay to address
+        }
+        if (whichType == TX_PUBKEYHASH) // pay to address type
+        {
+            //convert to pay to public key type
+            CKey key;
+            if (!keystore.GetKey(uint160(vSolutions[0]), key)) {
                 if (fDebug && GetBoolArg("-printcoinstake", false))
-                    LogPrintf("CreateCoinStake : no support for kernel type=%d\n", whichType);
-                break; // only support pay to public key and pay to address
+                    LogPrintf("CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
+                return false; // unable to find corresponding public key
             }
-            if (whichType == TX_PUBKEYHASH) // pay to address type
-            {
-                //convert to pay to public key type
-                CKey key;
-                if (!keystore.GetKey(uint160(vSolutions[0]), key)) {
-                    if (fDebug && GetBoolArg("-printcoinstake", false))
-                        LogPrintf("CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
-                    break; // unable to find corresponding public key
-                }
 
-                scriptPubKeyOut << key.GetPubKey() << OP_CHECKSIG;
-            } else
-                scriptPubKeyOut = scriptPubKeyKernel;
+            scriptPubKeyOut << key.GetPubKey() << OP_CHECKSIG;
+        } else
+            scriptPubKeyOut = scriptPubKeyKernel;
 
-            txNew.vin.push_back(CTxIn(pcoin.first->GetHash(), pcoin.second));
-            nCredit += pcoin.first->vout[pcoin.second].nValue;
-            vwtxPrev.push_back(pcoin.first);
-            txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
+        txNew.vin.push_back(CTxIn(pcoin.first->GetHash(), pcoin.second));
+        nCredit += pcoin.first->vout[pcoin.second].nValue;
+        vwtxPrev.push_back(pcoin.first);
+        txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
 
-            //presstab HyperStake - calculate the total size of our new output including the stake reward so that we can use it to decide whether to split the stake outputs
-            const CBlockIndex* pIndex0 = chainActive.Tip();
-            uint64_t nTotalSize = pcoin.first->vout[pcoin.second].nValue + GetBlockValue(pIndex0->nHeight);
+        //presstab HyperStake - calculate the total size of our new output including the stake reward so that we can use it to decide whether to split the stake outputs
+        const CBlockIndex* pIndex0 = chainActive.Tip();
+        uint64_t nTotalSize = pcoin.first->vout[pcoin.second].nValue + GetBlockValue(pIndex0->nHeight);
 
-            //presstab HyperStake - if MultiSend is set to send in coinstake we will add our outputs here (values asigned further down)
-            if (nTotalSize / 2 > nStakeSplitThreshold * COIN)
-                txNew.vout.push_back(CTxOut(0, scriptPubKeyOut)); //split stake
+        //presstab HyperStake - if MultiSend is set to send in coinstake we will add our outputs here (values asigned further down)
+        if (nTotalSize / 2 > nStakeSplitThreshold * COIN)
+            txNew.vout.push_back(CTxOut(0, scriptPubKeyOut)); //split stake
 
-            if (fDebug && GetBoolArg("-printcoinstake", false))
-                LogPrintf("CreateCoinStake : added kernel type=%d\n", whichType);
-            fKernelFound = true;
-            break;
-        }
-        if (fKernelFound)
-            break; // if kernel is found stop searching
+        if (fDebug && GetBoolArg("-printcoinstake", false))
+            LogPrintf("CreateCoinStake : added kernel type=%d\n", whichType);
     }
     if (nCredit == 0 || nCredit > nBalance - nReserveBalance)
         return false;
@@ -3349,6 +3426,8 @@ bool CWallet::UpdatedTransaction(const uint256& hashTx)
         // Only notify UI if this transaction is in this wallet
         map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(hashTx);
         if (mi != mapWallet.end()) {
+            // Its depth may now count SwiftX locks
+            fBalancesCached = false;
             NotifyTransactionChanged(this, hashTx, CT_UPDATED);
             return true;
         }
@@ -3360,18 +3439,21 @@ void CWallet::LockCoin(COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.insert(output);
+    fBalancesCached = false;
 }
 
 void CWallet::UnlockCoin(COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.erase(output);
+    fBalancesCached = false;
 }
 
 void CWallet::UnlockAllCoins()
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.clear();
+    fBalancesCached = false;
 }
 
 bool CWallet::IsLockedCoin(uint256 hash, unsigned int n) const
@@ -4059,6 +4141,70 @@ bool CWallet::CreateZerocoinMintTransaction(const CAmount nValue, CMutableTransa
     return true;
 }
 
+void ThreadPrecomputeWitnesses(CWallet* pwallet)
+{
+    RenameThread("sling-witness");
+
+    //witnesses for security level 100 only move on once every ten blocks
+    int nHeightLast = 0;
+    while (true) {
+        MilliSleep(5000);
+
+        int nHeight;
+        {
+            LOCK(cs_main);
+            if (IsInitialBlockDownload())
+                continue;
+            nHeight = chainActive.Height() - chainActive.Height() % 10;
+        }
+        if (nHeight == nHeightLast)
+            continue;
+
+        int64_t nTimeStart = GetTimeMillis();
+        std::vector<CZerocoinMint> vMints;
+        {
+            LOCK(pwallet->cs_wallet);
+            for (const std::pair<const CBigNum, CZerocoinMint>& item : pwallet->mapMintSerials)
+                vMints.push_back(item.second);
+        }
+        CWalletDB walletdb(pwallet->strWalletFile);
+        for (const CZerocoinMint& mint : vMints) {
+            boost::this_thread::interruption_point();
+
+            // Spent or archived since the copy was taken
+            if (!pwallet->IsMyZerocoinMintSerial(mint.GetSerialNumber()))
+                continue;
+
+            libzerocoin::PublicCoin pubcoin(Params().Zerocoin_Params(), mint.GetValue(), mint.GetDenomination());
+            CMintWitness mintWitness;
+            uint256 hashWitness;
+            {
+                LOCK(pwallet->cs_witness);
+                walletdb.ReadMintWitness(mint.GetValue(), mintWitness);
+                hashWitness = SerializeHash(mintWitness);
+            }
+            // Takes cs_main, so cs_witness can't be held meanwhile
+            if (!PrecomputeAccumulatorWitness(pubcoin, mintWitness))
+                continue;
+
+            // Spent or archived meanwhile: its witness is erased under cs_witness, don't write it back
+            LOCK2(pwallet->cs_wallet, pwallet->cs_witness);
+            CZerocoinMint mintStored;
+            if (!pwallet->IsMyZerocoinMintSerial(mint.GetSerialNumber()) ||
+                !walletdb.ReadZerocoinMint(mint.GetValue(), mintStored) || mintStored.IsUsed())
+                continue;
+
+            // A spend may have moved the witness on meanwhile, then keep its version
+            CMintWitness mintWitnessStored;
+            walletdb.ReadMintWitness(mint.GetValue(), mintWitnessStored);
+            if (SerializeHash(mintWitnessStored) == hashWitness)
+                walletdb.WriteMintWitness(mintWitness);
+        }
+        LogPrint("zero", "%s : updated the witnesses of %u mints in %dms\n", __func__, vMints.size(), GetTimeMillis() - nTimeStart);
+        nHeightLast = nHeight;
+    }
+}
+
 bool CWallet::MintToTxIn(CZerocoinMint zerocoinSelected, int nSecurityLevel, const uint256& hashTxOut, CTxIn& newTxIn, CZerocoinSpendReceipt& receipt)
 {
     // Default error status if not changed below
@@ -4078,10 +4224,16 @@ bool CWallet::MintToTxIn(CZerocoinMint zerocoinSelected, int nSecurityLevel, con
     libzerocoin::AccumulatorWitness witness(Params().Zerocoin_Params(), accumulator, pubCoinSelected);
     string strFailReason = "";
     int nMintsAdded = 0;
-    if (!GenerateAccumulatorWitness(pubCoinSelected, accumulator, witness, nSecurityLevel, nMintsAdded, strFailReason)) {
-        receipt.SetStatus("Try to spend with a higher security level to include more coins", ZSLING_FAILED_ACCUMULATOR_INITIALIZATION);
-        LogPrintf("%s : %s \n", __func__, receipt.GetStatusMessage());
-        return false;
+    {
+        LOCK(cs_witness);
+        CMintWitness mintWitness;
+        CWalletDB(strWalletFile).ReadMintWitness(pubCoinSelected.getValue(), mintWitness);
+        if (!GenerateAccumulatorWitness(pubCoinSelected, accumulator, witness, nSecurityLevel, nMintsAdded, strFailReason, &mintWitness)) {
+            receipt.SetStatus("Try to spend with a higher security level to include more coins", ZSLING_FAILED_ACCUMULATOR_INITIALIZATION);
+            LogPrintf("%s : %s \n", __func__, receipt.GetStatusMessage());
+            return false;
+        }
+        CWalletDB(strWalletFile).WriteMintWitness(mintWitness);
     }
 
     // Construct the CoinSpend object. This acts like a signature on the transaction.
@@ -4136,6 +4288,7 @@ bool CWallet::MintToTxIn(CZerocoinMint zerocoinSelected, int nSecurityLevel, con
                 zerocoinSelected.SetUsed(true);
                 if (!CWalletDB(strWalletFile).WriteZerocoinMint(zerocoinSelected))
                     LogPrintf("%s failed to write zerocoinmint\n", __func__);
+                UpdateMintSerial(zerocoinSelected, false);
 
                 pwalletMain->NotifyZerocoinChanged(pwalletMain, zerocoinSelected.GetValue().GetHex(), "Used", CT_UPDATED);
                 receipt.SetStatus("the coin spend has been used", ZSLING_SPENT_USED_ZSLING);
@@ -4215,6 +4368,7 @@ bool CWallet::CreateZerocoinSpendTransaction(CAmount nValue, int nSecurityLevel,
 
             mint.SetUsed(true);
             walletdb.WriteZerocoinMint(mint);
+            UpdateMintSerial(mint, false);
 
             return false;
         }
@@ -4234,6 +4388,7 @@ bool CWallet::CreateZerocoinSpendTransaction(CAmount nValue, int nSecurityLevel,
         // archive this mint as an orphan
         if (fArchive) {
             walletdb.ArchiveMintOrphan(mint);
+            UpdateMintSerial(mint, true);
             nArchived++;
         }
     }
@@ -4362,12 +4517,14 @@ string CWallet::ResetMintZerocoin(bool fExtendedSearch)
     for (CZerocoinMint mint : vMintsToUpdate) {
         updates++;
         walletdb.WriteZerocoinMint(mint);
+        UpdateMintSerial(mint, false);
     }
 
     // Delete any mints that were unable to be located on the blockchain
     for (CZerocoinMint mint : vMintsMissing) {
         deletions++;
         walletdb.ArchiveMintOrphan(mint);
+        UpdateMintSerial(mint, true);
     }
 
     string strResult = _("ResetMintZerocoin finished: ") + to_string(updates) + _(" mints updated, ") + to_string(deletions) + _(" mints deleted\n");
@@ -4403,6 +4560,7 @@ string CWallet::ResetSpentZerocoin()
                 mint.SetUsed(false);
                 RemoveSerialFromDB(spend.GetSerial());
                 walletdb.WriteZerocoinMint(mint);
+                UpdateMintSerial(mint, false);
                 walletdb.EraseZerocoinSpendSerialEntry(spend.GetSerial());
                 continue;
             }
@@ -4439,6 +4597,7 @@ void CWallet::ReconsiderZerocoins(std::list<CZerocoinMint>& listMintsRestored)
         if (!walletdb.UnarchiveZerocoin(mint)) {
             LogPrintf("%s : failed to unarchive mint %s\n", __func__, mint.GetValue().GetHex());
         }
+        UpdateMintSerial(mint, false);
         listMintsRestored.emplace_back(mint);
     }
 }
@@ -4523,6 +4682,7 @@ string CWallet::MintZerocoin(CAmount nValue, CWalletTx& wtxNew, vector<CZerocoin
         for (CZerocoinMint mint : vMints) {
             mint.SetTxHash(wtxNew.GetHash());
             walletdb.WriteZerocoinMint(mint);
+            UpdateMintSerial(mint, false);
             pwalletMain->NotifyZerocoinChanged(pwalletMain, mint.GetValue().GetHex(), "Used", CT_UPDATED);
         }
     }
@@ -4562,6 +4722,7 @@ bool CWallet::SpendZerocoin(CAmount nAmount, int nSecurityLevel, CWalletTx& wtxN
         for (CZerocoinMint mint : vMintsSelected) {
             mint.SetUsed(false); // having error, so set to false, to be able to use again
             walletdb.WriteZerocoinMint(mint);
+            UpdateMintSerial(mint, false);
             pwalletMain->NotifyZerocoinChanged(pwalletMain, mint.GetValue().GetHex(), "New", CT_UPDATED);
         }
 
@@ -4580,6 +4741,7 @@ bool CWallet::SpendZerocoin(CAmount nAmount, int nSecurityLevel, CWalletTx& wtxN
             if (!walletdb.EraseZerocoinMint(mint)) {
                 receipt.SetStatus("Error: Unable to cannot delete zerocoin mint in wallet", ZSLING_ERASE_NEW_MINTS_FAILED);
             }
+            UpdateMintSerial(mint, true);
         }
 
         receipt.SetStatus("Error: The transaction was rejected! This might happen if some of the coins in your wallet were already spent, such as if you used a copy of wallet.dat and coins were spent in the copy but not marked as spent here.", nStatus);
@@ -4592,6 +4754,7 @@ bool CWallet::SpendZerocoin(CAmount nAmount, int nSecurityLevel, CWalletTx& wtxN
             receipt.SetStatus("Failed to write mint to db", nStatus);
             return false;
         }
+        UpdateMintSerial(mint, false);
 
         CZerocoinMint mintCheck;
         if (!walletdb.ReadZerocoinMint(mint.GetValue(), mintCheck)) {
@@ -4609,6 +4772,7 @@ bool CWallet::SpendZerocoin(CAmount nAmount, int nSecurityLevel, CWalletTx& wtxN
     for (CZerocoinMint mint : vNewMints) {
         mint.SetTxHash(wtxNew.GetHash());
         walletdb.WriteZerocoinMint(mint);
+        UpdateMintSerial(mint, false);
     }
 
     receipt.SetStatus("Spend Successful", ZSLING_SPEND_OKAY);  // When we reach this point spending zSLING was successful
@@ -55,6 +55,9 @@ static const CAmount nHighTransactionMaxFeeWarning = 100 * nHighTransactionFeeWa
 //! Largest (in bytes) free transaction we're willing to create
 static const unsigned int MAX_FREE_TRANSACTION_CREATE_SIZE = 1000;
 
+//! -precomputewitnesses default
+static const bool DEFAULT_PRECOMPUTE_WITNESSES = true;
+
 // Zerocoin denomination which creates exactly one of each denominations:
 // 6666 = 1*5000 + 1*1000 + 1*500 + 1*100 + 1*50 + 1*10 + 1*5 + 1
 static const int ZQ_6666 = 6666;
@@ -104,6 +107,9 @@ enum ZerocoinSpendStatus {
     ZSLING_SPENT_USED_ZSLING = 14                       // Coin has already been spend
 };
 
+/** Keep the witnesses of the unspent zerocoin mints of a wallet up to date, so that spends need not compute them */
+void ThreadPrecomputeWitnesses(CWallet* pwallet);
+
 struct CompactTallyItem {
     CBitcoinAddress address;
     CAmount nAmount;
@@ -185,6 +191,49 @@ private:
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
+    /**
+     * Outputs of wallet transactions that may still count towards a balance:
+     * every output that is ours and not spent by a wallet transaction in the
+     * main chain. Balance queries and coin selection only look at the
+     * transactions in here; they still apply all of their own filters.
+     * Changed transactions are queued in setWalletUTXOPending and folded in
+     * by SyncWalletUTXO(), which runs with cs_main held.
+     */
+    mutable std::set<COutPoint> setWalletUTXO;
+    mutable std::set<uint256> setWalletUTXOPending;
+    //! setWalletUTXO must be rebuilt from all of mapWallet, e.g. after keys were imported
+    mutable bool fWalletUTXODirty;
+    void UpdateWalletUTXO(const COutPoint& outpoint) const;
+    void SyncWalletUTXO() const;
+    void GetWalletUTXOTxs(std::vector<const CWalletTx*>& vTxs) const;
+
+    //! Totals behind the Get*Balance() family
+    struct CWalletBalances {
+        CAmount nBalance;
+        CAmount nUnconfirmed;
+        CAmount nImmature;
+        CAmount nWatchOnly;
+        CAmount nUnconfirmedWatchOnly;
+        CAmount nImmatureWatchOnly;
+        CAmount nUnlocked;
+        CAmount nLocked;
+        CAmount nAnonymizable;
+        CAmount nAnonymized;
+        CAmount nDenominatedConf;
+        CAmount nDenominatedUnconf;
+    };
+
+    /**
+     * Balances as of the chain tip, mempool and zeromint percentage they were
+     * computed for. Any change to a wallet transaction clears fBalancesCached.
+     */
+    mutable CWalletBalances balancesCached;
+    mutable bool fBalancesCached;
+    mutable const CBlockIndex* pindexBalancesCached;
+    mutable unsigned int nBalancesMempoolUpdated;
+    mutable int nBalancesZeromintPercentage;
+    const CWalletBalances& GetBalances() const;
+
 public:
     bool MintableCoins();
     bool SelectStakeCoins(std::set<std::pair<const CWalletTx*, unsigned int> >& setCoins, CAmount nTargetAmount) const;
@@ -207,6 +256,8 @@ public:
     std::string ResetSpentZerocoin();
     void ReconsiderZerocoins(std::list<CZerocoinMint>& listMintsRestored);
     void ZSlingcoinBackupWallet();
+    void UpdateMintSerial(const CZerocoinMint& mint, bool fErased);
+    bool IsMyZerocoinMintSerial(const CBigNum& bnSerial) const;
 
     /** Zerocin entry changed.
     * @note called with lock cs_wallet held.
@@ -283,6 +334,11 @@ public:
         nTimeFirstKey = 0;
         fWalletUnlockAnonymizeOnly = false;
         fBackupMints = false;
+        fWalletUTXODirty = true;
+        fBalancesCached = false;
+        pindexBalancesCached = NULL;
+        nBalancesMempoolUpdated = 0;
+        nBalancesZeromintPercentage = 0;
 
         // Stake Settings
         nHashDrift = 45;
@@ -336,6 +392,12 @@ public:
 
     std::set<COutPoint> setLockedCoins;
 
+    //! the unused zerocoin mints of this wallet, by serial number
+    std::map<CBigNum, CZerocoinMint> mapMintSerials;
+
+    //! serializes updates of the precomputed mint witnesses in the wallet database, static so CWalletDB can take it
+    static CCriticalSection cs_witness;
+
     int64_t nTimeFirstKey;
 
     const CWalletTx* GetWalletTx(const uint256& hash) const;
@@ -435,6 +497,8 @@ public:
     TxItems OrderedTxItems(std::list<CAccountingEntry>& acentries, std::string strAccount = "");
 
     void MarkDirty();
+    //! make sure the wallet balances are recalculated, see CWalletTx::MarkDirty()
+    void MarkBalancesDirty() const { fBalancesCached = false; }
     bool AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet = false);
     void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate);
@@ -926,6 +990,8 @@ public:
         fImmatureWatchCreditCached = false;
         fDebitCached = false;
         fChangeCached = false;
+        if (pwallet)
+            pwallet->MarkBalancesDirty();
     }
 
     void BindWallet(CWallet* pwalletIn)
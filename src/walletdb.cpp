@@ -657,6 +657,10 @@ bool ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue, CW
                 strErr = "Error reading wallet database: LoadDestData failed";
                 return false;
             }
+        } else if (strType == "zerocoin") {
+            CZerocoinMint mint;
+            ssValue >> mint;
+            pwallet->UpdateMintSerial(mint, false);
         }
     } catch (...) {
         return false;
@@ -1048,7 +1052,14 @@ bool CWalletDB::WriteZerocoinMint(const CZerocoinMint& zerocoinMint)
     uint256 hash = Hash(ss.begin(), ss.end());
 
     Erase(make_pair(string("zerocoin"), hash));
-    return Write(make_pair(string("zerocoin"), hash), zerocoinMint, true);
+    if (!Write(make_pair(string("zerocoin"), hash), zerocoinMint, true))
+        return false;
+
+    if (zerocoinMint.IsUsed()) {
+        LOCK(CWallet::cs_witness);
+        EraseMintWitness(zerocoinMint.GetValue());
+    }
+    return true;
 }
 
 bool CWalletDB::ReadZerocoinMint(const CBigNum &bnPubCoinValue, CZerocoinMint& zerocoinMint)
@@ -1066,6 +1077,8 @@ bool CWalletDB::EraseZerocoinMint(const CZerocoinMint& zerocoinMint)
     ss << zerocoinMint.GetValue();
     uint256 hash = Hash(ss.begin(), ss.end());
 
+    LOCK(CWallet::cs_witness);
+    EraseMintWitness(zerocoinMint.GetValue());
     return Erase(make_pair(string("zerocoin"), hash));
 }
 
@@ -1080,6 +1093,8 @@ bool CWalletDB::ArchiveMintOrphan(const CZerocoinMint& zerocoinMint)
         return false;
     }
 
+    LOCK(CWallet::cs_witness);
+    EraseMintWitness(zerocoinMint.GetValue());
     if (!Erase(make_pair(string("zerocoin"), hash))) {
         LogPrintf("%s : failed to erase orphaned zerocoin mint\n", __func__);
         return false;
@@ -1088,6 +1103,21 @@ bool CWalletDB::ArchiveMintOrphan(const CZerocoinMint& zerocoinMint)
     return true;
 }
 
+bool CWalletDB::WriteMintWitness(const CMintWitness& mintWitness)
+{
+    return Write(make_pair(string("zcwitness"), mintWitness.bnPubcoin), mintWitness);
+}
+
+bool CWalletDB::ReadMintWitness(const CBigNum& bnPubcoin, CMintWitness& mintWitness)
+{
+    return Read(make_pair(string("zcwitness"), bnPubcoin), mintWitness);
+}
+
+bool CWalletDB::EraseMintWitness(const CBigNum& bnPubcoin)
+{
+    return Erase(make_pair(string("zcwitness"), bnPubcoin));
+}
+
 bool CWalletDB::UnarchiveZerocoin(const CZerocoinMint& mint)
 {
     CDataStream ss(SER_GETHASH, 0);
@@ -1217,17 +1247,6 @@ std::list<CZerocoinMint> CWalletDB::ListMintedCoins(bool fUnusedOnly, bool fMatu
 
     return listPubCoin;
 }
-// Just get the Serial Numbers
-std::list<CBigNum> CWalletDB::ListMintedCoinsSerial()
-{
-    std::list<CBigNum> listPubCoin;
-    std::list<CZerocoinMint> listCoins = ListMintedCoins(true, false, false);
-    
-    for ( auto& coin : listCoins) {
-        listPubCoin.push_back(coin.GetSerialNumber());
-    }
-    return listPubCoin;
-}
 
 
 std::list<CZerocoinSpend> CWalletDB::ListSpentCoins()
@@ -156,9 +156,11 @@ public:
     bool UnarchiveZerocoin(const CZerocoinMint& mint);
     std::list<CZerocoinMint> ListMintedCoins(bool fUnusedOnly, bool fMaturedOnly, bool fUpdateStatus);
     std::list<CZerocoinSpend> ListSpentCoins();
-    std::list<CBigNum> ListMintedCoinsSerial();
     std::list<CBigNum> ListSpentCoinsSerial();
     std::list<CZerocoinMint> ListArchivedZerocoins();
+    bool WriteMintWitness(const CMintWitness& mintWitness);
+    bool ReadMintWitness(const CBigNum& bnPubcoin, CMintWitness& mintWitness);
+    bool EraseMintWitness(const CBigNum& bnPubcoin);
     bool WriteZerocoinSpendSerialEntry(const CZerocoinSpend& zerocoinSpend);
     bool EraseZerocoinSpendSerialEntry(const CBigNum& serialEntry);
     bool ReadZerocoinSpendSerialEntry(const CBigNum& bnSerial);